@@ -0,0 +1,99 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "lib/Client/client.h"
+#include "lib/Stats/stats.h"
+
+namespace {
+
+struct Options {
+  std::string unix_path = "/tmp/database.sock";
+  std::string host = "127.0.0.1";
+  uint16_t port = 0;
+  size_t connections = 4;
+  size_t requests = 10000;
+  size_t pipeline = 16;
+  std::string query = "SHOW STATS";
+  std::string setup;
+};
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [--socket PATH | --port N] [--connections N] [--requests N]"
+            << " [--pipeline N] [--query SQL] [--setup SQL]\n";
+}
+
+Client Connect(const Options& options) {
+  return options.port != 0 ? Client::ConnectTcp(options.host, options.port) : Client::ConnectUnix(options.unix_path);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--socket") == 0 && has_value) {
+      options.unix_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+      options.port = static_cast<uint16_t>(std::stoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--connections") == 0 && has_value) {
+      options.connections = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--requests") == 0 && has_value) {
+      options.requests = std::stoul(argv[++i]);
+    } else if (std::strcmp(argv[i], "--pipeline") == 0 && has_value) {
+      options.pipeline = std::max<size_t>(1, std::stoul(argv[++i]));
+    } else if (std::strcmp(argv[i], "--query") == 0 && has_value) {
+      options.query = argv[++i];
+    } else if (std::strcmp(argv[i], "--setup") == 0 && has_value) {
+      options.setup = argv[++i];
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (!options.setup.empty()) {
+    std::cout << Connect(options).Execute(options.setup).message << std::endl;
+  }
+
+  LatencyHistogram latency;
+  std::atomic<size_t> errors = 0;
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t c = 0; c < options.connections; ++c) {
+    workers.emplace_back([&options, &latency, &errors] {
+      Client client = Connect(options);
+      size_t per_connection = options.requests / options.connections;
+      for (size_t sent = 0; sent < per_connection; sent += options.pipeline) {
+        size_t batch = std::min(options.pipeline, per_connection - sent);
+        auto batch_start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch; ++i) {
+          client.Send(options.query);
+        }
+        for (size_t i = 0; i < batch; ++i) {
+          if (client.Receive().status == kErrorResponse) {
+            ++errors;
+          }
+        }
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - batch_start).count();
+        latency.Record(static_cast<uint64_t>(nanos));
+      }
+    });
+  }
+  for (auto& w : workers) {
+    w.join();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  size_t total = options.requests / options.connections * options.connections;
+  std::cout << "requests: " << total << ", errors: " << errors << '\n'
+            << "throughput: " << static_cast<double>(total) / seconds << " req/s\n"
+            << "batch latency p50: " << static_cast<double>(latency.Percentile(0.5)) / 1e3 << " us, p99: "
+            << static_cast<double>(latency.Percentile(0.99)) / 1e3 << " us, p999: "
+            << static_cast<double>(latency.Percentile(0.999)) / 1e3 << " us\n";
+  return 0;
+}
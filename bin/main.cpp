@@ -1,8 +1,66 @@
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
 #include "lib/Database/database.h"
+#include "lib/Server/server.h"
+
+namespace {
+
+Server* running_server = nullptr;
+
+void HandleSignal(int) {
+  if (running_server != nullptr) {
+    running_server->Stop();
+  }
+}
+
+void PrintUsage(const char* program) {
+  std::cerr << "Usage: " << program << " [--socket PATH] [--port N] [--no-tcp] [--threads N] [--open NAME]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ServerOptions options;
+  options.unix_path = "/tmp/database.sock";
+  options.tcp_port = 5433;
+  SchedulerOptions scheduler_options;
+  std::string state;
+  for (int i = 1; i < argc; ++i) {
+    bool has_value = i + 1 < argc;
+    if (std::strcmp(argv[i], "--socket") == 0 && has_value) {
+      options.unix_path = argv[++i];
+    } else if (std::strcmp(argv[i], "--port") == 0 && has_value) {
+      options.tcp_port = static_cast<uint16_t>(std::stoi(argv[++i]));
+    } else if (std::strcmp(argv[i], "--no-tcp") == 0) {
+      options.listen_tcp = false;
+    } else if (std::strcmp(argv[i], "--threads") == 0 && has_value) {
+      scheduler_options.max_concurrency = std::stoul(argv[++i]);
+      scheduler_options.max_long_queries = std::max<size_t>(1, scheduler_options.max_concurrency / 2);
+    } else if (std::strcmp(argv[i], "--open") == 0 && has_value) {
+      state = argv[++i];
+    } else {
+      PrintUsage(argv[0]);
+      return 1;
+    }
+  }
 
-int main() {
   Database db;
-  db.Open("DB1");
-  std::cout << db.Execute("SELECT * FROM products") << std::endl;
+  db.ConfigureScheduler(scheduler_options);
+  if (!state.empty()) {
+    db.Open(state);
+  }
+  Server server(db, options);
+  running_server = &server;
+  std::signal(SIGINT, HandleSignal);
+  std::signal(SIGTERM, HandleSignal);
+  std::cout << "Listening on " << (options.unix_path.empty() ? "-" : options.unix_path);
+  if (options.listen_tcp) {
+    std::cout << " and 127.0.0.1:" << server.tcp_port();
+  }
+  std::cout << std::endl;
+  server.Run();
+  running_server = nullptr;
   return 0;
-}
\ No newline at end of file
+}
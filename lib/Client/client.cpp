@@ -0,0 +1,151 @@
+#include "client.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+#include <utility>
+
+#include "../Encoder/result_encoder.h"
+
+namespace {
+
+const size_t kReadChunk = 64 * 1024;
+
+std::system_error SystemError(const std::string& what) {
+  return {errno, std::generic_category(), what};
+}
+
+int Connect(int domain, const void* address, size_t address_size) {
+  int fd = ::socket(domain, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    throw SystemError("socket");
+  }
+  if (::connect(fd, static_cast<const sockaddr*>(address), address_size) == -1) {
+    auto error = SystemError("connect");
+    ::close(fd);
+    throw error;
+  }
+  return fd;
+}
+
+}  // namespace
+
+Client::Client(int fd) : fd_(fd) {}
+
+Client Client::ConnectUnix(const std::string& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::logic_error("Unix socket path is too long");
+  }
+  std::strcpy(address.sun_path, path.c_str());
+  return Client(Connect(AF_UNIX, &address, sizeof(address)));
+}
+
+Client Client::ConnectTcp(const std::string& host, uint16_t port) {
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+    throw std::logic_error("Invalid address '" + host + "'");
+  }
+  Client client(Connect(AF_INET, &address, sizeof(address)));
+  int one = 1;
+  ::setsockopt(client.fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  return client;
+}
+
+Client::Client(Client&& other) noexcept
+    : fd_(std::exchange(other.fd_, -1)), out_(std::move(other.out_)),
+      in_(std::move(other.in_)), in_offset_(other.in_offset_) {}
+
+Client& Client::operator=(Client&& other) noexcept {
+  if (this != &other) {
+    if (fd_ != -1) {
+      ::close(fd_);
+    }
+    fd_ = std::exchange(other.fd_, -1);
+    out_ = std::move(other.out_);
+    in_ = std::move(other.in_);
+    in_offset_ = other.in_offset_;
+  }
+  return *this;
+}
+
+Client::~Client() {
+  if (fd_ != -1) {
+    ::close(fd_);
+  }
+}
+
+void Client::Send(std::string_view query) {
+  AppendFrame(out_, query);
+}
+
+void Client::Flush() {
+  size_t offset = 0;
+  while (offset < out_.size()) {
+    ssize_t n = ::send(fd_, out_.data() + offset, out_.size() - offset, MSG_NOSIGNAL);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SystemError("send");
+    }
+    offset += n;
+  }
+  out_.clear();
+}
+
+ClientResponse Client::Receive() {
+  Flush();
+  while (true) {
+    size_t consumed = 0;
+    auto frame = ReadFrame(std::string_view(in_).substr(in_offset_), consumed);
+    if (frame) {
+      if (frame->empty()) {
+        throw std::logic_error("Invalid response frame");
+      }
+      ClientResponse response;
+      response.status = static_cast<ResponseStatus>(frame->front());
+      std::string_view payload = frame->substr(1);
+      if (response.status == kTableResponse) {
+        response.table = DecodeRowBatch(payload);
+      } else {
+        response.message = std::string(payload);
+      }
+      in_offset_ += consumed;
+      if (in_offset_ == in_.size()) {
+        in_.clear();
+        in_offset_ = 0;
+      }
+      return response;
+    }
+    size_t old_size = in_.size();
+    in_.resize(old_size + kReadChunk);
+    ssize_t n = ::recv(fd_, in_.data() + old_size, kReadChunk, 0);
+    in_.resize(old_size + std::max<ssize_t>(n, 0));
+    if (n == 0) {
+      throw std::logic_error("Connection closed by server");
+    }
+    if (n == -1 && errno != EINTR) {
+      throw SystemError("recv");
+    }
+  }
+}
+
+ClientResponse Client::Execute(std::string_view query) {
+  Send(query);
+  ClientResponse response = Receive();
+  if (response.status == kErrorResponse) {
+    throw std::logic_error(response.message);
+  }
+  return response;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "../Database/database.h"
+#include "../Server/protocol.h"
+
+struct ClientResponse {
+  ResponseStatus status = kMessageResponse;
+  /// текст сообщения или ошибки
+  std::string message;
+  Table table;
+};
+
+/// Клиент сервера базы. Send только буферизует запрос, поэтому несколько Send подряд
+/// уходят одним пакетом, а ответы читаются Receive в том же порядке.
+class Client {
+ public:
+  static Client ConnectUnix(const std::string& path);
+
+  static Client ConnectTcp(const std::string& host, uint16_t port);
+
+  Client(Client&& other) noexcept;
+  Client& operator=(Client&& other) noexcept;
+  Client(const Client&) = delete;
+  Client& operator=(const Client&) = delete;
+
+  ~Client();
+
+  void Send(std::string_view query);
+
+  /// отправить все накопленные запросы
+  void Flush();
+
+  /// следующий ответ; перед чтением отправляет накопленные запросы
+  ClientResponse Receive();
+
+  /// Send + Receive; ответ с ошибкой превращается в std::logic_error, как у Database::Execute
+  ClientResponse Execute(std::string_view query);
+
+ private:
+  explicit Client(int fd);
+
+  int fd_ = -1;
+  std::string out_;
+  std::string in_;
+  size_t in_offset_ = 0;
+};
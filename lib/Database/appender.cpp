@@ -0,0 +1,81 @@
+#include "appender.h"
+
+Appender::Appender(Database& db, std::string table) : db_(db), table_(std::move(table)) {
+  const Table& target = db_.GetTable(table_);
+  for (const auto& name : target.column_names()) {
+    types_.push_back(target.column(name).type());
+  }
+  row_.reserve(types_.size());
+}
+
+DataType Appender::NextType() const {
+  if (row_.size() >= types_.size()) {
+    throw std::logic_error("Too many values in row");
+  }
+  return types_[row_.size()];
+}
+
+Appender& Appender::Push(Value value) {
+  if (!std::holds_alternative<MyMonostate>(value) && value.index() != ValueIndex(NextType())) {
+    throw std::logic_error("Invalid value type");
+  }
+  row_.push_back(std::move(value));
+  return *this;
+}
+
+Appender& Appender::Append(int value) {
+  switch (NextType()) {
+    case kDouble:
+      return Push(static_cast<double>(value));
+    case kFloat:
+      return Push(static_cast<float>(value));
+    default:
+      return Push(value);
+  }
+}
+
+Appender& Appender::Append(double value) {
+  if (NextType() == kFloat) {
+    return Push(static_cast<float>(value));
+  }
+  return Push(value);
+}
+
+Appender& Appender::Append(float value) {
+  if (NextType() == kDouble) {
+    return Push(static_cast<double>(value));
+  }
+  return Push(value);
+}
+
+Appender& Appender::Append(bool value) {
+  return Push(value);
+}
+
+Appender& Appender::Append(std::string_view value) {
+  return Push(std::string(value));
+}
+
+Appender& Appender::Append(const char* value) {
+  return Append(std::string_view(value));
+}
+
+Appender& Appender::AppendNull() {
+  NextType();
+  return Push(MyMonostate());
+}
+
+void Appender::EndRow() {
+  try {
+    db_.AppendRow(table_, row_);
+  } catch (...) {
+    row_.clear();
+    throw;
+  }
+  row_.clear();
+  ++rows_appended_;
+}
+
+size_t Appender::rows_appended() const {
+  return rows_appended_;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "database.h"
+
+/// Построчная вставка типизированных значений в порядке схемы таблицы без разбора SQL.
+/// Значения строки копятся до EndRow и вставляются через Database::AppendRow, поэтому
+/// ошибка не оставляет столбцы разной длины, а внешние ключи и представления
+/// проверяются и обновляются так же, как при INSERT.
+class Appender {
+ public:
+  Appender(Database& db, std::string table);
+
+  Appender& Append(int value);
+  Appender& Append(double value);
+  Appender& Append(float value);
+  Appender& Append(bool value);
+  Appender& Append(std::string_view value);
+  Appender& Append(const char* value);
+  Appender& AppendNull();
+
+  void EndRow();
+
+  size_t rows_appended() const;
+
+ private:
+  DataType NextType() const;
+  Appender& Push(Value value);
+
+  Database& db_;
+  std::string table_;
+  std::vector<DataType> types_;
+  std::vector<Value> row_;
+  size_t rows_appended_ = 0;
+};
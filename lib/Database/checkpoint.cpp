@@ -0,0 +1,458 @@
+#include "checkpoint.h"
+
+#include "database.h"
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <set>
+#include <system_error>
+
+#include "../Scheduler/parallel_for.h"
+
+namespace {
+
+constexpr std::string_view kManifestHeader = "checkpoint";
+constexpr int kManifestVersion = 4;
+/// версии 2 и 3 читаются: в них нет внешних ключей и разделов соответственно
+constexpr int kMinManifestVersion = 2;
+
+template <typename T>
+void Put(std::string& out, const T& value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T Get(std::string_view data, size_t& offset) {
+  if (offset + sizeof(T) > data.size()) {
+    throw std::logic_error("Corrupted checkpoint block");
+  }
+  T value;
+  std::memcpy(&value, data.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
+std::system_error FileError(const std::string& path) {
+  return {errno, std::generic_category(), path};
+}
+
+}  // namespace
+
+CheckpointStats Checkpointer::Write(const std::string& directory, std::unordered_map<std::string, Table>& tables,
+                                    const CheckpointOptions& options) {
+  std::filesystem::create_directories(directory);
+  if (directory != directory_) {
+    manifest_ = std::filesystem::exists(std::filesystem::path(directory) / "manifest")
+                ? ReadManifest(directory) : Manifest();
+  }
+  bool full = NeedsFull(directory, options);
+  Manifest next = full ? Manifest() : manifest_;
+  next.generation = manifest_.generation + 1;
+  next.last_full = full ? next.generation : manifest_.last_full;
+
+  CheckpointStats stats;
+  stats.generation = next.generation;
+  stats.full = full;
+  std::string path = DataPath(directory, next.generation);
+  std::ofstream data(path, std::ios::binary | std::ios::trunc);
+  if (!data) {
+    throw FileError(path);
+  }
+  uint64_t offset = 0;
+  std::erase_if(next.tables, [&tables](const auto& p) { return !tables.contains(p.first); });
+  for (const auto& [name, table] : tables) {
+    auto it = next.tables.find(name);
+    if (it != next.tables.end() && !table.dirty()) {
+      continue;
+    }
+    TableManifest written;
+    written.rows = table.n_rows_;
+    written.foreign_keys = table.foreign_keys_;
+    written.partition_key = table.partition_key_;
+    written.partitions = table.partitions_.size();
+    for (size_t i = 0; i < table.column_names_.size(); ++i) {
+      const std::string& column_name = table.column_names_[i];
+      const Column& column = table.columns_.at(column_name);
+      ColumnManifest manifest{column_name, column.type_, column.max_len_of_value_, column.is_primary_,
+                              column.not_null_, {}};
+      const std::vector<BlockRef>* old = nullptr;
+      if (it != next.tables.end() && i < it->second.columns.size()) {
+        const ColumnManifest& prev = it->second.columns[i];
+        if (prev.name == manifest.name && prev.type == manifest.type) {
+          old = &prev.blocks;
+        }
+      }
+      for (size_t b = 0; b < column.blocks(); ++b) {
+        if (old != nullptr && b < old->size() && !column.IsDirty(b)) {
+          manifest.blocks.push_back((*old)[b]);
+          continue;
+        }
+        std::string block = EncodeBlock(column, b);
+        data.write(block.data(), static_cast<std::streamsize>(block.size()));
+        manifest.blocks.push_back({next.generation, offset, block.size()});
+        offset += block.size();
+        ++stats.blocks_written;
+      }
+      written.columns.push_back(std::move(manifest));
+    }
+    next.tables[name] = std::move(written);
+    ++stats.tables_written;
+  }
+  data.close();
+  if (!data) {
+    throw FileError(path);
+  }
+  stats.bytes_written = offset;
+
+  std::set<uint64_t> referenced;
+  for (const auto& [name, table] : next.tables) {
+    for (const auto& column : table.columns) {
+      for (const auto& block : column.blocks) {
+        referenced.insert(block.generation);
+      }
+    }
+  }
+  next.files[next.generation] = offset;
+  std::erase_if(next.files, [&referenced](const auto& p) { return !referenced.contains(p.first); });
+  WriteManifest(directory, next);
+
+  for (auto& [name, table] : tables) {
+    table.ClearDirty();
+  }
+  std::error_code ignored;
+  if (!next.files.contains(next.generation)) {
+    std::filesystem::remove(path, ignored);
+  }
+  for (const auto& [generation, size] : manifest_.files) {
+    if (!next.files.contains(generation)) {
+      std::filesystem::remove(DataPath(directory, generation), ignored);
+    }
+  }
+  manifest_ = std::move(next);
+  directory_ = directory;
+  return stats;
+}
+
+std::unordered_map<std::string, Table> Checkpointer::Read(
+    const std::string& directory,
+    const std::function<std::shared_ptr<TrackingResource>(const std::string&)>& memory, size_t threads) {
+  Manifest manifest = ReadManifest(directory);
+  std::vector<std::pair<const std::string*, Table>> tables;
+  // колонки всех таблиц читаются одним пулом, чтобы большая таблица не ждала в одном потоке
+  std::vector<std::pair<size_t, const ColumnManifest*>> tasks;
+  for (const auto& [name, info] : manifest.tables) {
+    for (const auto& c : info.columns) {
+      tasks.emplace_back(tables.size(), &c);
+    }
+    tables.emplace_back(&name, Table(memory(name)));
+  }
+  std::vector<std::optional<Column>> columns(tasks.size());
+  ParallelFor(tasks.size(), threads, [&](size_t i) {
+    const auto& [name, table] = tables[tasks[i].first];
+    columns[i].emplace(ReadColumn(directory, *name, *tasks[i].second, manifest.tables.at(*name).rows,
+                                  table.memory_));
+  });
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    tables[tasks[i].first].second.EmplaceColumn(tasks[i].second->name, std::move(*columns[i]));
+  }
+  std::unordered_map<std::string, Table> result;
+  for (auto& [name, table] : tables) {
+    const TableManifest& info = manifest.tables.at(*name);
+    table.n_rows_ = info.rows;
+    for (const auto& key : info.foreign_keys) {
+      table.AddForeignKey(key);
+    }
+    if (info.partitions != 0) {
+      table.SetPartitioning(info.partition_key, info.partitions);
+    }
+    table.ClearDirty();
+    result.emplace(*name, std::move(table));
+  }
+  manifest_ = std::move(manifest);
+  directory_ = directory;
+  return result;
+}
+
+std::unordered_map<std::string, LazyTable> Checkpointer::ReadLazy(const std::string& directory, size_t threads) {
+  Manifest manifest = ReadManifest(directory);
+  std::unordered_map<std::string, LazyTable> result;
+  for (const auto& [name, info] : manifest.tables) {
+    result.emplace(name, LazyTable{info.rows, info.foreign_keys, [directory, name, info, threads](std::shared_ptr<TrackingResource> memory) {
+      return LoadTable(directory, name, info, std::move(memory), threads);
+    }});
+  }
+  manifest_ = std::move(manifest);
+  directory_ = directory;
+  return result;
+}
+
+Table Checkpointer::LoadTable(const std::string& directory, const std::string& name, const TableManifest& info,
+                              std::shared_ptr<TrackingResource> memory, size_t threads) {
+  Table table(std::move(memory));
+  std::vector<std::optional<Column>> columns(info.columns.size());
+  ParallelFor(columns.size(), threads, [&](size_t i) {
+    columns[i].emplace(ReadColumn(directory, name, info.columns[i], info.rows, table.memory_));
+  });
+  for (size_t i = 0; i < columns.size(); ++i) {
+    table.EmplaceColumn(info.columns[i].name, std::move(*columns[i]));
+  }
+  table.n_rows_ = info.rows;
+  for (const auto& key : info.foreign_keys) {
+    table.AddForeignKey(key);
+  }
+  if (info.partitions != 0) {
+    table.SetPartitioning(info.partition_key, info.partitions);
+  }
+  table.ClearDirty();
+  return table;
+}
+
+Column Checkpointer::ReadColumn(const std::string& directory, const std::string& table, const ColumnManifest& info,
+                                size_t rows, const std::shared_ptr<TrackingResource>& memory) {
+  Column column(info.type, info.max_len, info.not_null, memory);
+  column.is_primary_ = info.is_primary;
+  column.not_null_ = info.not_null;
+  std::map<uint64_t, std::ifstream> files;
+  std::string buffer;
+  for (const auto& ref : info.blocks) {
+    auto [it, inserted] = files.try_emplace(ref.generation);
+    if (inserted) {
+      it->second.open(DataPath(directory, ref.generation), std::ios::binary);
+    }
+    buffer.resize(ref.size);
+    it->second.seekg(static_cast<std::streamoff>(ref.offset));
+    if (!it->second.read(buffer.data(), static_cast<std::streamsize>(ref.size))) {
+      throw FileError(DataPath(directory, ref.generation));
+    }
+    DecodeBlock(buffer, column);
+  }
+  if (column.size() != rows) {
+    throw std::logic_error("Corrupted checkpoint: column '" + table + "." + info.name + "' has "
+                               + std::to_string(column.size()) + " rows instead of " + std::to_string(rows));
+  }
+  return column;
+}
+
+std::string Checkpointer::DataPath(const std::string& directory, uint64_t generation) {
+  return (std::filesystem::path(directory) / ("data." + std::to_string(generation))).string();
+}
+
+std::string Checkpointer::EncodeBlock(const Column& column, size_t block) {
+  std::string out;
+  if (block < column.sealed_.size()) {
+    // первым байтом пишется кодировка блока, kPlain — несжатые значения
+    column.sealed_[block].Serialize(out);
+    return out;
+  }
+  size_t begin = block * Column::kBlockRows;
+  size_t end = std::min(begin + Column::kBlockRows, column.size());
+  Put(out, static_cast<uint8_t>(kPlain));
+  Put(out, static_cast<uint32_t>(end - begin));
+  for (size_t i = begin; i < end; ++i) {
+    Value value = column[i];
+    Put(out, static_cast<uint8_t>(value.index()));
+    switch (value.index()) {
+      case 1:
+        Put(out, std::get<int>(value));
+        break;
+      case 2:
+        Put(out, std::get<double>(value));
+        break;
+      case 3:
+        Put(out, std::get<float>(value));
+        break;
+      case 4:
+        Put(out, static_cast<uint8_t>(std::get<bool>(value)));
+        break;
+      case 5: {
+        const auto& s = std::get<std::string>(value);
+        Put(out, static_cast<uint32_t>(s.size()));
+        out += s;
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  return out;
+}
+
+void Checkpointer::DecodeBlock(std::string_view data, Column& column) {
+  size_t offset = 0;
+  if (Get<uint8_t>(data, offset) != kPlain) {
+    offset = 0;
+    column.AppendBlock(EncodedBlock::Deserialize(data, offset, Column::Resource(column.memory_)));
+    return;
+  }
+  auto count = Get<uint32_t>(data, offset);
+  for (uint32_t i = 0; i < count; ++i) {
+    switch (Get<uint8_t>(data, offset)) {
+      case 0:
+        column.PushValue(MyMonostate());
+        break;
+      case 1:
+        column.PushValue(Get<int>(data, offset));
+        break;
+      case 2:
+        column.PushValue(Get<double>(data, offset));
+        break;
+      case 3:
+        column.PushValue(Get<float>(data, offset));
+        break;
+      case 4:
+        column.PushValue(Get<uint8_t>(data, offset) != 0);
+        break;
+      case 5: {
+        auto size = Get<uint32_t>(data, offset);
+        if (offset + size > data.size()) {
+          throw std::logic_error("Corrupted checkpoint block");
+        }
+        column.PushValue(std::string(data.substr(offset, size)));
+        offset += size;
+        break;
+      }
+      default:
+        throw std::logic_error("Corrupted checkpoint block");
+    }
+  }
+}
+
+void Checkpointer::WriteManifest(const std::string& directory, const Manifest& manifest) {
+  auto path = std::filesystem::path(directory) / "manifest";
+  auto tmp = std::filesystem::path(directory) / "manifest.tmp";
+  {
+    std::ofstream f(tmp, std::ios::trunc);
+    f << kManifestHeader << ' ' << kManifestVersion << '\n'
+      << "generation " << manifest.generation << '\n'
+      << "last_full " << manifest.last_full << '\n'
+      << "files " << manifest.files.size() << '\n';
+    for (const auto& [generation, size] : manifest.files) {
+      f << generation << ' ' << size << '\n';
+    }
+    f << "tables " << manifest.tables.size() << '\n';
+    for (const auto& [name, table] : manifest.tables) {
+      f << "table " << name << ' ' << table.rows << ' ' << table.columns.size() << '\n';
+      for (const auto& c : table.columns) {
+        f << "column " << c.name << ' ' << c.type << ' ' << c.max_len << ' ' << c.is_primary << ' '
+          << c.not_null << ' ' << c.blocks.size();
+        for (const auto& b : c.blocks) {
+          f << ' ' << b.generation << ' ' << b.offset << ' ' << b.size;
+        }
+        f << '\n';
+      }
+      f << "foreign_keys " << table.foreign_keys.size() << '\n';
+      for (const auto& key : table.foreign_keys) {
+        f << "key " << key.column << ' ' << key.table << ' ' << key.referenced << '\n';
+      }
+      f << "partitions " << table.partitions;
+      if (table.partitions != 0) {
+        f << ' ' << table.partition_key;
+      }
+      f << '\n';
+    }
+    f.close();
+    if (!f) {
+      throw FileError(tmp.string());
+    }
+  }
+  std::filesystem::rename(tmp, path);
+}
+
+Checkpointer::Manifest Checkpointer::ReadManifest(const std::string& directory) {
+  auto path = std::filesystem::path(directory) / "manifest";
+  std::ifstream f(path);
+  if (!f) {
+    throw FileError(path.string());
+  }
+  auto expect = [&f](std::string_view word) {
+    std::string buf;
+    if (!(f >> buf) || buf != word) {
+      throw std::logic_error("Corrupted checkpoint manifest: expected '" + std::string(word) + "'");
+    }
+  };
+  Manifest manifest;
+  int version;
+  expect(kManifestHeader);
+  f >> version;
+  if (version < kMinManifestVersion || version > kManifestVersion) {
+    throw std::logic_error("Unsupported checkpoint version " + std::to_string(version));
+  }
+  size_t n;
+  expect("generation");
+  f >> manifest.generation;
+  expect("last_full");
+  f >> manifest.last_full;
+  expect("files");
+  f >> n;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t generation, size;
+    f >> generation >> size;
+    manifest.files[generation] = size;
+  }
+  expect("tables");
+  f >> n;
+  for (size_t i = 0; i < n; ++i) {
+    std::string name;
+    size_t n_columns;
+    expect("table");
+    f >> name;
+    TableManifest& table = manifest.tables[name];
+    f >> table.rows >> n_columns;
+    for (size_t j = 0; j < n_columns; ++j) {
+      ColumnManifest c;
+      int type;
+      size_t n_blocks;
+      expect("column");
+      f >> c.name >> type >> c.max_len >> c.is_primary >> c.not_null >> n_blocks;
+      c.type = static_cast<DataType>(type);
+      c.blocks.resize(n_blocks);
+      for (auto& b : c.blocks) {
+        f >> b.generation >> b.offset >> b.size;
+      }
+      table.columns.push_back(std::move(c));
+    }
+    if (version >= 3) {
+      size_t n_keys;
+      expect("foreign_keys");
+      f >> n_keys;
+      table.foreign_keys.resize(n_keys);
+      for (auto& key : table.foreign_keys) {
+        expect("key");
+        f >> key.column >> key.table >> key.referenced;
+      }
+    }
+    if (version >= 4) {
+      expect("partitions");
+      f >> table.partitions;
+      if (table.partitions != 0) {
+        f >> table.partition_key;
+      }
+    }
+  }
+  if (!f) {
+    throw std::logic_error("Corrupted checkpoint manifest");
+  }
+  return manifest;
+}
+
+bool Checkpointer::NeedsFull(const std::string& directory, const CheckpointOptions& options) const {
+  if (options.force_full || directory != directory_ || manifest_.generation == 0
+      || manifest_.generation + 1 - manifest_.last_full >= std::max<size_t>(options.full_interval, 1)) {
+    return true;
+  }
+  uint64_t total = 0;
+  uint64_t live = 0;
+  for (const auto& [generation, size] : manifest_.files) {
+    total += size;
+  }
+  for (const auto& [name, table] : manifest_.tables) {
+    for (const auto& column : table.columns) {
+      for (const auto& block : column.blocks) {
+        live += block.size;
+      }
+    }
+  }
+  return total != 0 && static_cast<double>(live) < options.min_live_ratio * static_cast<double>(total);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "../Memory/tracking_resource.h"
+#include "../Parser/sql_parser.h"
+
+class Column;
+class Table;
+
+struct CheckpointOptions {
+  /// каждый full_interval-й чекпоинт пишется целиком, после чего старые файлы удаляются
+  size_t full_interval = 16;
+  /// полный чекпоинт и раньше, если живых блоков в файлах меньше этой доли
+  double min_live_ratio = 0.5;
+  bool force_full = false;
+};
+
+/// таблица, зарегистрированная без чтения данных; load читает ее при первом обращении
+struct LazyTable {
+  size_t rows = 0;
+  /// известны до чтения, чтобы проверки ключей могли загрузить связанные таблицы
+  std::vector<ForeignKey> foreign_keys;
+  std::function<Table(std::shared_ptr<TrackingResource>)> load;
+};
+
+struct CheckpointStats {
+  uint64_t generation = 0;
+  bool full = false;
+  size_t tables_written = 0;
+  size_t blocks_written = 0;
+  size_t bytes_written = 0;
+};
+
+/// Чекпоинты в каталоге: файлы data.<поколение> с блоками колонок по Column::kBlockRows
+/// значений (сжатые блоки пишутся в той же кодировке, что и в памяти) и манифест, который для каждого блока указывает файл и смещение его
+/// последней версии. Инкрементальный чекпоинт пишет только измененные таблицы и блоки,
+/// манифест заменяется атомарно через rename.
+class Checkpointer {
+ public:
+  /// помечает таблицы чистыми после записи
+  CheckpointStats Write(const std::string& directory, std::unordered_map<std::string, Table>& tables,
+                        const CheckpointOptions& options);
+
+  /// загружает последний чекпоинт, колонки читаются параллельно в threads потоках
+  /// (0 — по числу ядер); следующий Write продолжит его цепочку
+  std::unordered_map<std::string, Table> Read(
+      const std::string& directory,
+      const std::function<std::shared_ptr<TrackingResource>(const std::string&)>& memory, size_t threads = 0);
+
+  /// как Read, но читает только манифест; файлы данных удаляет лишь следующий Write,
+  /// поэтому до него все таблицы должны быть загружены
+  std::unordered_map<std::string, LazyTable> ReadLazy(const std::string& directory, size_t threads = 0);
+
+ private:
+  struct BlockRef {
+    uint64_t generation = 0;
+    uint64_t offset = 0;
+    uint64_t size = 0;
+  };
+
+  struct ColumnManifest {
+    std::string name;
+    DataType type = kInt;
+    size_t max_len = 0;
+    bool is_primary = false;
+    bool not_null = true;
+    std::vector<BlockRef> blocks;
+  };
+
+  struct TableManifest {
+    size_t rows = 0;
+    std::vector<ColumnManifest> columns;
+    std::vector<ForeignKey> foreign_keys;
+    std::string partition_key;
+    size_t partitions = 0;
+  };
+
+  struct Manifest {
+    uint64_t generation = 0;
+    uint64_t last_full = 0;
+    /// размер каждого файла данных по поколениям
+    std::map<uint64_t, uint64_t> files;
+    std::map<std::string, TableManifest> tables;
+  };
+
+  static std::string DataPath(const std::string& directory, uint64_t generation);
+  static Column ReadColumn(const std::string& directory, const std::string& table, const ColumnManifest& info,
+                           size_t rows, const std::shared_ptr<TrackingResource>& memory);
+  static Table LoadTable(const std::string& directory, const std::string& name, const TableManifest& info,
+                         std::shared_ptr<TrackingResource> memory, size_t threads);
+  static std::string EncodeBlock(const Column& column, size_t block);
+  static void DecodeBlock(std::string_view data, Column& column);
+  static void WriteManifest(const std::string& directory, const Manifest& manifest);
+  static Manifest ReadManifest(const std::string& directory);
+  bool NeedsFull(const std::string& directory, const CheckpointOptions& options) const;
+
+  std::string directory_;
+  Manifest manifest_;
+};
@@ -0,0 +1,415 @@
+#include "compression.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+size_t Words(size_t count, uint8_t width) {
+  return (count * width + 63) / 64;
+}
+
+void PutBits(std::pmr::vector<uint64_t>& words, size_t i, uint8_t width, uint64_t value) {
+  if (width == 0) {
+    return;
+  }
+  size_t bit = i * width;
+  size_t shift = bit % 64;
+  words[bit / 64] |= value << shift;
+  if (shift + width > 64) {
+    words[bit / 64 + 1] |= value >> (64 - shift);
+  }
+}
+
+uint64_t GetBits(const uint64_t* words, size_t i, uint8_t width) {
+  if (width == 0) {
+    return 0;
+  }
+  size_t bit = i * width;
+  size_t shift = bit % 64;
+  uint64_t value = words[bit / 64] >> shift;
+  if (shift + width > 64) {
+    value |= words[bit / 64 + 1] << (64 - shift);
+  }
+  return width == 64 ? value : value & ((uint64_t(1) << width) - 1);
+}
+
+uint8_t Width(uint64_t range) {
+  return static_cast<uint8_t>(std::bit_width(range));
+}
+
+template <typename F>
+void WithComparator(TokenType op, F&& f) {
+  switch (op) {
+    case kEquals:
+      f(std::equal_to<>());
+      break;
+    case kNotEquals:
+      f(std::not_equal_to<>());
+      break;
+    case kGreater:
+      f(std::greater<>());
+      break;
+    case kLess:
+      f(std::less<>());
+      break;
+    case kNotGreater:
+      f(std::less_equal<>());
+      break;
+    case kNotLess:
+      f(std::greater_equal<>());
+      break;
+    default:
+      throw std::logic_error("Invalid operation");
+  }
+}
+
+template <typename T>
+void Put(std::string& out, const T& value) {
+  out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T Get(std::string_view data, size_t& offset) {
+  if (offset + sizeof(T) > data.size()) {
+    throw std::logic_error("Corrupted encoded block");
+  }
+  T value;
+  std::memcpy(&value, data.data() + offset, sizeof(T));
+  offset += sizeof(T);
+  return value;
+}
+
+template <typename T>
+void PutVector(std::string& out, const std::pmr::vector<T>& values) {
+  Put(out, static_cast<uint32_t>(values.size()));
+  out.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+}
+
+template <typename T>
+void GetVector(std::string_view data, size_t& offset, std::pmr::vector<T>& values) {
+  auto size = Get<uint32_t>(data, offset);
+  if (offset + size * sizeof(T) > data.size()) {
+    throw std::logic_error("Corrupted encoded block");
+  }
+  values.resize(size);
+  std::memcpy(values.data(), data.data() + offset, size * sizeof(T));
+  offset += size * sizeof(T);
+}
+
+}  // namespace
+
+EncodedBlock::EncodedBlock(allocator_type allocator)
+    : codes_(allocator), anchors_(allocator), ends_(allocator), nulls_(allocator) {}
+
+EncodedBlock::EncodedBlock(const EncodedBlock& other, allocator_type allocator)
+    : encoding_(other.encoding_),
+      rows_(other.rows_),
+      null_count_(other.null_count_),
+      width_(other.width_),
+      base_(other.base_),
+      min_(other.min_),
+      max_(other.max_),
+      codes_(other.codes_, allocator),
+      anchors_(other.anchors_, allocator),
+      ends_(other.ends_, allocator),
+      nulls_(other.nulls_, allocator) {}
+
+EncodedBlock::EncodedBlock(EncodedBlock&& other, allocator_type allocator)
+    : encoding_(other.encoding_),
+      rows_(other.rows_),
+      null_count_(other.null_count_),
+      width_(other.width_),
+      base_(other.base_),
+      min_(other.min_),
+      max_(other.max_),
+      codes_(std::move(other.codes_), allocator),
+      anchors_(std::move(other.anchors_), allocator),
+      ends_(std::move(other.ends_), allocator),
+      nulls_(std::move(other.nulls_), allocator) {}
+
+EncodedBlock EncodedBlock::Encode(std::span<const int64_t> values, std::span<const uint8_t> is_null,
+                                  allocator_type allocator) {
+  EncodedBlock block(allocator);
+  size_t n = values.size();
+  block.rows_ = static_cast<uint32_t>(n);
+
+  // NULL заменяются предыдущим значением (в начале блока — первым не NULL)
+  std::vector<int64_t> filled(values.begin(), values.end());
+  if (!is_null.empty()) {
+    block.nulls_.resize((n + 63) / 64);
+    auto first = std::find(is_null.begin(), is_null.end(), 0);
+    int64_t last = first == is_null.end() ? 0 : values[static_cast<size_t>(first - is_null.begin())];
+    for (size_t i = 0; i < n; ++i) {
+      if (is_null[i] != 0) {
+        block.nulls_[i / 64] |= uint64_t(1) << (i % 64);
+        ++block.null_count_;
+        filled[i] = last;
+      } else {
+        last = filled[i];
+      }
+    }
+    if (block.null_count_ == 0) {
+      block.nulls_.clear();
+    }
+  }
+
+  bool sorted = true;
+  size_t runs = n == 0 ? 0 : 1;
+  uint64_t max_delta = 0;
+  block.min_ = n == 0 ? 0 : filled[0];
+  block.max_ = block.min_;
+  for (size_t i = 1; i < n; ++i) {
+    block.min_ = std::min(block.min_, filled[i]);
+    block.max_ = std::max(block.max_, filled[i]);
+    if (filled[i] < filled[i - 1]) {
+      sorted = false;
+    } else {
+      max_delta = std::max(max_delta, static_cast<uint64_t>(filled[i] - filled[i - 1]));
+    }
+    runs += filled[i] != filled[i - 1];
+  }
+  uint8_t range_width = Width(static_cast<uint64_t>(block.max_ - block.min_));
+  uint8_t delta_width = Width(max_delta);
+  size_t for_bytes = Words(n, range_width) * 8;
+  size_t delta_bytes = sorted ? Words(n, delta_width) * 8 + (n + kDeltaStride - 1) / kDeltaStride * 8 : SIZE_MAX;
+  size_t rle_bytes = Words(runs, range_width) * 8 + runs * sizeof(uint32_t);
+
+  block.base_ = block.min_;
+  if (rle_bytes < for_bytes && rle_bytes < delta_bytes) {
+    block.encoding_ = kRunLength;
+    block.width_ = range_width;
+    block.codes_.resize(Words(runs, range_width));
+    block.ends_.reserve(runs);
+    for (size_t i = 0; i < n; ++i) {
+      if (i + 1 == n || filled[i + 1] != filled[i]) {
+        PutBits(block.codes_, block.ends_.size(), range_width, static_cast<uint64_t>(filled[i] - block.base_));
+        block.ends_.push_back(static_cast<uint32_t>(i + 1));
+      }
+    }
+  } else if (delta_bytes < for_bytes) {
+    block.encoding_ = kDelta;
+    block.width_ = delta_width;
+    block.codes_.resize(Words(n, delta_width));
+    for (size_t i = 0; i < n; ++i) {
+      if (i % kDeltaStride == 0) {
+        block.anchors_.push_back(filled[i]);
+      } else {
+        PutBits(block.codes_, i, delta_width, static_cast<uint64_t>(filled[i] - filled[i - 1]));
+      }
+    }
+  } else {
+    block.encoding_ = kFrameOfReference;
+    block.width_ = range_width;
+    block.codes_.resize(Words(n, range_width));
+    for (size_t i = 0; i < n; ++i) {
+      PutBits(block.codes_, i, range_width, static_cast<uint64_t>(filled[i] - block.base_));
+    }
+  }
+  return block;
+}
+
+EncodedBlock EncodedBlock::Deserialize(std::string_view data, size_t& offset, allocator_type allocator) {
+  EncodedBlock block(allocator);
+  auto encoding = Get<uint8_t>(data, offset);
+  if (encoding != kFrameOfReference && encoding != kDelta && encoding != kRunLength) {
+    throw std::logic_error("Corrupted encoded block");
+  }
+  block.encoding_ = static_cast<Encoding>(encoding);
+  block.rows_ = Get<uint32_t>(data, offset);
+  block.null_count_ = Get<uint32_t>(data, offset);
+  block.width_ = Get<uint8_t>(data, offset);
+  block.base_ = Get<int64_t>(data, offset);
+  block.min_ = Get<int64_t>(data, offset);
+  block.max_ = Get<int64_t>(data, offset);
+  GetVector(data, offset, block.codes_);
+  GetVector(data, offset, block.anchors_);
+  GetVector(data, offset, block.ends_);
+  GetVector(data, offset, block.nulls_);
+  size_t codes = block.encoding_ == kRunLength ? block.ends_.size() : block.rows_;
+  bool valid = block.width_ <= 64 && block.codes_.size() == Words(codes, block.width_)
+               && (block.nulls_.empty() || block.nulls_.size() == (block.rows_ + 63) / 64);
+  if (block.encoding_ == kDelta) {
+    valid = valid && block.anchors_.size() == (block.rows_ + kDeltaStride - 1) / kDeltaStride;
+  }
+  if (block.encoding_ == kRunLength) {
+    valid = valid && std::is_sorted(block.ends_.begin(), block.ends_.end())
+            && (block.ends_.empty() ? block.rows_ == 0 : block.ends_.back() == block.rows_);
+  }
+  if (!valid) {
+    throw std::logic_error("Corrupted encoded block");
+  }
+  return block;
+}
+
+void EncodedBlock::Serialize(std::string& out) const {
+  Put(out, static_cast<uint8_t>(encoding_));
+  Put(out, rows_);
+  Put(out, null_count_);
+  Put(out, width_);
+  Put(out, base_);
+  Put(out, min_);
+  Put(out, max_);
+  PutVector(out, codes_);
+  PutVector(out, anchors_);
+  PutVector(out, ends_);
+  PutVector(out, nulls_);
+}
+
+Encoding EncodedBlock::encoding() const {
+  return encoding_;
+}
+
+size_t EncodedBlock::size() const {
+  return rows_;
+}
+
+bool EncodedBlock::IsNull(size_t row) const {
+  return !nulls_.empty() && (nulls_[row / 64] >> (row % 64) & 1) != 0;
+}
+
+int64_t EncodedBlock::operator[](size_t row) const {
+  switch (encoding_) {
+    case kDelta: {
+      size_t anchor = row / kDeltaStride;
+      int64_t value = anchors_[anchor];
+      for (size_t i = anchor * kDeltaStride + 1; i <= row; ++i) {
+        value += static_cast<int64_t>(GetBits(codes_.data(), i, width_));
+      }
+      return value;
+    }
+    case kRunLength: {
+      auto run = std::upper_bound(ends_.begin(), ends_.end(), row) - ends_.begin();
+      return base_ + static_cast<int64_t>(GetBits(codes_.data(), static_cast<size_t>(run), width_));
+    }
+    default:
+      return base_ + static_cast<int64_t>(GetBits(codes_.data(), row, width_));
+  }
+}
+
+void EncodedBlock::Decode(std::span<int64_t> out) const {
+  switch (encoding_) {
+    case kDelta:
+      for (size_t i = 0; i < rows_; ++i) {
+        out[i] = i % kDeltaStride == 0 ? anchors_[i / kDeltaStride]
+                                       : out[i - 1] + static_cast<int64_t>(GetBits(codes_.data(), i, width_));
+      }
+      break;
+    case kRunLength: {
+      size_t begin = 0;
+      for (size_t r = 0; r < ends_.size(); ++r) {
+        std::fill(out.begin() + static_cast<std::ptrdiff_t>(begin), out.begin() + ends_[r],
+                  base_ + static_cast<int64_t>(GetBits(codes_.data(), r, width_)));
+        begin = ends_[r];
+      }
+      break;
+    }
+    default:
+      for (size_t i = 0; i < rows_; ++i) {
+        out[i] = base_ + static_cast<int64_t>(GetBits(codes_.data(), i, width_));
+      }
+      break;
+  }
+}
+
+void EncodedBlock::Match(TokenType op, int64_t constant, uint8_t* out) const {
+  bool uniform = null_count_ == rows_;
+  bool result = false;
+  if (!uniform) {
+    // сравнение монотонно по значению: одинаковый ответ на минимуме и максимуме
+    // значит одинаковый ответ для всего блока (для = и != — если константа вне диапазона)
+    WithComparator(op, [&](auto cmp) {
+      bool at_min = cmp(min_, constant);
+      bool at_max = cmp(max_, constant);
+      if (op == kEquals || op == kNotEquals) {
+        uniform = constant < min_ || constant > max_ || min_ == max_;
+      } else {
+        uniform = at_min == at_max;
+      }
+      result = at_min;
+    });
+  }
+  if (uniform) {
+    std::fill(out, out + rows_, static_cast<uint8_t>(result));
+  } else {
+    WithComparator(op, [&](auto cmp) {
+      switch (encoding_) {
+        case kDelta: {
+          int64_t value = 0;
+          for (size_t i = 0; i < rows_; ++i) {
+            value = i % kDeltaStride == 0 ? anchors_[i / kDeltaStride]
+                                          : value + static_cast<int64_t>(GetBits(codes_.data(), i, width_));
+            out[i] = cmp(value, constant);
+          }
+          break;
+        }
+        case kRunLength: {
+          uint64_t code = static_cast<uint64_t>(constant - base_);
+          size_t begin = 0;
+          for (size_t r = 0; r < ends_.size(); ++r) {
+            std::fill(out + begin, out + ends_[r], static_cast<uint8_t>(cmp(GetBits(codes_.data(), r, width_), code)));
+            begin = ends_[r];
+          }
+          break;
+        }
+        default: {
+          // константа внутри [min, max], поэтому сравнимо со смещением без знака
+          uint64_t code = static_cast<uint64_t>(constant - base_);
+          for (size_t i = 0; i < rows_; ++i) {
+            out[i] = cmp(GetBits(codes_.data(), i, width_), code);
+          }
+          break;
+        }
+      }
+    });
+  }
+  for (size_t w = 0; w < nulls_.size(); ++w) {
+    for (uint64_t word = nulls_[w]; word != 0; word &= word - 1) {
+      out[w * 64 + static_cast<size_t>(std::countr_zero(word))] = 0;
+    }
+  }
+}
+
+bool EncodedBlock::Contains(int64_t value) const {
+  // заполнители NULL повторяют соседние значения, поэтому проверка по ним точна
+  if (null_count_ == rows_ || value < min_ || value > max_) {
+    return false;
+  }
+  uint64_t code = static_cast<uint64_t>(value - base_);
+  switch (encoding_) {
+    case kDelta: {
+      auto anchor = std::upper_bound(anchors_.begin(), anchors_.end(), value) - anchors_.begin();
+      if (anchor == 0) {
+        return false;
+      }
+      size_t begin = static_cast<size_t>(anchor - 1) * kDeltaStride;
+      int64_t current = anchors_[begin / kDeltaStride];
+      for (size_t i = begin + 1; current < value && i < std::min<size_t>(begin + kDeltaStride, rows_); ++i) {
+        current += static_cast<int64_t>(GetBits(codes_.data(), i, width_));
+      }
+      return current == value;
+    }
+    case kRunLength:
+      for (size_t r = 0; r < ends_.size(); ++r) {
+        if (GetBits(codes_.data(), r, width_) == code) {
+          return true;
+        }
+      }
+      return false;
+    default:
+      for (size_t i = 0; i < rows_; ++i) {
+        if (GetBits(codes_.data(), i, width_) == code) {
+          return true;
+        }
+      }
+      return false;
+  }
+}
+
+size_t EncodedBlock::memory_usage() const {
+  return codes_.capacity() * sizeof(uint64_t) + anchors_.capacity() * sizeof(int64_t)
+         + ends_.capacity() * sizeof(uint32_t) + nulls_.capacity() * sizeof(uint64_t);
+}
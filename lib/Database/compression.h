@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../Parser/Base/base_parser.h"
+
+enum Encoding : uint8_t {
+  /// значения как есть; в самом блоке не используется, помечает несжатые блоки чекпоинта
+  kPlain,
+  /// смещения от минимума, упакованные в минимальное число бит
+  kFrameOfReference,
+  /// разности соседних значений неубывающего блока с опорными значениями через kDeltaStride
+  kDelta,
+  /// серии одинаковых значений: значение серии и номер строки после ее конца
+  kRunLength
+};
+
+/// Блок целых чисел (значения int и bool колонок) в сжатом виде. Кодировка выбирается
+/// по статистике блока — та, что занимает меньше памяти. NULL отмечаются битами в nulls_,
+/// на их местах хранится соседнее значение, чтобы не ломать серии и порядок.
+/// Минимум и максимум блока позволяют отбросить блок в фильтре целиком.
+class EncodedBlock {
+ public:
+  using allocator_type = std::pmr::polymorphic_allocator<>;
+
+  EncodedBlock() = default;
+  explicit EncodedBlock(allocator_type allocator);
+  EncodedBlock(const EncodedBlock& other, allocator_type allocator = {});
+  EncodedBlock(EncodedBlock&& other) noexcept = default;
+  EncodedBlock(EncodedBlock&& other, allocator_type allocator);
+  EncodedBlock& operator=(const EncodedBlock& other) = default;
+  EncodedBlock& operator=(EncodedBlock&& other) = default;
+
+  /// is_null пуст, если NULL в блоке нет
+  static EncodedBlock Encode(std::span<const int64_t> values, std::span<const uint8_t> is_null,
+                             allocator_type allocator = {});
+
+  /// бросает std::logic_error, если данные повреждены
+  static EncodedBlock Deserialize(std::string_view data, size_t& offset, allocator_type allocator = {});
+
+  void Serialize(std::string& out) const;
+
+  Encoding encoding() const;
+
+  size_t size() const;
+
+  bool IsNull(size_t row) const;
+
+  /// значение строки; для NULL — значение-заполнитель
+  int64_t operator[](size_t row) const;
+
+  /// распаковка всего блока за один проход, out.size() == size()
+  void Decode(std::span<int64_t> out) const;
+
+  /// out[i] = (значение i op constant) без распаковки в Value; сравнение с NULL дает UNKNOWN, то есть 0
+  void Match(TokenType op, int64_t constant, uint8_t* out) const;
+
+  /// есть ли не NULL значение, равное value
+  bool Contains(int64_t value) const;
+
+  /// байты вне самого объекта
+  size_t memory_usage() const;
+
+ private:
+  static constexpr size_t kDeltaStride = 128;
+
+  Encoding encoding_ = kFrameOfReference;
+  uint32_t rows_ = 0;
+  uint32_t null_count_ = 0;
+  uint8_t width_ = 0;
+  int64_t base_ = 0;
+  int64_t min_ = 0;
+  int64_t max_ = 0;
+  std::pmr::vector<uint64_t> codes_;
+  std::pmr::vector<int64_t> anchors_;
+  std::pmr::vector<uint32_t> ends_;
+  std::pmr::vector<uint64_t> nulls_;
+};
@@ -1,39 +1,265 @@
 #include "database.h"
 
+#include <bit>
+#include <csignal>
+#include <fcntl.h>
+#include <numeric>
+#include <optional>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "operators.h"
+#include "result_cache.h"
+#include "undo_log.h"
+#include "view.h"
+#include "../Scheduler/parallel_for.h"
+
+Table::Table(std::shared_ptr<TrackingResource> memory) : memory_(std::move(memory)) {}
+
+Table::Table(const Table& other, std::shared_ptr<TrackingResource> memory)
+    : memory_(std::move(memory)),
+      column_names_(other.column_names_),
+      n_rows_(other.n_rows_),
+      foreign_keys_(other.foreign_keys_),
+      partition_key_(other.partition_key_),
+      partitions_(other.partitions_) {
+  for (const auto& p : other.columns_) {
+    columns_.emplace(p.first, Column(p.second, memory_));
+  }
+}
+
 void Table::CreateColumn(const std::tuple<std::string, DataType, size_t, bool>& info) {
-  columns_.emplace(std::get<0>(info),
-                   Column{std::get<1>(info), std::get<2>(info), false});
+  EmplaceColumn(std::get<0>(info), Column{std::get<1>(info), std::get<2>(info), false, memory_});
 }
 
 void Table::SetPrimaryKey(const std::string& primary_key) {
+  Touch();
   columns_[primary_key].SetNotNull(false);
   columns_[primary_key].SetIsPrimary(true);
 }
 
+void Table::AddForeignKey(const ForeignKey& key) {
+  auto it = columns_.find(key.column);
+  if (it == columns_.end()) {
+    throw std::logic_error("No column with name '" + key.column + "'");
+  }
+  Touch();
+  it->second.SetIndexed(true);
+  foreign_keys_.push_back(key);
+}
+
+const std::vector<ForeignKey>& Table::foreign_keys() const {
+  return foreign_keys_;
+}
+
+void Table::SetPartitioning(const std::string& key, size_t n) {
+  if (!columns_.contains(key)) {
+    throw std::logic_error("No column with name '" + key + "'");
+  }
+  if (n == 0) {
+    throw std::logic_error("Number of partitions must be positive");
+  }
+  Touch();
+  partition_key_ = key;
+  partitions_.assign(n, {});
+  Route(0);
+}
+
+const std::string& Table::partition_key() const {
+  return partition_key_;
+}
+
+const std::vector<std::vector<size_t>>& Table::partitions() const {
+  return partitions_;
+}
+
+size_t Table::PartitionOf(const Value& key) const {
+  uint64_t h = Hash(key);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return (h ^ (h >> 31)) % partitions_.size();
+}
+
+void Table::Route(size_t first_row) {
+  if (partitions_.empty()) {
+    return;
+  }
+  if (first_row == 0) {
+    for (auto& partition : partitions_) {
+      partition.clear();
+    }
+  }
+  const Column& key = columns_.at(partition_key_);
+  for (size_t row = first_row; row < n_rows_; ++row) {
+    partitions_[PartitionOf(key[row])].push_back(row);
+  }
+}
+
+std::vector<size_t> Table::PartitionsOf(const std::vector<size_t>& rows) const {
+  std::vector<size_t> res;
+  if (partitions_.empty()) {
+    return res;
+  }
+  const Column& key = columns_.at(partition_key_);
+  res.reserve(rows.size());
+  for (size_t row : rows) {
+    res.push_back(PartitionOf(key[row]));
+  }
+  return res;
+}
+
+void Table::Reroute(const std::vector<size_t>& rows, const std::vector<size_t>& from) {
+  if (partitions_.empty()) {
+    return;
+  }
+  const Column& key = columns_.at(partition_key_);
+  std::vector<std::vector<size_t>> removed(partitions_.size());
+  std::vector<std::vector<size_t>> added(partitions_.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    size_t to = PartitionOf(key[rows[i]]);
+    if (to != from[i]) {
+      removed[from[i]].push_back(rows[i]);
+      added[to].push_back(rows[i]);
+    }
+  }
+  // списки остаются отсортированными; остальные разделы не трогаются
+  for (size_t p = 0; p < partitions_.size(); ++p) {
+    auto& partition = partitions_[p];
+    if (!removed[p].empty()) {
+      std::vector<size_t> kept;
+      kept.reserve(partition.size() - removed[p].size());
+      std::set_difference(partition.begin(), partition.end(), removed[p].begin(), removed[p].end(),
+                          std::back_inserter(kept));
+      partition = std::move(kept);
+    }
+    if (!added[p].empty()) {
+      size_t middle = partition.size();
+      partition.insert(partition.end(), added[p].begin(), added[p].end());
+      std::inplace_merge(partition.begin(), partition.begin() + static_cast<ptrdiff_t>(middle), partition.end());
+    }
+  }
+}
+
+std::optional<std::vector<size_t>> Table::PruneFilter(const std::vector<Token>& filters) const {
+  if (partitions_.empty() || filters.size() != 3 || filters[2].type != kEquals) {
+    return std::nullopt;
+  }
+  const Token* var = &filters[0];
+  const Token* constant = &filters[1];
+  if (var->type != kVar) {
+    std::swap(var, constant);
+  }
+  if (var->type != kVar || constant->type != kConst || var->value != partition_key_) {
+    return std::nullopt;
+  }
+  const Column& column = columns_.at(partition_key_);
+  Value key = Cast(constant->value, column.type());
+  if (std::holds_alternative<MyMonostate>(key)) {
+    return std::nullopt;
+  }
+  std::vector<size_t> rows;
+  for (size_t row : partitions_[PartitionOf(key)]) {
+    if (column[row] == key) {
+      rows.push_back(row);
+    }
+  }
+  return rows;
+}
+
 void Table::CreateRow(std::unordered_map<std::string, std::string>& info) {
+  Touch();
+  try {
+    for (auto& p : columns_) {
+      if (info.contains(p.first)) {
+        p.second.EmplaceValue(info[p.first]);
+      } else {
+        p.second.PushValue({});
+      }
+    }
+  } catch (...) {
+    Truncate(n_rows_);
+    throw;
+  }
+  ++n_rows_;
+  Route(n_rows_ - 1);
+}
+
+void Table::CreateRows(const std::vector<std::string>& columns,
+                       const std::vector<std::vector<std::string>>& rows) {
+  std::vector<Column*> targets;
+  targets.reserve(columns.size());
+  for (const auto& name : columns) {
+    auto it = columns_.find(name);
+    if (it == columns_.end()) {
+      throw std::logic_error("No column with name '" + name + "'");
+    }
+    if (std::find(targets.begin(), targets.end(), &it->second) != targets.end()) {
+      throw std::logic_error("Column '" + name + "' specified more than once");
+    }
+    targets.push_back(&it->second);
+  }
+  std::vector<Column*> missing;
   for (auto& p : columns_) {
-    if (info.contains(p.first)) {
-      p.second.EmplaceValue(info[p.first]);
-    } else {
-      p.second.PushValue({});
+    if (std::find(targets.begin(), targets.end(), &p.second) == targets.end()) {
+      missing.push_back(&p.second);
+    }
+  }
+  Touch();
+  size_t n_rows = n_rows_;
+  try {
+    for (const auto& row : rows) {
+      for (size_t i = 0; i < targets.size(); ++i) {
+        targets[i]->EmplaceValue(row[i]);
+      }
+      for (auto* column : missing) {
+        column->PushValue({});
+      }
+      ++n_rows_;
+    }
+  } catch (...) {
+    Truncate(n_rows);
+    throw;
+  }
+  Route(n_rows);
+}
+
+void Table::AppendRow(const std::vector<Value>& row) {
+  if (row.size() != column_names_.size()) {
+    throw std::logic_error("Expected " + std::to_string(column_names_.size()) + " values, found "
+                               + std::to_string(row.size()));
+  }
+  for (size_t i = 0; i < row.size(); ++i) {
+    columns_[column_names_[i]].CheckValue(row[i]);
+  }
+  Touch();
+  try {
+    for (size_t i = 0; i < row.size(); ++i) {
+      columns_[column_names_[i]].PushValue(row[i]);
     }
+  } catch (...) {
+    Truncate(n_rows_);
+    throw;
   }
   ++n_rows_;
+  Route(n_rows_ - 1);
 }
 
 std::ostream& operator<<(std::ostream& stream, const Table& table) {
-  for (const auto& column : table.columns_) {
-    stream << std::setw(std::max(column.second.max_len_of_value(), column.first.size() + 3))
-           << std::left << column.first;
+  for (const auto& name : table.column_names_) {
+    const auto& column = table.columns_.at(name);
+    stream << std::setw(std::max(column.max_len_of_value(), name.size() + 3))
+           << std::left << name;
   }
   stream << '\n';
   for (size_t i = 0; i < table.n_rows_; ++i) {
-    for (const auto& column : table.columns_) {
+    for (const auto& name : table.column_names_) {
+      const auto& column = table.columns_.at(name);
       std::visit(
-          [&stream, &column](auto&& arg) {
-            stream << std::setw(std::max(column.second.max_len_of_value(), column.first.size() + 3))
+          [&stream, &column, &name](auto&& arg) {
+            stream << std::setw(std::max(column.max_len_of_value(), name.size() + 3))
                    << std::left << arg;
-          }, column.second[i]
+          }, column[i]
       );
     }
     stream << '\n';
@@ -49,7 +275,15 @@ void Column::SetIsPrimary(bool is_primary) {
   is_primary_ = is_primary;
 }
 
-Column::Column(DataType type, size_t max_len, bool can_be_null) : type_(type) {
+void Column::SetIndexed(bool indexed) {
+  indexed_ = indexed;
+  if (!Indexed()) {
+    DropIndex();
+  }
+}
+
+Column::Column(DataType type, size_t max_len, bool can_be_null, std::shared_ptr<TrackingResource> memory)
+    : memory_(std::move(memory)), type_(type), values_(Resource(memory_)) {
   if (max_len != 0) {
     max_len_of_value_ = max_len;
   } else {
@@ -68,252 +302,2336 @@ Column::Column(DataType type, size_t max_len, bool can_be_null) : type_(type) {
   }
 }
 
-void Column::EmplaceValue(const std::string& value) {
-  if (value.size() > max_len_of_value_) {
-    throw std::logic_error("Invalid value");
+Column::Column(const Column& other, std::shared_ptr<TrackingResource> memory)
+    : memory_(std::move(memory)),
+      type_(other.type_),
+      max_len_of_value_(other.max_len_of_value_),
+      is_primary_(other.is_primary_),
+      not_null_(other.not_null_),
+      compressible_(other.compressible_),
+      sorted_(other.sorted_),
+      sealed_(other.sealed_, Resource(memory_)),
+      values_(other.values_, Resource(memory_)),
+      validity_(other.validity_, Resource(memory_)),
+      dirty_blocks_(other.dirty_blocks_),
+      indexed_(other.indexed_) {
+  for (const auto& v : values_) {
+    heap_bytes_ += HeapBytes(v);
   }
-  Value v;
-  if (value == "NULL") {
-    if (!not_null_) {
-      throw std::logic_error("Invalid value");
+  Charge(heap_bytes_);
+}
+
+Column::Column(const Column& other) : Column(other, other.memory_) {}
+
+Column::Column(Column&& other) noexcept
+    : memory_(other.memory_),
+      type_(other.type_),
+      max_len_of_value_(other.max_len_of_value_),
+      is_primary_(other.is_primary_),
+      not_null_(other.not_null_),
+      compressible_(other.compressible_),
+      sorted_(other.sorted_),
+      sealed_(std::move(other.sealed_)),
+      values_(std::move(other.values_)),
+      heap_bytes_(std::exchange(other.heap_bytes_, 0)),
+      validity_(std::move(other.validity_)),
+      dirty_blocks_(std::move(other.dirty_blocks_)),
+      indexed_(other.indexed_),
+      index_(std::move(other.index_)),
+      index_built_(std::exchange(other.index_built_, false)),
+      sketches_(std::move(other.sketches_)) {}
+
+Column& Column::operator=(const Column& other) {
+  if (this != &other) {
+    *this = Column(other, memory_);
+  }
+  return *this;
+}
+
+Column& Column::operator=(Column&& other) {
+  if (memory_ != other.memory_) {
+    return *this = static_cast<const Column&>(other);
+  }
+  Discharge(heap_bytes_);
+  type_ = other.type_;
+  max_len_of_value_ = other.max_len_of_value_;
+  is_primary_ = other.is_primary_;
+  not_null_ = other.not_null_;
+  compressible_ = other.compressible_;
+  sorted_ = other.sorted_;
+  sealed_ = std::move(other.sealed_);
+  values_ = std::move(other.values_);
+  heap_bytes_ = std::exchange(other.heap_bytes_, 0);
+  validity_ = std::move(other.validity_);
+  dirty_blocks_ = std::move(other.dirty_blocks_);
+  indexed_ = other.indexed_;
+  index_ = std::move(other.index_);
+  index_built_ = std::exchange(other.index_built_, false);
+  sketches_ = std::move(other.sketches_);
+  return *this;
+}
+
+Column::~Column() {
+  Discharge(heap_bytes_);
+}
+
+size_t Column::HeapBytes(const Value& value) {
+  static const size_t kInlineCapacity = std::string().capacity();
+  const auto* s = std::get_if<std::string>(&value);
+  return s != nullptr && s->capacity() > kInlineCapacity ? s->capacity() + 1 : 0;
+}
+
+std::pmr::memory_resource* Column::Resource(const std::shared_ptr<TrackingResource>& memory) {
+  return memory ? memory.get() : std::pmr::get_default_resource();
+}
+
+void Column::Charge(size_t bytes) {
+  if (memory_ && bytes != 0) {
+    memory_->Consume(bytes);
+  }
+}
+
+void Column::Discharge(size_t bytes) {
+  if (memory_ && bytes != 0) {
+    memory_->Release(bytes);
+  }
+}
+
+size_t Column::sealed_rows() const {
+  return sealed_.size() * kBlockRows;
+}
+
+int64_t Column::ToInteger(const Value& value) const {
+  return type_ == kBool ? static_cast<int64_t>(std::get<bool>(value)) : std::get<int>(value);
+}
+
+Value Column::FromInteger(int64_t value) const {
+  return type_ == kBool ? Value(value != 0) : Value(static_cast<int>(value));
+}
+
+void Column::Seal() {
+  if (!compressible_ || (type_ != kInt && type_ != kBool)) {
+    return;
+  }
+  size_t n_blocks = values_.size() / kBlockRows;
+  size_t before = sealed_.size();
+  std::vector<int64_t> raw(kBlockRows);
+  std::vector<uint8_t> is_null(kBlockRows);
+  try {
+    for (size_t b = 0; b < n_blocks; ++b) {
+      bool has_nulls = false;
+      for (size_t r = 0; r < kBlockRows; ++r) {
+        const Value& value = values_[b * kBlockRows + r];
+        if (std::holds_alternative<MyMonostate>(value)) {
+          has_nulls = true;
+          is_null[r] = 1;
+          raw[r] = 0;
+        } else if (value.index() == ValueIndex(type_)) {
+          is_null[r] = 0;
+          raw[r] = ToInteger(value);
+        } else {
+          sealed_.erase(sealed_.begin() + static_cast<std::ptrdiff_t>(before), sealed_.end());
+          compressible_ = false;
+          Unseal(0);
+          return;
+        }
+      }
+      sealed_.push_back(EncodedBlock::Encode(raw, has_nulls ? std::span<const uint8_t>(is_null)
+                                                            : std::span<const uint8_t>(),
+                                             Resource(memory_)));
+    }
+  } catch (...) {
+    sealed_.erase(sealed_.begin() + static_cast<std::ptrdiff_t>(before), sealed_.end());
+    throw;
+  }
+  values_.erase(values_.begin(), values_.begin() + static_cast<std::ptrdiff_t>(n_blocks * kBlockRows));
+  values_.shrink_to_fit();
+}
+
+void Column::Unseal(size_t block) {
+  if (block >= sealed_.size()) {
+    return;
+  }
+  std::pmr::vector<Value> values(Resource(memory_));
+  values.reserve((sealed_.size() - block) * kBlockRows + values_.size());
+  std::vector<int64_t> raw(kBlockRows);
+  for (size_t b = block; b < sealed_.size(); ++b) {
+    const EncodedBlock& encoded = sealed_[b];
+    encoded.Decode(raw);
+    for (size_t r = 0; r < encoded.size(); ++r) {
+      values.push_back(encoded.IsNull(r) ? Value() : FromInteger(raw[r]));
+    }
+  }
+  values.insert(values.end(), std::make_move_iterator(values_.begin()), std::make_move_iterator(values_.end()));
+  values_ = std::move(values);
+  sealed_.erase(sealed_.begin() + static_cast<std::ptrdiff_t>(block), sealed_.end());
+}
+
+void Column::AppendBlock(EncodedBlock&& block) {
+  DropIndex();
+  size_t first = size();
+  if (compressible_ && (type_ == kInt || type_ == kBool) && values_.empty() && block.size() == kBlockRows) {
+    if (sorted_) {
+      std::vector<int64_t> raw(block.size());
+      block.Decode(raw);
+      Value last = first == 0 ? Value() : (*this)[first - 1];
+      for (size_t r = 0; r < block.size() && sorted_; ++r) {
+        Value value = block.IsNull(r) ? Value() : FromInteger(raw[r]);
+        sorted_ = !(value < last);
+        last = std::move(value);
+      }
+    }
+    validity_.resize((first + block.size() + 63) / 64);
+    sealed_.push_back(std::move(block));
+    for (size_t r = 0; r < kBlockRows; ++r) {
+      SetValid(first + r, !sealed_.back().IsNull(r));
     }
   } else {
-    v = Cast(value, type_);
-    if (is_primary_) {
-      for (const auto& w : values_) {
-        if (w == v) {
-          throw std::logic_error(" Primary key '" + value + "' already exists");
+    std::vector<int64_t> raw(block.size());
+    block.Decode(raw);
+    for (size_t r = 0; r < block.size(); ++r) {
+      Store(block.IsNull(r) ? Value() : FromInteger(raw[r]));
+    }
+  }
+  MarkDirtyFrom(first);
+}
+
+void Column::Store(const Value& value) {
+  bool sorted = sorted_ && (size() == 0 || !(value < (values_.empty() ? (*this)[size() - 1] : values_.back())));
+  validity_.resize(size() / 64 + 1);
+  values_.push_back(value);
+  size_t bytes = HeapBytes(values_.back());
+  try {
+    Charge(bytes);
+  } catch (...) {
+    values_.pop_back();
+    throw;
+  }
+  try {
+    IndexAdd(value);
+  } catch (...) {
+    Discharge(bytes);
+    values_.pop_back();
+    throw;
+  }
+  heap_bytes_ += bytes;
+  sorted_ = sorted;
+  SetValid(size() - 1, !std::holds_alternative<MyMonostate>(value));
+  MarkDirty(size() - 1);
+  if (values_.size() >= kBlockRows) {
+    Seal();
+  }
+}
+
+bool Column::Indexed() const {
+  return is_primary_ || indexed_;
+}
+
+void Column::BuildIndex() const {
+  index_.clear();
+  try {
+    std::vector<int64_t> raw(kBlockRows);
+    for (const auto& block : sealed_) {
+      block.Decode(raw);
+      for (size_t r = 0; r < block.size(); ++r) {
+        if (!block.IsNull(r)) {
+          ++index_[FromInteger(raw[r])];
         }
       }
     }
+    for (const auto& value : values_) {
+      if (!std::holds_alternative<MyMonostate>(value)) {
+        ++index_[value];
+      }
+    }
+  } catch (...) {
+    index_.clear();
+    throw;
   }
-  values_.push_back(v);
+  index_built_ = true;
 }
 
-DataType Column::type() const {
-  return type_;
+void Column::IndexAdd(const Value& value) {
+  if (!index_built_ || std::holds_alternative<MyMonostate>(value)) {
+    return;
+  }
+  ++index_[value];
 }
 
-Column Column::Select(const std::vector<size_t>& idx) {
-  Column res;
-  for (const auto& i : idx) {
-    res.values_.push_back(values_[i]);
+void Column::IndexRemove(const Value& value) {
+  if (!index_built_ || std::holds_alternative<MyMonostate>(value)) {
+    return;
+  }
+  auto it = index_.find(value);
+  if (it != index_.end() && --it->second == 0) {
+    index_.erase(it);
   }
-  res.max_len_of_value_ = max_len_of_value_;
-  return res;
 }
 
-const Value& Column::operator[](size_t id) const {
-  return values_[id];
+void Column::DropIndex() const {
+  index_.clear();
+  index_built_ = false;
 }
 
-size_t Column::max_len_of_value() const {
-  return max_len_of_value_;
+size_t Column::Count(const Value& value) const {
+  if (std::holds_alternative<MyMonostate>(value) || value.index() != ValueIndex(type_)) {
+    return 0;
+  }
+  if (Indexed()) {
+    if (!index_built_) {
+      BuildIndex();
+    }
+    auto it = index_.find(value);
+    return it == index_.end() ? 0 : it->second;
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < size(); ++i) {
+    count += (*this)[i] == value;
+  }
+  return count;
 }
 
-void Column::Update(const std::vector<size_t>& idx, const std::string& value) {
-  Value v;
-  if (value != "NULL") {
-    v = Cast(value, type_);
+bool Column::Contains(const Value& value) const {
+  if (std::holds_alternative<MyMonostate>(value) || value.index() != ValueIndex(type_)) {
+    return false;
+  }
+  if (Indexed()) {
+    return Count(value) != 0;
   }
-  for (const auto& i : idx) {
-    values_[i] = v;
+  for (const auto& block : sealed_) {
+    if (block.Contains(ToInteger(value))) {
+      return true;
+    }
   }
+  return std::find(values_.begin(), values_.end(), value) != values_.end();
 }
 
-void Column::Delete(const std::vector<size_t>& idx) {
-  for (const auto& i : std::ranges::reverse_view(idx)) {
-    values_.erase(values_.begin() + i);
+void Column::MarkDirty(size_t row) {
+  DropSketches(row, true);
+  size_t block = row / kBlockRows;
+  if (block >= dirty_blocks_.size()) {
+    dirty_blocks_.resize(block + 1, true);
   }
+  dirty_blocks_[block] = true;
 }
 
-void Column::DeleteAll() {
-  values_.clear();
+void Column::MarkDirtyFrom(size_t row) {
+  DropSketches(row, false);
+  size_t block = row / kBlockRows;
+  dirty_blocks_.resize(std::max(dirty_blocks_.size(), blocks()), true);
+  std::fill(dirty_blocks_.begin() + static_cast<std::ptrdiff_t>(std::min(block, dirty_blocks_.size())),
+            dirty_blocks_.end(), true);
 }
 
-size_t Column::size() const {
-  return values_.size();
+size_t Column::blocks() const {
+  return (size() + kBlockRows - 1) / kBlockRows;
 }
 
-void Column::PushValue(const Value& value) {
-  values_.push_back(value);
+bool Column::IsDirty(size_t block) const {
+  return block >= dirty_blocks_.size() || dirty_blocks_[block];
 }
 
-void Column::GetData(std::ofstream& f) const {
-  f << type_ << '\t' << max_len_of_value_ << '\t' << is_primary_
-    << '\t' << not_null_ << '\t' << values_.size() << '\t';
-  for (const auto& v : values_) {
-    std::visit([&f](auto&& arg) { f << arg << '\t'; }, v);
+void Column::ClearDirty() {
+  dirty_blocks_.assign(blocks(), false);
+}
+
+Column::Marks Column::marks() const {
+  return {dirty_blocks_, sorted_};
+}
+
+void Column::RestoreMarks(Marks marks) {
+  dirty_blocks_ = std::move(marks.dirty_blocks);
+  sorted_ = marks.sorted;
+}
+
+bool Column::is_primary() const {
+  return is_primary_;
+}
+
+bool Column::not_null() const {
+  return not_null_;
+}
+
+bool Column::sorted() const {
+  return sorted_;
+}
+
+void Column::EmplaceValue(const std::string& value) {
+  if (value.size() > max_len_of_value_) {
+    throw std::logic_error("Invalid value");
+  }
+  if (value == "NULL") {
+    AppendValue({});
+  } else {
+    AppendValue(Cast(value, type_));
   }
-  f << '\n';
 }
 
-void Column::SetData(std::ifstream& f) {
-  int dt;
-  f >> dt;
-  switch (dt) {
-    case 0:
-      type_ = kInt;
-      break;
-    case 1:
-      type_ = kDouble;
-      break;
-    case 2:
-      type_ = kFloat;
-      break;
-    case 3:
-      type_ = kBool;
-      break;
-    case 4:
-      type_ = kVarchar;
-      break;
+void Column::CheckValue(const Value& value) const {
+  if (std::holds_alternative<MyMonostate>(value)) {
+    if (!not_null_) {
+      throw std::logic_error("Invalid value");
+    }
+    return;
   }
-  f >> max_len_of_value_ >> is_primary_ >> not_null_;
-  size_t n;
-  f >> n;
-  for (size_t i = 0; i < n; ++i) {
-    std::string buf;
-    f >> buf;
-    EmplaceValue(buf);
+  if (value.index() != ValueIndex(type_)) {
+    throw std::logic_error("Invalid value type");
+  }
+  if (type_ == kVarchar && std::get<std::string>(value).size() > max_len_of_value_) {
+    throw std::logic_error("Invalid value");
+  }
+  if (is_primary_ && Contains(value)) {
+    throw std::logic_error(" Primary key '" + ToString(value) + "' already exists");
   }
 }
 
-void Database::Save(const std::string& file_name) {
-  std::ofstream f("..\\..\\db_states\\" + file_name + ".tsv", std::ios::binary);
-  f << tables_.size() << '\n';
-  for (const auto& t : tables_) {
-    f << t.first << '\n';
-    t.second.GetData(f);
+void Column::AppendValue(const Value& value) {
+  CheckValue(value);
+  Store(value);
+}
+
+DataType Column::type() const {
+  return type_;
+}
+
+Column Column::Select(std::span<const size_t> idx, std::shared_ptr<TrackingResource> memory) const {
+  Column res(type_, max_len_of_value_, not_null_, std::move(memory));
+  res.max_len_of_value_ = max_len_of_value_;
+  res.not_null_ = not_null_;
+  res.values_.reserve(std::min(idx.size(), kBlockRows));
+  for (size_t k = 0; k < idx.size(); ++k) {
+    if (k % kBlockRows == 0) {
+      CheckCancellation();
+    }
+    size_t i = idx[k];
+    res.Store(i == kNoRow ? Value() : (*this)[i]);
   }
+  return res;
 }
 
-void Database::Open(const std::string& file_name) {
-  tables_.clear();
-  std::ifstream f("..\\..\\db_states\\" + file_name + ".tsv", std::ios::binary);
-  size_t n;
-  f >> n;
-  for (size_t i = 0; i < n; ++i) {
-    std::string name;
-    f >> name;
-    tables_.emplace(name, Table());
-    tables_[name].SetData(f);
+Value Column::operator[](size_t id) const {
+  size_t sealed = sealed_rows();
+  if (id >= sealed) {
+    return values_[id - sealed];
   }
+  const EncodedBlock& block = sealed_[id / kBlockRows];
+  size_t row = id % kBlockRows;
+  return block.IsNull(row) ? Value() : FromInteger(block[row]);
 }
 
-Response Database::Execute(const std::string& query) {
-  Response r;
-  Query q = SqlParser(query).Parse();
-  switch (q.query_type) {
-    case kCreate:
-      r = CreateTable(std::get<SerializerForCreate>(q.serializer));
-      break;
-    case kDrop:
-      r = DropTable(std::get<SerializerForDrop>(q.serializer));
-      break;
-    case kInsert:
-      r = Insert(std::get<SerializerForInsert>(q.serializer));
-      break;
-    case kSelect:
-      r = Select(std::get<SerializerForSelect>(q.serializer));
-      break;
-    case kUpdate:
-      r = Update(std::get<SerializerForUpdate>(q.serializer));
-      break;
-    case kDelete:
-      r = Delete(std::get<SerializerForDelete>(q.serializer));
-      break;
-    default:
-      break;
+void Column::Match(TokenType op, const Value& constant, std::vector<uint8_t>& out) const {
+  out.resize(size());
+  if (std::holds_alternative<MyMonostate>(constant)) {
+    std::fill(out.begin(), out.end(), 0);
+    return;
+  }
+  size_t sealed = sealed_rows();
+  if (!sealed_.empty() && constant.index() == ValueIndex(type_)) {
+    int64_t value = ToInteger(constant);
+    for (size_t b = 0; b < sealed_.size(); ++b) {
+      CheckCancellation();
+      sealed_[b].Match(op, value, out.data() + b * kBlockRows);
+    }
+  } else {
+    for (size_t i = 0; i < sealed; ++i) {
+      if (i % kBlockRows == 0) {
+        CheckCancellation();
+      }
+      out[i] = CompareValues(op, (*this)[i], constant);
+    }
+  }
+  for (size_t i = 0; i < values_.size(); ++i) {
+    if (i % kBlockRows == 0) {
+      CheckCancellation();
+    }
+    out[sealed + i] = CompareValues(op, values_[i], constant);
+  }
+}
+
+void Column::MatchNull(bool is_null, std::vector<uint8_t>& out) const {
+  size_t n = size();
+  out.resize(n);
+  uint64_t flip = is_null ? ~uint64_t(0) : 0;
+  for (size_t w = 0; w * 64 < n; ++w) {
+    uint64_t word = validity_[w] ^ flip;
+    size_t begin = w * 64;
+    size_t end = std::min(n, begin + 64);
+    // целое слово из одних NULL или без них заполняется сразу
+    if (word == 0 || word == ~uint64_t(0)) {
+      std::fill(out.begin() + static_cast<std::ptrdiff_t>(begin), out.begin() + static_cast<std::ptrdiff_t>(end),
+                static_cast<uint8_t>(word & 1));
+      continue;
+    }
+    for (size_t row = begin; row < end; ++row) {
+      out[row] = word >> (row - begin) & 1;
+    }
+  }
+}
+
+std::vector<size_t> Column::NullRows(bool is_null) const {
+  size_t n = size();
+  size_t nulls = null_count();
+  std::vector<size_t> rows;
+  rows.reserve(is_null ? nulls : n - nulls);
+  for (size_t w = 0; w * 64 < n; ++w) {
+    uint64_t word = is_null ? ~validity_[w] : validity_[w];
+    if (n - w * 64 < 64) {
+      word &= (uint64_t(1) << (n - w * 64)) - 1;
+    }
+    for (; word != 0; word &= word - 1) {
+      rows.push_back(w * 64 + static_cast<size_t>(std::countr_zero(word)));
+    }
+  }
+  return rows;
+}
+
+void Column::MatchBloom(const BloomFilter& filter, std::vector<uint8_t>& out) const {
+  out.resize(size());
+  std::vector<int64_t> raw(kBlockRows);
+  for (size_t b = 0; b < sealed_.size(); ++b) {
+    CheckCancellation();
+    sealed_[b].Decode(raw);
+    uint8_t* block = out.data() + b * kBlockRows;
+    for (size_t r = 0; r < kBlockRows; ++r) {
+      uint64_t hash = type_ == kBool ? std::hash<bool>()(raw[r] != 0) : std::hash<int>()(static_cast<int>(raw[r]));
+      block[r] = filter.MayContain(hash);
+    }
+    for (size_t r = 0; r < kBlockRows; r += 64) {
+      for (uint64_t nulls = ~validity_[(b * kBlockRows + r) / 64]; nulls != 0; nulls &= nulls - 1) {
+        block[r + static_cast<size_t>(std::countr_zero(nulls))] = 0;
+      }
+    }
+  }
+  size_t sealed = sealed_rows();
+  for (size_t i = 0; i < values_.size(); ++i) {
+    out[sealed + i] = !std::holds_alternative<MyMonostate>(values_[i]) && filter.MayContain(Hash(values_[i]));
+  }
+}
+
+size_t Column::null_count() const {
+  size_t valid = 0;
+  for (size_t w = 0; w * 64 < size(); ++w) {
+    valid += static_cast<size_t>(std::popcount(validity_[w]));
+  }
+  return size() - valid;
+}
+
+ColumnSketch Column::Sketch(const std::vector<size_t>* rows) const {
+  ColumnSketch sketch;
+  if (rows != nullptr) {
+    // выборка делится на куски, наброски кусков строятся параллельно и объединяются
+    std::vector<ColumnSketch> parts((rows->size() + kSketchRows - 1) / kSketchRows);
+    ParallelFor(parts.size(), 0, [&](size_t p) {
+      size_t end = std::min(rows->size(), (p + 1) * kSketchRows);
+      for (size_t i = p * kSketchRows; i < end; ++i) {
+        if (i % kBlockRows == 0) {
+          CheckCancellation();
+        }
+        AddToSketch(parts[p], (*this)[(*rows)[i]]);
+      }
+    });
+    for (const auto& part : parts) {
+      sketch.Merge(part);
+    }
+    return sketch;
+  }
+  std::vector<std::shared_ptr<const ColumnSketch>> parts((size() + kSketchRows - 1) / kSketchRows);
+  if (sketches_) {
+    std::lock_guard lock(sketches_->mutex);
+    std::copy_n(sketches_->segments.begin(), std::min(parts.size(), sketches_->segments.size()), parts.begin());
+  }
+  ParallelFor(parts.size(), 0, [&](size_t s) {
+    if (!parts[s]) {
+      parts[s] = std::make_shared<const ColumnSketch>(BuildSketch(s));
+    }
+  });
+  if (sketches_) {
+    std::lock_guard lock(sketches_->mutex);
+    sketches_->segments.resize(parts.size());
+    for (size_t s = 0; s < parts.size(); ++s) {
+      if (!sketches_->segments[s]) {
+        sketches_->segments[s] = parts[s];
+      }
+    }
+  }
+  for (const auto& part : parts) {
+    sketch.Merge(*part);
+  }
+  return sketch;
+}
+
+void Column::AddToSketch(ColumnSketch& sketch, const Value& value) const {
+  if (std::holds_alternative<MyMonostate>(value)) {
+    return;
+  }
+  sketch.distinct.Add(Hash(value));
+  if (const auto* i = std::get_if<int>(&value)) {
+    sketch.quantiles.Add(*i);
+  } else if (const auto* d = std::get_if<double>(&value)) {
+    sketch.quantiles.Add(*d);
+  } else if (const auto* f = std::get_if<float>(&value)) {
+    sketch.quantiles.Add(*f);
+  }
+}
+
+ColumnSketch Column::BuildSketch(size_t segment) const {
+  ColumnSketch sketch;
+  size_t end = std::min(size(), (segment + 1) * kSketchRows);
+  std::vector<int64_t> raw(kBlockRows);
+  for (size_t row = segment * kSketchRows; row < end;) {
+    size_t b = row / kBlockRows;
+    if (row % kBlockRows == 0) {
+      CheckCancellation();
+    }
+    if (b < sealed_.size()) {
+      // сжатый блок распаковывается целиком, NULL берутся из битовой карты
+      sealed_[b].Decode(raw);
+      for (size_t r = 0; r < kBlockRows; ++r, ++row) {
+        if (validity_[row / 64] >> (row % 64) & 1) {
+          AddToSketch(sketch, FromInteger(raw[r]));
+        }
+      }
+    } else {
+      AddToSketch(sketch, values_[row - sealed_rows()]);
+      ++row;
+    }
+  }
+  return sketch;
+}
+
+void Column::DropSketches(size_t row, bool last) const {
+  if (!sketches_) {
+    return;
+  }
+  auto& segments = sketches_->segments;
+  size_t segment = row / kSketchRows;
+  if (segment >= segments.size()) {
+    return;
+  }
+  if (last) {
+    segments[segment].reset();
+  } else {
+    segments.resize(segment);
+  }
+}
+
+void Column::SetValid(size_t row, bool valid) {
+  if (validity_.size() <= row / 64) {
+    validity_.resize(row / 64 + 1);
+  }
+  uint64_t bit = uint64_t(1) << (row % 64);
+  validity_[row / 64] = valid ? validity_[row / 64] | bit : validity_[row / 64] & ~bit;
+}
+
+size_t Column::max_len_of_value() const {
+  return max_len_of_value_;
+}
+
+template <typename F>
+void Column::Assign(const std::vector<size_t>& idx, F&& value) {
+  if (!idx.empty()) {
+    sorted_ = false;
+  }
+  if (index_built_) {
+    try {
+      for (size_t k = 0; k < idx.size(); ++k) {
+        IndexRemove((*this)[idx[k]]);
+        IndexAdd(value(k));
+      }
+    } catch (...) {
+      DropIndex();
+      throw;
+    }
+  }
+  size_t sealed = sealed_rows();
+  // строка и номер ее значения
+  std::vector<std::pair<size_t, size_t>> in_blocks;
+  for (size_t k = 0; k < idx.size(); ++k) {
+    if (idx[k] < sealed) {
+      in_blocks.emplace_back(idx[k], k);
+    }
+  }
+  // сжатый блок пересобирается целиком, один раз на все его строки
+  std::sort(in_blocks.begin(), in_blocks.end());
+  std::vector<int64_t> raw(kBlockRows);
+  std::vector<uint8_t> is_null(kBlockRows);
+  for (size_t k = 0; k < in_blocks.size();) {
+    size_t b = in_blocks[k].first / kBlockRows;
+    EncodedBlock& block = sealed_[b];
+    block.Decode(raw);
+    for (size_t r = 0; r < kBlockRows; ++r) {
+      is_null[r] = block.IsNull(r);
+    }
+    for (; k < in_blocks.size() && in_blocks[k].first / kBlockRows == b; ++k) {
+      size_t r = in_blocks[k].first % kBlockRows;
+      Value v = value(in_blocks[k].second);
+      is_null[r] = std::holds_alternative<MyMonostate>(v);
+      raw[r] = is_null[r] ? 0 : ToInteger(v);
+    }
+    block = EncodedBlock::Encode(raw, is_null, Resource(memory_));
+    for (size_t r = 0; r < kBlockRows; ++r) {
+      SetValid(b * kBlockRows + r, is_null[r] == 0);
+    }
+    MarkDirty(b * kBlockRows);
+  }
+  for (size_t k = 0; k < idx.size(); ++k) {
+    size_t i = idx[k];
+    if (i < sealed) {
+      continue;
+    }
+    Value tmp = value(k);
+    size_t bytes = HeapBytes(tmp);
+    Charge(bytes);
+    heap_bytes_ += bytes;
+    std::swap(values_[i - sealed], tmp);
+    SetValid(i, !std::holds_alternative<MyMonostate>(values_[i - sealed]));
+    bytes = HeapBytes(tmp);
+    Discharge(bytes);
+    heap_bytes_ -= bytes;
+    MarkDirty(i);
+  }
+}
+
+void Column::Update(const std::vector<size_t>& idx, const std::string& value) {
+  Value v;
+  if (value != "NULL") {
+    v = Cast(value, type_);
+  }
+  Assign(idx, [&v](size_t) { return v; });
+}
+
+void Column::Restore(const std::vector<size_t>& idx, const Column& values) {
+  Assign(idx, [&values](size_t k) { return values[k]; });
+}
+
+void Column::Delete(const std::vector<size_t>& idx) {
+  if (idx.empty()) {
+    return;
+  }
+  if (index_built_) {
+    for (const auto& i : idx) {
+      IndexRemove((*this)[i]);
+    }
+  }
+  size_t first = *std::min_element(idx.begin(), idx.end());
+  MarkDirtyFrom(first);
+  Unseal(first / kBlockRows);
+  size_t sealed = sealed_rows();
+  for (const auto& i : std::ranges::reverse_view(idx)) {
+    size_t bytes = HeapBytes(values_[i - sealed]);
+    Discharge(bytes);
+    heap_bytes_ -= bytes;
+    values_.erase(values_.begin() + static_cast<std::ptrdiff_t>(i - sealed));
+  }
+  // строки после first сдвинулись: их биты пересчитываются, хвост за концом обнуляется
+  std::fill(validity_.begin() + static_cast<std::ptrdiff_t>(first / 64), validity_.end(), 0);
+  for (size_t row = first / 64 * 64; row < size(); ++row) {
+    SetValid(row, !std::holds_alternative<MyMonostate>(values_[row - sealed]));
+  }
+  Seal();
+}
+
+void Column::Reinsert(const std::vector<size_t>& idx, const Column& values) {
+  if (idx.empty()) {
+    return;
+  }
+  size_t bytes = 0;
+  for (size_t k = 0; k < idx.size(); ++k) {
+    bytes += HeapBytes(values[k]);
+  }
+  Charge(bytes);
+  heap_bytes_ += bytes;
+  for (size_t k = 0; k < idx.size(); ++k) {
+    IndexAdd(values[k]);
+  }
+  size_t first = idx.front();
+  MarkDirtyFrom(first);
+  Unseal(first / kBlockRows);
+  size_t sealed = sealed_rows();
+  std::pmr::vector<Value> merged(Resource(memory_));
+  merged.reserve(values_.size() + idx.size());
+  size_t old = 0;
+  for (size_t k = 0; k < idx.size(); ++k) {
+    while (sealed + merged.size() < idx[k]) {
+      merged.push_back(std::move(values_[old++]));
+    }
+    merged.push_back(values[k]);
+  }
+  merged.insert(merged.end(), std::make_move_iterator(values_.begin() + static_cast<std::ptrdiff_t>(old)),
+                std::make_move_iterator(values_.end()));
+  values_ = std::move(merged);
+  // строки после first сдвинулись: их биты пересчитываются
+  for (size_t row = first / 64 * 64; row < size(); ++row) {
+    SetValid(row, !std::holds_alternative<MyMonostate>(values_[row - sealed]));
+  }
+  Seal();
+}
+
+void Column::DeleteAll() {
+  Discharge(heap_bytes_);
+  heap_bytes_ = 0;
+  sealed_.clear();
+  values_.clear();
+  validity_.clear();
+  dirty_blocks_.clear();
+  index_.clear();
+  DropSketches(0, false);
+  sorted_ = true;
+}
+
+void Column::Truncate(size_t n) {
+  if (n >= size()) {
+    return;
+  }
+  MarkDirtyFrom(n);
+  Unseal(n / kBlockRows);
+  size_t keep = n - sealed_rows();
+  for (size_t i = keep; i < values_.size(); ++i) {
+    IndexRemove(values_[i]);
+    size_t bytes = HeapBytes(values_[i]);
+    Discharge(bytes);
+    heap_bytes_ -= bytes;
+  }
+  values_.erase(values_.begin() + static_cast<std::ptrdiff_t>(keep), values_.end());
+  validity_.resize((n + 63) / 64);
+  if (n % 64 != 0) {
+    validity_.back() &= (uint64_t(1) << (n % 64)) - 1;
+  }
+}
+
+size_t Column::size() const {
+  return sealed_rows() + values_.size();
+}
+
+size_t Column::memory_usage() const {
+  size_t bytes = sizeof(Column) + sealed_.capacity() * sizeof(EncodedBlock) + values_.capacity() * sizeof(Value)
+                 + validity_.capacity() * sizeof(uint64_t) + heap_bytes_;
+  for (const auto& block : sealed_) {
+    bytes += block.memory_usage();
+  }
+  // узел хеш-таблицы: значение, счетчик и указатель на следующий узел
+  bytes += index_.size() * (sizeof(Value) + 2 * sizeof(size_t)) + index_.bucket_count() * sizeof(void*);
+  if (sketches_) {
+    std::lock_guard lock(sketches_->mutex);
+    for (const auto& sketch : sketches_->segments) {
+      bytes += sketch ? sketch->memory_usage() : 0;
+    }
+  }
+  return bytes;
+}
+
+void Column::PushValue(const Value& value) {
+  Store(value);
+}
+
+void Column::GetData(std::ofstream& f) const {
+  f << type_ << '\t' << max_len_of_value_ << '\t' << is_primary_
+    << '\t' << not_null_ << '\t' << size() << '\t';
+  for (size_t i = 0; i < size(); ++i) {
+    std::visit([&f](auto&& arg) { f << arg << '\t'; }, (*this)[i]);
+  }
+  f << '\n';
+}
+
+void Column::SetData(std::istream& f) {
+  int dt;
+  f >> dt;
+  switch (dt) {
+    case 0:
+      type_ = kInt;
+      break;
+    case 1:
+      type_ = kDouble;
+      break;
+    case 2:
+      type_ = kFloat;
+      break;
+    case 3:
+      type_ = kBool;
+      break;
+    case 4:
+      type_ = kVarchar;
+      break;
+  }
+  f >> max_len_of_value_ >> is_primary_ >> not_null_;
+  size_t n;
+  f >> n;
+  for (size_t i = 0; i < n; ++i) {
+    std::string buf;
+    f >> buf;
+    EmplaceValue(buf);
+  }
+}
+
+std::string Database::SavePath(const std::string& file_name) {
+  return "..\\..\\db_states\\" + file_name + ".tsv";
+}
+
+void Database::Save(const std::string& file_name) {
+  MaterializeAll();
+  std::shared_lock lock(mutex_);
+  std::ofstream f(SavePath(file_name), std::ios::binary);
+  f << tables_.size() << '\n';
+  for (const auto& t : tables_) {
+    f << t.first << '\n';
+    t.second.GetData(f);
+  }
+}
+
+namespace {
+
+/// таблица в файле Save: ее колонки — строки файла с begin по end
+struct SnapshotTable {
+  std::string name;
+  size_t columns = 0;
+  size_t rows = 0;
+  std::streamoff begin = 0;
+  std::streamoff end = 0;
+};
+
+/// проходит файл, пропуская строки колонок без разбора
+std::vector<SnapshotTable> IndexSnapshot(std::istream& f) {
+  std::vector<SnapshotTable> tables;
+  size_t n = 0;
+  f >> n;
+  for (size_t i = 0; i < n && f; ++i) {
+    SnapshotTable& t = tables.emplace_back();
+    f >> t.name >> t.columns >> t.rows;
+    f.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    t.begin = f.tellg();
+    for (size_t c = 0; c < t.columns; ++c) {
+      f.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    }
+    t.end = f.tellg();
+  }
+  if (!f) {
+    throw std::logic_error("Corrupted snapshot");
+  }
+  return tables;
+}
+
+std::string ReadRange(std::istream& f, std::streamoff begin, std::streamoff end) {
+  std::string data(static_cast<size_t>(end - begin), '\0');
+  f.clear();
+  f.seekg(begin);
+  if (!f.read(data.data(), static_cast<std::streamsize>(data.size()))) {
+    throw std::logic_error("Corrupted snapshot");
+  }
+  return data;
+}
+
+std::vector<std::string_view> SplitLines(std::string_view data) {
+  std::vector<std::string_view> lines;
+  while (!data.empty()) {
+    size_t end = std::min(data.find('\n'), data.size());
+    lines.push_back(data.substr(0, end));
+    data.remove_prefix(std::min(end + 1, data.size()));
+  }
+  return lines;
+}
+
+std::pair<std::string, Column> ParseColumn(std::string_view line, const std::shared_ptr<TrackingResource>& memory) {
+  std::istringstream in{std::string(line)};
+  std::pair<std::string, Column> column(std::string(), Column(kInt, 0, false, memory));
+  in >> column.first;
+  column.second.SetData(in);
+  return column;
+}
+
+/// разбирает строки колонок в threads потоков; memory(i) — ресурс таблицы строки i
+template <typename Memory>
+std::vector<std::pair<std::string, Column>> ParseColumns(const std::vector<std::string_view>& lines,
+                                                         const Memory& memory, size_t threads) {
+  std::vector<std::optional<std::pair<std::string, Column>>> parsed(lines.size());
+  ParallelFor(lines.size(), threads, [&](size_t i) {
+    parsed[i].emplace(ParseColumn(lines[i], memory(i)));
+  });
+  std::vector<std::pair<std::string, Column>> columns;
+  columns.reserve(parsed.size());
+  for (auto& column : parsed) {
+    columns.push_back(std::move(*column));
+  }
+  return columns;
+}
+
+}  // namespace
+
+void Database::Open(const std::string& file_name, const OpenOptions& options) {
+  std::string path = SavePath(file_name);
+  std::ifstream f(path, std::ios::binary);
+  if (!f) {
+    throw std::system_error(errno, std::generic_category(), path);
+  }
+  std::vector<SnapshotTable> index = IndexSnapshot(f);
+  std::unordered_map<std::string, Table> tables;
+  std::unordered_map<std::string, LazyTable> pending;
+  if (options.lazy) {
+    for (const auto& t : index) {
+      pending.emplace(t.name, LazyTable{t.rows, {}, [path, t, threads = options.threads](
+          std::shared_ptr<TrackingResource> memory) {
+        std::ifstream f(path, std::ios::binary);
+        std::string data = ReadRange(f, t.begin, t.end);
+        Table table(std::move(memory));
+        table.SetColumns(ParseColumns(SplitLines(data), [&table](size_t) { return table.memory(); }, threads),
+                         t.rows);
+        return table;
+      }});
+    }
+  } else {
+    // строки колонок всех таблиц разбираются одним пулом
+    std::vector<std::string> data;
+    std::vector<std::string_view> lines;
+    std::vector<size_t> owner;
+    std::vector<std::shared_ptr<TrackingResource>> memory;
+    for (size_t i = 0; i < index.size(); ++i) {
+      data.push_back(ReadRange(f, index[i].begin, index[i].end));
+      memory.push_back(TableMemory(index[i].name));
+    }
+    for (size_t i = 0; i < index.size(); ++i) {
+      for (auto line : SplitLines(data[i])) {
+        lines.push_back(line);
+        owner.push_back(i);
+      }
+    }
+    auto columns = ParseColumns(lines, [&](size_t line) { return memory[owner[line]]; }, options.threads);
+    for (size_t i = 0, line = 0; i < index.size(); ++i) {
+      std::vector<std::pair<std::string, Column>> own;
+      for (; line < lines.size() && owner[line] == i; ++line) {
+        own.push_back(std::move(columns[line]));
+      }
+      Table table(memory[i]);
+      table.SetColumns(std::move(own), index[i].rows);
+      tables.emplace(index[i].name, std::move(table));
+    }
+  }
+  Replace(std::move(tables), std::move(pending));
+}
+
+void Database::Replace(std::unordered_map<std::string, Table>&& tables,
+                       std::unordered_map<std::string, LazyTable>&& pending) {
+  std::unique_lock lock(mutex_);
+  std::lock_guard pending_lock(pending_mutex_);
+  tables_ = std::move(tables);
+  views_.clear();
+  pending_.clear();
+  for (auto& [name, table] : pending) {
+    auto entry = std::make_shared<PendingTable>();
+    entry->table = std::move(table);
+    pending_.emplace(name, std::move(entry));
+  }
+}
+
+void Database::Materialize(const std::string& table) {
+  std::shared_ptr<PendingTable> pending;
+  {
+    std::lock_guard lock(pending_mutex_);
+    auto it = pending_.find(table);
+    if (it == pending_.end()) {
+      return;
+    }
+    pending = it->second;
+  }
+  // таблицу читает первый обратившийся, остальные ждут его на мьютексе таблицы
+  std::lock_guard load_lock(pending->mutex);
+  if (pending->loaded) {
+    return;
+  }
+  Table loaded = pending->table.load(TableMemory(table));
+  std::unique_lock lock(mutex_);
+  std::lock_guard pending_lock(pending_mutex_);
+  auto it = pending_.find(table);
+  if (it == pending_.end() || it->second != pending) {
+    // пока таблица читалась, база была открыта заново
+    return;
+  }
+  pending_.erase(it);
+  tables_.insert_or_assign(table, std::move(loaded));
+  pending->loaded = true;
+}
+
+void Database::MaterializeRelated(const std::string& table) {
+  Materialize(table);
+  std::vector<std::string> related;
+  {
+    std::shared_lock lock(mutex_);
+    std::lock_guard pending_lock(pending_mutex_);
+    auto collect = [&](const std::string& name, const std::vector<ForeignKey>& keys) {
+      for (const auto& key : keys) {
+        if (name == table) {
+          related.push_back(key.table);
+        } else if (key.table == table) {
+          related.push_back(name);
+        }
+      }
+    };
+    for (const auto& [name, t] : tables_) {
+      collect(name, t.foreign_keys());
+    }
+    for (const auto& [name, pending] : pending_) {
+      collect(name, pending->table.foreign_keys);
+    }
+  }
+  for (const auto& name : related) {
+    Materialize(name);
+  }
+}
+
+void Database::MaterializeAll() {
+  std::vector<std::string> names;
+  {
+    std::lock_guard lock(pending_mutex_);
+    for (const auto& p : pending_) {
+      names.push_back(p.first);
+    }
+  }
+  for (const auto& name : names) {
+    Materialize(name);
+  }
+}
+
+namespace {
+
+/// сообщение дочернего процесса SaveAsync о ходе записи
+struct SaveRecord {
+  uint64_t tables = 0;
+  uint64_t rows = 0;
+  int32_t error = 0;
+};
+
+void WriteRecord(int fd, const SaveRecord& record) {
+  const char* data = reinterpret_cast<const char*>(&record);
+  size_t written = 0;
+  while (written < sizeof(record)) {
+    ssize_t n = ::write(fd, data + written, sizeof(record) - written);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    written += static_cast<size_t>(n);
+  }
+}
+
+bool ReadRecord(int fd, SaveRecord& record) {
+  char* data = reinterpret_cast<char*>(&record);
+  size_t read = 0;
+  while (read < sizeof(record)) {
+    ssize_t n = ::read(fd, data + read, sizeof(record) - read);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    read += static_cast<size_t>(n);
+  }
+  return true;
+}
+
+}  // namespace
+
+Future<SaveProgress> Database::SaveAsync(const std::string& file_name,
+                                         std::function<void(const SaveProgress&)> on_progress) {
+  MaterializeAll();
+  if (saving_.exchange(true)) {
+    throw std::logic_error("Background save is already in progress");
+  }
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0) {
+    saving_ = false;
+    throw std::system_error(errno, std::generic_category(), "pipe2");
+  }
+  SaveProgress progress;
+  pid_t pid;
+  {
+    // ни один запрос не изменяет таблицы в момент fork
+    std::shared_lock lock(mutex_);
+    progress.tables_total = tables_.size();
+    for (const auto& t : tables_) {
+      progress.rows_total += t.second.size();
+    }
+    pid = ::fork();
+    if (pid == 0) {
+      ::close(fds[0]);
+      ::signal(SIGPIPE, SIG_IGN);
+      int error = WriteSnapshot(file_name, fds[1]);
+      ::_exit(error == 0 ? 0 : 1);
+    }
+  }
+  ::close(fds[1]);
+  if (pid < 0) {
+    int error = errno;
+    ::close(fds[0]);
+    saving_ = false;
+    throw std::system_error(error, std::generic_category(), "fork");
+  }
+  Promise<SaveProgress> promise;
+  Future<SaveProgress> future = promise.GetFuture();
+  save_thread_ = std::jthread([this, fd = fds[0], pid, progress, promise, on_progress]() mutable {
+    SaveRecord record;
+    int error = 0;
+    while (ReadRecord(fd, record)) {
+      progress.tables_written = record.tables;
+      progress.rows_written = record.rows;
+      error = record.error;
+      if (error == 0 && on_progress) {
+        on_progress(progress);
+      }
+    }
+    ::close(fd);
+    int status = 0;
+    while (::waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (error == 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+      progress.done = true;
+      if (on_progress) {
+        on_progress(progress);
+      }
+      saving_ = false;
+      promise.SetValue(progress);
+    } else {
+      saving_ = false;
+      promise.SetException(std::make_exception_ptr(
+          std::system_error(error != 0 ? error : EIO, std::generic_category(), "Background save failed")));
+    }
+  });
+  return future;
+}
+
+int Database::WriteSnapshot(const std::string& file_name, int progress_fd) const {
+  SaveRecord record;
+  try {
+    std::string path = SavePath(file_name);
+    std::string tmp = path + ".tmp";
+    {
+      std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+      f << tables_.size() << '\n';
+      for (const auto& t : tables_) {
+        f << t.first << '\n';
+        t.second.GetData(f);
+        if (!f) {
+          break;
+        }
+        ++record.tables;
+        record.rows += t.second.size();
+        WriteRecord(progress_fd, record);
+      }
+      f.close();
+      if (!f) {
+        record.error = errno != 0 ? errno : EIO;
+      }
+    }
+    if (record.error == 0 && std::rename(tmp.c_str(), path.c_str()) != 0) {
+      record.error = errno;
+    }
+  } catch (...) {
+    record.error = EIO;
+  }
+  if (record.error != 0) {
+    WriteRecord(progress_fd, record);
+  }
+  return record.error;
+}
+
+CheckpointStats Database::Checkpoint(const std::string& directory, const CheckpointOptions& options) {
+  std::lock_guard checkpoint_lock(checkpoint_mutex_);
+  // Write удаляет из чекпоинта таблицы, которых нет в памяти, и файлы, на которые
+  // ссылаются еще не прочитанные таблицы
+  MaterializeAll();
+  std::shared_lock lock(mutex_);
+  return checkpointer_.Write(directory, tables_, options);
+}
+
+void Database::OpenCheckpoint(const std::string& directory, const OpenOptions& options) {
+  std::lock_guard checkpoint_lock(checkpoint_mutex_);
+  if (options.lazy) {
+    Replace({}, checkpointer_.ReadLazy(directory, options.threads));
+  } else {
+    Replace(checkpointer_.Read(directory, [this](const std::string& table) { return TableMemory(table); },
+                               options.threads), {});
+  }
+}
+
+Response Database::Execute(const std::string& query, const QueryOptions& options) {
+  auto start = std::chrono::steady_clock::now();
+  Query q;
+  try {
+    q = SqlParser(query).Parse();
+  } catch (...) {
+    metrics_.RecordParseError();
+    throw;
+  }
+  return ExecuteQuery(q, start, q.query_type == kSelect ? query : "", StartQuery(options, start));
+}
+
+Future<Response> Database::ExecuteAsync(std::string query, const QueryOptions& options) {
+  auto start = std::chrono::steady_clock::now();
+  Promise<Response> promise;
+  Future<Response> future = promise.GetFuture();
+  auto q = std::make_shared<Query>();
+  std::shared_ptr<CancellationToken> token;
+  try {
+    *q = SqlParser(query).Parse();
+  } catch (...) {
+    metrics_.RecordParseError();
+    promise.SetException(std::current_exception());
+    return future;
+  }
+  try {
+    token = StartQuery(options, start);
+  } catch (...) {
+    promise.SetException(std::current_exception());
+    return future;
+  }
+  if (q->query_type != kSelect) {
+    query.clear();
+  }
+  // token отмены ожидающего в очереди запроса принадлежит задаче и освобождается
+  // вместе с ней, даже если планировщик ее не принял
+  return Submit(Classify(*q), [this, q, start, query = std::move(query), token = std::move(token)]() mutable {
+    return ExecuteQuery(*q, start, query, std::move(token));
+  });
+}
+
+bool Database::Cancel(uint64_t query_id) {
+  std::lock_guard lock(running_mutex_);
+  auto it = running_.find(query_id);
+  if (it == running_.end()) {
+    return false;
+  }
+  auto token = it->second.lock();
+  if (!token) {
+    running_.erase(it);
+    return false;
+  }
+  token->Cancel();
+  return true;
+}
+
+std::shared_ptr<CancellationToken> Database::StartQuery(const QueryOptions& options,
+                                                        std::chrono::steady_clock::time_point start) {
+  std::chrono::milliseconds timeout = options.timeout;
+  if (timeout.count() == 0) {
+    std::lock_guard lock(scheduler_mutex_);
+    timeout = scheduler_options_.query_timeout;
+  }
+  if (options.id == 0 && timeout.count() == 0) {
+    return nullptr;
+  }
+  auto token = std::make_shared<CancellationToken>(
+      timeout.count() == 0 ? CancellationToken::Clock::time_point::max() : start + timeout);
+  if (options.id != 0) {
+    std::lock_guard lock(running_mutex_);
+    std::erase_if(running_, [](const auto& entry) { return entry.second.expired(); });
+    auto [it, inserted] = running_.try_emplace(options.id, token);
+    if (!inserted) {
+      throw std::logic_error("Query with id " + std::to_string(options.id) + " is already running");
+    }
+  }
+  return token;
+}
+
+Future<Response> Database::Submit(QueryClass query_class, std::function<Response()> run) {
+  Promise<Response> promise;
+  Future<Response> future = promise.GetFuture();
+  bool admitted = Scheduler()->Submit(query_class, [promise, run = std::move(run)]() mutable {
+    Response r;
+    std::exception_ptr error;
+    try {
+      r = run();
+    } catch (...) {
+      error = std::current_exception();
+    }
+    if (error) {
+      promise.SetException(error);
+    } else {
+      promise.SetValue(std::move(r));
+    }
+  });
+  if (!admitted) {
+    metrics_.RecordRejected();
+    promise.SetException(std::make_exception_ptr(std::logic_error("Query rejected: scheduler queue is full")));
+  }
+  return future;
+}
+
+void Database::ConfigureScheduler(const SchedulerOptions& options) {
+  std::shared_ptr<QueryScheduler> old;
+  {
+    std::lock_guard lock(scheduler_mutex_);
+    scheduler_options_ = options;
+    old = std::move(scheduler_);
+  }
+}
+
+void Database::ConfigureMemory(const MemoryOptions& options) {
+  memory_->SetLimit(options.global_limit);
+  query_memory_limit_.store(options.query_limit, std::memory_order_relaxed);
+  operator_memory_limit_.store(options.operator_memory, std::memory_order_relaxed);
+}
+
+void Database::ConfigureResultCache(const ResultCacheOptions& options) {
+  std::unique_lock lock(mutex_);
+  if (options.max_bytes == 0) {
+    result_cache_.reset();
+  } else {
+    result_cache_ = std::make_shared<ResultCache>(options);
+  }
+}
+
+void Database::SetTableMemoryLimit(const std::string& table, size_t bytes) {
+  Materialize(table);
+  std::unique_lock lock(mutex_);
+  FindTable(table).memory()->SetLimit(bytes);
+}
+
+std::shared_ptr<TrackingResource> Database::TableMemory(const std::string& table) {
+  return std::make_shared<TrackingResource>("table '" + table + "'", 0, memory_);
+}
+
+std::shared_ptr<TrackingResource> Database::QueryMemory() {
+  // промежуточные результаты и сам ответ живут в арене запроса и освобождаются разом вместе с Response
+  return TrackingResource::WithArena("query", query_memory_limit_.load(std::memory_order_relaxed), memory_);
+}
+
+std::shared_ptr<TrackingResource> Database::WorkMemory(const std::shared_ptr<TrackingResource>& query) {
+  return std::make_shared<TrackingResource>("operator", operator_memory_limit_.load(std::memory_order_relaxed), query);
+}
+
+std::shared_ptr<QueryScheduler> Database::Scheduler() {
+  std::lock_guard lock(scheduler_mutex_);
+  if (!scheduler_) {
+    scheduler_ = std::make_shared<QueryScheduler>(scheduler_options_);
+  }
+  return scheduler_;
+}
+
+QueryClass Database::Classify(const Query& q) const {
+  switch (q.query_type) {
+    case kSelect: {
+      const auto& info = std::get<SerializerForSelect>(q.serializer);
+      return ClassifyScan(info.table_name1, info.is_join);
+    }
+    case kUpdate:
+      return ClassifyScan(std::get<SerializerForUpdate>(q.serializer).table_name, false);
+    case kDelete:
+      return ClassifyScan(std::get<SerializerForDelete>(q.serializer).table_name, false);
+    default:
+      return kShortQuery;
+  }
+}
+
+QueryClass Database::ClassifyScan(const std::string& table, bool is_join) const {
+  if (is_join) {
+    return kLongQuery;
+  }
+  std::shared_lock lock(mutex_, std::try_to_lock);
+  if (!lock.owns_lock()) {
+    return kLongQuery;
+  }
+  auto it = tables_.find(table);
+  if (it != tables_.end() && it->second.size() > scheduler_options_.long_query_rows) {
+    return kLongQuery;
+  }
+  return kShortQuery;
+}
+
+void Database::MaterializeFor(const Query& q) {
+  std::visit([this](const auto& info) {
+    using Info = std::decay_t<decltype(info)>;
+    if constexpr (std::is_same_v<Info, SerializerForSelect>) {
+      Materialize(info.table_name1);
+      if (info.is_join) {
+        Materialize(info.table_name2);
+      }
+      for (const auto& clause : info.joins) {
+        Materialize(clause.table);
+      }
+    } else if constexpr (std::is_same_v<Info, SerializerForCreate>) {
+      if (info.is_view) {
+        Materialize(info.view.table_name1);
+        if (info.view.is_join) {
+          Materialize(info.view.table_name2);
+        }
+      }
+      for (const auto& key : info.foreign_keys) {
+        Materialize(key.table);
+      }
+    } else if constexpr (!std::is_same_v<Info, SerializerForShow>
+                         && !std::is_same_v<Info, SerializerForTransaction>) {
+      MaterializeRelated(info.table_name);
+    }
+  }, q.serializer);
+}
+
+Response Database::ExecuteQuery(Query& q, std::chrono::steady_clock::time_point start, const std::string& query,
+                                std::shared_ptr<CancellationToken> token) {
+  auto elapsed = [&start]() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  };
+  if (!token) {
+    token = StartQuery(QueryOptions(), start);
+  }
+  // отмененный в очереди или за время ожидания блокировки запрос не начинается
+  auto check = [&]() {
+    if (!token) {
+      return;
+    }
+    try {
+      token->Check();
+    } catch (const QueryCancelledError&) {
+      metrics_.RecordCancelled(!token->cancelled());
+      metrics_.RecordStatement(q.query_type, elapsed(), true);
+      throw;
+    }
+  };
+  check();
+  MaterializeFor(q);
+  std::shared_lock<std::shared_mutex> read_lock;
+  std::unique_lock<std::shared_mutex> write_lock;
+  if (q.query_type == kSelect || q.query_type == kShow) {
+    read_lock = std::shared_lock(mutex_);
+  } else {
+    write_lock = std::unique_lock(mutex_);
+  }
+  check();
+  std::string key;
+  std::vector<uint64_t> versions;
+  if (result_cache_ && !query.empty()) {
+    versions = Versions(std::get<SerializerForSelect>(q.serializer));
+    if (!versions.empty()) {
+      key = NormalizeQuery(query);
+      auto cached = result_cache_->Find(key, versions);
+      metrics_.RecordCacheLookup(cached != nullptr);
+      if (cached) {
+        metrics_.RecordStatement(q.query_type, elapsed(), false);
+        // копия в свежую арену, которая освобождается вместе с ответом вызывающего
+        return cached->is_table() ? Response(Table(cached->table(), QueryMemory())) : *cached;
+      }
+    }
+  }
+  Response r;
+  try {
+    // изменение, прерванное на середине, осталось бы примененным наполовину,
+    // поэтому в операторах отмена проверяется только для SELECT
+    CancellationScope scope(q.query_type == kSelect ? token.get() : nullptr);
+    r = Run(q);
+  } catch (const QueryCancelledError&) {
+    metrics_.RecordCancelled(!token->cancelled());
+    metrics_.RecordStatement(q.query_type, elapsed(), true);
+    throw;
+  } catch (...) {
+    metrics_.RecordStatement(q.query_type, elapsed(), true);
+    throw;
+  }
+  if (!key.empty()) {
+    result_cache_->Insert(key, std::move(versions), r);
+  }
+  metrics_.RecordStatement(q.query_type, elapsed(), false);
+  return r;
+}
+
+std::vector<uint64_t> Database::Versions(const SerializerForSelect& info) const {
+  std::vector<uint64_t> versions;
+  std::vector<const std::string*> names{&info.table_name1};
+  if (info.is_join) {
+    names.push_back(&info.table_name2);
+  }
+  for (const auto& clause : info.joins) {
+    names.push_back(&clause.table);
+  }
+  for (const auto* name : names) {
+    auto it = tables_.find(*name);
+    if (it == tables_.end()) {
+      return {};
+    }
+    versions.push_back(it->second.version());
+  }
+  return versions;
+}
+
+Response Database::ApplyTransaction(std::vector<Query>& writes, Query* read, bool commit) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start]() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  };
+  for (const auto& q : writes) {
+    MaterializeFor(q);
+  }
+  if (read != nullptr) {
+    MaterializeFor(*read);
+  }
+  std::unique_lock lock(mutex_);
+  UndoLog undo(tables_);
+  undo_ = &undo;
+  skip_views_ = !commit;
+  // содержимое представлений, подмененное на время read
+  std::vector<std::pair<std::string, Table>> replaced;
+  auto restore = [this, &undo, &replaced, commit]() {
+    for (auto& [name, content] : std::ranges::reverse_view(replaced)) {
+      tables_.at(name) = std::move(content);
+    }
+    std::vector<std::string> changed = undo.tables();
+    undo.Rollback();
+    undo_ = nullptr;
+    skip_views_ = false;
+    if (!commit) {
+      return;
+    }
+    // COMMIT успел перенести часть изменений в представления
+    for (auto& [name, view] : views_) {
+      if (std::any_of(changed.begin(), changed.end(), [&view](const auto& table) { return view->DependsOn(table); })) {
+        tables_.insert_or_assign(name, view->Build(tables_, TableMemory(name)));
+      }
+    }
+  };
+  Response r("Transaction is committed");
+  try {
+    for (auto& q : writes) {
+      std::visit([](const auto& info) {
+        using Info = std::decay_t<decltype(info)>;
+        if constexpr (!std::is_same_v<Info, SerializerForInsert> && !std::is_same_v<Info, SerializerForUpdate>
+                      && !std::is_same_v<Info, SerializerForDelete>) {
+          throw std::logic_error("Only INSERT, UPDATE and DELETE can be part of a transaction");
+        }
+      }, q.serializer);
+      Run(q);
+    }
+    if (read != nullptr) {
+      // зависящие от измененных таблиц представления, которые читает запрос, строятся
+      // копией определения, чтобы состояние самих представлений не менялось
+      const auto& info = std::get<SerializerForSelect>(read->serializer);
+      std::vector<std::string> names{info.table_name1, info.table_name2};
+      for (const auto& clause : info.joins) {
+        names.push_back(clause.table);
+      }
+      std::vector<std::string> changed = undo.tables();
+      for (const auto& name : names) {
+        auto view = views_.find(name);
+        if (view == views_.end() || std::none_of(changed.begin(), changed.end(), [&view](const auto& table) {
+              return view->second->DependsOn(table);
+            })) {
+          continue;
+        }
+        MaterializedView scratch(*view->second);
+        Table content = scratch.Build(tables_, QueryMemory());
+        replaced.emplace_back(name, std::exchange(tables_.at(name), std::move(content)));
+      }
+      r = Run(*read);
+    }
+  } catch (...) {
+    restore();
+    metrics_.RecordStatement(commit ? kCommit : read->query_type, elapsed(), true);
+    throw;
+  }
+  if (!commit) {
+    restore();
+  }
+  undo_ = nullptr;
+  skip_views_ = false;
+  metrics_.RecordStatement(commit ? kCommit : read->query_type, elapsed(), false);
+  return r;
+}
+
+Response Database::Run(Query& q) {
+  Response r;
+  switch (q.query_type) {
+    case kCreate:
+      r = CreateTable(std::get<SerializerForCreate>(q.serializer));
+      break;
+    case kDrop:
+      r = DropTable(std::get<SerializerForDrop>(q.serializer));
+      break;
+    case kInsert:
+      r = Insert(std::get<SerializerForInsert>(q.serializer));
+      break;
+    case kSelect:
+      r = Select(std::get<SerializerForSelect>(q.serializer));
+      break;
+    case kUpdate:
+      r = Update(std::get<SerializerForUpdate>(q.serializer));
+      break;
+    case kDelete:
+      r = Delete(std::get<SerializerForDelete>(q.serializer));
+      break;
+    case kShow:
+      r = Show();
+      break;
+    case kBegin:
+    case kCommit:
+    case kRollback:
+      throw std::logic_error("BEGIN, COMMIT and ROLLBACK are available only in a Session");
+    default:
+      break;
+  }
+  return r;
+}
+
+DatabaseStats Database::Stats() const {
+  std::shared_lock lock(mutex_);
+  return StatsLocked();
+}
+
+DatabaseStats Database::StatsLocked() const {
+  DatabaseStats stats = CollectStats(metrics_);
+  stats.memory_used = memory_->used();
+  stats.memory_peak = memory_->peak();
+  stats.memory_limit = memory_->limit();
+  stats.query_memory_limit = query_memory_limit_.load(std::memory_order_relaxed);
+  if (result_cache_) {
+    stats.result_cache_entries = result_cache_->size();
+    stats.result_cache_bytes = result_cache_->bytes();
+  }
+  for (const auto& t : tables_) {
+    TableMemoryStats table = t.second.MemoryUsage();
+    table.table = t.first;
+    stats.tables.push_back(table);
+  }
+  std::lock_guard pending_lock(pending_mutex_);
+  for (const auto& [name, pending] : pending_) {
+    TableMemoryStats table;
+    table.table = name;
+    table.rows = pending->table.rows;
+    stats.tables.push_back(table);
+  }
+  return stats;
+}
+
+Response Database::Show() {
+  DatabaseStats stats = StatsLocked();
+  // имена метрик включают имена таблиц и столбцов, поэтому ширина столбца metric
+  // берется по самой длинной строке, а значения добавляются типизированными
+  std::vector<std::pair<std::string, double>> rows;
+  auto add = [&rows](const std::string& metric, double value) {
+    rows.emplace_back(metric, value);
+  };
+  for (const auto& s : stats.statements) {
+    add(s.statement + ".count", static_cast<double>(s.count));
+    add(s.statement + ".errors", static_cast<double>(s.errors));
+    add(s.statement + ".p50_us", static_cast<double>(s.p50_ns) / 1e3);
+    add(s.statement + ".p99_us", static_cast<double>(s.p99_ns) / 1e3);
+    add(s.statement + ".p999_us", static_cast<double>(s.p999_ns) / 1e3);
+  }
+  add("parse_errors", static_cast<double>(stats.parse_errors));
+  add("rejected_queries", static_cast<double>(stats.rejected_queries));
+  add("cancelled_queries", static_cast<double>(stats.cancelled_queries));
+  add("timed_out_queries", static_cast<double>(stats.timed_out_queries));
+  add("rows_scanned", static_cast<double>(stats.rows_scanned));
+  add("rows_returned", static_cast<double>(stats.rows_returned));
+  add("index_lookups", static_cast<double>(stats.index_lookups));
+  add("index_hits", static_cast<double>(stats.index_hits));
+  add("index_hit_ratio", stats.index_hit_ratio);
+  add("memory.used_bytes", static_cast<double>(stats.memory_used));
+  add("memory.peak_bytes", static_cast<double>(stats.memory_peak));
+  add("memory.limit_bytes", static_cast<double>(stats.memory_limit));
+  add("memory.query_limit_bytes", static_cast<double>(stats.query_memory_limit));
+  add("spill.files", static_cast<double>(stats.spill_files));
+  add("spill.bytes", static_cast<double>(stats.spill_bytes));
+  add("joins.merge", static_cast<double>(stats.merge_joins));
+  add("joins.partitioned", static_cast<double>(stats.partitioned_joins));
+  add("joins.bloom", static_cast<double>(stats.bloom_joins));
+  add("joins.bloom_dropped_rows", static_cast<double>(stats.bloom_dropped_rows));
+  add("result_cache.hits", static_cast<double>(stats.result_cache_hits));
+  add("result_cache.misses", static_cast<double>(stats.result_cache_misses));
+  add("result_cache.entries", static_cast<double>(stats.result_cache_entries));
+  add("result_cache.bytes", static_cast<double>(stats.result_cache_bytes));
+  for (const auto& t : stats.tables) {
+    add("table." + t.table + ".rows", static_cast<double>(t.rows));
+    add("table." + t.table + ".bytes", static_cast<double>(t.bytes));
+    add("table." + t.table + ".tracked_bytes", static_cast<double>(t.tracked_bytes));
+    add("table." + t.table + ".memory_limit_bytes", static_cast<double>(t.memory_limit));
+    for (const auto& c : t.columns) {
+      add("column." + t.table + "." + c.column + ".bytes", static_cast<double>(c.bytes));
+    }
+  }
+  size_t width = 0;
+  for (const auto& row : rows) {
+    width = std::max(width, row.first.size());
+  }
+  Table table;
+  table.CreateColumn({"metric", kVarchar, width, false});
+  table.CreateColumn({"value", kDouble, 0, false});
+  for (auto& [metric, value] : rows) {
+    table.AppendRow({std::move(metric), value});
+  }
+  return Response(table);
+}
+
+const Table& Database::GetTable(const std::string& name) {
+  Materialize(name);
+  return FindTable(name);
+}
+
+void Database::AppendRow(const std::string& table, const std::vector<Value>& row) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsed = [&start]() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+  };
+  MaterializeRelated(table);
+  std::unique_lock lock(mutex_);
+  size_t first_row = 0;
+  try {
+    CheckWritable(table);
+    Table& target = FindTable(table);
+    first_row = target.size();
+    target.AppendRow(row);
+    try {
+      CheckForeignKeys(table, first_row);
+    } catch (...) {
+      target.Erase({first_row});
+      throw;
+    }
+  } catch (...) {
+    metrics_.RecordStatement(kInsert, elapsed(), true);
+    throw;
+  }
+  MaintainViews(table, [&](MaterializedView& view, Table& content) {
+    view.Inserted(table, first_row, tables_, content);
+  });
+  metrics_.RecordStatement(kInsert, elapsed(), false);
+}
+
+Table& Database::FindTable(const std::string& name) {
+  auto it = tables_.find(name);
+  if (it == tables_.end()) {
+    throw std::logic_error("No table with name '" + name + "'");
+  }
+  return it->second;
+}
+
+Table Database::Scan(const std::string& table, const std::vector<std::string>& columns, const Predicate& where) {
+  auto start = std::chrono::steady_clock::now();
+  auto token = StartQuery(QueryOptions(), start);
+  Materialize(table);
+  std::shared_lock lock(mutex_);
+  Table& source = FindTable(table);
+  Table result;
+  try {
+    CancellationScope scope(token.get());
+    result = source.Select(columns, where.tokens(), QueryMemory());
+  } catch (const QueryCancelledError&) {
+    metrics_.RecordCancelled(true);
+    throw;
+  }
+  metrics_.RecordRows(source.size(), result.size());
+  metrics_.RecordStatement(kSelect, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count()), false);
+  return result;
+}
+
+Response Database::CreateTable(const SerializerForCreate& info) {
+  if (info.is_view) {
+    return CreateView(info);
+  }
+  Table table(TableMemory(info.table_name));
+  for (const auto& column : info.table_columns) {
+    table.CreateColumn(column);
+  }
+  table.SetPrimaryKey(std::get<0>(info.table_columns[info.primary_key]));
+  for (const auto& key : info.foreign_keys) {
+    if (views_.contains(key.table)) {
+      throw std::logic_error("Foreign key cannot reference materialized view '" + key.table + "'");
+    }
+    const Table* referenced = key.table == info.table_name ? &table : nullptr;
+    if (referenced == nullptr) {
+      auto it = tables_.find(key.table);
+      if (it == tables_.end()) {
+        throw std::logic_error("No table with name '" + key.table + "'");
+      }
+      referenced = &it->second;
+    }
+    if (!referenced->ContainsColumn(key.referenced) || !referenced->column(key.referenced).is_primary()) {
+      throw std::logic_error("Foreign key must reference the primary key of '" + key.table + "'");
+    }
+    if (!table.ContainsColumn(key.column)
+        || table.column(key.column).type() != referenced->column(key.referenced).type()) {
+      throw std::logic_error("Foreign key column '" + key.column + "' does not match "
+                                 + key.table + "(" + key.referenced + ")");
+    }
+    table.AddForeignKey(key);
+  }
+  if (info.partitions != 0) {
+    table.SetPartitioning(info.partition_key, info.partitions);
+  }
+  tables_.emplace(info.table_name, std::move(table));
+  return Response("Table is successfully created");
+}
+
+Response Database::CreateView(const SerializerForCreate& info) {
+  if (tables_.contains(info.table_name)) {
+    throw std::logic_error("Table '" + info.table_name + "' already exists");
+  }
+  if (!info.view.aggregates.empty()) {
+    throw std::logic_error("Aggregates are not supported in materialized views");
+  }
+  auto view = std::make_shared<MaterializedView>(info.view, tables_);
+  tables_.emplace(info.table_name, view->Build(tables_, TableMemory(info.table_name)));
+  views_.emplace(info.table_name, std::move(view));
+  return Response("Materialized view is successfully created");
+}
+
+void Database::CheckWritable(const std::string& table) const {
+  if (views_.contains(table)) {
+    throw std::logic_error("Materialized view '" + table + "' is read-only");
+  }
+}
+
+void Database::MaintainViews(const std::string& table,
+                             const std::function<void(MaterializedView&, Table&)>& apply) {
+  if (skip_views_) {
+    return;
+  }
+  for (auto& [name, view] : views_) {
+    if (!view->DependsOn(table)) {
+      continue;
+    }
+    try {
+      apply(*view, tables_.at(name));
+    } catch (...) {
+      // источник уже изменен, поэтому представление считается заново
+      tables_.insert_or_assign(name, view->Build(tables_, TableMemory(name)));
+    }
+  }
+}
+
+void Database::CheckForeignKeys(const std::string& name, size_t first_row) {
+  const Table& table = tables_.at(name);
+  for (const auto& key : table.foreign_keys()) {
+    const Column& column = table.column(key.column);
+    const Column& referenced = tables_.at(key.table).column(key.referenced);
+    // при массовой загрузке ключи родителя повторяются, каждый ищется в индексе один раз
+    std::unordered_set<Value, ValueHash> checked;
+    for (size_t i = first_row; i < table.size(); ++i) {
+      Value value = column[i];
+      if (std::holds_alternative<MyMonostate>(value) || checked.contains(value)) {
+        continue;
+      }
+      bool hit = referenced.Contains(value);
+      metrics_.RecordIndexLookup(hit);
+      if (!hit) {
+        throw std::logic_error("Foreign key violation: '" + ToString(value) + "' is not present in "
+                                   + key.table + "(" + key.referenced + ")");
+      }
+      checked.insert(std::move(value));
+    }
+  }
+}
+
+bool Database::IsReferenced(const std::string& name) const {
+  for (const auto& [child_name, child] : tables_) {
+    for (const auto& key : child.foreign_keys()) {
+      if (key.table == name) {
+        return true;
+      }
+    }
   }
-  return r;
+  return false;
 }
 
-Response Database::CreateTable(const SerializerForCreate& info) {
-  Table table;
-  for (const auto& column : info.table_columns) {
-    table.CreateColumn(column);
+void Database::CheckReferences(const std::string& name, const std::vector<size_t>& rows, bool deleting) {
+  const Table& table = tables_.at(name);
+  for (const auto& [child_name, child] : tables_) {
+    for (const auto& key : child.foreign_keys()) {
+      if (key.table != name) {
+        continue;
+      }
+      const Column& parent = table.column(key.referenced);
+      const Column& column = child.column(key.column);
+      std::unordered_map<Value, size_t, ValueHash> leaving;
+      if (deleting && &child == &table) {
+        for (size_t row : rows) {
+          Value value = column[row];
+          if (!std::holds_alternative<MyMonostate>(value)) {
+            ++leaving[std::move(value)];
+          }
+        }
+      }
+      for (size_t row : rows) {
+        Value value = parent[row];
+        size_t references = column.Count(value);
+        metrics_.RecordIndexLookup(references != 0);
+        auto it = leaving.find(value);
+        if (references > (it == leaving.end() ? 0 : it->second)) {
+          throw std::logic_error("Key '" + ToString(value) + "' of table '" + name
+                                     + "' is referenced by table '" + child_name + "'");
+        }
+      }
+    }
   }
-  table.SetPrimaryKey(std::get<0>(info.table_columns[info.primary_key]));
-  tables_.emplace(info.table_name, table);
-  return Response("Table is successfully created");
 }
 
 Response Database::DropTable(const SerializerForDrop& info) {
+  for (const auto& [name, table] : tables_) {
+    for (const auto& key : table.foreign_keys()) {
+      if (key.table == info.table_name && name != info.table_name) {
+        throw std::logic_error("Table '" + info.table_name + "' is referenced by table '" + name + "'");
+      }
+    }
+  }
+  if (!views_.erase(info.table_name)) {
+    for (const auto& [name, view] : views_) {
+      if (view->DependsOn(info.table_name)) {
+        throw std::logic_error("Table '" + info.table_name + "' is used by materialized view '" + name + "'");
+      }
+    }
+  }
   tables_.erase(info.table_name);
   return Response("Table '" + info.table_name + "' was succesfully dropped");
 }
 
 Response Database::Insert(SerializerForInsert& info) {
-  tables_[info.table_name].CreateRow(info.data);
+  if (!tables_.contains(info.table_name)) {
+    throw std::logic_error("No table with name '" + info.table_name + "'");
+  }
+  CheckWritable(info.table_name);
+  Table& table = tables_[info.table_name];
+  size_t first_row = table.size();
+  if (undo_ != nullptr) {
+    undo_->Inserting(info.table_name);
+  }
+  table.CreateRows(info.columns, info.rows);
+  try {
+    CheckForeignKeys(info.table_name, first_row);
+  } catch (...) {
+    std::vector<size_t> inserted(table.size() - first_row);
+    std::iota(inserted.begin(), inserted.end(), first_row);
+    table.Erase(inserted);
+    throw;
+  }
+  MaintainViews(info.table_name, [&](MaterializedView& view, Table& content) {
+    view.Inserted(info.table_name, first_row, tables_, content);
+  });
   return Response("Information is successfully inserted");
 }
 
 Response Database::Select(SerializerForSelect& info) {
-  if (!info.unique_columns.empty()) {
-    for (const auto& c : info.unique_columns) {
-      bool exists = false;
-      for (const auto& t : tables_) {
-        if (!exists) {
-          if (t.second.ContainsColumn(c)) {
-            exists = true;
-            if (t.first == info.table_name1) {
-              info.columns1.push_back(c);
-            } else if (t.first == info.table_name2) {
-              info.columns2.push_back(c);
-            } else {
-              throw std::logic_error("Invalid query");
-            }
-          }
-        } else {
-          throw std::logic_error("Ambiguous column selection");
-        }
-      }
+  if (!tables_.contains(info.table_name1)) {
+    throw std::logic_error("No table with name '" + info.table_name1 + "'");
+  }
+  const auto& table1 = tables_.at(info.table_name1);
+  const Table* table2 = nullptr;
+  if (info.is_join) {
+    if (!tables_.contains(info.table_name2)) {
+      throw std::logic_error("No table with name '" + info.table_name2 + "'");
     }
-    info.unique_columns.clear();
+    table2 = &tables_.at(info.table_name2);
   }
-  if (info.all_table) {
-    return Response(tables_[info.table_name1]);
-  } else {
-    if (!tables_.contains(info.table_name1)) {
-      throw std::logic_error("No table with name '" + info.table_name1 + "'");
+  std::vector<const Table*> joined;
+  for (const auto& clause : info.joins) {
+    if (!tables_.contains(clause.table)) {
+      throw std::logic_error("No table with name '" + clause.table + "'");
     }
-    auto t1 = tables_[info.table_name1].Select(info.columns1, info.filters);
-    if (!info.is_join) {
-      return Response(t1);
+    joined.push_back(&tables_.at(clause.table));
+  }
+  if (!info.aggregates.empty()) {
+    return Aggregate(info, table1);
+  }
+  ResolveColumns(info, table1, table2, joined);
+
+  auto memory = QueryMemory();
+  SpillStats spill;
+  // Строки результата до самой проекции — номера строк источников: фильтр, соединение
+  // и ORDER BY переставляют только их, а значения столбцов копируются один раз в Combine
+  std::vector<const Table*> tables{&table1};
+  std::vector<const std::vector<std::string>*> columns{&info.columns1};
+  JoinTuples rows;
+  size_t scanned = table1.size();
+  Table result;
+  if (!info.joins.empty()) {
+    tables.push_back(table2);
+    tables.insert(tables.end(), joined.begin(), joined.end());
+    columns.push_back(&info.columns2);
+    for (const auto& clause : info.joins) {
+      columns.push_back(&clause.columns);
     }
-    if (!tables_.contains(info.table_name2)) {
-      throw std::logic_error("No table with name '" + info.table_name2 + "'");
+    for (size_t t = 1; t < tables.size(); ++t) {
+      scanned += tables[t]->size();
     }
-    auto t2 = tables_[info.table_name2].Select(info.columns2);
-    Column c1, c2;
-    if (tables_[info.table_name1].ContainsColumn(info.join_columns.first) &&
-        tables_[info.table_name2].ContainsColumn(info.join_columns.second)) {
-      c1 = tables_[info.table_name1][info.join_columns.first];
-      c2 = tables_[info.table_name2][info.join_columns.second];
-    } else if (tables_[info.table_name1].ContainsColumn(info.join_columns.second) &&
-        tables_[info.table_name2].ContainsColumn(info.join_columns.first)) {
-      c1 = tables_[info.table_name1][info.join_columns.second];
-      c2 = tables_[info.table_name2][info.join_columns.first];
+    rows = MultiJoinRows(info, tables, memory);
+  } else if (!info.is_join) {
+    if (info.order_by.empty()) {
+      // без сортировки столбцы копируются сразу, а целые сжатые блоки — без распаковки
+      result = table1.Select(info.columns1, info.filters, memory);
+      tables.clear();
     } else {
-      throw std::logic_error("No column with given name");
+      auto& selection = rows.emplace_back(memory.get());
+      if (info.filters.empty()) {
+        selection.resize(table1.size());
+        std::iota(selection.begin(), selection.end(), 0);
+      } else {
+        std::vector<size_t> matched = table1.Filter(info.filters);
+        selection.assign(matched.begin(), matched.end());
+      }
+    }
+  } else {
+    auto [key1, key2] = info.join_columns;
+    const Table* left = &table1;
+    const Table* right = table2;
+    auto* left_columns = &info.columns1;
+    auto* right_columns = &info.columns2;
+    if (info.join_type == kRight) {
+      std::swap(left, right);
+      std::swap(key1, key2);
+      std::swap(left_columns, right_columns);
+    }
+    tables = {left, right};
+    columns = {left_columns, right_columns};
+    scanned += table2->size();
+    const Column& probe = left->column(key1);
+    const Column& build = right->column(key2);
+    bool merge = PreferMergeJoin(probe, build, operator_memory_limit_.load(std::memory_order_relaxed));
+    // разделы с одинаковой хеш-функцией по ключам соединения соединяются попарно
+    bool co_partitioned = !merge && !left->partitions().empty()
+                          && left->partitions().size() == right->partitions().size()
+                          && left->partition_key() == key1 && right->partition_key() == key2
+                          && probe.type() == build.type();
+    std::optional<JoinRows> pairs;
+    if (co_partitioned) {
+      try {
+        pairs.emplace(CoPartitionedJoin(probe, left->partitions(), build, right->partitions(),
+                                        info.join_type == kInner, memory, WorkMemory(memory)));
+        metrics_.RecordPartitionedJoin();
+      } catch (const MemoryLimitError&) {
+        // без вытеснения разделы не поместились; обычный HashJoin умеет писать на диск
+      }
+    }
+    if (!pairs && merge) {
+      pairs.emplace(MergeJoin(probe, build, info.join_type == kInner, memory, WorkMemory(memory), spill));
+      metrics_.RecordMergeJoin();
+    } else if (!pairs) {
+      // маленький build: строки probe без пары отсекаются фильтром Блума до пробы хеш-таблицы
+      auto work = WorkMemory(memory);
+      std::optional<std::vector<uint8_t>> filter = BloomSemiJoin(probe, build, work);
+      pairs.emplace(HashJoin(probe, build, info.join_type == kInner, memory, work, spill,
+                             filter ? &*filter : nullptr));
+      if (filter) {
+        metrics_.RecordBloomJoin(static_cast<uint64_t>(std::count(filter->begin(), filter->end(), 0)));
+      }
+    }
+    for (size_t side = 0; side < 2; ++side) {
+      auto& selection = rows.emplace_back(memory.get());
+      selection.reserve(pairs->size());
+      for (const auto& pair : *pairs) {
+        selection.push_back(side == 0 ? pair.first : pair.second);
+      }
+    }
+  }
+  if (!tables.empty()) {
+    if (!info.order_by.empty()) {
+      Table::Order(tables, columns, rows, info.order_by, memory, WorkMemory(memory), spill);
+    }
+    result = Table::Combine(tables, columns, rows, memory);
+  }
+  metrics_.RecordRows(scanned, result.size());
+  if (spill.files != 0) {
+    metrics_.RecordSpill(spill.files, spill.bytes);
+  }
+  return Response(std::move(result));
+}
+
+Response Database::Aggregate(const SerializerForSelect& info, const Table& table) {
+  if (info.is_join || !info.order_by.empty()) {
+    throw std::logic_error("Aggregates are supported only over a single table without ORDER BY");
+  }
+  std::optional<std::vector<size_t>> rows;
+  if (!info.filters.empty()) {
+    rows = table.Filter(info.filters);
+  }
+  Table result(QueryMemory());
+  std::vector<std::pair<std::string, Column>> columns;
+  for (const auto& aggregate : info.aggregates) {
+    const Column& column = table.column(aggregate.column);
+    DataType type = kInt;
+    if (aggregate.type == kApproxPercentile) {
+      if (column.type() != kInt && column.type() != kDouble && column.type() != kFloat) {
+        throw std::logic_error("APPROX_PERCENTILE needs a numeric column");
+      }
+      type = column.type();
+    }
+    ColumnSketch sketch = column.Sketch(rows ? &*rows : nullptr);
+    Value value;
+    if (aggregate.type == kApproxCountDistinct) {
+      value = static_cast<int>(sketch.distinct.Estimate());
+    } else if (auto quantile = sketch.quantiles.Quantile(aggregate.fraction)) {
+      // набросок хранит сами значения колонки, поэтому для int приведение точное
+      switch (type) {
+        case kInt:
+          value = static_cast<int>(*quantile);
+          break;
+        case kFloat:
+          value = static_cast<float>(*quantile);
+          break;
+        default:
+          value = *quantile;
+          break;
+      }
+    }
+    Column out(type, 0, true, result.memory());
+    out.PushValue(value);
+    columns.emplace_back(aggregate.name, std::move(out));
+  }
+  result.SetColumns(std::move(columns), 1);
+  metrics_.RecordRows(table.size(), 1);
+  return Response(std::move(result));
+}
+
+JoinTuples Database::MultiJoinRows(const SerializerForSelect& info, const std::vector<const Table*>& tables,
+                                   const std::shared_ptr<TrackingResource>& memory) {
+  std::vector<size_t> rows;
+  for (const auto* table : tables) {
+    rows.push_back(table->size());
+  }
+  std::vector<JoinEdge> edges{{0, &tables[0]->column(info.join_columns.first), 1,
+                               &tables[1]->column(info.join_columns.second), info.join_type}};
+  for (size_t k = 0; k < info.joins.size(); ++k) {
+    const JoinClause& clause = info.joins[k];
+    edges.push_back({clause.left, &tables[clause.left]->column(clause.left_column), 2 + k,
+                     &tables[2 + k]->column(clause.column), clause.type});
+  }
+  return MultiJoin(rows, edges, memory, WorkMemory(memory));
+}
+
+void ResolveColumns(SerializerForSelect& info, const Table& table1, const Table* table2,
+                    const std::vector<const Table*>& joined) {
+  std::vector<const Table*> tables{&table1};
+  std::vector<std::vector<std::string>*> columns{&info.columns1};
+  if (table2 != nullptr) {
+    tables.push_back(table2);
+    columns.push_back(&info.columns2);
+  }
+  for (size_t k = 0; k < joined.size(); ++k) {
+    tables.push_back(joined[k]);
+    columns.push_back(&info.joins[k].columns);
+  }
+  for (const auto& c : info.unique_columns) {
+    std::vector<std::string>* target = nullptr;
+    for (size_t t = 0; t < tables.size(); ++t) {
+      if (!tables[t]->ContainsColumn(c)) {
+        continue;
+      }
+      if (target != nullptr) {
+        throw std::logic_error("Ambiguous column selection");
+      }
+      target = columns[t];
+    }
+    if (target == nullptr) {
+      throw std::logic_error("No column with name '" + c + "'");
+    }
+    target->push_back(c);
+  }
+  info.unique_columns.clear();
+  if (info.all_table) {
+    for (size_t t = 0; t < tables.size(); ++t) {
+      *columns[t] = tables[t]->column_names();
+    }
+  }
+  for (size_t k = 0; k < joined.size(); ++k) {
+    JoinClause& clause = info.joins[k];
+    size_t self = 2 + k;
+    // номер таблицы стороны ON: явно указанной или единственной, где есть столбец
+    auto locate = [&](const std::pair<std::string, std::string>& side, bool earlier) -> size_t {
+      const auto& [table, column] = side;
+      std::vector<std::string> names{info.table_name1, info.table_name2};
+      for (const auto& c : info.joins) {
+        names.push_back(c.table);
+      }
+      size_t found = tables.size();
+      for (size_t t = 0; t <= self; ++t) {
+        if ((earlier && t == self) || (!table.empty() && names[t] != table) || !tables[t]->ContainsColumn(column)) {
+          continue;
+        }
+        if (found != tables.size()) {
+          throw std::logic_error("Ambiguous column '" + column + "' in JOIN condition");
+        }
+        found = t;
+      }
+      if (found == tables.size()) {
+        throw std::logic_error("No column with name '" + column + "'");
+      }
+      return found;
+    };
+    auto first = clause.on_first;
+    auto second = clause.on_second;
+    if (first.first == clause.table || (first.first.empty() && second.first != clause.table
+                                        && joined[k]->ContainsColumn(first.second))) {
+      std::swap(first, second);
     }
-    switch (info.join_type) {
-      case kInner:
-        return Response(t1.Join(t2, c1, c2, true));
-      case kLeft:
-        return Response(t1.Join(t2, c1, c2, false));
-      case kRight:
-        return Response(t2.Join(t1, c2, c1, false));
+    clause.left = locate(first, true);
+    if (locate(second, false) != self) {
+      throw std::logic_error("JOIN condition must reference table '" + clause.table + "'");
+    }
+    clause.left_column = first.second;
+    clause.column = second.second;
+  }
+  if (table2 != nullptr) {
+    auto& [key1, key2] = info.join_columns;
+    if (!table1.ContainsColumn(key1) || !table2->ContainsColumn(key2)) {
+      std::swap(key1, key2);
+      if (!table1.ContainsColumn(key1) || !table2->ContainsColumn(key2)) {
+        throw std::logic_error("No column with given name");
+      }
     }
   }
-  return Response();
 }
 
 Response Database::Update(const SerializerForUpdate& info) {
   if (!tables_.contains(info.table_name)) {
     throw std::logic_error("No table with given name");
   }
-  tables_[info.table_name].Update(info.values, info.filters);
+  CheckWritable(info.table_name);
+  Table& table = tables_[info.table_name];
+  // строки под WHERE нужны обеим проверкам ниже и ищутся не больше одного раза
+  std::optional<std::vector<size_t>> matched;
+  auto matched_rows = [&]() -> const std::vector<size_t>& {
+    if (!matched) {
+      matched = table.Filter(info.filters);
+    }
+    return *matched;
+  };
+  // значения SET — константы, поэтому внешние ключи проверяются до изменения;
+  // UPDATE, не затрагивающий ни одной строки, ничего не нарушает
+  for (const auto& key : table.foreign_keys()) {
+    auto it = info.values.find(key.column);
+    if (it == info.values.end() || it->second == "NULL" || matched_rows().empty()) {
+      continue;
+    }
+    Value value = Cast(it->second, table.column(key.column).type());
+    bool hit = tables_.at(key.table).column(key.referenced).Contains(value);
+    metrics_.RecordIndexLookup(hit);
+    if (!hit) {
+      throw std::logic_error("Foreign key violation: '" + it->second + "' is not present in "
+                                 + key.table + "(" + key.referenced + ")");
+    }
+  }
+  for (const auto& [column, value] : info.values) {
+    if (!table.ContainsColumn(column) || !table.column(column).is_primary() || !IsReferenced(info.table_name)) {
+      continue;
+    }
+    Value updated = value == "NULL" ? Value() : Cast(value, table.column(column).type());
+    std::vector<size_t> changed;
+    for (size_t row : matched_rows()) {
+      if (table.column(column)[row] != updated) {
+        changed.push_back(row);
+      }
+    }
+    CheckReferences(info.table_name, changed, false);
+  }
+  std::vector<std::string> columns;
+  for (const auto& [column, value] : info.values) {
+    columns.push_back(column);
+  }
+  std::function<void(const std::vector<size_t>&)> before;
+  if (undo_ != nullptr) {
+    before = [&](const std::vector<size_t>& rows) { undo_->Updating(info.table_name, rows, columns); };
+  }
+  auto rows = table.Update(info.values, info.filters, before);
+  MaintainViews(info.table_name, [&](MaterializedView& view, Table& content) {
+    view.Updated(info.table_name, rows, columns, tables_, content);
+  });
   return Response("Information was successfully updated");
 }
 
@@ -321,10 +2639,34 @@ Response Database::Delete(const SerializerForDelete& info) {
   if (!tables_.contains(info.table_name)) {
     throw std::logic_error("No table with given name");
   }
+  CheckWritable(info.table_name);
+  Table& table = tables_[info.table_name];
+  std::vector<size_t> rows;
+  if (!info.all_table) {
+    rows = table.Filter(info.filters);
+  } else if (IsReferenced(info.table_name)) {
+    rows.resize(table.size());
+    std::iota(rows.begin(), rows.end(), 0);
+  }
+  CheckReferences(info.table_name, rows, true);
+  if (undo_ != nullptr) {
+    std::vector<size_t> removed;
+    if (info.all_table && rows.empty()) {
+      removed.resize(table.size());
+      std::iota(removed.begin(), removed.end(), 0);
+    }
+    undo_->Deleting(info.table_name, removed.empty() ? rows : removed);
+  }
   if (info.all_table) {
-    tables_[info.table_name].DeleteAll();
+    table.DeleteAll();
+    MaintainViews(info.table_name, [&](MaterializedView& view, Table& content) {
+      view.Cleared(info.table_name, content);
+    });
   } else {
-    tables_[info.table_name].Delete(info.filters);
+    table.Erase(rows);
+    MaintainViews(info.table_name, [&](MaterializedView& view, Table& content) {
+      view.Deleted(info.table_name, rows, content);
+    });
   }
   return Response("Information was successfully deleted");
 }
@@ -333,6 +2675,20 @@ Response::Response(const std::string& msg) : data_(msg), type_(kMessage) {}
 
 Response::Response(const Table& table) : data_(table), type_(kTable) {}
 
+Response::Response(Table&& table) : type_(kTable), data_(std::move(table)) {}
+
+bool Response::is_table() const {
+  return type_ == kTable;
+}
+
+const std::string& Response::message() const {
+  return std::get<std::string>(data_);
+}
+
+const Table& Response::table() const {
+  return std::get<Table>(data_);
+}
+
 std::ostream& operator<<(std::ostream& stream, const Response& response) {
   switch (response.type_) {
     case Response::kMessage:
@@ -352,17 +2708,13 @@ std::ostream& operator<<(std::ostream& stream, const MyMonostate&) {
   return stream;
 }
 
-Table Table::Select(const std::vector<std::string>& columns,
-                    const std::vector<Token>& filters) {
-  Table result;
+Table Table::Select(const std::vector<std::string>& columns, const std::vector<Token>& filters,
+                    std::shared_ptr<TrackingResource> memory) const {
+  Table result(std::move(memory));
   std::vector<size_t> sat_rows;
   bool all_rows = false;
   if (!filters.empty()) {
-    for (size_t i = 0; i < n_rows_; ++i) {
-      if (Check(filters, i)) {
-        sat_rows.push_back(i);
-      }
-    }
+    sat_rows = Filter(filters);
     result.n_rows_ = sat_rows.size();
   } else {
     all_rows = true;
@@ -373,23 +2725,85 @@ Table Table::Select(const std::vector<std::string>& columns,
       throw std::logic_error("No column with given name");
     }
     if (all_rows) {
-      result.columns_.emplace(c, columns_[c]);
+      result.EmplaceColumn(c, Column(columns_.at(c), result.memory_));
     } else {
-      result.columns_.emplace(c, columns_[c].Select(sat_rows));
+      result.EmplaceColumn(c, columns_.at(c).Select(sat_rows, result.memory_));
     }
   }
   return result;
 }
 
-bool Table::Check(const std::vector<Token>& filters, size_t row) {
-  std::stack<Token> stack; // values
-  Token t1, t2;
-  Value a, b;
+std::vector<size_t> Table::Filter(const std::vector<Token>& filters) const {
+  if (auto rows = PruneFilter(filters)) {
+    return std::move(*rows);
+  }
+  if (filters.size() == 2 && filters[0].type == kVar && (filters[1].type == kIsNull || filters[1].type == kIsNotNull)) {
+    return columns_.at(filters[0].value).NullRows(filters[1].type == kIsNull);
+  }
+  // сравнение с NULL дает UNKNOWN; WHERE отбрасывает его так же, как FALSE, поэтому в mask он
+  // хранится нулем. Отдельная маска unknown нужна только для (выражение) IS [NOT] NULL
+  // и ведется, лишь когда такие проверки в условии есть
+  bool track_unknown = std::any_of(filters.begin(), filters.end(), [](const Token& f) {
+    return f.type == kIsNull || f.type == kIsNotNull;
+  });
+  auto constant = [](const Token& token, DataType type) {
+    return token.value == "NULL" ? Value() : Cast(token.value, type);
+  };
+  // операнд — токен (столбец или константа) либо уже вычисленный результат по всем строкам;
+  // пустая unknown — ни одной строки с UNKNOWN
+  struct Operand {
+    const Token* token = nullptr;
+    std::vector<uint8_t> mask;
+    std::vector<uint8_t> unknown;
+  };
+  auto value = [this, &constant](const Operand& x, const Operand& other, size_t row) -> Value {
+    if (x.token == nullptr) {
+      return x.mask[row] != 0;
+    }
+    if (x.token->type == kVar) {
+      return columns_.at(x.token->value)[row];
+    }
+    if (x.token->type == kConst && other.token != nullptr && other.token->type == kVar) {
+      return constant(*x.token, columns_.at(other.token->value).type());
+    }
+    return constant(*x.token, kBool);
+  };
+  // строки, где операнд NULL или UNKNOWN
+  auto unknown = [this](const Operand& x) {
+    std::vector<uint8_t> res;
+    if (x.token == nullptr) {
+      res = x.unknown;
+    } else if (x.token->type == kVar) {
+      columns_.at(x.token->value).MatchNull(true, res);
+    } else if (x.token->value == "NULL") {
+      res.assign(n_rows_, 1);
+    }
+    res.resize(n_rows_);
+    return res;
+  };
+  auto flip = [](TokenType op) {
+    switch (op) {
+      case kGreater:
+        return kLess;
+      case kLess:
+        return kGreater;
+      case kNotGreater:
+        return kNotLess;
+      case kNotLess:
+        return kNotGreater;
+      default:
+        return op;
+    }
+  };
+  auto is = [](const Operand& x, TokenType type) {
+    return x.token != nullptr && x.token->type == type;
+  };
+  std::vector<Operand> stack;
   for (const auto& f : filters) {
     switch (f.type) {
       case kVar:
       case kConst:
-        stack.emplace(f);
+        stack.push_back({&f, {}, {}});
         break;
       case kEquals:
       case kNotEquals:
@@ -398,35 +2812,91 @@ bool Table::Check(const std::vector<Token>& filters, size_t row) {
       case kNotGreater:
       case kNotLess:
       case kOr:
-      case kAnd:
-        t2 = stack.top();
-        stack.pop();
-        t1 = stack.top();
-        stack.pop();
-        if (t1.type == kVar) {
-          a = columns_[t1.value][row];
-        } else if (t1.type == kConst && t2.type == kVar) {
-          a = Cast(t1.value, columns_[t2.value].type());
+      case kAnd: {
+        Operand b = std::move(stack.back());
+        stack.pop_back();
+        Operand a = std::move(stack.back());
+        stack.pop_back();
+        Operand res;
+        if (f.type != kOr && f.type != kAnd && is(a, kVar) && is(b, kConst)) {
+          const Column& column = columns_.at(a.token->value);
+          column.Match(f.type, constant(*b.token, column.type()), res.mask);
+        } else if (f.type != kOr && f.type != kAnd && is(a, kConst) && is(b, kVar)) {
+          const Column& column = columns_.at(b.token->value);
+          column.Match(flip(f.type), constant(*a.token, column.type()), res.mask);
         } else {
-          a = Cast(t1.value, kBool);
+          res.mask.resize(n_rows_);
+          for (size_t i = 0; i < n_rows_; ++i) {
+            if (i % Column::kBlockRows == 0) {
+              CheckCancellation();
+            }
+            res.mask[i] = CompareValues(f.type, value(a, b, i), value(b, a, i));
+          }
         }
-        if (t2.type == kVar) {
-          b = columns_[t2.value][row];
-        } else if (t2.type == kConst && t1.type == kVar) {
-          b = Cast(t2.value, columns_[t1.value].type());
+        if (track_unknown) {
+          std::vector<uint8_t> ua = unknown(a);
+          std::vector<uint8_t> ub = unknown(b);
+          res.unknown.resize(n_rows_);
+          for (size_t i = 0; i < n_rows_; ++i) {
+            if (f.type == kAnd) {
+              // UNKNOWN, если ни одна сторона не FALSE, но и обе сразу не TRUE
+              bool a_false = !ua[i] && !std::get<bool>(value(a, a, i));
+              bool b_false = !ub[i] && !std::get<bool>(value(b, b, i));
+              res.unknown[i] = !res.mask[i] && !a_false && !b_false;
+            } else if (f.type == kOr) {
+              res.unknown[i] = !res.mask[i] && (ua[i] || ub[i]);
+            } else {
+              res.unknown[i] = ua[i] || ub[i];
+            }
+          }
+        }
+        stack.push_back(std::move(res));
+        break;
+      }
+      case kIsNull:
+      case kIsNotNull: {
+        Operand a = std::move(stack.back());
+        stack.pop_back();
+        Operand res;
+        if (is(a, kVar)) {
+          columns_.at(a.token->value).MatchNull(f.type == kIsNull, res.mask);
         } else {
-          b = Cast(t2.value, kBool);
+          // у константы и результата сравнения NULL — это UNKNOWN
+          res.mask = unknown(a);
+          if (f.type == kIsNotNull) {
+            for (auto& bit : res.mask) {
+              bit = !bit;
+            }
+          }
         }
-        stack.emplace(kRes, std::to_string(Compare(f.type, a, b)));
+        stack.push_back(std::move(res));
         break;
+      }
       default:
         break;
     }
   }
-  return std::get<bool>(Cast(stack.top().value, kBool));
+  std::vector<size_t> rows;
+  if (stack.empty()) {
+    return rows;
+  }
+  const Operand& top = stack.back();
+  for (size_t i = 0; i < n_rows_; ++i) {
+    if (i % Column::kBlockRows == 0) {
+      CheckCancellation();
+    }
+    if (top.token == nullptr ? top.mask[i] != 0 : std::get<bool>(value(top, top, i))) {
+      rows.push_back(i);
+    }
+  }
+  return rows;
 }
 
-bool Table::Compare(TokenType op, const Value& a, const Value& b) {
+bool CompareValues(TokenType op, const Value& a, const Value& b) {
+  if (op != kOr && op != kAnd
+      && (std::holds_alternative<MyMonostate>(a) || std::holds_alternative<MyMonostate>(b))) {
+    return false;
+  }
   switch (op) {
     case kEquals:
       return a == b;
@@ -449,109 +2919,317 @@ bool Table::Compare(TokenType op, const Value& a, const Value& b) {
   }
 }
 
-void Table::Update(const std::unordered_map<std::string, std::string>& values,
-                   const std::vector<Token>& filters) {
-  std::vector<size_t> sat_rows;
-  for (size_t i = 0; i < n_rows_; ++i) {
-    if (Check(filters, i)) {
-      sat_rows.push_back(i);
-    }
-  }
+std::vector<size_t> Table::Update(const std::unordered_map<std::string, std::string>& values,
+                                  const std::vector<Token>& filters,
+                                  const std::function<void(const std::vector<size_t>&)>& before) {
+  // значения проверяются до первого изменения, чтобы UPDATE не остался примененным наполовину
   for (const auto& p : values) {
-    if (!columns_.contains(p.first)) {
+    auto it = columns_.find(p.first);
+    if (it == columns_.end()) {
       throw std::logic_error("No column with given name");
     }
+    if (p.second != "NULL") {
+      Cast(p.second, it->second.type());
+    }
+  }
+  std::vector<size_t> sat_rows = Filter(filters);
+  if (before) {
+    before(sat_rows);
+  }
+  for (const auto& p : values) {
+    Touch();
+    std::vector<size_t> from = p.first == partition_key_ ? PartitionsOf(sat_rows) : std::vector<size_t>();
     columns_[p.first].Update(sat_rows, p.second);
+    if (p.first == partition_key_) {
+      Reroute(sat_rows, from);
+    }
   }
+  return sat_rows;
 }
 
-void Table::Delete(const std::vector<Token>& filters) {
-  std::vector<size_t> sat_rows;
-  for (size_t i = 0; i < n_rows_; ++i) {
-    if (Check(filters, i)) {
-      sat_rows.push_back(i);
+std::vector<size_t> Table::Delete(const std::vector<Token>& filters) {
+  std::vector<size_t> sat_rows = Filter(filters);
+  Erase(sat_rows);
+  return sat_rows;
+}
+
+void Table::Erase(const std::vector<size_t>& rows) {
+  Touch();
+  for (auto& p : columns_) {
+    p.second.Delete(rows);
+  }
+  n_rows_ -= rows.size();
+  for (auto& partition : partitions_) {
+    size_t next = 0;
+    for (size_t row : partition) {
+      auto before = std::lower_bound(rows.begin(), rows.end(), row);
+      if (before == rows.end() || *before != row) {
+        partition[next++] = row - static_cast<size_t>(before - rows.begin());
+      }
     }
+    partition.resize(next);
   }
-  for (auto& p : columns_) {
-    p.second.Delete(sat_rows);
+}
+
+Table Table::SelectRows(const std::vector<size_t>& rows, std::shared_ptr<TrackingResource> memory) const {
+  Table result(std::move(memory));
+  for (const auto& name : column_names_) {
+    result.EmplaceColumn(name, columns_.at(name).Select(rows, result.memory_));
   }
-  n_rows_ -= sat_rows.size();
+  result.n_rows_ = rows.size();
+  return result;
 }
 
 void Table::DeleteAll() {
+  Touch();
   for (auto& c : columns_) {
     c.second.DeleteAll();
   }
   n_rows_ = 0;
+  for (auto& partition : partitions_) {
+    partition.clear();
+  }
+}
+
+void Table::Truncate(size_t n_rows) {
+  Touch();
+  for (auto& c : columns_) {
+    c.second.Truncate(n_rows);
+  }
+  n_rows_ = n_rows;
+  for (auto& partition : partitions_) {
+    while (!partition.empty() && partition.back() >= n_rows) {
+      partition.pop_back();
+    }
+  }
+}
+
+void Table::Restore(const std::vector<size_t>& rows, const std::vector<std::pair<std::string, Column>>& values) {
+  Touch();
+  for (const auto& [name, column] : values) {
+    std::vector<size_t> from = name == partition_key_ ? PartitionsOf(rows) : std::vector<size_t>();
+    columns_.at(name).Restore(rows, column);
+    if (name == partition_key_) {
+      Reroute(rows, from);
+    }
+  }
+}
+
+void Table::Reinsert(const std::vector<size_t>& rows, const Table& values) {
+  Touch();
+  for (auto& [name, column] : columns_) {
+    column.Reinsert(rows, values.column(name));
+  }
+  n_rows_ += rows.size();
+  if (partitions_.empty()) {
+    return;
+  }
+  // обратное к Erase: прежняя строка r сдвигается на число вставленных перед ней,
+  // то есть строк rows[j], для которых rows[j] - j <= r
+  std::vector<size_t> shifted(rows.size());
+  for (size_t j = 0; j < rows.size(); ++j) {
+    shifted[j] = rows[j] - j;
+  }
+  for (auto& partition : partitions_) {
+    for (size_t& row : partition) {
+      row += static_cast<size_t>(std::upper_bound(shifted.begin(), shifted.end(), row) - shifted.begin());
+    }
+  }
+  const Column& key = columns_.at(partition_key_);
+  std::vector<std::vector<size_t>> added(partitions_.size());
+  for (size_t row : rows) {
+    added[PartitionOf(key[row])].push_back(row);
+  }
+  for (size_t p = 0; p < partitions_.size(); ++p) {
+    auto& partition = partitions_[p];
+    size_t middle = partition.size();
+    partition.insert(partition.end(), added[p].begin(), added[p].end());
+    std::inplace_merge(partition.begin(), partition.begin() + static_cast<ptrdiff_t>(middle), partition.end());
+  }
 }
 
 bool Table::ContainsColumn(const std::string& column) const {
   return columns_.contains(column);
 }
 
-Table Table::Join(Table& table, const Column& column1, const Column& column2, bool is_inner) {
-  Table res;
+size_t Table::size() const {
+  return n_rows_;
+}
 
-  for (const auto& c : columns_) {
-    res.AddColumn(c);
+TableMemoryStats Table::MemoryUsage() const {
+  TableMemoryStats stats;
+  stats.rows = n_rows_;
+  if (memory_) {
+    stats.tracked_bytes = memory_->used();
+    stats.memory_limit = memory_->limit();
   }
-
-  for (const auto& c : table.columns_) {
-    res.AddColumn(c);
+  for (const auto& name : column_names_) {
+    size_t bytes = columns_.at(name).memory_usage() + name.capacity();
+    stats.columns.push_back({name, bytes});
+    stats.bytes += bytes;
   }
+  return stats;
+}
 
-  for (size_t i = 0; i < column1.size(); ++i) {
-    bool found = false;
-    size_t j = 0;
-    for (; j < column2.size(); ++j) {
-      if (column1[i] == column2[j]) {
-        found = true;
-        break;
-      }
-    }
-    if (found || !is_inner) {
-      for (const auto& c : columns_) {
-        res.columns_[c.first].PushValue(c.second[i]);
-      }
-      for (const auto& c : table.columns_) {
-        if (!found) {
-          res.columns_[c.first].PushValue({});
-        } else {
-          res.columns_[c.first].PushValue(c.second[j]);
-        }
+Table Table::Combine(const std::vector<const Table*>& tables,
+                     const std::vector<const std::vector<std::string>*>& columns,
+                     const std::vector<std::pmr::vector<size_t>>& rows,
+                     std::shared_ptr<TrackingResource> memory) {
+  Table res(std::move(memory));
+  for (size_t t = 0; t < tables.size(); ++t) {
+    for (const auto& name : *columns[t]) {
+      if (res.columns_.contains(name)) {
+        continue;
       }
-      ++res.n_rows_;
+      Column target = tables[t]->column(name).Select(rows[t], res.memory_);
+      target.SetNotNull(true);
+      res.EmplaceColumn(name, std::move(target));
     }
   }
-
+  res.n_rows_ = rows.empty() ? 0 : rows[0].size();
   return res;
 }
-const Column& Table::operator[](const std::string& key) {
-  return columns_[key];
+
+void Table::Order(const std::vector<const Table*>& tables,
+                  const std::vector<const std::vector<std::string>*>& columns,
+                  std::vector<std::pmr::vector<size_t>>& rows,
+                  const std::vector<std::pair<std::string, bool>>& order,
+                  const std::shared_ptr<TrackingResource>& memory,
+                  const std::shared_ptr<TrackingResource>& work, SpillStats& spill) {
+  std::vector<Column> keys;
+  std::vector<bool> descending;
+  keys.reserve(order.size());
+  for (const auto& [name, desc] : order) {
+    size_t t = 0;
+    while (t < tables.size() && std::find(columns[t]->begin(), columns[t]->end(), name) == columns[t]->end()) {
+      ++t;
+    }
+    if (t == tables.size()) {
+      throw std::logic_error("No column with given name");
+    }
+    keys.push_back(tables[t]->column(name).Select(rows[t], memory));
+    descending.push_back(desc);
+  }
+  std::vector<const Column*> key_columns;
+  for (const auto& key : keys) {
+    key_columns.push_back(&key);
+  }
+  size_t n_rows = rows.empty() ? 0 : rows[0].size();
+  std::pmr::vector<size_t> sorted(memory.get());
+  sorted.reserve(n_rows);
+  SortRows(key_columns, descending, n_rows, work, spill, [&sorted](size_t i) { sorted.push_back(i); });
+  keys.clear();
+  for (auto& selection : rows) {
+    std::pmr::vector<size_t> permuted(selection.get_allocator());
+    permuted.reserve(n_rows);
+    for (size_t i : sorted) {
+      permuted.push_back(selection[i]);
+    }
+    selection = std::move(permuted);
+  }
 }
 
 void Table::GetData(std::ofstream& f) const {
   f << columns_.size() << '\t' << n_rows_ << '\n';
-  for (const auto& c : columns_) {
-    f << c.first << '\t';
-    c.second.GetData(f);
+  for (const auto& name : column_names_) {
+    f << name << '\t';
+    columns_.at(name).GetData(f);
   }
 }
 
-void Table::SetData(std::ifstream& f) {
+void Table::SetData(std::istream& f) {
   size_t n;
   f >> n;
   f >> n_rows_;
   for (size_t i = 0; i < n; ++i) {
     std::string name;
     f >> name;
-    columns_.emplace(name, Column());
+    EmplaceColumn(name, Column(kInt, 0, false, memory_));
     columns_[name].SetData(f);
   }
+  Route(0);
+}
+
+void Table::SetColumns(std::vector<std::pair<std::string, Column>>&& columns, size_t n_rows) {
+  for (auto& [name, column] : columns) {
+    if (column.size() != n_rows) {
+      throw std::logic_error("Column '" + name + "' has " + std::to_string(column.size()) + " rows instead of "
+                                 + std::to_string(n_rows));
+    }
+    EmplaceColumn(name, Column(std::move(column)));
+  }
+  n_rows_ = n_rows;
+  Route(0);
 }
 
 void Table::AddColumn(const std::pair<std::string, Column>& column) {
-  columns_.emplace(column);
+  if (!columns_.contains(column.first)) {
+    EmplaceColumn(column.first, Column(column.second, memory_));
+  }
+}
+
+void Table::EmplaceColumn(const std::string& name, Column&& column) {
+  Touch();
+  if (columns_.emplace(name, std::move(column)).second) {
+    column_names_.push_back(name);
+  }
+}
+
+const std::vector<std::string>& Table::column_names() const {
+  return column_names_;
+}
+
+const Column& Table::column(const std::string& name) const {
+  auto it = columns_.find(name);
+  if (it == columns_.end()) {
+    throw std::logic_error("No column with given name");
+  }
+  return it->second;
+}
+
+const std::shared_ptr<TrackingResource>& Table::memory() const {
+  return memory_;
+}
+
+bool Table::dirty() const {
+  return dirty_;
+}
+
+uint64_t Table::version() const {
+  return version_;
+}
+
+uint64_t Table::NewVersion() {
+  static std::atomic<uint64_t> next = 0;
+  return ++next;
+}
+
+Table::Marks Table::marks() const {
+  Marks marks{version_, dirty_, {}};
+  for (const auto& [name, column] : columns_) {
+    marks.columns.emplace(name, column.marks());
+  }
+  return marks;
+}
+
+void Table::RestoreMarks(Marks marks) {
+  version_ = marks.version;
+  dirty_ = marks.dirty;
+  for (auto& [name, column] : marks.columns) {
+    columns_.at(name).RestoreMarks(std::move(column));
+  }
+}
+
+void Table::Touch() {
+  dirty_ = true;
+  version_ = NewVersion();
+}
+
+void Table::ClearDirty() {
+  for (auto& c : columns_) {
+    c.second.ClearDirty();
+  }
+  dirty_ = false;
 }
 
 Value Cast(const std::string& value, DataType type) {
@@ -589,3 +3267,48 @@ Value Cast(const std::string& value, DataType type) {
   }
   return res;
 }
+
+size_t ValueIndex(DataType type) {
+  switch (type) {
+    case kInt:
+      return 1;
+    case kDouble:
+      return 2;
+    case kFloat:
+      return 3;
+    case kBool:
+      return 4;
+    case kVarchar:
+      return 5;
+  }
+  return 0;
+}
+
+std::string ToString(const Value& value) {
+  char buf[32];
+  switch (value.index()) {
+    case 0:
+      return "NULL";
+    case 1:
+      return std::to_string(std::get<int>(value));
+    case 2:
+      return {buf, std::to_chars(buf, buf + sizeof(buf), std::get<double>(value)).ptr};
+    case 3:
+      return {buf, std::to_chars(buf, buf + sizeof(buf), std::get<float>(value)).ptr};
+    case 4:
+      return std::get<bool>(value) ? "1" : "0";
+    default:
+      return std::get<std::string>(value);
+  }
+}
+
+size_t Hash(const Value& value) {
+  return std::visit([](const auto& v) -> size_t {
+    using T = std::decay_t<decltype(v)>;
+    if constexpr (std::is_same_v<T, MyMonostate>) {
+      return 0;
+    } else {
+      return std::hash<T>()(v);
+    }
+  }, value);
+}
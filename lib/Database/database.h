@@ -1,14 +1,35 @@
+#pragma once
+
+#include <charconv>
 #include <chrono>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <fstream>
+#include <functional>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <span>
 
 #include <ranges>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <variant>
 
+#include "../Memory/tracking_resource.h"
 #include "../Parser/sql_parser.h"
+#include "../Scheduler/cancellation.h"
+#include "../Scheduler/future.h"
+#include "../Scheduler/query_scheduler.h"
+#include "sketch.h"
+#include "checkpoint.h"
+#include "compression.h"
+#include "predicate.h"
+#include "../Stats/stats.h"
 
 class MyMonostate : public std::monostate {
  public:
@@ -17,54 +38,275 @@ class MyMonostate : public std::monostate {
 
 using Value = std::variant<MyMonostate, int, double, float, bool, std::string>;
 
+/// хеш, согласованный с operator== для Value
+size_t Hash(const Value& value);
+
+struct ValueHash {
+  size_t operator()(const Value& value) const {
+    return Hash(value);
+  }
+};
+
+/// номер строки в выборке, на месте которого стоит NULL (строка внешнего соединения без пары)
+constexpr size_t kNoRow = std::numeric_limits<size_t>::max();
+
+/// значения колонки лежат в ресурсе памяти memory (nullptr — без учета),
+/// копия колонки учитывается в том же ресурсе, что и оригинал.
+/// Значения int и bool колонок хранятся полными блоками по kBlockRows в сжатом виде
+/// (EncodedBlock), последний неполный блок и колонки остальных типов — как Value.
 class Column {
  public:
+  /// единица учета изменений для инкрементальных чекпоинтов
+  static constexpr size_t kBlockRows = 4096;
+  /// сегмент, на который хранится один набросок ColumnSketch
+  static constexpr size_t kSketchRows = 16 * kBlockRows;
+
   Column() = default;
-  explicit Column(DataType type, size_t max_len, bool can_be_null);
+  explicit Column(DataType type, size_t max_len, bool can_be_null,
+                  std::shared_ptr<TrackingResource> memory = nullptr);
+  /// копия данных в другом ресурсе памяти
+  Column(const Column& other, std::shared_ptr<TrackingResource> memory);
+  Column(const Column& other);
+  Column(Column&& other) noexcept;
+  Column& operator=(const Column& other);
+  Column& operator=(Column&& other);
+  ~Column();
   void SetNotNull(bool status);
   void SetIsPrimary(bool is_primary);
-  const Value& operator[](size_t id) const;
+  /// хеш-индекс значений; у первичного ключа есть всегда, строится при первом поиске
+  void SetIndexed(bool indexed);
+  Value operator[](size_t id) const;
   size_t max_len_of_value() const;
   DataType type() const;
+  bool is_primary() const;
+  bool not_null() const;
+  /// значения не убывают в порядке строк (NULL — в начале); сбрасывается при UPDATE
+  bool sorted() const;
   size_t size() const;
+  size_t blocks() const;
+  /// блок изменился после последнего ClearDirty
+  bool IsDirty(size_t block) const;
+  void ClearDirty();
+  /// отметки изменений и упорядоченности; откат транзакции возвращает их вместе со строками
+  struct Marks {
+    std::vector<bool> dirty_blocks;
+    bool sorted = true;
+  };
+  Marks marks() const;
+  void RestoreMarks(Marks marks);
+  size_t memory_usage() const;
   void PushValue(const Value& value);
   void EmplaceValue(const std::string& value);
-  Column Select(const std::vector<size_t>& idx);
+  /// проверка типа, NULL и уникальности первичного ключа без вставки
+  void CheckValue(const Value& value) const;
+  /// число строк со значением value (NULL не считается); с индексом — за O(1)
+  size_t Count(const Value& value) const;
+  bool Contains(const Value& value) const;
+  void AppendValue(const Value& value);
+  /// out[i] = (значение i op constant); сжатые блоки сравниваются без распаковки
+  void Match(TokenType op, const Value& constant, std::vector<uint8_t>& out) const;
+  /// out[i] = (значение i IS NULL) или IS NOT NULL по битовой карте, без чтения значений
+  void MatchNull(bool is_null, std::vector<uint8_t>& out) const;
+  /// номера строк с NULL (или без NULL) по словам битовой карты
+  std::vector<size_t> NullRows(bool is_null) const;
+  size_t null_count() const;
+  /// out[i] = filter.MayContain(Hash(значение i)), NULL — 0; сжатые блоки распаковываются
+  /// целиком, без сборки Value на каждую строку
+  void MatchBloom(const BloomFilter& filter, std::vector<uint8_t>& out) const;
+  /// наброски APPROX_* по строкам rows; без rows — по всей колонке, из наброска каждого
+  /// сегмента, который строится один раз и живет до изменения сегмента
+  ColumnSketch Sketch(const std::vector<size_t>* rows = nullptr) const;
+  /// значения в строках idx, kNoRow дает NULL
+  Column Select(std::span<const size_t> idx, std::shared_ptr<TrackingResource> memory = nullptr) const;
   void Update(const std::vector<size_t>& idx, const std::string& value);
+  /// в строку idx[k] записывается values[k] (откат UPDATE)
+  void Restore(const std::vector<size_t>& idx, const Column& values);
   void Delete(const std::vector<size_t>& idx);
+  /// values[k] встает на место idx[k]; idx по возрастанию, номера после вставки (откат DELETE)
+  void Reinsert(const std::vector<size_t>& idx, const Column& values);
   void DeleteAll();
+  /// оставляет первые n значений, используется для отката частично вставленных строк
+  void Truncate(size_t n);
   void GetData(std::ofstream& f) const;
-  void SetData(std::ifstream& f);
+  void SetData(std::istream& f);
  private:
-  DataType type_;
+  /// байты строки вне Value, которые не проходят через ресурс памяти
+  static size_t HeapBytes(const Value& value);
+  static std::pmr::memory_resource* Resource(const std::shared_ptr<TrackingResource>& memory);
+  size_t sealed_rows() const;
+  int64_t ToInteger(const Value& value) const;
+  Value FromInteger(int64_t value) const;
+  /// сжимает полные блоки из начала values_
+  void Seal();
+  /// распаковывает блоки, начиная с block, обратно в values_
+  void Unseal(size_t block);
+  /// блок из чекпоинта; если колонка не на границе сжатых блоков, значения распаковываются
+  void AppendBlock(EncodedBlock&& block);
+  void Store(const Value& value);
+  /// в строку idx[k] записывается value(k); сжатые блоки пересобираются по разу
+  template <typename F>
+  void Assign(const std::vector<size_t>& idx, F&& value);
+  bool Indexed() const;
+  void BuildIndex() const;
+  void IndexAdd(const Value& value);
+  void IndexRemove(const Value& value);
+  /// индекс перестраивается при следующем поиске
+  void DropIndex() const;
+  void MarkDirty(size_t row);
+  /// сдвиг или усечение значений меняет все блоки, начиная с row
+  void MarkDirtyFrom(size_t row);
+  /// бит строки row в validity_; слово под нее добавляется, если его нет
+  void SetValid(size_t row, bool valid);
+  void AddToSketch(ColumnSketch& sketch, const Value& value) const;
+  ColumnSketch BuildSketch(size_t segment) const;
+  /// сбрасывает наброски сегментов, начиная с того, где лежит row; last — только этот сегмент
+  void DropSketches(size_t row, bool last) const;
+  void Charge(size_t bytes);
+  void Discharge(size_t bytes);
+  std::shared_ptr<TrackingResource> memory_;
+  DataType type_ = kInt;
   size_t max_len_of_value_ = 0;
   bool is_primary_ = false;
   bool not_null_ = true;
-  std::vector<Value> values_;
+  /// false, если в колонку попали значения другого типа: тогда все хранится как Value
+  bool compressible_ = true;
+  bool sorted_ = true;
+  std::pmr::vector<EncodedBlock> sealed_{Resource(memory_)};
+  /// строки после сжатых блоков
+  std::pmr::vector<Value> values_{Resource(memory_)};
+  size_t heap_bytes_ = 0;
+  /// бит на строку, 1 — значение не NULL; слов может быть больше нужного, лишние биты нулевые
+  std::pmr::vector<uint64_t> validity_{Resource(memory_)};
+  std::vector<bool> dirty_blocks_;
+  bool indexed_ = false;
+  /// значение -> число строк с ним; действителен при index_built_
+  mutable std::pmr::unordered_map<Value, size_t, ValueHash> index_{Resource(memory_)};
+  mutable bool index_built_ = false;
+  /// кеш наброска по сегментам: заполняется читателями под общей блокировкой базы, поэтому
+  /// со своим мьютексом; изменения колонки идут под исключительной и читателей не встречают
+  struct SketchCache {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<const ColumnSketch>> segments;
+  };
+  /// nullptr только у перемещенной колонки
+  std::unique_ptr<SketchCache> sketches_ = std::make_unique<SketchCache>();
+  friend class Checkpointer;
 };
 
+struct SpillStats;
+
 class Table {
  public:
   Table() = default;
+  /// колонки таблицы размещаются в memory и списываются с его лимита
+  explicit Table(std::shared_ptr<TrackingResource> memory);
+  /// копия таблицы в другом ресурсе памяти
+  Table(const Table& other, std::shared_ptr<TrackingResource> memory);
   void SetPrimaryKey(const std::string& primary_key);
+  /// ограничение хранится в таблице, проверяет его Database; столбец получает хеш-индекс
+  void AddForeignKey(const ForeignKey& key);
+  const std::vector<ForeignKey>& foreign_keys() const;
+  /// PARTITION BY HASH: строки распределяются по n разделам по хешу столбца key.
+  /// Хранение общее, раздел — список номеров своих строк; он поддерживается при вставке,
+  /// удалении и изменении ключа
+  void SetPartitioning(const std::string& key, size_t n);
+  /// пусто, если таблица не разбита
+  const std::string& partition_key() const;
+  /// номера строк каждого раздела по возрастанию
+  const std::vector<std::vector<size_t>>& partitions() const;
+  size_t PartitionOf(const Value& key) const;
   friend std::ostream& operator<<(std::ostream& stream, const Table& response);
-  const Column& operator[](const std::string& key);
   void CreateColumn(const std::tuple<std::string, DataType, size_t, bool>& info);
   void AddColumn(const std::pair<std::string, Column>& column);
   void CreateRow(std::unordered_map<std::string, std::string>& info);
-  Table Select(const std::vector<std::string>& columns, const std::vector<Token>& filters = std::vector<Token>());
-  Table Join(Table& table, const Column& column1, const Column& column2, bool is_inner);
-  void Update(const std::unordered_map<std::string, std::string>& values, const std::vector<Token>& filters);
-  void Delete(const std::vector<Token>& filters);
+  void CreateRows(const std::vector<std::string>& columns, const std::vector<std::vector<std::string>>& rows);
+  /// типизированная строка в порядке схемы, вставляется целиком или не вставляется
+  void AppendRow(const std::vector<Value>& row);
+  /// результат размещается в memory, обычно в ресурсе запроса
+  Table Select(const std::vector<std::string>& columns, const std::vector<Token>& filters = std::vector<Token>(),
+               std::shared_ptr<TrackingResource> memory = nullptr) const;
+  /// Собирает результат по выборке: rows[t][i] — строка tables[t] в i-й строке (kNoRow — NULL).
+  /// Значения копируются только здесь, по столбцу за раз; из одноименных столбцов остается первый.
+  static Table Combine(const std::vector<const Table*>& tables,
+                       const std::vector<const std::vector<std::string>*>& columns,
+                       const std::vector<std::pmr::vector<size_t>>& rows,
+                       std::shared_ptr<TrackingResource> memory);
+  /// ORDER BY по столбцам будущего результата Combine: в memory собираются только ключи
+  /// сортировки, переставляются номера строк в rows; рабочая память сортировки берется из work
+  static void Order(const std::vector<const Table*>& tables,
+                    const std::vector<const std::vector<std::string>*>& columns,
+                    std::vector<std::pmr::vector<size_t>>& rows,
+                    const std::vector<std::pair<std::string, bool>>& order,
+                    const std::shared_ptr<TrackingResource>& memory,
+                    const std::shared_ptr<TrackingResource>& work, SpillStats& spill);
+  /// возвращают номера измененных строк (для Delete — до удаления);
+  /// before получает номера строк Update после проверок, но до первого изменения
+  std::vector<size_t> Update(const std::unordered_map<std::string, std::string>& values,
+                             const std::vector<Token>& filters,
+                             const std::function<void(const std::vector<size_t>&)>& before = nullptr);
+  std::vector<size_t> Delete(const std::vector<Token>& filters);
+  /// удаляет строки с данными номерами, номера по возрастанию
+  void Erase(const std::vector<size_t>& rows);
   void DeleteAll();
+  /// отбрасывает строки начиная с n_rows (откат вставок)
+  void Truncate(size_t n_rows);
+  /// записывает прежние значения столбцов в строки rows (откат UPDATE)
+  void Restore(const std::vector<size_t>& rows, const std::vector<std::pair<std::string, Column>>& values);
+  /// возвращает удаленные строки rows (номера до удаления, по возрастанию) с содержимым values (откат DELETE)
+  void Reinsert(const std::vector<size_t>& rows, const Table& values);
+  /// номера строк, удовлетворяющих фильтру; сравнения столбца с константой
+  /// вычисляются сразу для всей колонки
+  std::vector<size_t> Filter(const std::vector<Token>& filters) const;
+  /// все колонки в строках rows
+  Table SelectRows(const std::vector<size_t>& rows, std::shared_ptr<TrackingResource> memory = nullptr) const;
   bool ContainsColumn(const std::string& column) const;
+  size_t size() const;
+  TableMemoryStats MemoryUsage() const;
+  const std::vector<std::string>& column_names() const;
+  const Column& column(const std::string& name) const;
+  const std::shared_ptr<TrackingResource>& memory() const;
+  /// таблица изменилась после последнего ClearDirty
+  bool dirty() const;
+  void ClearDirty();
+  /// меняется при каждом изменении; версии берутся из общего счетчика,
+  /// поэтому у разных таблиц (и у пересозданной таблицы) они не совпадают
+  uint64_t version() const;
+  /// версия и отметки изменений таблицы и колонок; после отката транзакции они возвращаются,
+  /// и для кеша результатов и инкрементального чекпоинта таблица не менялась
+  struct Marks {
+    uint64_t version = 0;
+    bool dirty = false;
+    std::unordered_map<std::string, Column::Marks> columns;
+  };
+  Marks marks() const;
+  void RestoreMarks(Marks marks);
   void GetData(std::ofstream& f) const;
-  void SetData(std::ifstream& f);
+  void SetData(std::istream& f);
+  /// колонки, разобранные отдельно (например, параллельно), в порядке схемы
+  void SetColumns(std::vector<std::pair<std::string, Column>>&& columns, size_t n_rows);
  private:
-  bool Compare(TokenType op, const Value& a, const Value& b);
-  bool Check(const std::vector<Token>& filters, size_t row);
+  static uint64_t NewVersion();
+  void Touch();
+  void EmplaceColumn(const std::string& name, Column&& column);
+  /// распределяет по разделам строки начиная с first_row (с нуля — заново, только при загрузке
+  /// и смене разбиения); изменения строк правят лишь затронутые разделы
+  void Route(size_t first_row);
+  /// разделы строк rows по текущему значению ключа; пусто, если таблица не разбита
+  std::vector<size_t> PartitionsOf(const std::vector<size_t>& rows) const;
+  /// переносит строки rows (по возрастанию), лежавшие в разделах from, в разделы по новому ключу
+  void Reroute(const std::vector<size_t>& rows, const std::vector<size_t>& from);
+  /// строки с ключом key из одного раздела, если фильтр — ровно partition_key = константа
+  std::optional<std::vector<size_t>> PruneFilter(const std::vector<Token>& filters) const;
+  std::shared_ptr<TrackingResource> memory_;
   std::unordered_map<std::string, Column> columns_;
+  std::vector<std::string> column_names_;
   size_t n_rows_ = 0;
+  std::vector<ForeignKey> foreign_keys_;
+  std::string partition_key_;
+  std::vector<std::vector<size_t>> partitions_;
+  bool dirty_ = true;
+  uint64_t version_ = NewVersion();
+  friend class Checkpointer;
 };
 
 class Response {
@@ -72,6 +314,10 @@ class Response {
   Response() = default;
   explicit Response(const std::string& msg);
   explicit Response(const Table& table);
+  explicit Response(Table&& table);
+  bool is_table() const;
+  const std::string& message() const;
+  const Table& table() const;
   friend std::ostream& operator<<(std::ostream& stream, const Response& response);
  private:
   enum Type {
@@ -82,20 +328,194 @@ class Response {
   std::variant<std::string, Table> data_;
 };
 
+struct OpenOptions {
+  /// потоки, читающие колонки; 0 — по числу ядер
+  size_t threads = 0;
+  /// таблицы регистрируются сразу, а читаются при первом обращении к ним
+  bool lazy = false;
+};
+
+struct ResultCacheOptions {
+  /// суммарный размер результатов; 0 — кеш выключен
+  size_t max_bytes = 0;
+  size_t max_entries = 1024;
+};
+
+struct QueryOptions {
+  /// номер для Database::Cancel, выбирает вызывающий; 0 — запрос нельзя отменить по номеру
+  uint64_t id = 0;
+  /// дедлайн от приема запроса; 0 — SchedulerOptions::query_timeout
+  std::chrono::milliseconds timeout{0};
+};
+
+struct SaveProgress {
+  size_t tables_written = 0;
+  size_t tables_total = 0;
+  size_t rows_written = 0;
+  size_t rows_total = 0;
+  bool done = false;
+};
+
+class MaterializedView;
+class UndoLog;
+class ResultCache;
+class Session;
+
 class Database {
  public:
   Database() = default;
-  Response Execute(const std::string& query);
+  Response Execute(const std::string& query, const QueryOptions& options = QueryOptions());
+  /// разбор в вызывающем потоке, исполнение в планировщике; ошибки приходят через Future
+  Future<Response> ExecuteAsync(std::string query, const QueryOptions& options = QueryOptions());
+  /// Отменяет принятый и еще не завершенный запрос; false, если запроса с таким номером нет.
+  /// SELECT прерывается на ближайшей границе блока, изменения — только до начала,
+  /// чтобы не остаться примененными наполовину. Запрос завершается QueryCancelledError.
+  bool Cancel(uint64_t query_id);
+  /// заменяет планировщик; уже принятые запросы старого планировщика дорабатывают
+  void ConfigureScheduler(const SchedulerOptions& options);
+  /// новые лимиты действуют на следующие аллокации, уже занятая память не освобождается
+  void ConfigureMemory(const MemoryOptions& options);
+  /// кеш результатов SELECT; сбрасывается при каждом вызове
+  void ConfigureResultCache(const ResultCacheOptions& options);
+  /// бюджет таблицы (0 — без ограничения), действует вместе с глобальным лимитом
+  void SetTableMemoryLimit(const std::string& table, size_t bytes);
   void Save(const std::string& file_name);
-  void Open(const std::string& file_name);
+  /// Снимок на момент вызова пишет дочерний процесс (fork): страницы памяти делятся
+  /// с копированием при записи, поэтому запросы и изменения продолжаются без паузы.
+  /// on_progress вызывается из фонового потока после каждой таблицы и по завершении.
+  /// Одновременно идет не больше одного сохранения.
+  Future<SaveProgress> SaveAsync(const std::string& file_name,
+                                 std::function<void(const SaveProgress&)> on_progress = nullptr);
+  void Open(const std::string& file_name, const OpenOptions& options = OpenOptions());
+  /// пишет в directory только таблицы и блоки, измененные с прошлого чекпоинта,
+  /// периодически — полный чекпоинт со сборкой мусора
+  CheckpointStats Checkpoint(const std::string& directory, const CheckpointOptions& options = CheckpointOptions());
+  /// заменяет содержимое базы последним чекпоинтом из directory
+  void OpenCheckpoint(const std::string& directory, const OpenOptions& options = OpenOptions());
+  DatabaseStats Stats() const;
+  /// таблица только для чтения в обход блокировок, не использовать параллельно с ExecuteAsync
+  const Table& GetTable(const std::string& name);
+  /// типизированная вставка строки в порядке схемы: блокировка, внешние ключи,
+  /// представления и версия таблицы — как у INSERT
+  void AppendRow(const std::string& table, const std::vector<Value>& row);
+  /// типизированный аналог SELECT без разбора текста запроса
+  Table Scan(const std::string& table, const std::vector<std::string>& columns,
+             const Predicate& where = Predicate());
  private:
+  /// корень учета: от него считаются таблицы и промежуточные результаты запросов
+  std::shared_ptr<TrackingResource> memory_ = std::make_shared<TrackingResource>("database");
+  std::atomic<size_t> query_memory_limit_ = 0;
+  std::atomic<size_t> operator_memory_limit_ = 0;
   std::unordered_map<std::string, Table> tables_;
+  Metrics metrics_;
+  mutable std::shared_mutex mutex_;
+  std::mutex checkpoint_mutex_;
+  Checkpointer checkpointer_;
+  std::mutex scheduler_mutex_;
+  SchedulerOptions scheduler_options_;
+  /// запросы с номером; запись живет, пока запрос держит свой token
+  std::unordered_map<uint64_t, std::weak_ptr<CancellationToken>> running_;
+  std::mutex running_mutex_;
+  /// таблицы, открытые лениво и еще не прочитанные
+  struct PendingTable {
+    LazyTable table;
+    std::mutex mutex;
+    bool loaded = false;
+  };
+  std::unordered_map<std::string, std::shared_ptr<PendingTable>> pending_;
+  mutable std::mutex pending_mutex_;
+  /// материализованные представления; их содержимое — таблицы в tables_ под тем же именем
+  std::unordered_map<std::string, std::shared_ptr<MaterializedView>> views_;
+  /// журнал отката транзакции, которую ApplyTransaction применяет под mutex_; иначе nullptr
+  UndoLog* undo_ = nullptr;
+  /// SELECT внутри транзакции: ее изменения не переносятся в представления
+  bool skip_views_ = false;
+  /// nullptr, пока кеш не включен; заменяется под mutex_
+  std::shared_ptr<ResultCache> result_cache_;
+  std::atomic<bool> saving_ = false;
+  std::jthread save_thread_;
+  /// объявлен последним, чтобы остановиться раньше, чем разрушатся таблицы
+  std::shared_ptr<QueryScheduler> scheduler_;
+  static std::string SavePath(const std::string& file_name);
+  /// читает отложенную таблицу; вызывается без mutex_, до начала работы с таблицей
+  void Materialize(const std::string& table);
+  void MaterializeAll();
+  /// table и таблицы, связанные с ней внешними ключами в любую сторону
+  void MaterializeRelated(const std::string& table);
+  /// таблицы, которые читает или меняет запрос
+  void MaterializeFor(const Query& q);
+  /// заменяет таблицы базы; отложенные таблицы прежнего содержимого забываются
+  void Replace(std::unordered_map<std::string, Table>&& tables,
+               std::unordered_map<std::string, LazyTable>&& pending);
+  Table& FindTable(const std::string& name);
+  /// исполняется в дочернем процессе SaveAsync; возвращает errno или 0
+  int WriteSnapshot(const std::string& file_name, int progress_fd) const;
+  /// token отмены с дедлайном от start; nullptr, если запрос нельзя ни отменить, ни просрочить
+  std::shared_ptr<CancellationToken> StartQuery(const QueryOptions& options,
+                                                std::chrono::steady_clock::time_point start);
+  /// query — текст запроса для кеша результатов, пустой — без кеша;
+  /// без token действует дедлайн по умолчанию из SchedulerOptions
+  Response ExecuteQuery(Query& q, std::chrono::steady_clock::time_point start, const std::string& query = "",
+                        std::shared_ptr<CancellationToken> token = nullptr);
+  /// исполняет run в планировщике; отказ планировщика приходит ошибкой через Future
+  Future<Response> Submit(QueryClass query_class, std::function<Response()> run);
+  /// Изменения транзакции применяются подряд под одной блокировкой записи, затронутые строки
+  /// пишутся в UndoLog. Затем исполняется read (если есть). При ошибке или commit = false
+  /// журнал откатывается, таблицы получают прежние версии. Для read (commit = false)
+  /// представления не ведутся: читаемые им зависимые представления строятся на время запроса.
+  /// При ошибке COMMIT зависящие от измененных таблиц представления пересчитываются.
+  Response ApplyTransaction(std::vector<Query>& writes, Query* read, bool commit);
+  /// версии таблиц, которые читает SELECT; пусто, если какой-то таблицы нет
+  std::vector<uint64_t> Versions(const SerializerForSelect& info) const;
+  Response Run(Query& q);
+  DatabaseStats StatsLocked() const;
+  QueryClass Classify(const Query& q) const;
+  QueryClass ClassifyScan(const std::string& table, bool is_join) const;
+  std::shared_ptr<QueryScheduler> Scheduler();
+  std::shared_ptr<TrackingResource> TableMemory(const std::string& table);
+  std::shared_ptr<TrackingResource> QueryMemory();
+  /// рабочая память одного оператора запроса с лимитом operator_memory
+  std::shared_ptr<TrackingResource> WorkMemory(const std::shared_ptr<TrackingResource>& query);
   Response CreateTable(const SerializerForCreate& info);
+  /// внешние ключи строк table начиная с first_row; проверка после вставки всех строк
+  /// оператора, поэтому строки одной вставки могут ссылаться друг на друга
+  void CheckForeignKeys(const std::string& table, size_t first_row);
+  /// строки rows таблицы table удаляются или меняют первичный ключ: на их ключи
+  /// не должно остаться ссылок; при deleting не считаются ссылки из самих удаляемых строк
+  void CheckReferences(const std::string& table, const std::vector<size_t>& rows, bool deleting);
+  bool IsReferenced(const std::string& table) const;
+  Response CreateView(const SerializerForCreate& info);
+  /// бросает std::logic_error для представлений: их меняют только источники
+  void CheckWritable(const std::string& table) const;
+  /// переносит изменение table в зависящие представления; при ошибке представление пересчитывается
+  void MaintainViews(const std::string& table, const std::function<void(MaterializedView&, Table&)>& apply);
   Response DropTable(const SerializerForDrop& info);
   Response Insert(SerializerForInsert& info);
   Response Select(SerializerForSelect& info);
+  /// APPROX_*: одна строка по наброскам колонок table, без WHERE — из кеша сегментов
+  Response Aggregate(const SerializerForSelect& info, const Table& table);
+  /// номера строк соединения трех и более таблиц; tables — table_name1, table_name2 и таблицы joins
+  std::vector<std::pmr::vector<size_t>> MultiJoinRows(const SerializerForSelect& info,
+                                                      const std::vector<const Table*>& tables,
+                                                      const std::shared_ptr<TrackingResource>& memory);
   Response Update(const SerializerForUpdate& info);
   Response Delete(const SerializerForDelete& info);
+  Response Show();
+  friend class Session;
 };
 
-Value Cast(const std::string& value, DataType type);
\ No newline at end of file
+Value Cast(const std::string& value, DataType type);
+
+/// раскладывает столбцы SELECT по таблицам: после вызова columns1 и columns2 (и columns
+/// в joins) заполнены, join_columns упорядочены как (столбец table1, столбец table2),
+/// а условия ON в joins разобраны; joined — таблицы joins в том же порядке
+void ResolveColumns(SerializerForSelect& info, const Table& table1, const Table* table2,
+                    const std::vector<const Table*>& joined = {});
+
+/// a op b для операций сравнения и AND/OR над bool
+bool CompareValues(TokenType op, const Value& a, const Value& b);
+
+/// индекс альтернативы Value, хранящей значения данного типа
+size_t ValueIndex(DataType type);
+
+std::string ToString(const Value& value);
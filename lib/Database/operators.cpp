@@ -0,0 +1,698 @@
+#include "operators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <unordered_map>
+
+#include "../Scheduler/cancellation.h"
+#include "../Scheduler/parallel_for.h"
+
+namespace {
+
+constexpr size_t kSpillPartitions = 8;
+/// после стольких разбиений раздел считается неделимым (например, один ключ на все строки)
+constexpr size_t kMaxSpillDepth = 4;
+constexpr size_t kMinRunRows = 1024;
+/// больше прогонов за одно слияние не открывается; остальные сливаются в несколько проходов
+constexpr size_t kMaxMergeFanIn = 64;
+/// строк в выборке для оценки числа различных значений
+constexpr size_t kDistinctSample = 1024;
+/// вставка строки в хеш-таблицу дороже, чем ее чтение ведущей таблицей или проба
+constexpr double kBuildCost = 2.0;
+
+/// отмена запроса проверяется раз в блок строк: часы на каждой строке дороже самой работы
+void CheckAtBlock(size_t i) {
+  if (i % Column::kBlockRows == 0) {
+    CheckCancellation();
+  }
+}
+
+std::pmr::memory_resource* Resource(const std::shared_ptr<TrackingResource>& memory) {
+  return memory ? memory.get() : std::pmr::get_default_resource();
+}
+
+/// часть рабочей памяти оператора под буферы временных файлов
+size_t SpillBudget(const std::shared_ptr<TrackingResource>& work) {
+  return work && work->limit() != 0 ? work->limit() / 4 : 0;
+}
+
+/// блок, при котором files одновременно открытых файлов укладываются в SpillBudget
+size_t SpillBlockSize(const std::shared_ptr<TrackingResource>& work, size_t files) {
+  size_t budget = SpillBudget(work);
+  if (budget == 0) {
+    return SpillFile::kBlockSize;
+  }
+  return std::clamp(budget / files, SpillFile::kMinBlockSize, SpillFile::kBlockSize);
+}
+
+std::vector<SpillFile> MakeSpillFiles(size_t n, const std::shared_ptr<TrackingResource>& work, size_t block) {
+  std::vector<SpillFile> files;
+  files.reserve(n);
+  for (size_t i = 0; i < n; ++i) {
+    files.emplace_back(Resource(work), block);
+  }
+  return files;
+}
+
+/// на каждом уровне рекурсии свое перемешивание, иначе раздел не разделится повторно
+size_t Partition(const Value& key, size_t depth) {
+  uint64_t h = Hash(key) + 0x9e3779b97f4a7c15ull * (depth + 1);
+  h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+  h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+  return (h ^ (h >> 31)) % kSpillPartitions;
+}
+
+struct ColumnSource {
+  const Column& column;
+
+  template <typename F>
+  void ForEach(F&& f) const {
+    for (size_t i = 0; i < column.size(); ++i) {
+      CheckAtBlock(i);
+      f(i, column[i]);
+    }
+  }
+};
+
+/// строки probe, не прошедшие фильтр Блума, отдаются с ключом NULL: пары у них нет,
+/// а внешнему соединению они нужны на своих местах
+struct FilteredSource {
+  const Column& column;
+  const std::vector<uint8_t>& mask;
+  bool is_inner;
+
+  template <typename F>
+  void ForEach(F&& f) const {
+    for (size_t i = 0; i < column.size(); ++i) {
+      CheckAtBlock(i);
+      if (mask[i] != 0) {
+        f(i, column[i]);
+      } else if (!is_inner) {
+        f(i, Value());
+      }
+    }
+  }
+};
+
+struct FileSource {
+  SpillFile& file;
+
+  template <typename F>
+  void ForEach(F&& f) const {
+    file.Rewind();
+    uint64_t row;
+    Value key;
+    for (size_t i = 0; file.Read(row, &key, 1); ++i) {
+      CheckAtBlock(i);
+      f(row, key);
+    }
+  }
+};
+
+template <typename Build, typename Probe>
+void JoinPartition(const Build& build, const Probe& probe, bool is_inner,
+                   const std::shared_ptr<TrackingResource>& work, JoinRows& out, SpillStats& spill, size_t depth) {
+  std::optional<std::pmr::unordered_multimap<Value, size_t, ValueHash>> table;
+  try {
+    table.emplace(Resource(work));
+    build.ForEach([&table](size_t row, const Value& key) {
+      if (!std::holds_alternative<MyMonostate>(key)) {
+        table->emplace(key, row);
+      }
+    });
+  } catch (const MemoryLimitError&) {
+    if (depth == kMaxSpillDepth) {
+      throw;
+    }
+    table.reset();
+  }
+  if (table) {
+    probe.ForEach([&table, &out, is_inner](size_t row, const Value& key) {
+      size_t first = out.size();
+      auto [it, last] = table->equal_range(key);
+      for (; it != last; ++it) {
+        CheckAtBlock(out.size());
+        out.emplace_back(row, it->second);
+      }
+      if (out.size() == first) {
+        if (!is_inner) {
+          out.emplace_back(row, kNoRow);
+        }
+      } else {
+        std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end());
+      }
+    });
+    return;
+  }
+
+  // все разделы уровня пишутся одновременно, поэтому блок делится на их число
+  size_t block = SpillBlockSize(work, 2 * kSpillPartitions);
+  std::vector<SpillFile> build_parts = MakeSpillFiles(kSpillPartitions, work, block);
+  std::vector<SpillFile> probe_parts = MakeSpillFiles(kSpillPartitions, work, block);
+  build.ForEach([&build_parts, depth](size_t row, const Value& key) {
+    if (!std::holds_alternative<MyMonostate>(key)) {
+      build_parts[Partition(key, depth)].Write(row, &key, 1);
+    }
+  });
+  probe.ForEach([&probe_parts, &out, is_inner, depth](size_t row, const Value& key) {
+    if (!std::holds_alternative<MyMonostate>(key)) {
+      probe_parts[Partition(key, depth)].Write(row, &key, 1);
+    } else if (!is_inner) {
+      out.emplace_back(row, kNoRow);
+    }
+  });
+  // Rewind дописывает и отдает буферы записи сразу, а не когда до раздела дойдет очередь
+  for (size_t p = 0; p < kSpillPartitions; ++p) {
+    for (auto* file : {&build_parts[p], &probe_parts[p]}) {
+      file->Rewind();
+      if (file->records() != 0) {
+        ++spill.files;
+        spill.bytes += file->bytes();
+      }
+    }
+  }
+  for (size_t p = 0; p < kSpillPartitions; ++p) {
+    if (probe_parts[p].records() == 0) {
+      continue;
+    }
+    JoinPartition(FileSource{build_parts[p]}, FileSource{probe_parts[p]}, is_inner, work, out, spill, depth + 1);
+  }
+}
+
+/// хеш-таблица по столбцу: первая строка с ключом и цепочка следующих строк с тем же ключом
+class KeyIndex {
+ public:
+  KeyIndex(const Column& column, const std::shared_ptr<TrackingResource>& work)
+      : heads_(Resource(work)), next_(column.size(), kNoRow, Resource(work)) {
+    for (size_t i = column.size(); i-- > 0;) {
+      CheckAtBlock(i);
+      Value key = column[i];
+      if (std::holds_alternative<MyMonostate>(key)) {
+        continue;
+      }
+      auto [it, inserted] = heads_.try_emplace(std::move(key), i);
+      if (!inserted) {
+        next_[i] = it->second;
+        it->second = i;
+      }
+    }
+  }
+
+  size_t First(const Value& key) const {
+    auto it = heads_.find(key);
+    return it == heads_.end() ? kNoRow : it->second;
+  }
+
+  size_t Next(size_t row) const {
+    return next_[row];
+  }
+
+ private:
+  std::pmr::unordered_map<Value, size_t, ValueHash> heads_;
+  std::pmr::vector<size_t> next_;
+};
+
+JoinTuples MakeTuples(size_t tables, const std::shared_ptr<TrackingResource>& memory) {
+  JoinTuples tuples;
+  for (size_t t = 0; t < tables; ++t) {
+    tuples.emplace_back(Resource(memory));
+  }
+  return tuples;
+}
+
+}  // namespace
+
+JoinRows HashJoin(const Column& probe, const Column& build, bool is_inner,
+                  const std::shared_ptr<TrackingResource>& memory,
+                  const std::shared_ptr<TrackingResource>& work, SpillStats& spill,
+                  const std::vector<uint8_t>* probe_filter) {
+  JoinRows out(Resource(memory));
+  size_t files = spill.files;
+  if (probe_filter != nullptr) {
+    JoinPartition(ColumnSource{build}, FilteredSource{probe, *probe_filter, is_inner}, is_inner, work, out, spill, 0);
+  } else {
+    JoinPartition(ColumnSource{build}, ColumnSource{probe}, is_inner, work, out, spill, 0);
+  }
+  if (spill.files != files) {
+    std::sort(out.begin(), out.end());
+  }
+  return out;
+}
+
+std::optional<std::vector<uint8_t>> BloomSemiJoin(const Column& probe, const Column& build,
+                                                  const std::shared_ptr<TrackingResource>& work) {
+  if (probe.size() < Column::kBlockRows || build.size() * kBloomBuildRatio > probe.size()) {
+    return std::nullopt;
+  }
+  BloomFilter filter(build.size(), Resource(work));
+  for (size_t i = 0; i < build.size(); ++i) {
+    CheckAtBlock(i);
+    Value key = build[i];
+    if (!std::holds_alternative<MyMonostate>(key)) {
+      filter.Add(Hash(key));
+    }
+  }
+  std::vector<uint8_t> mask;
+  probe.MatchBloom(filter, mask);
+  return mask;
+}
+
+JoinRows MergeJoin(const Column& probe, const Column& build, bool is_inner,
+                   const std::shared_ptr<TrackingResource>& memory,
+                   const std::shared_ptr<TrackingResource>& work, SpillStats& spill) {
+  JoinRows out(Resource(memory));
+  std::pmr::vector<size_t> order(Resource(memory));
+  if (!build.sorted()) {
+    order.reserve(build.size());
+    SortRows({&build}, {false}, build.size(), work, spill, [&order](size_t row) { order.push_back(row); });
+  }
+  auto build_row = [&build, &order](size_t pos) { return build.sorted() ? pos : order[pos]; };
+
+  // группа равных ключей build начинается с cursor и просматривается заново
+  // для каждой строки probe с тем же ключом
+  size_t cursor = 0;
+  auto emit = [&](size_t row) {
+    Value key = probe[row];
+    bool matched = false;
+    if (!std::holds_alternative<MyMonostate>(key)) {
+      while (cursor < build.size() && build[build_row(cursor)] < key) {
+        ++cursor;
+      }
+      for (size_t pos = cursor; pos < build.size(); ++pos) {
+        size_t other = build_row(pos);
+        if (build[other] != key) {
+          break;
+        }
+        CheckAtBlock(out.size());
+        out.emplace_back(row, other);
+        matched = true;
+      }
+    }
+    if (!matched && !is_inner) {
+      out.emplace_back(row, kNoRow);
+    }
+  };
+  if (probe.sorted()) {
+    for (size_t row = 0; row < probe.size(); ++row) {
+      CheckAtBlock(row);
+      emit(row);
+    }
+  } else {
+    SortRows({&probe}, {false}, probe.size(), work, spill, emit);
+  }
+  return out;
+}
+
+JoinRows CoPartitionedJoin(const Column& probe, const std::vector<std::vector<size_t>>& probe_partitions,
+                           const Column& build, const std::vector<std::vector<size_t>>& build_partitions,
+                           bool is_inner, const std::shared_ptr<TrackingResource>& memory,
+                           const std::shared_ptr<TrackingResource>& work) {
+  std::vector<JoinRows> parts;
+  parts.reserve(probe_partitions.size());
+  for (size_t p = 0; p < probe_partitions.size(); ++p) {
+    parts.emplace_back(Resource(memory));
+  }
+  ParallelFor(probe_partitions.size(), 0, [&](size_t p) {
+    std::pmr::unordered_multimap<Value, size_t, ValueHash> table(Resource(work));
+    for (size_t i = 0; i < build_partitions[p].size(); ++i) {
+      CheckAtBlock(i);
+      size_t row = build_partitions[p][i];
+      Value key = build[row];
+      if (!std::holds_alternative<MyMonostate>(key)) {
+        table.emplace(std::move(key), row);
+      }
+    }
+    JoinRows& out = parts[p];
+    for (size_t i = 0; i < probe_partitions[p].size(); ++i) {
+      CheckAtBlock(i);
+      size_t row = probe_partitions[p][i];
+      size_t first = out.size();
+      auto [it, last] = table.equal_range(probe[row]);
+      for (; it != last; ++it) {
+        CheckAtBlock(out.size());
+        out.emplace_back(row, it->second);
+      }
+      if (out.size() == first && !is_inner) {
+        out.emplace_back(row, kNoRow);
+      }
+    }
+  });
+  size_t total = 0;
+  for (const auto& part : parts) {
+    total += part.size();
+  }
+  JoinRows out(Resource(memory));
+  out.reserve(total);
+  for (const auto& part : parts) {
+    out.insert(out.end(), part.begin(), part.end());
+  }
+  std::sort(out.begin(), out.end());
+  return out;
+}
+
+bool PreferMergeJoin(const Column& probe, const Column& build, size_t work_limit) {
+  if (probe.sorted() && build.sorted()) {
+    return true;
+  }
+  // узел unordered_multimap: ключ, номер строки, указатель на следующий и корзина
+  constexpr size_t kHashEntryBytes = sizeof(Value) + 4 * sizeof(void*);
+  return probe.is_primary() && build.is_primary() && work_limit != 0
+         && build.size() * kHashEntryBytes > work_limit;
+}
+
+void SortRows(const std::vector<const Column*>& keys, const std::vector<bool>& descending, size_t n_rows,
+              const std::shared_ptr<TrackingResource>& work, SpillStats& spill,
+              const std::function<void(size_t)>& emit) {
+  auto compare = [&descending](const Value& a, const Value& b, size_t k) {
+    return descending[k] ? b < a : a < b;
+  };
+  auto less = [&keys, &compare](size_t a, size_t b) {
+    for (size_t k = 0; k < keys.size(); ++k) {
+      const Value& x = (*keys[k])[a];
+      const Value& y = (*keys[k])[b];
+      if (x != y) {
+        return compare(x, y, k);
+      }
+    }
+    return a < b;
+  };
+
+  // прогоны сливаются не больше чем по fan_in; их буферы и буфер результата слияния
+  // укладываются в SpillBudget, а номера строк прогона — в остаток рабочей памяти
+  size_t block = SpillBlockSize(work, kMaxMergeFanIn + 1);
+  size_t fan_in = kMaxMergeFanIn;
+  size_t max_run_rows = n_rows;
+  if (size_t budget = SpillBudget(work); budget != 0) {
+    fan_in = std::clamp(budget / block, size_t(3), kMaxMergeFanIn + 1) - 1;
+    max_run_rows = (work->limit() - budget) / sizeof(size_t);
+  }
+  size_t run_rows = n_rows;
+  std::optional<std::pmr::vector<size_t>> rows;
+  while (!rows) {
+    try {
+      rows.emplace(run_rows, Resource(work));
+    } catch (const MemoryLimitError&) {
+      if (run_rows <= kMinRunRows) {
+        throw;
+      }
+      run_rows = std::max(kMinRunRows, std::min(run_rows / 2, max_run_rows));
+    }
+  }
+  // сама std::sort не прерывается: отмена проверяется до нее и при выдаче строк
+  CheckCancellation();
+  if (run_rows == n_rows) {
+    std::iota(rows->begin(), rows->end(), 0);
+    std::sort(rows->begin(), rows->end(), less);
+    for (size_t i = 0; i < n_rows; ++i) {
+      CheckAtBlock(i);
+      emit((*rows)[i]);
+    }
+    return;
+  }
+
+  struct Head {
+    std::vector<Value> keys;
+    uint64_t row = 0;
+  };
+  auto merge = [&keys, &compare](std::vector<SpillFile>& runs, const auto& output) {
+    std::vector<Head> heads(runs.size());
+    auto after = [&heads, &compare](size_t a, size_t b) {
+      const Head& x = heads[a];
+      const Head& y = heads[b];
+      for (size_t k = 0; k < x.keys.size(); ++k) {
+        if (x.keys[k] != y.keys[k]) {
+          return compare(y.keys[k], x.keys[k], k);
+        }
+      }
+      return x.row > y.row;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> queue(after);
+    for (size_t r = 0; r < runs.size(); ++r) {
+      heads[r].keys.resize(keys.size());
+      if (runs[r].Read(heads[r].row, heads[r].keys.data(), keys.size())) {
+        queue.push(r);
+      }
+    }
+    for (size_t i = 0; !queue.empty(); ++i) {
+      CheckAtBlock(i);
+      size_t r = queue.top();
+      queue.pop();
+      output(heads[r]);
+      if (runs[r].Read(heads[r].row, heads[r].keys.data(), keys.size())) {
+        queue.push(r);
+      }
+    }
+  };
+  auto merge_to_file = [&](std::vector<SpillFile>& runs) {
+    SpillFile merged(Resource(work), block);
+    merge(runs, [&merged](const Head& head) {
+      merged.Write(head.row, head.keys.data(), head.keys.size());
+    });
+    runs.clear();
+    merged.Rewind();
+    ++spill.files;
+    spill.bytes += merged.bytes();
+    return merged;
+  };
+
+  // каскад: fan_in прогонов уровня сливаются в один прогон следующего уровня, как только
+  // наберутся, поэтому открытых файлов не больше fan_in на уровень даже на сотнях тысяч прогонов
+  std::vector<std::vector<SpillFile>> levels;
+  auto add_run = [&](SpillFile run) {
+    for (size_t level = 0;; ++level) {
+      if (level == levels.size()) {
+        levels.emplace_back();
+      }
+      levels[level].push_back(std::move(run));
+      if (levels[level].size() < fan_in) {
+        return;
+      }
+      run = merge_to_file(levels[level]);
+    }
+  };
+  std::vector<Value> values(keys.size());
+  for (size_t start = 0; start < n_rows; start += run_rows) {
+    auto end = rows->begin() + static_cast<std::ptrdiff_t>(std::min(run_rows, n_rows - start));
+    std::iota(rows->begin(), end, start);
+    std::sort(rows->begin(), end, less);
+    CheckCancellation();
+    SpillFile run(Resource(work), block);
+    for (auto it = rows->begin(); it != end; ++it) {
+      for (size_t k = 0; k < keys.size(); ++k) {
+        values[k] = (*keys[k])[*it];
+      }
+      run.Write(*it, values.data(), values.size());
+    }
+    run.Rewind();
+    ++spill.files;
+    spill.bytes += run.bytes();
+    add_run(std::move(run));
+  }
+  rows.reset();
+
+  std::vector<SpillFile> runs;
+  for (auto& level : levels) {
+    for (auto& run : level) {
+      runs.push_back(std::move(run));
+    }
+  }
+  levels.clear();
+  while (runs.size() > fan_in) {
+    std::vector<SpillFile> next;
+    for (size_t first = 0; first < runs.size(); first += fan_in) {
+      std::vector<SpillFile> group;
+      for (size_t r = first; r < std::min(first + fan_in, runs.size()); ++r) {
+        group.push_back(std::move(runs[r]));
+      }
+      next.push_back(group.size() == 1 ? std::move(group.front()) : merge_to_file(group));
+    }
+    runs = std::move(next);
+  }
+  merge(runs, [&emit](const Head& head) {
+    emit(head.row);
+  });
+}
+
+double EstimateDistinct(const Column& column) {
+  size_t n = column.size();
+  if (n == 0) {
+    return 0;
+  }
+  if (column.is_primary()) {
+    return static_cast<double>(n);
+  }
+  size_t sample = std::min(n, kDistinctSample);
+  size_t stride = n / sample;
+  std::unordered_map<Value, size_t, ValueHash> counts;
+  size_t taken = 0;
+  for (size_t i = 0; i < sample; ++i) {
+    Value value = column[i * stride];
+    if (!std::holds_alternative<MyMonostate>(value)) {
+      ++counts[std::move(value)];
+      ++taken;
+    }
+  }
+  if (taken == 0) {
+    return 0;
+  }
+  // значения, встреченные в выборке один раз, масштабируются на sqrt(N / n)
+  double once = 0;
+  double repeated = 0;
+  for (const auto& [value, count] : counts) {
+    (count == 1 ? once : repeated) += 1;
+  }
+  double non_null = static_cast<double>(n) * static_cast<double>(taken) / static_cast<double>(sample);
+  return std::sqrt(non_null / static_cast<double>(taken)) * once + repeated;
+}
+
+std::vector<size_t> PlanJoinOrder(const std::vector<size_t>& rows, const std::vector<JoinEdge>& edges) {
+  size_t n = rows.size();
+  std::vector<double> left_distinct;
+  std::vector<double> distinct;
+  for (const auto& edge : edges) {
+    left_distinct.push_back(EstimateDistinct(*edge.left_column));
+    distinct.push_back(EstimateDistinct(*edge.column));
+  }
+  std::vector<size_t> best;
+  double best_cost = std::numeric_limits<double>::infinity();
+  for (size_t driver = 0; driver < n; ++driver) {
+    std::vector<size_t> order{driver};
+    std::vector<bool> joined(n);
+    joined[driver] = true;
+    auto result = static_cast<double>(rows[driver]);
+    double cost = result;
+    while (order.size() < n) {
+      size_t next = n;
+      double next_rows = std::numeric_limits<double>::infinity();
+      for (size_t e = 0; e < edges.size(); ++e) {
+        size_t a = edges[e].left;
+        size_t b = edges[e].table;
+        if (joined[a] == joined[b]) {
+          continue;
+        }
+        size_t candidate = joined[a] ? b : a;
+        double estimate = result * static_cast<double>(rows[candidate])
+                          / std::max({left_distinct[e], distinct[e], 1.0});
+        if (estimate < next_rows) {
+          next_rows = estimate;
+          next = candidate;
+        }
+      }
+      if (next == n) {
+        throw std::logic_error("Join tables are not connected");
+      }
+      joined[next] = true;
+      order.push_back(next);
+      result = next_rows;
+      cost += next_rows + kBuildCost * static_cast<double>(rows[next]);
+    }
+    if (cost < best_cost) {
+      best_cost = cost;
+      best = std::move(order);
+    }
+  }
+  return best;
+}
+
+JoinTuples MultiJoin(const std::vector<size_t>& rows, const std::vector<JoinEdge>& edges,
+                     const std::shared_ptr<TrackingResource>& memory,
+                     const std::shared_ptr<TrackingResource>& work) {
+  size_t n = rows.size();
+  JoinTuples out = MakeTuples(n, memory);
+  if (std::all_of(edges.begin(), edges.end(), [](const JoinEdge& e) { return e.type == kInner; })) {
+    std::vector<size_t> order = PlanJoinOrder(rows, edges);
+    // шаг k: таблица order[k + 1], ее хеш-таблица и столбец уже соединенной таблицы для пробы
+    struct Step {
+      size_t table = 0;
+      size_t probe_table = 0;
+      const Column* probe = nullptr;
+    };
+    std::vector<Step> steps;
+    std::vector<KeyIndex> indexes;
+    std::vector<bool> joined(n);
+    joined[order[0]] = true;
+    for (size_t k = 1; k < n; ++k) {
+      size_t t = order[k];
+      for (const auto& edge : edges) {
+        if (edge.table == t && joined[edge.left]) {
+          steps.push_back({t, edge.left, edge.left_column});
+          indexes.emplace_back(*edge.column, work);
+          break;
+        }
+        if (edge.left == t && joined[edge.table]) {
+          steps.push_back({t, edge.table, edge.column});
+          indexes.emplace_back(*edge.left_column, work);
+          break;
+        }
+      }
+      joined[t] = true;
+    }
+    std::vector<size_t> current(n);
+    auto probe = [&](auto&& self, size_t k) -> void {
+      if (k == steps.size()) {
+        CheckAtBlock(out[0].size());
+        for (size_t t = 0; t < n; ++t) {
+          out[t].push_back(current[t]);
+        }
+        return;
+      }
+      const Step& step = steps[k];
+      Value key = (*step.probe)[current[step.probe_table]];
+      if (std::holds_alternative<MyMonostate>(key)) {
+        return;
+      }
+      for (size_t row = indexes[k].First(key); row != kNoRow; row = indexes[k].Next(row)) {
+        current[step.table] = row;
+        self(self, k + 1);
+      }
+    };
+    for (size_t row = 0; row < rows[order[0]]; ++row) {
+      CheckAtBlock(row);
+      current[order[0]] = row;
+      probe(probe, 0);
+    }
+    return out;
+  }
+
+  out[0].resize(rows[0]);
+  std::iota(out[0].begin(), out[0].end(), 0);
+  for (size_t k = 1; k < n; ++k) {
+    const JoinEdge& edge = edges[k - 1];
+    KeyIndex index(*edge.column, work);
+    JoinTuples next = MakeTuples(n, memory);
+    std::vector<bool> matched(edge.type == kRight ? rows[k] : 0);
+    auto emit = [&](size_t i, size_t row) {
+      CheckAtBlock(next[k].size());
+      for (size_t t = 0; t < k; ++t) {
+        next[t].push_back(i == kNoRow ? kNoRow : out[t][i]);
+      }
+      next[k].push_back(row);
+    };
+    for (size_t i = 0; i < out[0].size(); ++i) {
+      CheckAtBlock(i);
+      size_t left_row = out[edge.left][i];
+      Value key = left_row == kNoRow ? Value() : (*edge.left_column)[left_row];
+      size_t row = std::holds_alternative<MyMonostate>(key) ? kNoRow : index.First(key);
+      if (row == kNoRow && edge.type == kLeft) {
+        emit(i, kNoRow);
+      }
+      for (; row != kNoRow; row = index.Next(row)) {
+        emit(i, row);
+        if (edge.type == kRight) {
+          matched[row] = true;
+        }
+      }
+    }
+    for (size_t row = 0; row < matched.size(); ++row) {
+      if (!matched[row]) {
+        emit(kNoRow, row);
+      }
+    }
+    out = std::move(next);
+  }
+  return out;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <functional>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "database.h"
+#include "spill_file.h"
+
+using JoinRows = std::pmr::vector<std::pair<size_t, size_t>>;
+
+/// Пары строк (probe, build) с равными ключами, упорядоченные по probe, затем по build;
+/// NULL не равен ничему. Хеш-таблица строится по build в work. Если она не помещается
+/// в лимит work, обе стороны разбиваются по хешу ключа на разделы во временных файлах
+/// и соединяются по разделам (grace hash join), при необходимости рекурсивно.
+/// probe_filter (см. BloomSemiJoin) отсекает строки probe без пары до чтения ключа и пробы.
+JoinRows HashJoin(const Column& probe, const Column& build, bool is_inner,
+                  const std::shared_ptr<TrackingResource>& memory,
+                  const std::shared_ptr<TrackingResource>& work, SpillStats& spill,
+                  const std::vector<uint8_t>* probe_filter = nullptr);
+
+/// Полусоединение по фильтру Блума: фильтр строится по ключам build в work и проверяется
+/// по всему столбцу probe; mask[i] == 0 — у строки i точно нет пары. nullopt, если build
+/// не меньше probe хотя бы в kBloomBuildRatio раз и фильтр не окупится.
+constexpr size_t kBloomBuildRatio = 8;
+std::optional<std::vector<uint8_t>> BloomSemiJoin(const Column& probe, const Column& build,
+                                                  const std::shared_ptr<TrackingResource>& work);
+
+/// То же, что HashJoin, но слиянием: стороны читаются в порядке ключей. Упорядоченный
+/// столбец (Column::sorted) читается как есть, иначе номера строк сортируются SortRows
+/// (с вытеснением в work); для build они хранятся в memory, хеш-таблица не строится.
+/// Если probe упорядочен, пары идут в том же порядке, что у HashJoin, иначе — по ключу.
+JoinRows MergeJoin(const Column& probe, const Column& build, bool is_inner,
+                   const std::shared_ptr<TrackingResource>& memory,
+                   const std::shared_ptr<TrackingResource>& work, SpillStats& spill);
+
+/// То же, что HashJoin, для таблиц, разбитых по ключам соединения на одинаковое число
+/// разделов: раздел i probe соединяется только с разделом i build. Разделы обрабатываются
+/// параллельно, у каждого своя хеш-таблица в work; вытеснения на диск нет, при нехватке
+/// памяти бросается MemoryLimitError.
+JoinRows CoPartitionedJoin(const Column& probe, const std::vector<std::vector<size_t>>& probe_partitions,
+                           const Column& build, const std::vector<std::vector<size_t>>& build_partitions,
+                           bool is_inner, const std::shared_ptr<TrackingResource>& memory,
+                           const std::shared_ptr<TrackingResource>& work);
+
+/// Соединение слиянием выбирается, если обе стороны уже упорядочены или если это первичные
+/// ключи и хеш-таблица по build не помещается в work_limit байт (0 — без ограничения).
+bool PreferMergeJoin(const Column& probe, const Column& build, size_t work_limit);
+
+/// Передает в emit номера строк в порядке ключей, равные ключи — в исходном порядке.
+/// Номера строк сортируются в work; если они не помещаются, отсортированные прогоны
+/// пишутся во временные файлы и сливаются каскадом, не больше 64 прогонов за слияние.
+/// Буферы файлов тоже берутся из work и занимают не больше четверти ее лимита.
+void SortRows(const std::vector<const Column*>& keys, const std::vector<bool>& descending, size_t n_rows,
+              const std::shared_ptr<TrackingResource>& work, SpillStats& spill,
+              const std::function<void(size_t)>& emit);
+
+/// условие соединения таблицы table с таблицей left: left_column принадлежит left, column — table
+struct JoinEdge {
+  size_t left = 0;
+  const Column* left_column = nullptr;
+  size_t table = 0;
+  const Column* column = nullptr;
+  JoinType type = kInner;
+};
+
+/// число различных не NULL значений по равномерной выборке (оценщик GEE);
+/// для первичного ключа — число строк
+double EstimateDistinct(const Column& column);
+
+/// Порядок внутреннего соединения таблиц с числом строк rows: первая — ведущая, остальные
+/// присоединяются по одной через ребро к уже соединенным. Для каждой ведущей таблицы следующая
+/// выбирается жадно по наименьшей оценке результата |R| * |T| / max(V(R.a), V(T.b)); стоимость
+/// плана — строки ведущей таблицы, промежуточные результаты и (с большим весом) размеры хеш-таблиц.
+std::vector<size_t> PlanJoinOrder(const std::vector<size_t>& rows, const std::vector<JoinEdge>& edges);
+
+/// tuples[t][i] — строка таблицы t в i-й строке результата соединения, kNoRow — NULL
+using JoinTuples = std::vector<std::pmr::vector<size_t>>;
+
+/// Соединение rows.size() таблиц, edges[k - 1] присоединяет таблицу k к одной из предыдущих.
+/// Если все соединения внутренние, порядок выбирает PlanJoinOrder: хеш-таблицы строятся
+/// по всем таблицам, кроме ведущей, а каждая строка ведущей проходит пробы подряд
+/// (конвейером), так что промежуточные результаты не собираются. С внешними соединениями
+/// таблицы присоединяются в порядке записи. Хеш-таблицы лежат в work и не вытесняются на диск.
+JoinTuples MultiJoin(const std::vector<size_t>& rows, const std::vector<JoinEdge>& edges,
+                     const std::shared_ptr<TrackingResource>& memory,
+                     const std::shared_ptr<TrackingResource>& work);
@@ -0,0 +1,85 @@
+#include "predicate.h"
+
+#include <charconv>
+
+const std::vector<Token>& Predicate::tokens() const {
+  return tokens_;
+}
+
+bool Predicate::empty() const {
+  return tokens_.empty();
+}
+
+Predicate Predicate::Combine(const Predicate& a, const Predicate& b, TokenType op) {
+  if (a.empty() || b.empty()) {
+    throw std::logic_error("Invalid logic expression");
+  }
+  Predicate res;
+  res.tokens_.reserve(a.tokens_.size() + b.tokens_.size() + 1);
+  res.tokens_ = a.tokens_;
+  res.tokens_.insert(res.tokens_.end(), b.tokens_.begin(), b.tokens_.end());
+  res.tokens_.emplace_back(op);
+  return res;
+}
+
+Predicate operator&&(const Predicate& a, const Predicate& b) {
+  return Predicate::Combine(a, b, kAnd);
+}
+
+Predicate operator||(const Predicate& a, const Predicate& b) {
+  return Predicate::Combine(a, b, kOr);
+}
+
+Col::Col(std::string name) : name_(std::move(name)) {}
+
+Predicate Col::Compare(TokenType op, std::string constant) const {
+  Predicate res;
+  res.tokens_.emplace_back(kVar, name_);
+  res.tokens_.emplace_back(kConst, std::move(constant));
+  res.tokens_.emplace_back(op);
+  return res;
+}
+
+Predicate Col::IsNull() const {
+  Predicate res;
+  res.tokens_.emplace_back(kVar, name_);
+  res.tokens_.emplace_back(kIsNull);
+  return res;
+}
+
+Predicate Col::IsNotNull() const {
+  Predicate res;
+  res.tokens_.emplace_back(kVar, name_);
+  res.tokens_.emplace_back(kIsNotNull);
+  return res;
+}
+
+std::string Col::ToConstant(int value) {
+  return std::to_string(value);
+}
+
+std::string Col::ToConstant(double value) {
+  char buf[32];
+  return {buf, std::to_chars(buf, buf + sizeof(buf), value).ptr};
+}
+
+std::string Col::ToConstant(float value) {
+  char buf[32];
+  return {buf, std::to_chars(buf, buf + sizeof(buf), value).ptr};
+}
+
+std::string Col::ToConstant(bool value) {
+  return value ? "1" : "0";
+}
+
+std::string Col::ToConstant(std::string_view value) {
+  return std::string(value);
+}
+
+std::string Col::ToConstant(const std::string& value) {
+  return value;
+}
+
+std::string Col::ToConstant(const char* value) {
+  return value;
+}
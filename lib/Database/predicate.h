@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../Parser/Base/base_parser.h"
+
+/// условие WHERE, собранное в коде; компилируется в тот же постфиксный вид, что и ParseFilters
+class Predicate {
+ public:
+  Predicate() = default;
+
+  const std::vector<Token>& tokens() const;
+
+  bool empty() const;
+
+  friend Predicate operator&&(const Predicate& a, const Predicate& b);
+
+  friend Predicate operator||(const Predicate& a, const Predicate& b);
+
+ private:
+  friend class Col;
+
+  static Predicate Combine(const Predicate& a, const Predicate& b, TokenType op);
+
+  std::vector<Token> tokens_;
+};
+
+/// ссылка на столбец для построения условий: Col("salary") > 80000 && Col("sex") == "M"
+class Col {
+ public:
+  explicit Col(std::string name);
+
+  template <typename T>
+  Predicate operator==(const T& value) const {
+    return Compare(kEquals, ToConstant(value));
+  }
+
+  template <typename T>
+  Predicate operator!=(const T& value) const {
+    return Compare(kNotEquals, ToConstant(value));
+  }
+
+  template <typename T>
+  Predicate operator<(const T& value) const {
+    return Compare(kLess, ToConstant(value));
+  }
+
+  template <typename T>
+  Predicate operator>(const T& value) const {
+    return Compare(kGreater, ToConstant(value));
+  }
+
+  template <typename T>
+  Predicate operator<=(const T& value) const {
+    return Compare(kNotGreater, ToConstant(value));
+  }
+
+  template <typename T>
+  Predicate operator>=(const T& value) const {
+    return Compare(kNotLess, ToConstant(value));
+  }
+
+  Predicate IsNull() const;
+
+  Predicate IsNotNull() const;
+
+ private:
+  Predicate Compare(TokenType op, std::string constant) const;
+
+  static std::string ToConstant(int value);
+  static std::string ToConstant(double value);
+  static std::string ToConstant(float value);
+  static std::string ToConstant(bool value);
+  static std::string ToConstant(std::string_view value);
+  static std::string ToConstant(const std::string& value);
+  static std::string ToConstant(const char* value);
+
+  std::string name_;
+};
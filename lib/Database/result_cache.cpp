@@ -0,0 +1,98 @@
+#include "result_cache.h"
+
+#include <algorithm>
+
+#include "../Parser/Base/lexer.h"
+
+std::string NormalizeQuery(std::string_view query) {
+  Lexer lexer(query);
+  std::string res;
+  for (Lexeme lexeme = lexer.Next(); lexeme.type != LexemeType::kEnd; lexeme = lexer.Next()) {
+    if (lexeme.type == LexemeType::kSymbol && lexeme.text == ";") {
+      continue;
+    }
+    if (!res.empty()) {
+      res += ' ';
+    }
+    if (lexeme.keyword != Keyword::kNone) {
+      res += Lexer::KeywordName(lexeme.keyword);
+    } else if (lexeme.type == LexemeType::kString) {
+      res += '\'';
+      res += lexeme.text;
+      res += '\'';
+    } else {
+      res += lexeme.text;
+    }
+  }
+  return res;
+}
+
+ResultCache::ResultCache(const ResultCacheOptions& options) : options_(options) {}
+
+void ResultCache::Configure(const ResultCacheOptions& options) {
+  std::lock_guard lock(mutex_);
+  options_ = options;
+  Evict();
+}
+
+std::shared_ptr<const Response> ResultCache::Find(const std::string& query, const std::vector<uint64_t>& versions) {
+  std::lock_guard lock(mutex_);
+  auto it = index_.find(query);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  if (it->second->versions != versions) {
+    Erase(it->second);
+    return nullptr;
+  }
+  entries_.splice(entries_.begin(), entries_, it->second);
+  return entries_.front().response;
+}
+
+void ResultCache::Insert(const std::string& query, std::vector<uint64_t> versions, const Response& response) {
+  // копия делается до подсчета размера: она ложится в ту же арену запроса
+  auto stored = std::make_shared<const Response>(response);
+  size_t bytes = query.size();
+  if (stored->is_table()) {
+    const Table& table = stored->table();
+    size_t used = table.MemoryUsage().bytes;
+    // ответ держит арену запроса целиком, вместе с уже мертвыми промежуточными результатами
+    if (table.memory() && table.memory()->arena()) {
+      used = std::max(used, table.memory()->arena()->allocated());
+    }
+    bytes += used;
+  }
+  std::lock_guard lock(mutex_);
+  if (bytes > options_.max_bytes || options_.max_entries == 0) {
+    return;
+  }
+  if (auto it = index_.find(query); it != index_.end()) {
+    Erase(it->second);
+  }
+  entries_.push_front({query, std::move(versions), std::move(stored), bytes});
+  index_.emplace(entries_.front().query, entries_.begin());
+  bytes_ += bytes;
+  Evict();
+}
+
+size_t ResultCache::size() const {
+  std::lock_guard lock(mutex_);
+  return entries_.size();
+}
+
+size_t ResultCache::bytes() const {
+  std::lock_guard lock(mutex_);
+  return bytes_;
+}
+
+void ResultCache::Erase(std::list<Entry>::iterator it) {
+  bytes_ -= it->bytes;
+  index_.erase(it->query);
+  entries_.erase(it);
+}
+
+void ResultCache::Evict() {
+  while (!entries_.empty() && (bytes_ > options_.max_bytes || entries_.size() > options_.max_entries)) {
+    Erase(std::prev(entries_.end()));
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "database.h"
+
+/// SELECT в каноническом виде: лексемы через один пробел, ключевые слова в верхнем регистре
+std::string NormalizeQuery(std::string_view query);
+
+/// Результаты SELECT по нормализованному тексту запроса. Вместе с результатом хранятся
+/// версии таблиц запроса на момент выполнения; запись годна, пока версии не изменились,
+/// устаревшая запись удаляется при обращении. Вытесняются давно не использованные записи.
+class ResultCache {
+ public:
+  explicit ResultCache(const ResultCacheOptions& options);
+
+  /// новые лимиты; лишние записи вытесняются сразу
+  void Configure(const ResultCacheOptions& options);
+
+  /// сохраненный ответ или nullptr; ответ общий для всех попаданий, копировать его
+  /// нужно в свою память, а не в арену записи — иначе арена растет с каждым попаданием
+  std::shared_ptr<const Response> Find(const std::string& query, const std::vector<uint64_t>& versions);
+
+  /// результаты больше max_bytes не кешируются
+  void Insert(const std::string& query, std::vector<uint64_t> versions, const Response& response);
+
+  size_t size() const;
+
+  size_t bytes() const;
+
+ private:
+  struct Entry {
+    std::string query;
+    std::vector<uint64_t> versions;
+    std::shared_ptr<const Response> response;
+    size_t bytes = 0;
+  };
+
+  void Erase(std::list<Entry>::iterator it);
+  void Evict();
+
+  mutable std::mutex mutex_;
+  ResultCacheOptions options_;
+  /// в начале — последние использованные
+  std::list<Entry> entries_;
+  std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+  size_t bytes_ = 0;
+};
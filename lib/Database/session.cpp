@@ -0,0 +1,111 @@
+#include "session.h"
+
+Session::Session(Database& db) : db_(db) {}
+
+Response Session::Execute(const std::string& query) {
+  auto start = Clock::now();
+  auto q = std::make_shared<Query>(Parse(query));
+  if (auto r = Control(*q, start)) {
+    return std::move(*r);
+  }
+  return Task(std::move(q), start, query)();
+}
+
+Future<Response> Session::ExecuteAsync(std::string query) {
+  auto start = Clock::now();
+  Promise<Response> promise;
+  Future<Response> future = promise.GetFuture();
+  std::shared_ptr<Query> q;
+  try {
+    q = std::make_shared<Query>(Parse(query));
+    if (auto r = Control(*q, start)) {
+      promise.SetValue(std::move(*r));
+      return future;
+    }
+  } catch (...) {
+    promise.SetException(std::current_exception());
+    return future;
+  }
+  QueryClass query_class = db_.Classify(*q);
+  return db_.Submit(query_class, Task(std::move(q), start, std::move(query)));
+}
+
+bool Session::in_transaction() const {
+  return active_;
+}
+
+size_t Session::pending() const {
+  return writes_.size();
+}
+
+Query Session::Parse(const std::string& query) {
+  try {
+    return SqlParser(query).Parse();
+  } catch (...) {
+    db_.metrics_.RecordParseError();
+    throw;
+  }
+}
+
+std::optional<Response> Session::Control(const Query& q, Clock::time_point start) {
+  auto record = [this, &q, start]() {
+    db_.metrics_.RecordStatement(q.query_type, static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()), false);
+  };
+  switch (q.query_type) {
+    case kBegin:
+      if (active_) {
+        throw std::logic_error("Transaction is already started");
+      }
+      active_ = true;
+      record();
+      return Response("Transaction is started");
+    case kCommit:
+    case kRollback:
+      if (!active_) {
+        throw std::logic_error("No transaction is started");
+      }
+      if (q.query_type == kCommit && !writes_.empty()) {
+        return std::nullopt;
+      }
+      active_ = false;
+      writes_.clear();
+      record();
+      return Response(q.query_type == kCommit ? "Transaction is committed" : "Transaction is rolled back");
+    case kCreate:
+    case kDrop:
+      if (active_) {
+        throw std::logic_error("CREATE and DROP are not allowed inside a transaction");
+      }
+      return std::nullopt;
+    case kInsert:
+    case kUpdate:
+    case kDelete:
+      if (!active_) {
+        return std::nullopt;
+      }
+      writes_.push_back(q);
+      record();
+      return Response("Statement is queued until COMMIT");
+    default:
+      return std::nullopt;
+  }
+}
+
+std::function<Response()> Session::Task(std::shared_ptr<Query> q, Clock::time_point start, std::string query) {
+  Database& db = db_;
+  if (q->query_type == kCommit) {
+    auto writes = std::make_shared<std::vector<Query>>(std::move(writes_));
+    writes_.clear();
+    active_ = false;
+    return [&db, writes]() { return db.ApplyTransaction(*writes, nullptr, true); };
+  }
+  if (active_ && q->query_type == kSelect && !writes_.empty()) {
+    auto writes = std::make_shared<std::vector<Query>>(writes_);
+    return [&db, writes, q]() { return db.ApplyTransaction(*writes, q.get(), false); };
+  }
+  if (q->query_type != kSelect) {
+    query.clear();
+  }
+  return [&db, q, start, query = std::move(query)]() { return db.ExecuteQuery(*q, start, query); };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "database.h"
+
+/// Сеанс работы с базой с явными транзакциями. После BEGIN изменения (INSERT, UPDATE,
+/// DELETE) не применяются, а копятся в буфере сеанса. COMMIT применяет их пачкой под одной
+/// блокировкой записи: другие сеансы видят транзакцию целиком или не видят вовсе, а ошибка
+/// любого изменения откатывает уже примененные, и транзакция завершается. SELECT внутри
+/// транзакции видит ее изменения: они применяются на время запроса и откатываются.
+/// CREATE и DROP внутри транзакции запрещены. Вне транзакции запросы исполняются как
+/// в Database::Execute. Методы одного сеанса нельзя вызывать параллельно.
+class Session {
+ public:
+  explicit Session(Database& db);
+
+  Response Execute(const std::string& query);
+  /// как Database::ExecuteAsync; BEGIN, ROLLBACK и изменения внутри транзакции
+  /// завершаются сразу, без планировщика
+  Future<Response> ExecuteAsync(std::string query);
+
+  bool in_transaction() const;
+  /// изменения, ожидающие COMMIT
+  size_t pending() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  Query Parse(const std::string& query);
+  /// ответ, если запрос обработан сеансом, иначе nullopt
+  std::optional<Response> Control(const Query& q, Clock::time_point start);
+  /// исполнение запроса в базе; забирает буфер транзакции при COMMIT
+  std::function<Response()> Task(std::shared_ptr<Query> q, Clock::time_point start, std::string query);
+
+  Database& db_;
+  bool active_ = false;
+  std::vector<Query> writes_;
+};
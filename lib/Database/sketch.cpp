@@ -0,0 +1,199 @@
+#include "sketch.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <utility>
+
+namespace {
+
+uint64_t Mix(uint64_t hash) {
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+  return hash ^ (hash >> 31);
+}
+
+}  // namespace
+
+HyperLogLog::HyperLogLog() : registers_(size_t(1) << kPrecision) {}
+
+void HyperLogLog::Add(uint64_t hash) {
+  hash = Mix(hash);
+  size_t index = hash >> (64 - kPrecision);
+  // сторожевой бит ограничивает длину серии нулей, когда остаток хеша нулевой
+  uint64_t rest = hash << kPrecision | uint64_t(1) << (kPrecision - 1);
+  auto rank = static_cast<uint8_t>(std::countl_zero(rest) + 1);
+  registers_[index] = std::max(registers_[index], rank);
+}
+
+void HyperLogLog::Merge(const HyperLogLog& other) {
+  for (size_t i = 0; i < registers_.size(); ++i) {
+    registers_[i] = std::max(registers_[i], other.registers_[i]);
+  }
+}
+
+uint64_t HyperLogLog::Estimate() const {
+  auto m = static_cast<double>(registers_.size());
+  double sum = 0;
+  size_t zeros = 0;
+  for (uint8_t r : registers_) {
+    sum += std::ldexp(1.0, -r);
+    zeros += r == 0;
+  }
+  double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+  // на малых мощностях точнее линейный подсчет по пустым регистрам
+  if (estimate <= 2.5 * m && zeros != 0) {
+    estimate = m * std::log(m / static_cast<double>(zeros));
+  }
+  return static_cast<uint64_t>(std::llround(estimate));
+}
+
+size_t HyperLogLog::memory_usage() const {
+  return registers_.capacity();
+}
+
+void KllSketch::Add(double value) {
+  if (levels_.empty()) {
+    levels_.emplace_back();
+    offsets_.push_back(0);
+  }
+  levels_[0].push_back(value);
+  min_ = count_ == 0 ? value : std::min(min_, value);
+  max_ = count_ == 0 ? value : std::max(max_, value);
+  ++count_;
+  if (levels_[0].size() >= kCapacity) {
+    Compact(0);
+  }
+}
+
+void KllSketch::Merge(const KllSketch& other) {
+  if (levels_.size() < other.levels_.size()) {
+    levels_.resize(other.levels_.size());
+    offsets_.resize(other.levels_.size());
+  }
+  for (size_t h = 0; h < other.levels_.size(); ++h) {
+    levels_[h].insert(levels_[h].end(), other.levels_[h].begin(), other.levels_[h].end());
+  }
+  if (other.count_ != 0) {
+    min_ = count_ == 0 ? other.min_ : std::min(min_, other.min_);
+    max_ = count_ == 0 ? other.max_ : std::max(max_, other.max_);
+  }
+  count_ += other.count_;
+  for (size_t h = 0; h < levels_.size(); ++h) {
+    if (levels_[h].size() >= kCapacity) {
+      Compact(h);
+    }
+  }
+}
+
+void KllSketch::Compact(size_t level) {
+  if (level + 1 == levels_.size()) {
+    levels_.emplace_back();
+    offsets_.push_back(0);
+  }
+  std::vector<double>& items = levels_[level];
+  std::sort(items.begin(), items.end());
+  // при нечетном числе элементов последний остается на своем уровне
+  std::optional<double> left;
+  if (items.size() % 2 != 0) {
+    left = items.back();
+    items.pop_back();
+  }
+  offsets_[level] ^= 1;
+  std::vector<double>& upper = levels_[level + 1];
+  for (size_t i = offsets_[level]; i < items.size(); i += 2) {
+    upper.push_back(items[i]);
+  }
+  items.clear();
+  if (left) {
+    items.push_back(*left);
+  }
+  if (upper.size() >= kCapacity) {
+    Compact(level + 1);
+  }
+}
+
+std::optional<double> KllSketch::Quantile(double fraction) const {
+  if (count_ == 0) {
+    return std::nullopt;
+  }
+  if (fraction <= 0) {
+    return min_;
+  }
+  if (fraction >= 1) {
+    return max_;
+  }
+  std::vector<std::pair<double, uint64_t>> weighted;
+  for (size_t h = 0; h < levels_.size(); ++h) {
+    for (double value : levels_[h]) {
+      weighted.emplace_back(value, uint64_t(1) << h);
+    }
+  }
+  std::sort(weighted.begin(), weighted.end());
+  auto target = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count_)));
+  uint64_t seen = 0;
+  for (const auto& [value, weight] : weighted) {
+    seen += weight;
+    if (seen >= target) {
+      return value;
+    }
+  }
+  return weighted.back().first;
+}
+
+uint64_t KllSketch::count() const {
+  return count_;
+}
+
+size_t KllSketch::memory_usage() const {
+  size_t bytes = levels_.capacity() * sizeof(std::vector<double>) + offsets_.capacity();
+  for (const auto& level : levels_) {
+    bytes += level.capacity() * sizeof(double);
+  }
+  return bytes;
+}
+
+BloomFilter::BloomFilter(size_t keys, std::pmr::memory_resource* memory)
+    : blocks_(std::max<size_t>(1, (keys * kBitsPerKey + 511) / 512), memory) {}
+
+size_t BloomFilter::BlockOf(uint64_t mixed) const {
+  // младшие 48 бит выбирают биты в словах; блок — по еще раз перемешанным старшим битам,
+  // умножением вместо деления
+  uint64_t high = (mixed * 0x9e3779b97f4a7c15ull) >> 32;
+  return static_cast<size_t>(high * blocks_.size() >> 32);
+}
+
+uint64_t BloomFilter::Mask(uint64_t mixed, size_t word) {
+  return uint64_t(1) << (mixed >> (6 * word) & 63);
+}
+
+void BloomFilter::Add(uint64_t hash) {
+  uint64_t mixed = Mix(hash);
+  Block& block = blocks_[BlockOf(mixed)];
+  for (size_t w = 0; w < 8; ++w) {
+    block.words[w] |= Mask(mixed, w);
+  }
+}
+
+bool BloomFilter::MayContain(uint64_t hash) const {
+  uint64_t mixed = Mix(hash);
+  const Block& block = blocks_[BlockOf(mixed)];
+  bool found = true;
+  for (size_t w = 0; w < 8; ++w) {
+    found &= (block.words[w] & Mask(mixed, w)) != 0;
+  }
+  return found;
+}
+
+size_t BloomFilter::memory_usage() const {
+  return blocks_.capacity() * sizeof(Block);
+}
+
+void ColumnSketch::Merge(const ColumnSketch& other) {
+  distinct.Merge(other.distinct);
+  quantiles.Merge(other.quantiles);
+}
+
+size_t ColumnSketch::memory_usage() const {
+  return distinct.memory_usage() + quantiles.memory_usage();
+}
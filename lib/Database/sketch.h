@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+/// HyperLogLog на 2^kPrecision регистрах: число различных значений с ошибкой около 1.6%.
+/// Объединение — поэлементный максимум регистров, поэтому наброски сегментов, разделов и
+/// потоков складываются без повторного чтения строк.
+class HyperLogLog {
+ public:
+  static constexpr uint32_t kPrecision = 12;
+
+  HyperLogLog();
+
+  /// хеш перемешивается внутри, подойдет и слабый (например, значение int как есть)
+  void Add(uint64_t hash);
+
+  void Merge(const HyperLogLog& other);
+
+  uint64_t Estimate() const;
+
+  size_t memory_usage() const;
+
+ private:
+  std::vector<uint8_t> registers_;
+};
+
+/// Набросок квантилей KLL: уровни по kCapacity элементов, элемент уровня h весит 2^h.
+/// Переполненный уровень сортируется, и каждый второй элемент поднимается на уровень выше,
+/// так что вес сохраняется, а ошибка ранга остается порядка 1/kCapacity.
+/// Объединение — конкатенация уровней с последующим сжатием.
+class KllSketch {
+ public:
+  static constexpr size_t kCapacity = 128;
+
+  void Add(double value);
+
+  void Merge(const KllSketch& other);
+
+  /// значение ранга fraction * count(); пустой набросок — nullopt.
+  /// Минимум и максимум хранятся отдельно, поэтому для 0 и 1 ответ точный
+  std::optional<double> Quantile(double fraction) const;
+
+  uint64_t count() const;
+
+  size_t memory_usage() const;
+
+ private:
+  void Compact(size_t level);
+
+  std::vector<std::vector<double>> levels_;
+  /// какую половину уровня поднимать при следующем сжатии: чередуется, чтобы не смещать ранги
+  std::vector<uint8_t> offsets_;
+  uint64_t count_ = 0;
+  double min_ = 0;
+  double max_ = 0;
+};
+
+/// Блочный фильтр Блума: ключ попадает в один блок из 8 слов (одну кеш-линию) и ставит по биту
+/// в каждом слове, так что проверка — одно обращение к памяти и 8 независимых AND без ветвлений.
+/// kBitsPerKey бит на ключ дают около 1% ложных срабатываний; ложных отказов нет.
+class BloomFilter {
+ public:
+  static constexpr size_t kBitsPerKey = 16;
+
+  explicit BloomFilter(size_t keys, std::pmr::memory_resource* memory = std::pmr::get_default_resource());
+
+  /// хеш перемешивается внутри, как в HyperLogLog::Add
+  void Add(uint64_t hash);
+
+  bool MayContain(uint64_t hash) const;
+
+  size_t memory_usage() const;
+
+ private:
+  struct alignas(64) Block {
+    uint64_t words[8] = {};
+  };
+
+  size_t BlockOf(uint64_t mixed) const;
+  static uint64_t Mask(uint64_t mixed, size_t word);
+
+  std::pmr::vector<Block> blocks_;
+};
+
+/// наброски одной колонки по набору строк; NULL не учитываются
+struct ColumnSketch {
+  HyperLogLog distinct;
+  /// только для числовых колонок
+  KllSketch quantiles;
+
+  void Merge(const ColumnSketch& other);
+
+  size_t memory_usage() const;
+};
@@ -0,0 +1,206 @@
+#include "spill_file.h"
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+SpillFile::SpillFile(std::pmr::memory_resource* memory, size_t block_size)
+    : file_(std::tmpfile()), block_size_(block_size), buffer_(memory) {
+  if (file_ == nullptr) {
+    throw std::system_error(errno, std::generic_category(), "tmpfile");
+  }
+}
+
+SpillFile::SpillFile(SpillFile&& other) noexcept
+    : file_(std::exchange(other.file_, nullptr)),
+      block_size_(other.block_size_),
+      buffer_(std::move(other.buffer_)),
+      begin_(other.begin_),
+      end_(other.end_),
+      records_(other.records_),
+      read_(other.read_),
+      bytes_(other.bytes_),
+      reading_(other.reading_) {}
+
+SpillFile& SpillFile::operator=(SpillFile&& other) noexcept {
+  if (this != &other) {
+    if (file_ != nullptr) {
+      std::fclose(file_);
+    }
+    file_ = std::exchange(other.file_, nullptr);
+    block_size_ = other.block_size_;
+    buffer_ = std::move(other.buffer_);
+    begin_ = other.begin_;
+    end_ = other.end_;
+    records_ = other.records_;
+    read_ = other.read_;
+    bytes_ = other.bytes_;
+    reading_ = other.reading_;
+  }
+  return *this;
+}
+
+SpillFile::~SpillFile() {
+  if (file_ != nullptr) {
+    std::fclose(file_);
+  }
+}
+
+void SpillFile::Write(uint64_t row, const Value* keys, size_t n_keys) {
+  if (reading_) {
+    throw std::logic_error("Spill file is already rewound");
+  }
+  Put(row);
+  for (size_t i = 0; i < n_keys; ++i) {
+    const Value& key = keys[i];
+    Put(static_cast<uint8_t>(key.index()));
+    switch (key.index()) {
+      case 1:
+        Put(std::get<int>(key));
+        break;
+      case 2:
+        Put(std::get<double>(key));
+        break;
+      case 3:
+        Put(std::get<float>(key));
+        break;
+      case 4:
+        Put(static_cast<uint8_t>(std::get<bool>(key)));
+        break;
+      case 5: {
+        const auto& s = std::get<std::string>(key);
+        Put(static_cast<uint32_t>(s.size()));
+        PutBytes(s.data(), s.size());
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  ++records_;
+}
+
+void SpillFile::Rewind() {
+  if (!reading_) {
+    Flush();
+    reading_ = true;
+  }
+  ReleaseBuffer();
+  if (std::fseek(file_, 0, SEEK_SET) != 0) {
+    throw std::system_error(errno, std::generic_category(), "fseek");
+  }
+  begin_ = 0;
+  end_ = 0;
+  read_ = 0;
+}
+
+bool SpillFile::Read(uint64_t& row, Value* keys, size_t n_keys) {
+  if (!reading_) {
+    throw std::logic_error("Spill file is not rewound");
+  }
+  if (read_ == records_) {
+    return false;
+  }
+  row = Get<uint64_t>();
+  for (size_t i = 0; i < n_keys; ++i) {
+    switch (Get<uint8_t>()) {
+      case 0:
+        keys[i] = MyMonostate();
+        break;
+      case 1:
+        keys[i] = Get<int>();
+        break;
+      case 2:
+        keys[i] = Get<double>();
+        break;
+      case 3:
+        keys[i] = Get<float>();
+        break;
+      case 4:
+        keys[i] = Get<uint8_t>() != 0;
+        break;
+      case 5: {
+        auto size = Get<uint32_t>();
+        Fill(size);
+        keys[i] = std::string(buffer_.data() + begin_, size);
+        begin_ += size;
+        break;
+      }
+      default:
+        throw std::logic_error("Corrupted spill file");
+    }
+  }
+  if (++read_ == records_) {
+    ReleaseBuffer();
+  }
+  return true;
+}
+
+size_t SpillFile::records() const {
+  return records_;
+}
+
+size_t SpillFile::bytes() const {
+  return bytes_;
+}
+
+void SpillFile::Flush() {
+  if (end_ != 0 && std::fwrite(buffer_.data(), 1, end_, file_) != end_) {
+    throw std::system_error(errno, std::generic_category(), "fwrite");
+  }
+  end_ = 0;
+}
+
+void SpillFile::ReleaseBuffer() {
+  std::pmr::vector<char>(buffer_.get_allocator()).swap(buffer_);
+  begin_ = 0;
+  end_ = 0;
+}
+
+void SpillFile::Fill(size_t n) {
+  if (end_ - begin_ >= n) {
+    return;
+  }
+  std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+  end_ -= begin_;
+  begin_ = 0;
+  if (buffer_.size() < std::max(n, block_size_)) {
+    buffer_.resize(std::max(n, block_size_));
+  }
+  end_ += std::fread(buffer_.data() + end_, 1, buffer_.size() - end_, file_);
+  if (end_ < n) {
+    throw std::logic_error("Truncated spill file");
+  }
+}
+
+template <typename T>
+void SpillFile::Put(const T& value) {
+  PutBytes(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T SpillFile::Get() {
+  Fill(sizeof(T));
+  T value;
+  std::memcpy(&value, buffer_.data() + begin_, sizeof(T));
+  begin_ += sizeof(T);
+  return value;
+}
+
+void SpillFile::PutBytes(const char* data, size_t size) {
+  if (buffer_.size() < block_size_) {
+    buffer_.resize(block_size_);
+  }
+  if (end_ + size > buffer_.size()) {
+    Flush();
+  }
+  if (size > buffer_.size()) {
+    if (std::fwrite(data, 1, size, file_) != size) {
+      throw std::system_error(errno, std::generic_category(), "fwrite");
+    }
+  } else {
+    std::memcpy(buffer_.data() + end_, data, size);
+    end_ += size;
+  }
+  bytes_ += size;
+}
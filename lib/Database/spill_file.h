@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory_resource>
+#include <vector>
+
+#include "database.h"
+
+/// сколько данных операторы вытеснили на диск за запрос
+struct SpillStats {
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+};
+
+/// Временный файл в двоичном формате прогонов: запись — номер строки (u64)
+/// и фиксированное число ключей (тип u8 и данные). Пишется и читается
+/// последовательно блоками block_size, удаляется при разрушении.
+/// Буфер берется из memory и живет, только пока файл пишется или дочитывается:
+/// Rewind отдает буфер записи, чтение последней записи — буфер чтения.
+class SpillFile {
+ public:
+  static constexpr size_t kBlockSize = size_t(1) << 18;
+  /// меньше блок не делается даже при маленькой рабочей памяти
+  static constexpr size_t kMinBlockSize = 256;
+
+  explicit SpillFile(std::pmr::memory_resource* memory = std::pmr::get_default_resource(),
+                     size_t block_size = kBlockSize);
+
+  SpillFile(SpillFile&& other) noexcept;
+  SpillFile& operator=(SpillFile&& other) noexcept;
+  SpillFile(const SpillFile&) = delete;
+  SpillFile& operator=(const SpillFile&) = delete;
+
+  ~SpillFile();
+
+  void Write(uint64_t row, const Value* keys, size_t n_keys);
+
+  /// дописывает буфер и переводит файл в чтение с начала
+  void Rewind();
+
+  /// false, если записи закончились
+  bool Read(uint64_t& row, Value* keys, size_t n_keys);
+
+  size_t records() const;
+
+  size_t bytes() const;
+
+ private:
+  void Flush();
+  void ReleaseBuffer();
+  /// гарантирует n непрочитанных байт в буфере
+  void Fill(size_t n);
+  template <typename T>
+  void Put(const T& value);
+  template <typename T>
+  T Get();
+  void PutBytes(const char* data, size_t size);
+
+  std::FILE* file_ = nullptr;
+  size_t block_size_;
+  std::pmr::vector<char> buffer_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  size_t records_ = 0;
+  size_t read_ = 0;
+  size_t bytes_ = 0;
+  bool reading_ = false;
+};
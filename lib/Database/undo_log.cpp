@@ -0,0 +1,72 @@
+#include "undo_log.h"
+
+#include <ranges>
+
+UndoLog::UndoLog(std::unordered_map<std::string, Table>& tables) : tables_(tables) {}
+
+Table& UndoLog::Track(const std::string& table) {
+  Table& target = tables_.at(table);
+  if (!marks_.contains(table)) {
+    marks_.emplace(table, target.marks());
+  }
+  return target;
+}
+
+void UndoLog::Inserting(const std::string& table) {
+  Table& target = Track(table);
+  Entry& entry = entries_.emplace_back();
+  entry.kind = kInserted;
+  entry.table = table;
+  entry.size = target.size();
+}
+
+void UndoLog::Updating(const std::string& table, const std::vector<size_t>& rows,
+                       const std::vector<std::string>& columns) {
+  Table& target = Track(table);
+  Entry& entry = entries_.emplace_back();
+  entry.kind = kUpdated;
+  entry.table = table;
+  entry.rows = rows;
+  for (const auto& name : columns) {
+    entry.columns.emplace_back(name, target.column(name).Select(rows, target.memory()));
+  }
+}
+
+void UndoLog::Deleting(const std::string& table, const std::vector<size_t>& rows) {
+  Table& target = Track(table);
+  Entry& entry = entries_.emplace_back();
+  entry.kind = kDeleted;
+  entry.table = table;
+  entry.rows = rows;
+  entry.removed = target.SelectRows(rows, target.memory());
+}
+
+std::vector<std::string> UndoLog::tables() const {
+  std::vector<std::string> names;
+  for (const auto& [name, marks] : marks_) {
+    names.push_back(name);
+  }
+  return names;
+}
+
+void UndoLog::Rollback() {
+  for (auto& entry : std::ranges::reverse_view(entries_)) {
+    Table& table = tables_.at(entry.table);
+    switch (entry.kind) {
+      case kInserted:
+        table.Truncate(entry.size);
+        break;
+      case kUpdated:
+        table.Restore(entry.rows, entry.columns);
+        break;
+      case kDeleted:
+        table.Reinsert(entry.rows, entry.removed);
+        break;
+    }
+  }
+  entries_.clear();
+  for (auto& [name, marks] : marks_) {
+    tables_.at(name).RestoreMarks(std::move(marks));
+  }
+  marks_.clear();
+}
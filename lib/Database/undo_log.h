@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "database.h"
+
+/// Журнал отката транзакции. Для каждого изменения хранятся только затронутые строки:
+/// число строк до INSERT, прежние значения столбцов, измененных UPDATE, и строки,
+/// удаленные DELETE. Rollback проходит журнал в обратном порядке и возвращает таблицам
+/// прежние версии и отметки изменений. Все вызовы — под исключительной блокировкой базы.
+class UndoLog {
+ public:
+  explicit UndoLog(std::unordered_map<std::string, Table>& tables);
+
+  UndoLog(const UndoLog&) = delete;
+  UndoLog& operator=(const UndoLog&) = delete;
+
+  /// перед вставкой строк в table
+  void Inserting(const std::string& table);
+
+  /// перед UPDATE: rows — строки, которые изменятся, columns — изменяемые столбцы
+  void Updating(const std::string& table, const std::vector<size_t>& rows, const std::vector<std::string>& columns);
+
+  /// перед DELETE: rows по возрастанию
+  void Deleting(const std::string& table, const std::vector<size_t>& rows);
+
+  /// таблицы, измененные с начала журнала
+  std::vector<std::string> tables() const;
+
+  /// возвращает таблицам состояние до первой записи журнала
+  void Rollback();
+
+ private:
+  enum Kind {
+    kInserted,
+    kUpdated,
+    kDeleted
+  };
+
+  struct Entry {
+    Kind kind = kInserted;
+    std::string table;
+    /// число строк до INSERT
+    size_t size = 0;
+    /// строки UPDATE или DELETE
+    std::vector<size_t> rows;
+    /// прежние значения столбцов UPDATE в строках rows
+    std::vector<std::pair<std::string, Column>> columns;
+    /// удаленные DELETE строки
+    Table removed;
+  };
+
+  /// запоминает отметки таблицы перед ее первым изменением
+  Table& Track(const std::string& table);
+
+  std::unordered_map<std::string, Table>& tables_;
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, Table::Marks> marks_;
+};
@@ -0,0 +1,203 @@
+#include "view.h"
+
+#include <algorithm>
+#include <numeric>
+
+MaterializedView::MaterializedView(SerializerForSelect definition,
+                                   const std::unordered_map<std::string, Table>& tables)
+    : definition_(std::move(definition)) {
+  if (!definition_.order_by.empty()) {
+    throw std::logic_error("ORDER BY is not supported in materialized views");
+  }
+  auto find = [&tables](const std::string& name) -> const Table& {
+    auto it = tables.find(name);
+    if (it == tables.end()) {
+      throw std::logic_error("No table with name '" + name + "'");
+    }
+    return it->second;
+  };
+  const Table& table1 = find(definition_.table_name1);
+  const Table* table2 = nullptr;
+  tables_[0] = definition_.table_name1;
+  if (definition_.is_join) {
+    if (definition_.join_type != kInner) {
+      throw std::logic_error("Materialized views support only inner joins");
+    }
+    if (!definition_.joins.empty()) {
+      throw std::logic_error("Materialized views support joins of two tables only");
+    }
+    if (definition_.table_name2 == definition_.table_name1) {
+      throw std::logic_error("Materialized views do not support self-joins");
+    }
+    table2 = &find(definition_.table_name2);
+    tables_[1] = definition_.table_name2;
+  }
+  ResolveColumns(definition_, table1, table2);
+  keys_[0] = definition_.join_columns.first;
+  keys_[1] = definition_.join_columns.second;
+  // как и в Table::Join, столбец с уже занятым именем пропускается
+  auto add = [this](size_t side, const std::string& column) {
+    if (std::none_of(outputs_.begin(), outputs_.end(), [&column](const Output& o) { return o.column == column; })) {
+      outputs_.push_back({side, column});
+    }
+  };
+  for (const auto& c : definition_.columns1) {
+    add(0, c);
+  }
+  for (const auto& c : definition_.columns2) {
+    add(1, c);
+  }
+}
+
+Table MaterializedView::Build(const std::unordered_map<std::string, Table>& tables,
+                              std::shared_ptr<TrackingResource> memory) {
+  Table view(std::move(memory));
+  for (const auto& output : outputs_) {
+    const Column& source = tables.at(tables_[output.side]).column(output.column);
+    view.CreateColumn({output.column, source.type(), source.max_len_of_value(), false});
+  }
+  rows_[0].clear();
+  rows_[1].clear();
+  std::vector<size_t> all(tables.at(tables_[0]).size());
+  std::iota(all.begin(), all.end(), 0);
+  Add(0, all, tables, view);
+  return view;
+}
+
+bool MaterializedView::DependsOn(const std::string& table) const {
+  return table == tables_[0] || (definition_.is_join && table == tables_[1]);
+}
+
+void MaterializedView::Inserted(const std::string& table, size_t first_row,
+                                const std::unordered_map<std::string, Table>& tables, Table& view) {
+  std::vector<size_t> rows(tables.at(table).size() - first_row);
+  std::iota(rows.begin(), rows.end(), first_row);
+  Add(Side(table), rows, tables, view);
+}
+
+void MaterializedView::Updated(const std::string& table, const std::vector<size_t>& rows,
+                               const std::vector<std::string>& columns,
+                               const std::unordered_map<std::string, Table>& tables, Table& view) {
+  size_t side = Side(table);
+  if (std::none_of(columns.begin(), columns.end(), [this, side](const auto& c) { return References(side, c); })) {
+    return;
+  }
+  // измененные строки заново проходят фильтр или соединение и переходят в конец представления
+  Remove(side, rows, false, view);
+  Add(side, rows, tables, view);
+}
+
+void MaterializedView::Deleted(const std::string& table, const std::vector<size_t>& rows, Table& view) {
+  Remove(Side(table), rows, true, view);
+}
+
+void MaterializedView::Cleared(const std::string&, Table& view) {
+  view.DeleteAll();
+  rows_[0].clear();
+  rows_[1].clear();
+}
+
+size_t MaterializedView::Side(const std::string& table) const {
+  return table == tables_[0] ? 0 : 1;
+}
+
+bool MaterializedView::References(size_t side, const std::string& column) const {
+  if (definition_.is_join && keys_[side] == column) {
+    return true;
+  }
+  if (side == 0 && std::any_of(definition_.filters.begin(), definition_.filters.end(), [&column](const Token& t) {
+        return t.type == kVar && t.value == column;
+      })) {
+    return true;
+  }
+  return std::any_of(outputs_.begin(), outputs_.end(), [side, &column](const Output& o) {
+    return o.side == side && o.column == column;
+  });
+}
+
+void MaterializedView::Add(size_t side, const std::vector<size_t>& rows,
+                           const std::unordered_map<std::string, Table>& tables, Table& view) {
+  const Table& source = tables.at(tables_[side]);
+  // пары (строка первой стороны, строка второй стороны)
+  std::vector<std::pair<size_t, size_t>> pairs;
+  if (!definition_.is_join) {
+    std::vector<size_t> matched;
+    if (definition_.filters.empty()) {
+      matched = rows;
+    } else if (rows.size() == source.size()) {
+      matched = source.Filter(definition_.filters);
+    } else {
+      Table delta = source.SelectRows(rows);
+      for (size_t i : delta.Filter(definition_.filters)) {
+        matched.push_back(rows[i]);
+      }
+    }
+    for (size_t row : matched) {
+      pairs.emplace_back(row, 0);
+    }
+  } else {
+    const Table& other = tables.at(tables_[1 - side]);
+    const Column& key = source.column(keys_[side]);
+    const Column& other_key = other.column(keys_[1 - side]);
+    std::unordered_multimap<Value, size_t, ValueHash> index;
+    for (size_t row : rows) {
+      Value value = key[row];
+      if (!std::holds_alternative<MyMonostate>(value)) {
+        index.emplace(std::move(value), row);
+      }
+    }
+    for (size_t j = 0; j < other.size() && !index.empty(); ++j) {
+      auto [it, last] = index.equal_range(other_key[j]);
+      for (; it != last; ++it) {
+        pairs.push_back(side == 0 ? std::make_pair(it->second, j) : std::make_pair(j, it->second));
+      }
+    }
+    std::sort(pairs.begin(), pairs.end());
+  }
+
+  std::vector<const Column*> columns;
+  for (const auto& output : outputs_) {
+    columns.push_back(&tables.at(tables_[output.side]).column(output.column));
+  }
+  std::vector<Value> row(outputs_.size());
+  for (const auto& [first, second] : pairs) {
+    for (size_t k = 0; k < outputs_.size(); ++k) {
+      row[k] = (*columns[k])[outputs_[k].side == 0 ? first : second];
+    }
+    view.AppendRow(row);
+    rows_[0].push_back(first);
+    if (definition_.is_join) {
+      rows_[1].push_back(second);
+    }
+  }
+}
+
+void MaterializedView::Remove(size_t side, const std::vector<size_t>& rows, bool renumber, Table& view) {
+  std::vector<size_t>& own = rows_[side];
+  std::vector<size_t> doomed;
+  for (size_t k = 0; k < own.size(); ++k) {
+    if (std::binary_search(rows.begin(), rows.end(), own[k])) {
+      doomed.push_back(k);
+    }
+  }
+  view.Erase(doomed);
+  for (auto& mapping : rows_) {
+    if (mapping.empty()) {
+      continue;
+    }
+    size_t next = 0;
+    for (size_t k = 0, d = 0; k < mapping.size(); ++k) {
+      if (d < doomed.size() && doomed[d] == k) {
+        ++d;
+      } else {
+        mapping[next++] = mapping[k];
+      }
+    }
+    mapping.resize(next);
+  }
+  if (renumber) {
+    for (auto& row : own) {
+      row -= static_cast<size_t>(std::lower_bound(rows.begin(), rows.end(), row) - rows.begin());
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "database.h"
+
+/// Материализованное представление: результат SELECT хранится как обычная Table в базе,
+/// а для каждой его строки запоминаются номера строк источников. Изменения источников
+/// переносятся в результат по затронутым строкам, без повторного выполнения запроса.
+/// Поддерживаются проекции с WHERE и внутренние соединения двух разных таблиц.
+class MaterializedView {
+ public:
+  /// проверяет определение; источники должны существовать
+  MaterializedView(SerializerForSelect definition, const std::unordered_map<std::string, Table>& tables);
+
+  /// полностью вычисляет содержимое представления
+  Table Build(const std::unordered_map<std::string, Table>& tables, std::shared_ptr<TrackingResource> memory);
+
+  bool DependsOn(const std::string& table) const;
+
+  /// в table добавлены строки начиная с first_row
+  void Inserted(const std::string& table, size_t first_row, const std::unordered_map<std::string, Table>& tables,
+                Table& view);
+
+  /// в строках rows изменились столбцы columns
+  void Updated(const std::string& table, const std::vector<size_t>& rows, const std::vector<std::string>& columns,
+               const std::unordered_map<std::string, Table>& tables, Table& view);
+
+  /// из table удалены строки rows (номера до удаления, по возрастанию)
+  void Deleted(const std::string& table, const std::vector<size_t>& rows, Table& view);
+
+  void Cleared(const std::string& table, Table& view);
+
+ private:
+  /// столбец представления: из какой стороны и какого столбца источника
+  struct Output {
+    size_t side = 0;
+    std::string column;
+  };
+
+  size_t Side(const std::string& table) const;
+  bool References(size_t side, const std::string& column) const;
+  /// добавляет строки представления для строк rows стороны side
+  void Add(size_t side, const std::vector<size_t>& rows, const std::unordered_map<std::string, Table>& tables,
+           Table& view);
+  /// удаляет строки представления, построенные из строк rows стороны side;
+  /// при renumber номера остальных строк этой стороны сдвигаются как после удаления
+  void Remove(size_t side, const std::vector<size_t>& rows, bool renumber, Table& view);
+
+  SerializerForSelect definition_;
+  /// источники и ключи соединения по сторонам; для проекции используется только первая
+  std::string tables_[2];
+  std::string keys_[2];
+  std::vector<Output> outputs_;
+  /// номера строк источников для каждой строки представления
+  std::vector<size_t> rows_[2];
+};
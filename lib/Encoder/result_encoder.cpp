@@ -0,0 +1,442 @@
+#include "result_encoder.h"
+
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+const size_t kMaxNumberLength = 32;
+
+std::vector<const Column*> ResolveColumns(const Table& table) {
+  std::vector<const Column*> columns;
+  columns.reserve(table.column_names().size());
+  for (const auto& name : table.column_names()) {
+    columns.push_back(&table.column(name));
+  }
+  return columns;
+}
+
+size_t TextWidth(const std::string& name, const Column& column) {
+  return std::max(column.max_len_of_value(), name.size() + 3);
+}
+
+template <typename T>
+T ReadLittleEndian(std::string_view batch, size_t& offset) {
+  if (offset + sizeof(T) > batch.size()) {
+    throw std::logic_error("Invalid row batch");
+  }
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(static_cast<T>(static_cast<uint8_t>(batch[offset + i])) << (8 * i));
+  }
+  offset += sizeof(T);
+  return value;
+}
+
+std::string_view ReadBytes(std::string_view batch, size_t& offset, size_t n) {
+  if (offset + n > batch.size()) {
+    throw std::logic_error("Invalid row batch");
+  }
+  offset += n;
+  return batch.substr(offset - n, n);
+}
+
+}  // namespace
+
+ResultEncoder::ResultEncoder(EncodingFormat format, size_t initial_capacity)
+    : format_(format), buffer_(initial_capacity) {}
+
+EncodingFormat ResultEncoder::format() const {
+  return format_;
+}
+
+std::string_view ResultEncoder::Encode(const Table& table) {
+  size_ = 0;
+  switch (format_) {
+    case kText:
+      EncodeText(table);
+      break;
+    case kCsv:
+      EncodeCsv(table);
+      break;
+    case kJsonLines:
+      EncodeJsonLines(table);
+      break;
+    case kBinary:
+      EncodeBinary(table);
+      break;
+  }
+  return {buffer_.data(), size_};
+}
+
+std::string_view ResultEncoder::Encode(const Response& response) {
+  if (response.is_table()) {
+    return Encode(response.table());
+  }
+  if (format_ == kBinary) {
+    Table table;
+    table.CreateColumn({"message", kVarchar, response.message().size(), false});
+    std::unordered_map<std::string, std::string> row{{"message", response.message()}};
+    table.CreateRow(row);
+    return Encode(table);
+  }
+  size_ = 0;
+  if (format_ == kJsonLines) {
+    Put("{\"message\":");
+    PutJsonString(response.message());
+    Put('}');
+  } else {
+    Put(response.message());
+  }
+  Put('\n');
+  return {buffer_.data(), size_};
+}
+
+void ResultEncoder::EncodeText(const Table& table) {
+  const auto& names = table.column_names();
+  auto columns = ResolveColumns(table);
+  std::vector<size_t> widths;
+  size_t row_width = 1;
+  for (size_t c = 0; c < names.size(); ++c) {
+    widths.push_back(TextWidth(names[c], *columns[c]));
+    row_width += widths.back();
+  }
+  Reserve(row_width * (table.size() + 1));
+  for (size_t c = 0; c < names.size(); ++c) {
+    Put(names[c]);
+    PutPadding(widths[c] - std::min(widths[c], names[c].size()));
+  }
+  Put('\n');
+  for (size_t i = 0; i < table.size(); ++i) {
+    for (size_t c = 0; c < columns.size(); ++c) {
+      size_t start = size_;
+      PutTextValue((*columns[c])[i]);
+      PutPadding(widths[c] - std::min(widths[c], size_ - start));
+    }
+    Put('\n');
+  }
+}
+
+void ResultEncoder::EncodeCsv(const Table& table) {
+  const auto& names = table.column_names();
+  auto columns = ResolveColumns(table);
+  size_t row_width = 1;
+  for (const auto* column : columns) {
+    row_width += column->max_len_of_value() + 1;
+  }
+  Reserve(row_width * (table.size() + 1));
+  for (size_t c = 0; c < names.size(); ++c) {
+    if (c != 0) {
+      Put(',');
+    }
+    PutCsvField(names[c]);
+  }
+  Put('\n');
+  for (size_t i = 0; i < table.size(); ++i) {
+    for (size_t c = 0; c < columns.size(); ++c) {
+      if (c != 0) {
+        Put(',');
+      }
+      const Value& v = (*columns[c])[i];
+      if (const auto* s = std::get_if<std::string>(&v)) {
+        PutCsvField(*s);
+      } else if (!std::holds_alternative<MyMonostate>(v)) {
+        PutValue(v);
+      }
+    }
+    Put('\n');
+  }
+}
+
+void ResultEncoder::EncodeJsonLines(const Table& table) {
+  const auto& names = table.column_names();
+  auto columns = ResolveColumns(table);
+  size_t row_width = 3;
+  for (size_t c = 0; c < names.size(); ++c) {
+    row_width += names[c].size() + columns[c]->max_len_of_value() + 6;
+  }
+  Reserve(row_width * table.size());
+  for (size_t i = 0; i < table.size(); ++i) {
+    Put('{');
+    for (size_t c = 0; c < columns.size(); ++c) {
+      if (c != 0) {
+        Put(',');
+      }
+      PutJsonString(names[c]);
+      Put(':');
+      const Value& v = (*columns[c])[i];
+      switch (v.index()) {
+        case 0:
+          Put("null");
+          break;
+        case 2:
+          if (std::isfinite(std::get<double>(v))) {
+            PutNumber(std::get<double>(v));
+          } else {
+            Put("null");
+          }
+          break;
+        case 3:
+          if (std::isfinite(std::get<float>(v))) {
+            PutNumber(std::get<float>(v));
+          } else {
+            Put("null");
+          }
+          break;
+        case 4:
+          Put(std::get<bool>(v) ? "true" : "false");
+          break;
+        case 5:
+          PutJsonString(std::get<std::string>(v));
+          break;
+        default:
+          PutValue(v);
+          break;
+      }
+    }
+    Put("}\n");
+  }
+}
+
+void ResultEncoder::EncodeBinary(const Table& table) {
+  const auto& names = table.column_names();
+  auto columns = ResolveColumns(table);
+  size_t rows = table.size();
+  size_t bitmap_size = (rows + 7) / 8;
+  size_t estimate = 16;
+  for (size_t c = 0; c < names.size(); ++c) {
+    estimate += 3 + names[c].size() + bitmap_size;
+    estimate += rows * (columns[c]->type() == kVarchar ? columns[c]->max_len_of_value() + 4 : 8);
+  }
+  Reserve(estimate);
+  Put("RBT1");
+  PutLittleEndian(static_cast<uint32_t>(names.size()));
+  PutLittleEndian(static_cast<uint64_t>(rows));
+  for (size_t c = 0; c < names.size(); ++c) {
+    PutLittleEndian(static_cast<uint8_t>(columns[c]->type()));
+    PutLittleEndian(static_cast<uint16_t>(names[c].size()));
+    Put(names[c]);
+  }
+  for (const auto* column : columns) {
+    char* bitmap = Reserve(bitmap_size);
+    std::memset(bitmap, 0, bitmap_size);
+    size_t bitmap_offset = size_;
+    size_ += bitmap_size;
+    for (size_t i = 0; i < rows; ++i) {
+      const Value& v = (*column)[i];
+      if (std::holds_alternative<MyMonostate>(v)) {
+        continue;
+      }
+      buffer_[bitmap_offset + i / 8] |= static_cast<char>(1 << (i % 8));
+      switch (v.index()) {
+        case 1:
+          PutLittleEndian(static_cast<int32_t>(std::get<int>(v)));
+          break;
+        case 2:
+          PutLittleEndian(std::bit_cast<uint64_t>(std::get<double>(v)));
+          break;
+        case 3:
+          PutLittleEndian(std::bit_cast<uint32_t>(std::get<float>(v)));
+          break;
+        case 4:
+          PutLittleEndian(static_cast<uint8_t>(std::get<bool>(v)));
+          break;
+        case 5:
+          PutLittleEndian(static_cast<uint32_t>(std::get<std::string>(v).size()));
+          Put(std::get<std::string>(v));
+          break;
+        default:
+          break;
+      }
+    }
+  }
+}
+
+char* ResultEncoder::Reserve(size_t n) {
+  if (size_ + n > buffer_.size()) {
+    buffer_.resize(std::max(buffer_.size() * 2, size_ + n));
+  }
+  return buffer_.data() + size_;
+}
+
+void ResultEncoder::Put(char ch) {
+  *Reserve(1) = ch;
+  ++size_;
+}
+
+void ResultEncoder::Put(std::string_view s) {
+  std::memcpy(Reserve(s.size()), s.data(), s.size());
+  size_ += s.size();
+}
+
+void ResultEncoder::PutPadding(size_t n) {
+  std::memset(Reserve(n), ' ', n);
+  size_ += n;
+}
+
+void ResultEncoder::PutValue(const Value& value) {
+  switch (value.index()) {
+    case 0:
+      Put("NULL");
+      break;
+    case 1:
+      PutNumber(std::get<int>(value));
+      break;
+    case 2:
+      PutNumber(std::get<double>(value));
+      break;
+    case 3:
+      PutNumber(std::get<float>(value));
+      break;
+    case 4:
+      Put(std::get<bool>(value) ? '1' : '0');
+      break;
+    case 5:
+      Put(std::get<std::string>(value));
+      break;
+    default:
+      break;
+  }
+}
+
+void ResultEncoder::PutTextValue(const Value& value) {
+  // как ostream по умолчанию: %g с 6 значащими цифрами, а не кратчайшая запись
+  if (value.index() == 2 || value.index() == 3) {
+    double number = value.index() == 2 ? std::get<double>(value) : std::get<float>(value);
+    char* begin = Reserve(kMaxNumberLength);
+    auto [end, ec] = std::to_chars(begin, begin + kMaxNumberLength, number, std::chars_format::general, 6);
+    size_ += end - begin;
+    return;
+  }
+  PutValue(value);
+}
+
+void ResultEncoder::PutCsvField(std::string_view s) {
+  if (s.find_first_of(",\"\r\n") == std::string_view::npos) {
+    Put(s);
+    return;
+  }
+  Put('"');
+  for (char ch : s) {
+    if (ch == '"') {
+      Put('"');
+    }
+    Put(ch);
+  }
+  Put('"');
+}
+
+void ResultEncoder::PutJsonString(std::string_view s) {
+  static const char kHex[] = "0123456789abcdef";
+  Put('"');
+  for (char ch : s) {
+    switch (ch) {
+      case '"':
+        Put("\\\"");
+        break;
+      case '\\':
+        Put("\\\\");
+        break;
+      case '\n':
+        Put("\\n");
+        break;
+      case '\r':
+        Put("\\r");
+        break;
+      case '\t':
+        Put("\\t");
+        break;
+      default:
+        if (static_cast<unsigned char>(ch) < 0x20) {
+          Put("\\u00");
+          Put(kHex[(ch >> 4) & 0xF]);
+          Put(kHex[ch & 0xF]);
+        } else {
+          Put(ch);
+        }
+        break;
+    }
+  }
+  Put('"');
+}
+
+template <typename T>
+void ResultEncoder::PutNumber(T value) {
+  char* begin = Reserve(kMaxNumberLength);
+  auto [end, ec] = std::to_chars(begin, begin + kMaxNumberLength, value);
+  size_ += end - begin;
+}
+
+template <typename T>
+void ResultEncoder::PutLittleEndian(T value) {
+  char* out = Reserve(sizeof(T));
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    out[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+  }
+  size_ += sizeof(T);
+}
+
+Table DecodeRowBatch(std::string_view batch) {
+  size_t offset = 0;
+  if (ReadBytes(batch, offset, 4) != "RBT1") {
+    throw std::logic_error("Invalid row batch");
+  }
+  auto n_columns = ReadLittleEndian<uint32_t>(batch, offset);
+  auto n_rows = ReadLittleEndian<uint64_t>(batch, offset);
+  std::vector<std::pair<std::string, DataType>> schema;
+  for (uint32_t c = 0; c < n_columns; ++c) {
+    auto type = ReadLittleEndian<uint8_t>(batch, offset);
+    if (type > kVarchar) {
+      throw std::logic_error("Invalid row batch");
+    }
+    auto name_size = ReadLittleEndian<uint16_t>(batch, offset);
+    schema.emplace_back(ReadBytes(batch, offset, name_size), static_cast<DataType>(type));
+  }
+  size_t bitmap_size = (n_rows + 7) / 8;
+  std::vector<std::vector<Value>> columns(n_columns);
+  std::vector<size_t> max_len(n_columns, 0);
+  for (uint32_t c = 0; c < n_columns; ++c) {
+    std::string_view bitmap = ReadBytes(batch, offset, bitmap_size);
+    columns[c].reserve(n_rows);
+    for (uint64_t i = 0; i < n_rows; ++i) {
+      if ((bitmap[i / 8] & (1 << (i % 8))) == 0) {
+        columns[c].emplace_back(MyMonostate());
+        continue;
+      }
+      switch (schema[c].second) {
+        case kInt:
+          columns[c].emplace_back(static_cast<int>(ReadLittleEndian<uint32_t>(batch, offset)));
+          break;
+        case kDouble:
+          columns[c].emplace_back(std::bit_cast<double>(ReadLittleEndian<uint64_t>(batch, offset)));
+          break;
+        case kFloat:
+          columns[c].emplace_back(std::bit_cast<float>(ReadLittleEndian<uint32_t>(batch, offset)));
+          break;
+        case kBool:
+          columns[c].emplace_back(ReadLittleEndian<uint8_t>(batch, offset) != 0);
+          break;
+        case kVarchar: {
+          auto size = ReadLittleEndian<uint32_t>(batch, offset);
+          columns[c].emplace_back(std::string(ReadBytes(batch, offset, size)));
+          max_len[c] = std::max<size_t>(max_len[c], size);
+          break;
+        }
+      }
+    }
+  }
+  Table table;
+  for (uint32_t c = 0; c < n_columns; ++c) {
+    table.CreateColumn({schema[c].first, schema[c].second, max_len[c], false});
+  }
+  std::vector<Value> row(n_columns);
+  for (uint64_t i = 0; i < n_rows; ++i) {
+    for (uint32_t c = 0; c < n_columns; ++c) {
+      row[c] = std::move(columns[c][i]);
+    }
+    table.AppendRow(row);
+  }
+  return table;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+#include "../Database/database.h"
+
+enum EncodingFormat {
+  kText,
+  kCsv,
+  kJsonLines,
+  kBinary
+};
+
+/// Кодирует результат запроса в переиспользуемый буфер, столбцы идут в порядке схемы.
+///
+/// Бинарный формат (все числа little-endian):
+///   "RBT1", u32 число столбцов, u64 число строк,
+///   для каждого столбца: u8 DataType, u16 длина имени, имя,
+///   затем для каждого столбца: битовая маска непустых значений (ceil(rows / 8) байт)
+///   и сами непустые значения: INT i32, DOUBLE f64, FLOAT f32, BOOL u8, VARCHAR u32 длина + байты
+class ResultEncoder {
+ public:
+  explicit ResultEncoder(EncodingFormat format, size_t initial_capacity = 1 << 16);
+
+  /// результат действителен до следующего вызова Encode
+  std::string_view Encode(const Table& table);
+
+  std::string_view Encode(const Response& response);
+
+  EncodingFormat format() const;
+
+ private:
+  void EncodeText(const Table& table);
+  void EncodeCsv(const Table& table);
+  void EncodeJsonLines(const Table& table);
+  void EncodeBinary(const Table& table);
+
+  /// гарантирует место под n байт и возвращает указатель на конец данных
+  char* Reserve(size_t n);
+  void Put(char ch);
+  void Put(std::string_view s);
+  void PutPadding(size_t n);
+  void PutValue(const Value& value);
+  /// значение для kText — побайтно как operator<<
+  void PutTextValue(const Value& value);
+  void PutCsvField(std::string_view s);
+  void PutJsonString(std::string_view s);
+  template <typename T>
+  void PutNumber(T value);
+  template <typename T>
+  void PutLittleEndian(T value);
+
+  EncodingFormat format_;
+  std::vector<char> buffer_;
+  size_t size_ = 0;
+};
+
+/// обратное преобразование бинарного пакета строк в таблицу
+Table DecodeRowBatch(std::string_view batch);
@@ -0,0 +1,22 @@
+#include "arena_resource.h"
+
+ArenaResource::ArenaResource(size_t initial_size, std::pmr::memory_resource* upstream)
+    : arena_(initial_size, upstream) {}
+
+size_t ArenaResource::allocated() const {
+  std::lock_guard lock(mutex_);
+  return allocated_;
+}
+
+void* ArenaResource::do_allocate(size_t bytes, size_t alignment) {
+  std::lock_guard lock(mutex_);
+  void* p = arena_.allocate(bytes, alignment);
+  allocated_ += bytes;
+  return p;
+}
+
+void ArenaResource::do_deallocate(void*, size_t, size_t) {}
+
+bool ArenaResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
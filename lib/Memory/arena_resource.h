@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <mutex>
+
+/// арена одного запроса: выделение — сдвиг указателя в текущем куске, освобождение
+/// отдельного блока ничего не делает, все куски возвращаются upstream разом в деструкторе.
+/// Операторы запроса выделяют из нее из нескольких потоков, поэтому вызовы под мьютексом;
+/// между запросами арены не разделяются и общий malloc не трогают.
+class ArenaResource : public std::pmr::memory_resource {
+ public:
+  static constexpr size_t kInitialSize = 4096;
+
+  explicit ArenaResource(size_t initial_size = kInitialSize,
+                         std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+  ArenaResource(const ArenaResource&) = delete;
+  ArenaResource& operator=(const ArenaResource&) = delete;
+
+  /// байты, запрошенные у арены за все время (освобожденные блоки не вычитаются)
+  size_t allocated() const;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+  mutable std::mutex mutex_;
+  std::pmr::monotonic_buffer_resource arena_;
+  size_t allocated_ = 0;
+};
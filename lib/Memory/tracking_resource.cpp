@@ -0,0 +1,84 @@
+#include "tracking_resource.h"
+
+TrackingResource::TrackingResource(std::string name, size_t limit, std::shared_ptr<TrackingResource> parent,
+                                   std::pmr::memory_resource* upstream)
+    : name_(std::move(name)), limit_(limit), parent_(std::move(parent)), upstream_(upstream) {}
+
+std::shared_ptr<TrackingResource> TrackingResource::WithArena(std::string name, size_t limit,
+                                                             std::shared_ptr<TrackingResource> parent) {
+  auto arena = std::make_unique<ArenaResource>();
+  auto resource = std::make_shared<TrackingResource>(std::move(name), limit, std::move(parent), arena.get());
+  resource->arena_ = std::move(arena);
+  return resource;
+}
+
+void TrackingResource::Consume(size_t bytes) {
+  size_t used = used_.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  size_t limit = limit_.load(std::memory_order_relaxed);
+  if (limit != 0 && used > limit) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+    throw MemoryLimitError("Memory limit of " + name_ + " exceeded: " + std::to_string(used) + " > "
+                               + std::to_string(limit) + " bytes");
+  }
+  if (parent_) {
+    try {
+      parent_->Consume(bytes);
+    } catch (...) {
+      used_.fetch_sub(bytes, std::memory_order_relaxed);
+      throw;
+    }
+  }
+  size_t peak = peak_.load(std::memory_order_relaxed);
+  while (used > peak && !peak_.compare_exchange_weak(peak, used, std::memory_order_relaxed)) {
+  }
+}
+
+void TrackingResource::Release(size_t bytes) noexcept {
+  used_.fetch_sub(bytes, std::memory_order_relaxed);
+  if (parent_) {
+    parent_->Release(bytes);
+  }
+}
+
+void TrackingResource::SetLimit(size_t limit) {
+  limit_.store(limit, std::memory_order_relaxed);
+}
+
+const std::string& TrackingResource::name() const {
+  return name_;
+}
+
+size_t TrackingResource::used() const {
+  return used_.load(std::memory_order_relaxed);
+}
+
+size_t TrackingResource::peak() const {
+  return peak_.load(std::memory_order_relaxed);
+}
+
+size_t TrackingResource::limit() const {
+  return limit_.load(std::memory_order_relaxed);
+}
+
+const ArenaResource* TrackingResource::arena() const {
+  return arena_.get();
+}
+
+void* TrackingResource::do_allocate(size_t bytes, size_t alignment) {
+  Consume(bytes);
+  try {
+    return upstream_->allocate(bytes, alignment);
+  } catch (...) {
+    Release(bytes);
+    throw;
+  }
+}
+
+void TrackingResource::do_deallocate(void* p, size_t bytes, size_t alignment) {
+  upstream_->deallocate(p, bytes, alignment);
+  Release(bytes);
+}
+
+bool TrackingResource::do_is_equal(const std::pmr::memory_resource& other) const noexcept {
+  return this == &other;
+}
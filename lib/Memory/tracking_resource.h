@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+
+#include "arena_resource.h"
+
+struct MemoryOptions {
+  /// предел для всей базы: таблицы и промежуточные результаты запросов; 0 — без ограничения
+  size_t global_limit = 0;
+  /// предел промежуточных результатов одного запроса; 0 — без ограничения
+  size_t query_limit = 0;
+  /// рабочая память одного оператора (хеш-таблица соединения, сортировка);
+  /// при превышении оператор вытесняет данные во временные файлы; 0 — без ограничения
+  size_t operator_memory = 0;
+};
+
+/// превышение лимита памяти; запрос завершается, данные остаются согласованными
+class MemoryLimitError : public std::logic_error {
+ public:
+  using std::logic_error::logic_error;
+};
+
+/// pmr-ресурс, который считает выделенные через него байты и проверяет лимит.
+/// Ресурсы образуют дерево (база -> таблица/запрос), каждая аллокация списывается
+/// со всей цепочки предков. Байты, выделенные в обход ресурса (например, буферы
+/// std::string внутри Value), учитываются явно через Consume/Release.
+class TrackingResource : public std::pmr::memory_resource {
+ public:
+  explicit TrackingResource(std::string name, size_t limit = 0, std::shared_ptr<TrackingResource> parent = nullptr,
+                            std::pmr::memory_resource* upstream = std::pmr::new_delete_resource());
+
+  /// ресурс поверх собственной ArenaResource: освобождение списывает байты со счетчиков,
+  /// но сама память возвращается только вместе с ресурсом
+  static std::shared_ptr<TrackingResource> WithArena(std::string name, size_t limit = 0,
+                                                     std::shared_ptr<TrackingResource> parent = nullptr);
+
+  TrackingResource(const TrackingResource&) = delete;
+  TrackingResource& operator=(const TrackingResource&) = delete;
+
+  /// бросает MemoryLimitError, ничего не списав, если лимит любого предка превышен
+  void Consume(size_t bytes);
+
+  void Release(size_t bytes) noexcept;
+
+  void SetLimit(size_t limit);
+
+  const std::string& name() const;
+
+  size_t used() const;
+
+  size_t peak() const;
+
+  size_t limit() const;
+
+  /// арена ресурса или nullptr, если выделения идут прямо в upstream
+  const ArenaResource* arena() const;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override;
+
+  std::string name_;
+  std::atomic<size_t> limit_;
+  std::atomic<size_t> used_ = 0;
+  std::atomic<size_t> peak_ = 0;
+  std::shared_ptr<TrackingResource> parent_;
+  std::pmr::memory_resource* upstream_;
+  std::unique_ptr<ArenaResource> arena_;
+};
@@ -1,17 +1,16 @@
 #include "base_parser.h"
 
-BaseParser::BaseParser(const std::string& s) {
-  source_ = Source(s);
+BaseParser::BaseParser(std::string_view s) : lexer_(s) {
   Take();
 }
 
-char BaseParser::Take() {
-  char result = cur_;
-  cur_ = source_.HasNext() ? source_.Next() : kEnd;
+Lexeme BaseParser::Take() {
+  Lexeme result = cur_;
+  cur_ = lexer_.Next();
   return result;
 }
 
-bool BaseParser::Take(char expected) {
+bool BaseParser::Take(Keyword expected) {
   if (Test(expected)) {
     Take();
     return true;
@@ -20,65 +19,78 @@ bool BaseParser::Take(char expected) {
   }
 }
 
-void BaseParser::SkipWhitespace() {
-  while (std::isspace(cur_)) {
+bool BaseParser::Take(std::string_view symbol) {
+  if (Test(symbol)) {
     Take();
+    return true;
+  } else {
+    return false;
   }
 }
 
-void BaseParser::Expect(char expected) {
+void BaseParser::Expect(Keyword expected) {
   if (!Take(expected)) {
-    throw Error(std::string("Expected '") + expected + std::string("', found ") + ErrorChar());
+    throw Error(std::string("Expected ") + std::string(Lexer::KeywordName(expected)) + ", found " + ErrorLexeme());
   }
 }
 
-void BaseParser::Expect(const std::string& s) {
-  for (const auto& ch : s) {
-    Expect(ch);
+void BaseParser::Expect(std::string_view symbol) {
+  if (!Take(symbol)) {
+    throw Error(std::string("Expected '") + std::string(symbol) + "', found " + ErrorLexeme());
   }
 }
 
 bool BaseParser::Eof() const {
-  return cur_ == kEnd;
+  return cur_.type == LexemeType::kEnd;
 }
 
 void BaseParser::CheckEof() {
   if (!Eof()) {
-    throw Error(std::string("Expected EOF, found ") + ErrorChar());
+    throw Error(std::string("Expected EOF, found ") + ErrorLexeme());
   }
 }
 
-std::string BaseParser::ErrorChar() const {
-  return cur_ == kEnd ? "EOF" : std::string("'") + cur_ + std::string("'");
+std::string BaseParser::ErrorLexeme() const {
+  return Eof() ? "EOF" : std::string("'") + std::string(cur_.text) + std::string("'");
 }
 
-bool BaseParser::Test(char expected) const {
-  return cur_ == expected || (std::isalpha(cur_) && cur_ == std::tolower(expected));
+bool BaseParser::Test(Keyword expected) const {
+  return cur_.type == LexemeType::kWord && cur_.keyword == expected;
 }
 
-std::logic_error BaseParser::Error(const std::string& msg) {
-  return source_.Error(msg);
+bool BaseParser::Test(std::string_view symbol) const {
+  return cur_.type == LexemeType::kSymbol && cur_.text == symbol;
 }
 
-std::string BaseParser::TakeWord() {
-  std::string word;
-  while (!Eof() && !std::isspace(cur_) && !Test(",.()")) {
-    word += Take();
-  }
-  return word;
+std::logic_error BaseParser::Error(const std::string& msg) const {
+  return Lexer::Error(cur_, msg);
 }
 
-std::string BaseParser::ParseString() {
-  std::string res;
-  while (!Eof() && !Test('\'')) {
-    res += Take();
+std::string BaseParser::TakeWord() {
+  if (cur_.type != LexemeType::kWord) {
+    throw Error("Expected name, found " + ErrorLexeme());
   }
-  Expect('\'');
-  return res;
+  return std::string(Take().text);
 }
 
-bool BaseParser::Test(const std::string& s) const {
-  return std::any_of(s.begin(), s.end(), [this](char ch) { return Test(ch); });
+std::string BaseParser::TakeValue() {
+  switch (cur_.type) {
+    case LexemeType::kNumber:
+      return std::string(Take().text);
+    case LexemeType::kString:
+      return Unescape(Take());
+    case LexemeType::kWord:
+      if (Take(Keyword::kTrue)) {
+        return "1";
+      } else if (Take(Keyword::kFalse)) {
+        return "0";
+      } else if (Take(Keyword::kNull)) {
+        return "NULL";
+      }
+      return std::string(Take().text);
+    default:
+      throw Error("Invalid value " + ErrorLexeme());
+  }
 }
 
 std::vector<Token> BaseParser::ParseFilters() {
@@ -102,6 +114,9 @@ std::vector<Token> BaseParser::ParseFilters() {
     switch (token.type) {
       case kVar:
       case kConst:
+      // IS [NOT] NULL связывает сильнее всех и относится к уже выведенному операнду
+      case kIsNull:
+      case kIsNotNull:
         postfix_expr.push_back(token);
         break;
       case kOpenPar:
@@ -128,6 +143,9 @@ std::vector<Token> BaseParser::ParseFilters() {
   }
 
   while (!stack.empty()) {
+    if (stack.top().type == kOpenPar) {
+      throw Error("Invalid logic expression");
+    }
     postfix_expr.push_back(stack.top());
     stack.pop();
   }
@@ -136,49 +154,47 @@ std::vector<Token> BaseParser::ParseFilters() {
 }
 
 void BaseParser::Tokenize(std::vector<Token>& tokens) {
-  while (!Eof()) {
-    if (Take('(')) {
+  while (!Eof() && !Test(";") && !Test(Keyword::kOrder)) {
+    if (Take("(")) {
       tokens.emplace_back(kOpenPar);
-    } else if (Take(')')) {
+    } else if (Take(")")) {
       tokens.emplace_back(kClosePar);
-    } else if (Take('=')) {
+    } else if (Take("=")) {
       tokens.emplace_back(kEquals);
-    } else if (Take('<')) {
-      if (Take('=')) {
-        tokens.emplace_back(kNotGreater);
-      } else if (Take('>')) {
-        tokens.emplace_back(kNotEquals);
-      } else {
-        tokens.emplace_back(kLess);
+    } else if (Take("<>") || Take("!=")) {
+      tokens.emplace_back(kNotEquals);
+    } else if (Take("<=")) {
+      tokens.emplace_back(kNotGreater);
+    } else if (Take("<")) {
+      tokens.emplace_back(kLess);
+    } else if (Take(">=")) {
+      tokens.emplace_back(kNotLess);
+    } else if (Take(">")) {
+      tokens.emplace_back(kGreater);
+    } else if (Take(Keyword::kOr)) {
+      tokens.emplace_back(kOr);
+    } else if (Take(Keyword::kAnd)) {
+      tokens.emplace_back(kAnd);
+    } else if (Test(Keyword::kIs)) {
+      if (tokens.empty() || (tokens.back().type != kVar && tokens.back().type != kConst
+                             && tokens.back().type != kClosePar)) {
+        throw Error("Unexpected " + ErrorLexeme() + " in logic expression");
       }
-    } else if (Take('>')) {
-      if (Take('=')) {
-        tokens.emplace_back(kNotLess);
-      } else {
-        tokens.emplace_back(kGreater);
+      Take();
+      bool negated = Take(Keyword::kNot);
+      Expect(Keyword::kNull);
+      tokens.emplace_back(negated ? kIsNotNull : kIsNull);
+    } else if (cur_.type == LexemeType::kWord && cur_.keyword != Keyword::kTrue &&
+        cur_.keyword != Keyword::kFalse && cur_.keyword != Keyword::kNull) {
+      std::string name = TakeWord();
+      if (Take(".")) {
+        name = TakeWord();
       }
+      tokens.emplace_back(kVar, name);
+    } else if (cur_.type == LexemeType::kSymbol) {
+      throw Error("Unexpected " + ErrorLexeme() + " in logic expression");
     } else {
-      std::string tmp = TakeWord();
-      if (tmp[0] == '\'') {
-        if (tmp[tmp.size() - 1] == '\'') {
-          tokens.emplace_back(kConst, tmp.substr(1, tmp.size() - 2));
-        } else {
-          throw Error(std::string("Expected \', found ") + cur_);
-        }
-      } else if (std::isalpha(tmp[0])) {
-        if (tmp == "OR") {
-          tokens.emplace_back(kOr);
-        } else if (tmp == "AND") {
-          tokens.emplace_back(kAnd);
-        } else if (tmp == "TRUE" || tmp == "FALSE") {
-          tokens.emplace_back(kConst, tmp);
-        } else {
-          tokens.emplace_back(kVar, tmp);
-        }
-      } else {
-        tokens.emplace_back(kConst, tmp);
-      }
+      tokens.emplace_back(kConst, TakeValue());
     }
-    SkipWhitespace();
   }
-}
\ No newline at end of file
+}
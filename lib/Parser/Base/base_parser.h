@@ -1,13 +1,13 @@
 #pragma once
 
+#include <algorithm>
 #include <stack>
+#include <string>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
-#include "source.h"
-
-const char kEnd = 0;
+#include "lexer.h"
 
 enum TokenType {
   kVar,
@@ -21,6 +21,9 @@ enum TokenType {
   kNotLess,
   kOr,
   kAnd,
+  /// унарные постфиксные IS NULL и IS NOT NULL
+  kIsNull,
+  kIsNotNull,
   kOpenPar,
   kClosePar
 };
@@ -32,42 +35,45 @@ struct Token {
 
 class BaseParser {
  public:
-  explicit BaseParser(const std::string& s);
+  /// текст запроса не копируется и должен жить дольше парсера
+  explicit BaseParser(std::string_view s);
 
  protected:
-  Source source_;
-  char cur_;
+  Lexer lexer_;
+  Lexeme cur_;
+
+  /// вернуть текущую лексему и перейти к следующей
+  Lexeme Take();
 
-  /// вернуть текущий символ и перейти к следующему
-  char Take();
+  /// Take с проверкой ключевого слова
+  bool Take(Keyword expected);
 
-  /// Take с проверкой
-  bool Take(char expected);
+  /// Take с проверкой символа
+  bool Take(std::string_view symbol);
 
+  /// имя таблицы или столбца
   std::string TakeWord();
 
-  /// пропустить служебные символы
-  void SkipWhitespace();
+  /// значение константы: число, строка, слово или NULL
+  std::string TakeValue();
 
-  /// проверить, что текущий символ соответствует ожидаемому
-  void Expect(char expected);
+  /// проверить, что текущая лексема соответствует ожидаемой
+  void Expect(Keyword expected);
 
-  void Expect(const std::string& s);
+  void Expect(std::string_view symbol);
 
   /// проверить на конец
   void CheckEof();
 
   bool Eof() const;
 
-  std::string ErrorChar() const;
-
-  bool Test(char expected) const;
+  std::string ErrorLexeme() const;
 
-  bool Test(const std::string& s) const;
+  bool Test(Keyword expected) const;
 
-  std::logic_error Error(const std::string& msg);
+  bool Test(std::string_view symbol) const;
 
-  std::string ParseString();
+  std::logic_error Error(const std::string& msg) const;
 
   std::vector<Token> ParseFilters();
 
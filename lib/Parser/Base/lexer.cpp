@@ -0,0 +1,285 @@
+#include "lexer.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+
+namespace {
+
+struct KeywordEntry {
+  std::string_view text;
+  Keyword keyword;
+};
+
+constexpr KeywordEntry kKeywords[] = {
+    {"SELECT", Keyword::kSelect},
+    {"FROM", Keyword::kFrom},
+    {"WHERE", Keyword::kWhere},
+    {"JOIN", Keyword::kJoin},
+    {"LEFT", Keyword::kLeft},
+    {"RIGHT", Keyword::kRight},
+    {"INNER", Keyword::kInner},
+    {"ON", Keyword::kOn},
+    {"CREATE", Keyword::kCreate},
+    {"TABLE", Keyword::kTable},
+    {"DROP", Keyword::kDrop},
+    {"AND", Keyword::kAnd},
+    {"OR", Keyword::kOr},
+    {"IS", Keyword::kIs},
+    {"NOT", Keyword::kNot},
+    {"NULL", Keyword::kNull},
+    {"UPDATE", Keyword::kUpdate},
+    {"SET", Keyword::kSet},
+    {"INSERT", Keyword::kInsert},
+    {"INTO", Keyword::kInto},
+    {"VALUES", Keyword::kValues},
+    {"DELETE", Keyword::kDelete},
+    {"PRIMARY", Keyword::kPrimary},
+    {"FOREIGN", Keyword::kForeign},
+    {"KEY", Keyword::kKey},
+    {"REFERENCES", Keyword::kReferences},
+    {"INT", Keyword::kInt},
+    {"BOOL", Keyword::kBool},
+    {"DOUBLE", Keyword::kDouble},
+    {"FLOAT", Keyword::kFloat},
+    {"VARCHAR", Keyword::kVarchar},
+    {"TRUE", Keyword::kTrue},
+    {"FALSE", Keyword::kFalse},
+    {"SHOW", Keyword::kShow},
+    {"STATS", Keyword::kStats},
+    {"ORDER", Keyword::kOrder},
+    {"BY", Keyword::kBy},
+    {"ASC", Keyword::kAsc},
+    {"DESC", Keyword::kDesc},
+    {"MATERIALIZED", Keyword::kMaterialized},
+    {"VIEW", Keyword::kView},
+    {"AS", Keyword::kAs},
+    {"PARTITION", Keyword::kPartition},
+    {"PARTITIONS", Keyword::kPartitions},
+    {"HASH", Keyword::kHash},
+    {"BEGIN", Keyword::kBegin},
+    {"TRANSACTION", Keyword::kTransaction},
+    {"COMMIT", Keyword::kCommit},
+    {"ROLLBACK", Keyword::kRollback},
+    {"APPROX_COUNT_DISTINCT", Keyword::kApproxCountDistinct},
+    {"APPROX_PERCENTILE", Keyword::kApproxPercentile},
+};
+
+constexpr size_t kKeywordCount = sizeof(kKeywords) / sizeof(kKeywords[0]);
+constexpr size_t kKeywordTableSize = 256;
+
+constexpr char ToUpper(char ch) {
+  return ch >= 'a' && ch <= 'z' ? static_cast<char>(ch - 'a' + 'A') : ch;
+}
+
+constexpr uint32_t HashKeyword(std::string_view word, uint32_t seed) {
+  uint32_t h = seed;
+  for (char ch : word) {
+    h = (h ^ static_cast<uint8_t>(ToUpper(ch))) * 16777619u;
+  }
+  return h;
+}
+
+constexpr size_t MaxKeywordLength() {
+  size_t res = 0;
+  for (const auto& e : kKeywords) {
+    res = std::max(res, e.text.size());
+  }
+  return res;
+}
+
+/// подбирает затравку, при которой у всех ключевых слов разные ячейки таблицы
+constexpr uint32_t FindKeywordSeed() {
+  for (uint32_t seed = 2166136261u;; ++seed) {
+    std::array<bool, kKeywordTableSize> used{};
+    bool collision = false;
+    for (const auto& e : kKeywords) {
+      size_t slot = HashKeyword(e.text, seed) % kKeywordTableSize;
+      if (used[slot]) {
+        collision = true;
+        break;
+      }
+      used[slot] = true;
+    }
+    if (!collision) {
+      return seed;
+    }
+  }
+}
+
+constexpr uint32_t kKeywordSeed = FindKeywordSeed();
+
+constexpr std::array<uint8_t, kKeywordTableSize> BuildKeywordTable() {
+  std::array<uint8_t, kKeywordTableSize> table{};
+  table.fill(kKeywordCount);
+  for (size_t i = 0; i < kKeywordCount; ++i) {
+    table[HashKeyword(kKeywords[i].text, kKeywordSeed) % kKeywordTableSize] = i;
+  }
+  return table;
+}
+
+constexpr std::array<uint8_t, kKeywordTableSize> kKeywordTable = BuildKeywordTable();
+constexpr size_t kMaxKeywordLength = MaxKeywordLength();
+
+bool IsWordStart(char ch) {
+  return std::isalpha(static_cast<unsigned char>(ch)) || ch == '_';
+}
+
+bool IsWordChar(char ch) {
+  return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+}
+
+bool IsDigit(char ch) {
+  return ch >= '0' && ch <= '9';
+}
+
+}  // namespace
+
+Lexer::Lexer(std::string_view input) : input_(input) {}
+
+Keyword Lexer::LookupKeyword(std::string_view word) {
+  if (word.empty() || word.size() > kMaxKeywordLength) {
+    return Keyword::kNone;
+  }
+  size_t id = kKeywordTable[HashKeyword(word, kKeywordSeed) % kKeywordTableSize];
+  if (id == kKeywordCount || kKeywords[id].text.size() != word.size()) {
+    return Keyword::kNone;
+  }
+  for (size_t i = 0; i < word.size(); ++i) {
+    if (ToUpper(word[i]) != kKeywords[id].text[i]) {
+      return Keyword::kNone;
+    }
+  }
+  return kKeywords[id].keyword;
+}
+
+std::string_view Lexer::KeywordName(Keyword keyword) {
+  for (const auto& e : kKeywords) {
+    if (e.keyword == keyword) {
+      return e.text;
+    }
+  }
+  return "";
+}
+
+std::logic_error Lexer::Error(const Lexeme& at, const std::string& msg) {
+  return std::logic_error(std::to_string(at.line) + ":" + std::to_string(at.column) + ": " + msg);
+}
+
+char Lexer::Peek(size_t offset) const {
+  return pos_ + offset < input_.size() ? input_[pos_ + offset] : '\0';
+}
+
+void Lexer::Advance() {
+  if (input_[pos_] == '\n') {
+    ++line_;
+    line_start_ = pos_ + 1;
+  }
+  ++pos_;
+}
+
+void Lexer::SkipWhitespace() {
+  while (pos_ < input_.size()) {
+    if (std::isspace(static_cast<unsigned char>(input_[pos_]))) {
+      Advance();
+    } else if (Peek() == '-' && Peek(1) == '-') {
+      while (pos_ < input_.size() && input_[pos_] != '\n') {
+        Advance();
+      }
+    } else {
+      break;
+    }
+  }
+}
+
+Lexeme Lexer::Next() {
+  SkipWhitespace();
+  Lexeme res;
+  res.line = line_;
+  res.column = static_cast<uint32_t>(pos_ - line_start_ + 1);
+  if (pos_ >= input_.size()) {
+    return res;
+  }
+  size_t start = pos_;
+  char ch = input_[pos_];
+  if (IsWordStart(ch)) {
+    while (pos_ < input_.size() && IsWordChar(input_[pos_])) {
+      ++pos_;
+    }
+    res.type = LexemeType::kWord;
+    res.text = input_.substr(start, pos_ - start);
+    res.keyword = LookupKeyword(res.text);
+  } else if (IsDigit(ch) || ((ch == '-' || ch == '+') && (IsDigit(Peek(1)) || (Peek(1) == '.' && IsDigit(Peek(2)))))
+      || (ch == '.' && IsDigit(Peek(1)))) {
+    if (ch == '-' || ch == '+') {
+      ++pos_;
+    }
+    while (IsDigit(Peek())) {
+      ++pos_;
+    }
+    if (Peek() == '.') {
+      ++pos_;
+      while (IsDigit(Peek())) {
+        ++pos_;
+      }
+    }
+    if ((Peek() == 'e' || Peek() == 'E') &&
+        (IsDigit(Peek(1)) || ((Peek(1) == '-' || Peek(1) == '+') && IsDigit(Peek(2))))) {
+      pos_ += 2;
+      while (IsDigit(Peek())) {
+        ++pos_;
+      }
+    }
+    if (IsWordStart(Peek())) {
+      throw Error(res, "Invalid number");
+    }
+    res.type = LexemeType::kNumber;
+    res.text = input_.substr(start, pos_ - start);
+  } else if (ch == '\'') {
+    Advance();
+    size_t content = pos_;
+    while (true) {
+      if (pos_ >= input_.size()) {
+        throw Error(res, "Unterminated string");
+      }
+      if (input_[pos_] == '\'') {
+        if (Peek(1) == '\'') {
+          res.escaped = true;
+          pos_ += 2;
+          continue;
+        }
+        break;
+      }
+      Advance();
+    }
+    res.type = LexemeType::kString;
+    res.text = input_.substr(content, pos_ - content);
+    ++pos_;
+  } else {
+    if ((ch == '<' && (Peek(1) == '=' || Peek(1) == '>')) || ((ch == '>' || ch == '!') && Peek(1) == '=')) {
+      pos_ += 2;
+    } else if (std::string_view("(),.;*=<>").find(ch) != std::string_view::npos) {
+      ++pos_;
+    } else {
+      throw Error(res, std::string("Unexpected character '") + ch + "'");
+    }
+    res.type = LexemeType::kSymbol;
+    res.text = input_.substr(start, pos_ - start);
+  }
+  return res;
+}
+
+std::string Unescape(const Lexeme& lexeme) {
+  if (!lexeme.escaped) {
+    return std::string(lexeme.text);
+  }
+  std::string res;
+  res.reserve(lexeme.text.size());
+  for (size_t i = 0; i < lexeme.text.size(); ++i) {
+    res += lexeme.text[i];
+    if (lexeme.text[i] == '\'') {
+      ++i;
+    }
+  }
+  return res;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+enum class Keyword : uint8_t {
+  kNone,
+  kSelect,
+  kFrom,
+  kWhere,
+  kJoin,
+  kLeft,
+  kRight,
+  kInner,
+  kOn,
+  kCreate,
+  kTable,
+  kDrop,
+  kAnd,
+  kOr,
+  kIs,
+  kNot,
+  kNull,
+  kUpdate,
+  kSet,
+  kInsert,
+  kInto,
+  kValues,
+  kDelete,
+  kPrimary,
+  kForeign,
+  kKey,
+  kReferences,
+  kInt,
+  kBool,
+  kDouble,
+  kFloat,
+  kVarchar,
+  kTrue,
+  kFalse,
+  kShow,
+  kStats,
+  kOrder,
+  kBy,
+  kAsc,
+  kDesc,
+  kMaterialized,
+  kView,
+  kAs,
+  kPartition,
+  kPartitions,
+  kHash,
+  kBegin,
+  kTransaction,
+  kCommit,
+  kRollback,
+  kApproxCountDistinct,
+  kApproxPercentile
+};
+
+enum class LexemeType : uint8_t {
+  kWord,
+  kNumber,
+  kString,
+  kSymbol,
+  kEnd
+};
+
+/// лексема ссылается на исходный текст запроса, который должен пережить парсер
+struct Lexeme {
+  LexemeType type = LexemeType::kEnd;
+  Keyword keyword = Keyword::kNone;
+  std::string_view text;
+  uint32_t line = 1;
+  uint32_t column = 1;
+  /// строка содержит удвоенные кавычки ''
+  bool escaped = false;
+};
+
+class Lexer {
+ public:
+  Lexer() = default;
+
+  explicit Lexer(std::string_view input);
+
+  /// следующая лексема, в конце ввода возвращает kEnd
+  Lexeme Next();
+
+  /// поиск ключевого слова без учета регистра через совершенный хеш
+  static Keyword LookupKeyword(std::string_view word);
+
+  static std::string_view KeywordName(Keyword keyword);
+
+  /// ошибка с указанием строки и столбца
+  static std::logic_error Error(const Lexeme& at, const std::string& msg);
+
+ private:
+  char Peek(size_t offset = 0) const;
+  void Advance();
+  void SkipWhitespace();
+
+  std::string_view input_;
+  size_t pos_ = 0;
+  uint32_t line_ = 1;
+  size_t line_start_ = 0;
+};
+
+/// текст строковой лексемы без экранирования
+std::string Unescape(const Lexeme& lexeme);
@@ -1,24 +1,30 @@
 #include "sql_parser.h"
 
-SqlParser::SqlParser(const std::string& query) : BaseParser(query) {}
+SqlParser::SqlParser(std::string_view query) : BaseParser(query) {}
 
 Query SqlParser::Parse() {
   Query q;
-  SkipWhitespace();
-  if (Take('C')) {
+  if (Take(Keyword::kCreate)) {
     q = {kCreate, ParseCreate()};
-  } else if (Take('I')) {
+  } else if (Take(Keyword::kInsert)) {
     q = {kInsert, ParseInsert()};
-  } else if (Take('S')) {
+  } else if (Take(Keyword::kSelect)) {
     q = {kSelect, ParseSelect()};
-  } else if (Take('U')) {
+  } else if (Take(Keyword::kUpdate)) {
     q = {kUpdate, ParseUpdate()};
-  } else if (Take('D')) {
-    if (Take('E')) {
-      q = {kDelete, ParseDelete()};
-    } else if (Take('R')) {
-      q = {kDrop, ParseDrop()};
-    }
+  } else if (Take(Keyword::kDelete)) {
+    q = {kDelete, ParseDelete()};
+  } else if (Take(Keyword::kDrop)) {
+    q = {kDrop, ParseDrop()};
+  } else if (Take(Keyword::kShow)) {
+    q = {kShow, ParseShow()};
+  } else if (Take(Keyword::kBegin)) {
+    Take(Keyword::kTransaction);
+    q = {kBegin, ParseTransaction()};
+  } else if (Take(Keyword::kCommit)) {
+    q = {kCommit, ParseTransaction()};
+  } else if (Take(Keyword::kRollback)) {
+    q = {kRollback, ParseTransaction()};
   } else {
     throw Error("Unsupported query");
   }
@@ -26,337 +32,370 @@ Query SqlParser::Parse() {
   return q;
 }
 
-SerializerForCreate SqlParser::ParseCreate() {
-  Expect("REATE");
-  SkipWhitespace();
-  Expect("TABLE");
-  SkipWhitespace();
+void SqlParser::ParseEnd() {
+  Take(";");
+  CheckEof();
+}
 
+SerializerForCreate SqlParser::ParseCreate() {
   SerializerForCreate serializer;
+  if (Take(Keyword::kMaterialized)) {
+    Expect(Keyword::kView);
+    serializer.is_view = true;
+    serializer.table_name = TakeWord();
+    Expect(Keyword::kAs);
+    Expect(Keyword::kSelect);
+    serializer.view = ParseSelect();
+    return serializer;
+  }
+  Expect(Keyword::kTable);
+
   serializer.table_name = TakeWord();
-  SkipWhitespace();
-  Expect('(');
+  Expect("(");
   bool primary_is_set = false;
-  while (!Eof() && !Test(')')) {
-    SkipWhitespace();
+  while (!Eof() && !Test(")")) {
+    if (Take(Keyword::kForeign)) {
+      Expect(Keyword::kKey);
+      ForeignKey key;
+      Expect("(");
+      key.column = TakeWord();
+      Expect(")");
+      Expect(Keyword::kReferences);
+      key.table = TakeWord();
+      Expect("(");
+      key.referenced = TakeWord();
+      Expect(")");
+      if (!Test(")")) {
+        Expect(",");
+      }
+      serializer.foreign_keys.push_back(std::move(key));
+      continue;
+    }
     std::string name = TakeWord();
-    SkipWhitespace();
     DataType type;
     size_t len = 0;
-    if (Take('I')) {
-      Expect("NT");
+    if (Take(Keyword::kInt)) {
       type = kInt;
-    } else if (Take('B')) {
-      Expect("OOL");
+    } else if (Take(Keyword::kBool)) {
       type = kBool;
-    } else if (Take('D')) {
-      Expect("OUBLE");
+    } else if (Take(Keyword::kDouble)) {
       type = kDouble;
-    } else if (Take('F')) {
-      Expect("LOAT");
+    } else if (Take(Keyword::kFloat)) {
       type = kFloat;
-    } else if (Take('V')) {
-      std::string buf;
-      Expect("ARCHAR");
+    } else if (Take(Keyword::kVarchar)) {
       type = kVarchar;
-      SkipWhitespace();
-      Expect('(');
-      SkipWhitespace();
-      while (!Eof() && !Test(')') && !std::isspace(cur_)) {
-        buf += Take();
-      }
-      if (!buf.empty()) {
-        len = std::stoull(buf);
-      } else {
+      Expect("(");
+      if (cur_.type != LexemeType::kNumber) {
         throw Error("Varchar size is not set");
       }
-      SkipWhitespace();
-      Expect(')');
+      len = std::stoull(std::string(Take().text));
+      Expect(")");
     } else {
       throw Error("Invalid data type");
     }
-    SkipWhitespace();
-    if (!primary_is_set && Take('P')) {
-      Expect("RIMARY");
-      SkipWhitespace();
-      Expect("KEY");
-      SkipWhitespace();
+    if (!primary_is_set && Take(Keyword::kPrimary)) {
+      Expect(Keyword::kKey);
       serializer.primary_key = serializer.table_columns.size();
       primary_is_set = true;
     }
     bool not_null = false;
-    if (Take('N')) {
-      Expect("OT");
-      SkipWhitespace();
-      Expect("NULL");
+    if (Take(Keyword::kNot)) {
+      Expect(Keyword::kNull);
       not_null = true;
-      SkipWhitespace();
     }
-    if (!Test(')')) {
-      Expect(',');
+    if (!Test(")")) {
+      Expect(",");
     }
     serializer.table_columns.emplace_back(name, type, len, not_null);
   }
-  Expect(')');
+  Expect(")");
+
+  if (Take(Keyword::kPartition)) {
+    Expect(Keyword::kBy);
+    Expect(Keyword::kHash);
+    Expect("(");
+    serializer.partition_key = TakeWord();
+    Expect(")");
+    Expect(Keyword::kPartitions);
+    if (cur_.type != LexemeType::kNumber) {
+      throw Error("Number of partitions is not set");
+    }
+    serializer.partitions = std::stoull(std::string(Take().text));
+    if (serializer.partitions == 0) {
+      throw Error("Number of partitions must be positive");
+    }
+  }
 
   if (!primary_is_set) {
     throw std::logic_error("Primary key is not set");
   }
 
-  SkipWhitespace();
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  ParseEnd();
 
   return serializer;
 }
 
 SerializerForDrop SqlParser::ParseDrop() {
-  Expect("OP");
-  SkipWhitespace();
-  Expect("TABLE");
-  SkipWhitespace();
+  Expect(Keyword::kTable);
 
   SerializerForDrop serializer;
   serializer.table_name = TakeWord();
-  SkipWhitespace();
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  ParseEnd();
 
   return serializer;
 }
 
 SerializerForInsert SqlParser::ParseInsert() {
-  Expect("NSERT");
-  SkipWhitespace();
-  Expect("INTO");
-  SkipWhitespace();
+  Expect(Keyword::kInto);
 
   SerializerForInsert serializer;
   serializer.table_name = TakeWord();
-  std::queue<std::string> columns;
-
-  SkipWhitespace();
-  Expect('(');
-  while (!Eof() && !Test(')')) {
-    SkipWhitespace();
-    columns.push(TakeWord());
-    SkipWhitespace();
-    if (!Test(')')) {
-      Expect(',');
+
+  Expect("(");
+  while (!Eof() && !Test(")")) {
+    serializer.columns.push_back(TakeWord());
+    if (!Test(")")) {
+      Expect(",");
     }
   }
-  Expect(')');
-  SkipWhitespace();
-
-  Expect("VALUES");
-  SkipWhitespace();
-  Expect('(');
-  while (!Eof() && !Test(')')) {
-    SkipWhitespace();
-    std::string buf;
-    while (!Eof() && !Test(",)") && !std::isspace(cur_)) {
-      if (Take('\'')) {
-        buf = ParseString();
-      } else {
-        buf += Take();
+  Expect(")");
+
+  Expect(Keyword::kValues);
+  do {
+    Expect("(");
+    std::vector<std::string> row;
+    row.reserve(serializer.columns.size());
+    while (!Eof() && !Test(")")) {
+      row.push_back(TakeValue());
+      if (!Test(")")) {
+        Expect(",");
       }
     }
-    SkipWhitespace();
-    if (buf.empty()) {
-      throw Error("Invalid value");
+    if (row.size() != serializer.columns.size()) {
+      throw Error("Expected " + std::to_string(serializer.columns.size()) + " values, found "
+                      + std::to_string(row.size()));
     }
-    if (!Test(')')) {
-      Expect(',');
-    }
-    serializer.data.emplace(columns.front(), buf);
-    columns.pop();
-  }
-  Expect(')');
-  SkipWhitespace();
+    Expect(")");
+    serializer.rows.push_back(std::move(row));
+  } while (Take(","));
 
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  ParseEnd();
 
   return serializer;
 }
 
 SerializerForSelect SqlParser::ParseSelect() {
-  Expect("ELECT");
-  SkipWhitespace();
-
   SerializerForSelect serializer;
-  if (Take('*')) {
+  std::vector<std::pair<std::string, std::string>> qualified;
+  if (Take("*")) {
     serializer.all_table = true;
   } else {
-    while (!Eof()) {
+    do {
+      if (Test(Keyword::kApproxCountDistinct) || Test(Keyword::kApproxPercentile)) {
+        serializer.aggregates.push_back(ParseAggregate());
+        continue;
+      }
       std::string buf = TakeWord();
-      if (Take('.')) {
-        if (serializer.table_name1.empty() || buf == serializer.table_name1) {
-          serializer.table_name1 = buf;
-          serializer.columns1.push_back(TakeWord());
-        } else if (serializer.table_name2.empty() || buf == serializer.table_name2) {
-          serializer.table_name2 = buf;
-          serializer.columns2.push_back(TakeWord());
-        } else {
-          throw Error("Invalid query");
-        }
+      if (Take(".")) {
+        qualified.emplace_back(buf, TakeWord());
       } else {
         serializer.unique_columns.push_back(buf);
       }
-      SkipWhitespace();
-      if (Take(',')) {
-        SkipWhitespace();
-        continue;
-      } else {
-        break;
-      }
-    }
+    } while (Take(","));
   }
 
-  SkipWhitespace();
-  Expect("FROM");
-  SkipWhitespace();
+  if (!serializer.aggregates.empty() && (!serializer.unique_columns.empty() || !qualified.empty())) {
+    throw Error("Aggregates cannot be selected together with columns");
+  }
 
+  Expect(Keyword::kFrom);
   serializer.table_name1 = TakeWord();
-  SkipWhitespace();
 
-  if (Take('W')) {
-    Expect("HERE");
-    SkipWhitespace();
+  if (Take(Keyword::kWhere)) {
     serializer.filters = ParseFilters();
-  } else if (Take('L')) {
-    Expect("EFT");
-    serializer.join_type = kLeft;
-  } else if (Take('R')) {
-    Expect("IGHT");
-    serializer.join_type = kRight;
+  } else {
+    while (true) {
+      if (Take(Keyword::kLeft)) {
+        Expect(Keyword::kJoin);
+        ParseJoin(serializer, kLeft);
+      } else if (Take(Keyword::kRight)) {
+        Expect(Keyword::kJoin);
+        ParseJoin(serializer, kRight);
+      } else if (Take(Keyword::kInner)) {
+        Expect(Keyword::kJoin);
+        ParseJoin(serializer, kInner);
+      } else if (Take(Keyword::kJoin)) {
+        ParseJoin(serializer, kInner);
+      } else {
+        break;
+      }
+    }
   }
 
-  SkipWhitespace();
-  ParseJoin(serializer);
+  for (auto& [table, column] : qualified) {
+    auto clause = std::find_if(serializer.joins.begin(), serializer.joins.end(),
+                               [&table](const JoinClause& c) { return c.table == table; });
+    if (table == serializer.table_name1) {
+      serializer.columns1.push_back(std::move(column));
+    } else if (serializer.is_join && table == serializer.table_name2) {
+      serializer.columns2.push_back(std::move(column));
+    } else if (clause != serializer.joins.end()) {
+      clause->columns.push_back(std::move(column));
+    } else {
+      throw std::logic_error("Invalid query: unknown table '" + table + "'");
+    }
+  }
 
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  if (Take(Keyword::kOrder)) {
+    ParseOrderBy(serializer);
+  }
+
+  ParseEnd();
 
   return serializer;
 }
 
-void SqlParser::ParseJoin(SerializerForSelect& serializer) {
-  if (!Take('J')) {
+void SqlParser::ParseJoin(SerializerForSelect& serializer, JoinType type) {
+  if (serializer.is_join) {
+    JoinClause clause;
+    clause.type = type;
+    clause.table = TakeWord();
+    auto joined = [&serializer](const std::string& name) {
+      return name == serializer.table_name1 || name == serializer.table_name2
+             || std::any_of(serializer.joins.begin(), serializer.joins.end(),
+                            [&name](const JoinClause& c) { return c.table == name; });
+    };
+    if (joined(clause.table)) {
+      throw Error("Table '" + clause.table + "' is joined twice");
+    }
+    Expect(Keyword::kOn);
+    for (auto* side : {&clause.on_first, &clause.on_second}) {
+      if (side == &clause.on_second) {
+        Expect("=");
+      }
+      side->second = TakeWord();
+      if (Take(".")) {
+        side->first = std::move(side->second);
+        side->second = TakeWord();
+      }
+    }
+    serializer.joins.push_back(std::move(clause));
     return;
   }
-  Expect("OIN");
   serializer.is_join = true;
-  SkipWhitespace();
-  std::string buf = TakeWord();
-  if (serializer.table_name2.empty()) {
-    serializer.table_name2 = buf;
-  } else if (serializer.table_name2 != buf) {
-    throw Error("Invalid query");
-  }
-  SkipWhitespace();
-  Expect("ON");
-  SkipWhitespace();
-  buf = TakeWord();
-  if (Take('.')) {
-    if (buf == serializer.table_name1) {
-      serializer.join_columns.first = TakeWord();
-    } else if (buf == serializer.table_name2) {
-      serializer.join_columns.second = TakeWord();
+  serializer.join_type = type;
+  serializer.table_name2 = TakeWord();
+  Expect(Keyword::kOn);
+  for (size_t side = 0; side < 2; ++side) {
+    if (side == 1) {
+      Expect("=");
+    }
+    std::string buf = TakeWord();
+    if (Take(".")) {
+      std::string column = TakeWord();
+      if (buf == serializer.table_name1 && serializer.join_columns.first.empty()) {
+        serializer.join_columns.first = column;
+      } else if (buf == serializer.table_name2 && serializer.join_columns.second.empty()) {
+        serializer.join_columns.second = column;
+      } else {
+        throw Error("Invalid query");
+      }
+    } else if (side == 0) {
+      serializer.join_columns.first = buf;
+    } else if (serializer.join_columns.second.empty()) {
+      serializer.join_columns.second = buf;
     } else {
-      throw Error("Invalid query");
+      serializer.join_columns.first = buf;
     }
-  } else {
-    serializer.join_columns.first = TakeWord();
   }
-  SkipWhitespace();
-  Expect('=');
-  SkipWhitespace();
-  buf = TakeWord();
-  if (Take('.')) {
-    if (buf == serializer.table_name1 && serializer.join_columns.first.empty()) {
-      serializer.join_columns.first = TakeWord();
-    } else if (buf == serializer.table_name2 && serializer.join_columns.second.empty()) {
-      serializer.join_columns.second = TakeWord();
-    } else {
-      throw Error("Invalid query");
+}
+
+SelectAggregate SqlParser::ParseAggregate() {
+  SelectAggregate aggregate;
+  aggregate.type = Test(Keyword::kApproxCountDistinct) ? kApproxCountDistinct : kApproxPercentile;
+  std::string function(Lexer::KeywordName(Take().keyword));
+  Expect("(");
+  aggregate.column = TakeWord();
+  if (Take(".")) {
+    aggregate.column = TakeWord();
+  }
+  aggregate.name = function + "(" + aggregate.column;
+  if (aggregate.type == kApproxPercentile) {
+    Expect(",");
+    if (cur_.type != LexemeType::kNumber) {
+      throw Error("Percentile is not set");
     }
-  } else {
-    serializer.join_columns.second = TakeWord();
+    std::string_view text = Take().text;
+    aggregate.fraction = std::stod(std::string(text));
+    if (aggregate.fraction < 0 || aggregate.fraction > 1) {
+      throw Error("Percentile must be between 0 and 1");
+    }
+    aggregate.name += ", " + std::string(text);
   }
+  Expect(")");
+  aggregate.name += ")";
+  return aggregate;
 }
 
-SerializerForUpdate SqlParser::ParseUpdate() {
-  Expect("PDATE");
-  SkipWhitespace();
+void SqlParser::ParseOrderBy(SerializerForSelect& serializer) {
+  Expect(Keyword::kBy);
+  do {
+    std::string column = TakeWord();
+    if (Take(".")) {
+      column = TakeWord();
+    }
+    bool descending = Take(Keyword::kDesc);
+    if (!descending) {
+      Take(Keyword::kAsc);
+    }
+    serializer.order_by.emplace_back(std::move(column), descending);
+  } while (Take(","));
+}
 
+SerializerForUpdate SqlParser::ParseUpdate() {
   SerializerForUpdate serializer;
   serializer.table_name = TakeWord();
-  SkipWhitespace();
 
-  Expect("SET");
-  SkipWhitespace();
+  Expect(Keyword::kSet);
 
-  while (!Eof()) {
+  do {
     std::string column = TakeWord();
-    SkipWhitespace();
-    Expect('=');
-    SkipWhitespace();
-    std::string value = TakeWord();
-    SkipWhitespace();
-
-    if (value.empty()) {
-      throw Error("Invalid value");
-    }
+    Expect("=");
+    serializer.values.emplace(column, TakeValue());
+  } while (Take(","));
 
-    serializer.values.emplace(column, value);
-    if (Take(',')) {
-      SkipWhitespace();
-      continue;
-    } else {
-      break;
-    }
-  }
-
-  if (Take('W')) {
-    Expect("HERE");
-    SkipWhitespace();
+  if (Take(Keyword::kWhere)) {
     serializer.filters = ParseFilters();
   }
 
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  ParseEnd();
 
   return serializer;
 }
 
 SerializerForDelete SqlParser::ParseDelete() {
-  Expect("LETE");
-  SkipWhitespace();
-  Expect("FROM");
-  SkipWhitespace();
+  Expect(Keyword::kFrom);
 
   SerializerForDelete serializer;
   serializer.table_name = TakeWord();
-  SkipWhitespace();
 
-  if (Take('W')) {
-    Expect("HERE");
-    SkipWhitespace();
+  if (Take(Keyword::kWhere)) {
     serializer.filters = ParseFilters();
     serializer.all_table = false;
   }
 
-  Take(';');
-  SkipWhitespace();
-  CheckEof();
+  ParseEnd();
 
   return serializer;
 }
 
+SerializerForTransaction SqlParser::ParseTransaction() {
+  ParseEnd();
+  return {};
+}
 
+SerializerForShow SqlParser::ParseShow() {
+  Expect(Keyword::kStats);
+  ParseEnd();
+  return {};
+}
@@ -14,7 +14,11 @@ enum QueryType {
   kInsert,
   kSelect,
   kUpdate,
-  kDelete
+  kDelete,
+  kShow,
+  kBegin,
+  kCommit,
+  kRollback
 };
 
 enum DataType {
@@ -31,19 +35,44 @@ enum JoinType {
   kRight
 };
 
-struct SerializerForCreate {
-  std::string table_name;
-  std::vector<std::tuple<std::string, DataType, size_t, bool>> table_columns;
-  size_t primary_key;
-};
-
 struct SerializerForDrop {
   std::string table_name;
 };
 
 struct SerializerForInsert {
   std::string table_name;
-  std::unordered_map<std::string, std::string> data;
+  std::vector<std::string> columns;
+  std::vector<std::vector<std::string>> rows;
+};
+
+enum AggregateType {
+  kApproxCountDistinct,
+  kApproxPercentile
+};
+
+/// APPROX_COUNT_DISTINCT(column) или APPROX_PERCENTILE(column, fraction)
+struct SelectAggregate {
+  AggregateType type = kApproxCountDistinct;
+  std::string column;
+  double fraction = 0;
+  /// имя столбца результата
+  std::string name;
+};
+
+/// JOIN третьей и следующих таблиц
+struct JoinClause {
+  std::string table;
+  JoinType type = kInner;
+  /// стороны условия ON как записаны: (таблица или пусто, столбец)
+  std::pair<std::string, std::string> on_first;
+  std::pair<std::string, std::string> on_second;
+  /// заполняются ResolveColumns: номер уже присоединенной таблицы (0 — table_name1,
+  /// 1 — table_name2, 2 + k — joins[k]) и столбцы условия с обеих сторон
+  size_t left = 0;
+  std::string left_column;
+  std::string column;
+  /// выбранные столбцы этой таблицы
+  std::vector<std::string> columns;
 };
 
 struct SerializerForSelect {
@@ -57,6 +86,31 @@ struct SerializerForSelect {
   bool is_join = false;
   std::pair<std::string, std::string> join_columns;
   JoinType join_type = kInner;
+  std::vector<JoinClause> joins;
+  /// ORDER BY: столбец результата и признак DESC
+  std::vector<std::pair<std::string, bool>> order_by;
+  /// приближенные агрегаты по всей выборке; тогда обычных столбцов в SELECT нет
+  std::vector<SelectAggregate> aggregates;
+};
+
+/// FOREIGN KEY (column) REFERENCES table(referenced)
+struct ForeignKey {
+  std::string column;
+  std::string table;
+  std::string referenced;
+};
+
+struct SerializerForCreate {
+  std::string table_name;
+  std::vector<std::tuple<std::string, DataType, size_t, bool>> table_columns;
+  size_t primary_key;
+  std::vector<ForeignKey> foreign_keys;
+  /// PARTITION BY HASH(partition_key) PARTITIONS partitions; 0 — таблица не разбита
+  std::string partition_key;
+  size_t partitions = 0;
+  /// CREATE MATERIALIZED VIEW name AS SELECT ...: вместо колонок — определение представления
+  bool is_view = false;
+  SerializerForSelect view;
 };
 
 struct SerializerForUpdate {
@@ -71,16 +125,24 @@ struct SerializerForDelete {
   bool all_table = true;
 };
 
+struct SerializerForShow {
+};
+
+/// BEGIN [TRANSACTION], COMMIT, ROLLBACK: вид определяется QueryType
+struct SerializerForTransaction {
+};
+
 struct Query {
   QueryType query_type;
   std::variant<SerializerForCreate, SerializerForDrop,
                SerializerForInsert, SerializerForSelect,
-               SerializerForUpdate, SerializerForDelete> serializer;
+               SerializerForUpdate, SerializerForDelete,
+               SerializerForShow, SerializerForTransaction> serializer;
 };
 
 class SqlParser : public BaseParser {
  public:
-  explicit SqlParser(const std::string& query);
+  explicit SqlParser(std::string_view query);
   Query Parse();
  private:
   SerializerForCreate ParseCreate();
@@ -89,6 +151,12 @@ class SqlParser : public BaseParser {
   SerializerForSelect ParseSelect();
   SerializerForUpdate ParseUpdate();
   SerializerForDelete ParseDelete();
-  void ParseJoin(SerializerForSelect& serializer);
+  SerializerForShow ParseShow();
+  SerializerForTransaction ParseTransaction();
+  void ParseJoin(SerializerForSelect& serializer, JoinType type);
+  void ParseOrderBy(SerializerForSelect& serializer);
+
+  SelectAggregate ParseAggregate();
+  void ParseEnd();
 };
 
@@ -0,0 +1,48 @@
+#include "cancellation.h"
+
+namespace {
+
+thread_local const CancellationToken* current = nullptr;
+
+}  // namespace
+
+CancellationToken::CancellationToken(Clock::time_point deadline) : deadline_(deadline) {}
+
+void CancellationToken::Cancel() {
+  cancelled_.store(true, std::memory_order_relaxed);
+}
+
+bool CancellationToken::cancelled() const {
+  return cancelled_.load(std::memory_order_relaxed);
+}
+
+bool CancellationToken::expired() const {
+  return deadline_ != Clock::time_point::max() && Clock::now() >= deadline_;
+}
+
+void CancellationToken::Check() const {
+  if (cancelled()) {
+    throw QueryCancelledError("Query cancelled");
+  }
+  if (expired()) {
+    throw QueryCancelledError("Query timed out");
+  }
+}
+
+CancellationScope::CancellationScope(const CancellationToken* token) : previous_(current) {
+  current = token;
+}
+
+CancellationScope::~CancellationScope() {
+  current = previous_;
+}
+
+const CancellationToken* CurrentCancellation() {
+  return current;
+}
+
+void CheckCancellation() {
+  if (current != nullptr) {
+    current->Check();
+  }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+/// запрос отменен через Database::Cancel или не уложился в дедлайн; данные не меняются
+class QueryCancelledError : public std::logic_error {
+ public:
+  using std::logic_error::logic_error;
+};
+
+/// Флаг отмены и дедлайн одного запроса. Отменить можно из любого потока,
+/// проверка — чтение атомика и часов без блокировок.
+class CancellationToken {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit CancellationToken(Clock::time_point deadline = Clock::time_point::max());
+
+  void Cancel();
+
+  /// отменен вызовом Cancel
+  bool cancelled() const;
+
+  /// дедлайн прошел
+  bool expired() const;
+
+  /// QueryCancelledError, если запрос отменен или дедлайн прошел
+  void Check() const;
+
+ private:
+  std::atomic<bool> cancelled_ = false;
+  Clock::time_point deadline_;
+};
+
+/// Делает token текущим запросом потока на время жизни объекта; nullptr — запрос без отмены.
+/// Операторы не получают token явно, а опрашивают текущий через CheckCancellation.
+class CancellationScope {
+ public:
+  explicit CancellationScope(const CancellationToken* token);
+
+  CancellationScope(const CancellationScope&) = delete;
+  CancellationScope& operator=(const CancellationScope&) = delete;
+
+  ~CancellationScope();
+
+ private:
+  const CancellationToken* previous_;
+};
+
+const CancellationToken* CurrentCancellation();
+
+/// проверка текущего запроса потока; вызывается на границах блоков, а не на каждой строке
+void CheckCancellation();
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+template <typename T>
+class Promise;
+
+/// Результат асинхронного запроса. Можно ждать блокирующе (Wait/Get), подписаться на
+/// готовность (OnReady) или использовать в co_await: корутина продолжится в потоке,
+/// который завершил запрос.
+template <typename T>
+class Future {
+ public:
+  Future() = default;
+
+  bool valid() const {
+    return state_ != nullptr;
+  }
+
+  bool ready() const {
+    std::lock_guard lock(state_->mutex);
+    return state_->ready;
+  }
+
+  void Wait() const {
+    std::unique_lock lock(state_->mutex);
+    state_->cv.wait(lock, [this] { return state_->ready; });
+  }
+
+  /// дождаться результата; исключение запроса пробрасывается
+  T Get() {
+    Wait();
+    if (state_->error) {
+      std::rethrow_exception(state_->error);
+    }
+    return std::move(*state_->value);
+  }
+
+  /// callback вызывается один раз: сразу, если результат готов, иначе в потоке исполнителя
+  void OnReady(std::function<void()> callback) {
+    std::unique_lock lock(state_->mutex);
+    if (!state_->ready) {
+      state_->callbacks.push_back(std::move(callback));
+      return;
+    }
+    lock.unlock();
+    callback();
+  }
+
+  bool await_ready() const {
+    return ready();
+  }
+
+  bool await_suspend(std::coroutine_handle<> handle) {
+    std::lock_guard lock(state_->mutex);
+    if (state_->ready) {
+      return false;
+    }
+    state_->callbacks.emplace_back([handle] { handle.resume(); });
+    return true;
+  }
+
+  T await_resume() {
+    return Get();
+  }
+
+ private:
+  friend class Promise<T>;
+
+  struct State {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool ready = false;
+    std::optional<T> value;
+    std::exception_ptr error;
+    std::vector<std::function<void()>> callbacks;
+  };
+
+  explicit Future(std::shared_ptr<State> state) : state_(std::move(state)) {}
+
+  std::shared_ptr<State> state_;
+};
+
+template <typename T>
+class Promise {
+ public:
+  Promise() : state_(std::make_shared<typename Future<T>::State>()) {}
+
+  Future<T> GetFuture() const {
+    return Future<T>(state_);
+  }
+
+  void SetValue(T value) {
+    Complete([&value](auto& state) { state.value.emplace(std::move(value)); });
+  }
+
+  void SetException(std::exception_ptr error) {
+    Complete([&error](auto& state) { state.error = std::move(error); });
+  }
+
+ private:
+  template <typename F>
+  void Complete(F&& set) {
+    std::vector<std::function<void()>> callbacks;
+    {
+      std::lock_guard lock(state_->mutex);
+      set(*state_);
+      state_->ready = true;
+      callbacks.swap(state_->callbacks);
+    }
+    state_->cv.notify_all();
+    for (auto& callback : callbacks) {
+      callback();
+    }
+  }
+
+  std::shared_ptr<typename Future<T>::State> state_;
+};
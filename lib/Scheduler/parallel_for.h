@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cancellation.h"
+
+/// Вызывает f(i) для каждого i из [0, n) в threads потоках (0 — по числу ядер),
+/// потоки разбирают индексы по одному. После первого исключения новые индексы
+/// не выдаются, исключение пробрасывается, когда все потоки завершатся.
+/// Рабочие потоки наследуют текущий запрос вызывающего, перед каждым индексом
+/// проверяется его отмена.
+template <typename F>
+void ParallelFor(size_t n, size_t threads, F&& f) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  threads = std::min(threads, n);
+  if (threads <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      CheckCancellation();
+      f(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next = 0;
+  std::atomic<bool> failed = false;
+  std::exception_ptr error;
+  std::mutex error_mutex;
+  const CancellationToken* token = CurrentCancellation();
+  auto worker = [&]() {
+    CancellationScope scope(token);
+    for (size_t i = next++; i < n && !failed; i = next++) {
+      try {
+        CheckCancellation();
+        f(i);
+      } catch (...) {
+        std::lock_guard lock(error_mutex);
+        if (!error) {
+          error = std::current_exception();
+        }
+        failed = true;
+      }
+    }
+  };
+  {
+    std::vector<std::jthread> pool;
+    pool.reserve(threads - 1);
+    for (size_t t = 1; t < threads; ++t) {
+      pool.emplace_back(worker);
+    }
+    worker();
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
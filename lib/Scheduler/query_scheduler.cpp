@@ -0,0 +1,90 @@
+#include "query_scheduler.h"
+
+QueryScheduler::QueryScheduler(const SchedulerOptions& options) : options_(options) {
+  options_.max_concurrency = std::max<size_t>(options_.max_concurrency, 1);
+  options_.max_long_queries = std::clamp<size_t>(options_.max_long_queries, 1, options_.max_concurrency);
+  for (size_t i = 0; i < options_.max_concurrency; ++i) {
+    workers_.emplace_back([this] { Work(); });
+  }
+}
+
+QueryScheduler::~QueryScheduler() {
+  {
+    std::lock_guard lock(mutex_);
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+bool QueryScheduler::Submit(QueryClass query_class, std::function<void()> task) {
+  {
+    std::lock_guard lock(mutex_);
+    if (stop_) {
+      return false;
+    }
+    if (query_class == kShortQuery) {
+      if (short_queue_.size() >= options_.max_queued_short) {
+        return false;
+      }
+      short_queue_.push_back(std::move(task));
+    } else {
+      if (long_queue_.size() >= options_.max_queued_long) {
+        return false;
+      }
+      long_queue_.push_back(std::move(task));
+    }
+  }
+  cv_.notify_one();
+  return true;
+}
+
+const SchedulerOptions& QueryScheduler::options() const {
+  return options_;
+}
+
+size_t QueryScheduler::queued(QueryClass query_class) const {
+  std::lock_guard lock(mutex_);
+  return query_class == kShortQuery ? short_queue_.size() : long_queue_.size();
+}
+
+size_t QueryScheduler::running(QueryClass query_class) const {
+  std::lock_guard lock(mutex_);
+  return query_class == kShortQuery ? running_short_ : running_long_;
+}
+
+bool QueryScheduler::CanTakeLong() const {
+  return !long_queue_.empty() && running_long_ < options_.max_long_queries;
+}
+
+void QueryScheduler::Work() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    cv_.wait(lock, [this] { return !short_queue_.empty() || CanTakeLong() || (stop_ && long_queue_.empty()); });
+    if (short_queue_.empty() && !CanTakeLong()) {
+      return;
+    }
+    QueryClass query_class;
+    if (CanTakeLong() && (short_queue_.empty() || short_streak_ >= kLongQueryAging)) {
+      query_class = kLongQuery;
+      short_streak_ = 0;
+    } else {
+      query_class = kShortQuery;
+      short_streak_ = long_queue_.empty() ? 0 : short_streak_ + 1;
+    }
+    auto& queue = query_class == kShortQuery ? short_queue_ : long_queue_;
+    auto& running = query_class == kShortQuery ? running_short_ : running_long_;
+    std::function<void()> task = std::move(queue.front());
+    queue.pop_front();
+    ++running;
+    lock.unlock();
+    task();
+    lock.lock();
+    --running;
+    if (query_class == kLongQuery) {
+      cv_.notify_all();
+    }
+  }
+}
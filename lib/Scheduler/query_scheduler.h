@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum QueryClass {
+  kShortQuery,
+  kLongQuery
+};
+
+struct SchedulerOptions {
+  /// сколько запросов исполняется одновременно
+  size_t max_concurrency = std::max(2u, std::thread::hardware_concurrency());
+  /// сколько из них могут быть долгими; остальные потоки всегда свободны для коротких
+  size_t max_long_queries = std::max(1u, std::thread::hardware_concurrency() / 2);
+  /// допуск: сверх этого запросы отклоняются, а не копятся в очереди
+  size_t max_queued_short = 4096;
+  size_t max_queued_long = 64;
+  /// запрос, который просматривает больше строк, считается долгим
+  size_t long_query_rows = 100000;
+  /// дедлайн запроса от момента приема, если он не задан явно; 0 — без ограничения
+  std::chrono::milliseconds query_timeout{0};
+};
+
+/// Пул исполнителей с раздельными очередями коротких и долгих запросов.
+/// Короткие имеют приоритет, долгие ограничены max_long_queries и не голодают:
+/// после kLongQueryAging подряд взятых коротких берется ожидающий долгий.
+class QueryScheduler {
+ public:
+  explicit QueryScheduler(const SchedulerOptions& options = SchedulerOptions());
+
+  QueryScheduler(const QueryScheduler&) = delete;
+  QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+  /// дожидается завершения уже принятых запросов
+  ~QueryScheduler();
+
+  /// false, если очередь данного класса переполнена и запрос не принят
+  bool Submit(QueryClass query_class, std::function<void()> task);
+
+  const SchedulerOptions& options() const;
+
+  size_t queued(QueryClass query_class) const;
+
+  size_t running(QueryClass query_class) const;
+
+ private:
+  static constexpr size_t kLongQueryAging = 8;
+
+  void Work();
+  bool CanTakeLong() const;
+
+  SchedulerOptions options_;
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> short_queue_;
+  std::deque<std::function<void()>> long_queue_;
+  size_t running_short_ = 0;
+  size_t running_long_ = 0;
+  size_t short_streak_ = 0;
+  bool stop_ = false;
+  std::vector<std::thread> workers_;
+};
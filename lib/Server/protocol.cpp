@@ -0,0 +1,48 @@
+#include "protocol.h"
+
+#include <stdexcept>
+
+namespace {
+
+void AppendLength(std::string& out, uint32_t length) {
+  for (size_t i = 0; i < sizeof(length); ++i) {
+    out += static_cast<char>((length >> (8 * i)) & 0xFF);
+  }
+}
+
+}  // namespace
+
+void AppendFrame(std::string& out, std::string_view payload) {
+  if (payload.size() > kMaxFrameSize) {
+    throw std::logic_error("Frame is too large");
+  }
+  AppendLength(out, static_cast<uint32_t>(payload.size()));
+  out += payload;
+}
+
+void AppendResponseFrame(std::string& out, ResponseStatus status, std::string_view payload) {
+  if (payload.size() + 1 > kMaxFrameSize) {
+    throw std::logic_error("Frame is too large");
+  }
+  AppendLength(out, static_cast<uint32_t>(payload.size() + 1));
+  out += static_cast<char>(status);
+  out += payload;
+}
+
+std::optional<std::string_view> ReadFrame(std::string_view buffer, size_t& consumed) {
+  if (buffer.size() < sizeof(uint32_t)) {
+    return std::nullopt;
+  }
+  uint32_t length = 0;
+  for (size_t i = 0; i < sizeof(length); ++i) {
+    length |= static_cast<uint32_t>(static_cast<uint8_t>(buffer[i])) << (8 * i);
+  }
+  if (length > kMaxFrameSize) {
+    throw std::logic_error("Frame is too large");
+  }
+  if (buffer.size() < sizeof(uint32_t) + length) {
+    return std::nullopt;
+  }
+  consumed = sizeof(uint32_t) + length;
+  return buffer.substr(sizeof(uint32_t), length);
+}
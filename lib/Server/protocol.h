@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// Кадр протокола: u32 little-endian длина полезной нагрузки, затем сама нагрузка.
+/// Запрос: текст SQL. Ответ: u8 ResponseStatus, затем текст сообщения/ошибки
+/// или бинарный пакет строк ResultEncoder(kBinary). Ответы идут в порядке запросов,
+/// поэтому клиент может отправлять запросы, не дожидаясь ответов.
+enum ResponseStatus : uint8_t {
+  kMessageResponse,
+  kTableResponse,
+  kErrorResponse
+};
+
+const uint32_t kMaxFrameSize = 64u << 20;
+
+void AppendFrame(std::string& out, std::string_view payload);
+
+void AppendResponseFrame(std::string& out, ResponseStatus status, std::string_view payload);
+
+/// Полезная нагрузка первого кадра в buffer, consumed - сколько байт он занял.
+/// nullopt, если кадр пришел не целиком; исключение, если длина больше kMaxFrameSize.
+std::optional<std::string_view> ReadFrame(std::string_view buffer, size_t& consumed);
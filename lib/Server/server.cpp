@@ -0,0 +1,304 @@
+#include "server.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+namespace {
+
+const size_t kReadChunk = 64 * 1024;
+const int kMaxEvents = 64;
+
+std::system_error SystemError(const std::string& what) {
+  return {errno, std::generic_category(), what};
+}
+
+}  // namespace
+
+Server::Waker::~Waker() {
+  if (fd != -1) {
+    ::close(fd);
+  }
+}
+
+void Server::Waker::Wake() const {
+  uint64_t one = 1;
+  [[maybe_unused]] auto res = ::write(fd, &one, sizeof(one));
+}
+
+Server::Server(Database& db, const ServerOptions& options)
+    : db_(db), options_(options), encoder_(kBinary), waker_(std::make_shared<Waker>()) {
+  epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+  if (epoll_fd_ == -1) {
+    throw SystemError("epoll_create1");
+  }
+  waker_->fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (waker_->fd == -1) {
+    throw SystemError("eventfd");
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = waker_->fd;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, waker_->fd, &ev);
+
+  if (!options_.unix_path.empty()) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (options_.unix_path.size() >= sizeof(address.sun_path)) {
+      throw std::logic_error("Unix socket path is too long");
+    }
+    std::strcpy(address.sun_path, options_.unix_path.c_str());
+    ::unlink(options_.unix_path.c_str());
+    unix_fd_ = Listen(AF_UNIX, &address, sizeof(address));
+  }
+  if (options_.listen_tcp) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.tcp_port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    tcp_fd_ = Listen(AF_INET, &address, sizeof(address));
+    socklen_t size = sizeof(address);
+    ::getsockname(tcp_fd_, reinterpret_cast<sockaddr*>(&address), &size);
+    tcp_port_ = ntohs(address.sin_port);
+  }
+}
+
+Server::~Server() {
+  for (auto& [fd, conn] : connections_) {
+    if (conn.pending) {
+      conn.pending->Wait();
+    }
+    ::close(fd);
+  }
+  if (unix_fd_ != -1) {
+    ::close(unix_fd_);
+    ::unlink(options_.unix_path.c_str());
+  }
+  if (tcp_fd_ != -1) {
+    ::close(tcp_fd_);
+  }
+  ::close(epoll_fd_);
+}
+
+int Server::Listen(int domain, const void* address, size_t address_size) {
+  int fd = ::socket(domain, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd == -1) {
+    throw SystemError("socket");
+  }
+  if (domain == AF_INET) {
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }
+  if (::bind(fd, static_cast<const sockaddr*>(address), address_size) == -1 || ::listen(fd, SOMAXCONN) == -1) {
+    auto error = SystemError("bind");
+    ::close(fd);
+    throw error;
+  }
+  epoll_event ev{};
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+  return fd;
+}
+
+uint16_t Server::tcp_port() const {
+  return tcp_port_;
+}
+
+void Server::Stop() {
+  stop_ = true;
+  waker_->Wake();
+}
+
+void Server::Run() {
+  epoll_event events[kMaxEvents];
+  while (!stop_) {
+    int n = ::epoll_wait(epoll_fd_, events, kMaxEvents, -1);
+    if (n == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      throw SystemError("epoll_wait");
+    }
+    bool woken = false;
+    for (int i = 0; i < n; ++i) {
+      int fd = events[i].data.fd;
+      if (fd == waker_->fd) {
+        uint64_t count;
+        [[maybe_unused]] auto res = ::read(fd, &count, sizeof(count));
+        woken = true;
+      } else if (fd == unix_fd_ || fd == tcp_fd_) {
+        Accept(fd);
+      } else if (auto it = connections_.find(fd); it != connections_.end()) {
+        Connection& conn = it->second;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR | EPOLLRDHUP)) {
+          OnReadable(conn);
+        }
+        if (connections_.contains(fd) && (events[i].events & EPOLLOUT)) {
+          WriteOut(conn);
+        }
+      }
+    }
+    if (woken) {
+      std::vector<int> fds;
+      for (const auto& p : connections_) {
+        fds.push_back(p.first);
+      }
+      for (int fd : fds) {
+        FlushReady(connections_.at(fd));
+      }
+    }
+  }
+}
+
+void Server::Accept(int listen_fd) {
+  while (true) {
+    int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1) {
+      return;
+    }
+    if (listen_fd == tcp_fd_) {
+      int one = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    Connection& conn = connections_[fd];
+    conn.fd = fd;
+    conn.session = std::make_unique<Session>(db_);
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    conn.events = ev.events;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev);
+  }
+}
+
+bool Server::CanRead(const Connection& conn) const {
+  return !conn.closing && conn.in.size() - conn.in_offset < options_.max_buffered_input;
+}
+
+void Server::OnReadable(Connection& conn) {
+  while (CanRead(conn)) {
+    size_t old_size = conn.in.size();
+    conn.in.resize(old_size + kReadChunk);
+    ssize_t n = ::read(conn.fd, conn.in.data() + old_size, kReadChunk);
+    conn.in.resize(old_size + std::max<ssize_t>(n, 0));
+    if (n > 0) {
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == 0 || errno != EAGAIN) {
+      conn.closing = true;
+    }
+    break;
+  }
+  FlushReady(conn);
+}
+
+void Server::SubmitNext(Connection& conn) {
+  size_t consumed = 0;
+  std::optional<std::string_view> frame;
+  try {
+    frame = ReadFrame(std::string_view(conn.in).substr(conn.in_offset), consumed);
+  } catch (const std::logic_error&) {
+    conn.closing = true;
+    conn.in.clear();
+    conn.in_offset = 0;
+    return;
+  }
+  if (!frame) {
+    if (conn.in_offset > 0) {
+      conn.in.erase(0, conn.in_offset);
+      conn.in_offset = 0;
+    }
+    return;
+  }
+  conn.in_offset += consumed;
+  conn.pending = conn.session->ExecuteAsync(std::string(*frame));
+  conn.pending->OnReady([waker = waker_] { waker->Wake(); });
+}
+
+void Server::FlushReady(Connection& conn) {
+  while (true) {
+    if (!conn.pending) {
+      SubmitNext(conn);
+    }
+    if (!conn.pending || !conn.pending->ready()) {
+      break;
+    }
+    try {
+      Response response = conn.pending->Get();
+      if (response.is_table()) {
+        AppendResponseFrame(conn.out, kTableResponse, encoder_.Encode(response.table()));
+      } else {
+        AppendResponseFrame(conn.out, kMessageResponse, response.message());
+      }
+    } catch (const std::exception& e) {
+      AppendResponseFrame(conn.out, kErrorResponse, e.what());
+    }
+    conn.pending.reset();
+  }
+  WriteOut(conn);
+}
+
+void Server::WriteOut(Connection& conn) {
+  while (conn.out_offset < conn.out.size()) {
+    ssize_t n = ::send(conn.fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+    if (n > 0) {
+      conn.out_offset += n;
+      continue;
+    }
+    if (n == -1 && errno == EINTR) {
+      continue;
+    }
+    if (n == -1 && errno != EAGAIN) {
+      conn.closing = true;
+      conn.out.clear();
+      conn.out_offset = 0;
+    }
+    break;
+  }
+  if (conn.out_offset == conn.out.size()) {
+    conn.out.clear();
+    conn.out_offset = 0;
+  }
+  if (conn.closing && !conn.pending && conn.out.empty()) {
+    Close(conn.fd);
+    return;
+  }
+  UpdateEvents(conn);
+}
+
+void Server::UpdateEvents(Connection& conn) {
+  uint32_t events = 0;
+  if (CanRead(conn)) {
+    events |= EPOLLIN | EPOLLRDHUP;
+  }
+  if (!conn.out.empty()) {
+    events |= EPOLLOUT;
+  }
+  if (events != conn.events) {
+    epoll_event ev{};
+    ev.events = events;
+    ev.data.fd = conn.fd;
+    ::epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, conn.fd, &ev);
+    conn.events = events;
+  }
+}
+
+void Server::Close(int fd) {
+  ::epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+  ::close(fd);
+  connections_.erase(fd);
+}
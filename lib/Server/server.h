@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "../Database/database.h"
+#include "../Database/session.h"
+#include "../Encoder/result_encoder.h"
+#include "protocol.h"
+
+struct ServerOptions {
+  /// пустой путь - не слушать unix-сокет
+  std::string unix_path;
+  /// слушать 127.0.0.1:tcp_port; 0 - выбрать свободный порт
+  bool listen_tcp = true;
+  uint16_t tcp_port = 0;
+  /// сколько непрочитанных байт запросов копится на соединение, дальше чтение приостанавливается
+  size_t max_buffered_input = 16u << 20;
+};
+
+/// Однопоточный epoll-цикл: принимает соединения, режет входящий поток на кадры,
+/// отдает запросы в Database::ExecuteAsync и пишет ответы строго в порядке запросов.
+/// Запросы одного соединения исполняются по очереди (следующий уходит в планировщик,
+/// когда готов предыдущий), разные соединения исполняются параллельно. У каждого
+/// соединения свой Session, поэтому BEGIN ... COMMIT работает в пределах соединения.
+class Server {
+ public:
+  Server(Database& db, const ServerOptions& options);
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  ~Server();
+
+  /// блокирует до вызова Stop
+  void Run();
+
+  /// можно вызывать из любого потока и из обработчика сигнала
+  void Stop();
+
+  uint16_t tcp_port() const;
+
+ private:
+  struct Connection {
+    int fd = -1;
+    std::string in;
+    size_t in_offset = 0;
+    std::string out;
+    size_t out_offset = 0;
+    /// транзакция соединения; откатывается при закрытии
+    std::unique_ptr<Session> session;
+    /// запрос, который сейчас исполняется
+    std::optional<Future<Response>> pending;
+    uint32_t events = 0;
+    bool closing = false;
+  };
+
+  /// eventfd, которым завершенные запросы будят цикл; живет, пока на него ссылаются callbacks
+  struct Waker {
+    int fd = -1;
+    ~Waker();
+    void Wake() const;
+  };
+
+  int Listen(int domain, const void* address, size_t address_size);
+  void Accept(int listen_fd);
+  void OnReadable(Connection& conn);
+  void SubmitNext(Connection& conn);
+  bool CanRead(const Connection& conn) const;
+  void FlushReady(Connection& conn);
+  void WriteOut(Connection& conn);
+  void UpdateEvents(Connection& conn);
+  void Close(int fd);
+
+  Database& db_;
+  ServerOptions options_;
+  ResultEncoder encoder_;
+  int epoll_fd_ = -1;
+  int unix_fd_ = -1;
+  int tcp_fd_ = -1;
+  uint16_t tcp_port_ = 0;
+  std::shared_ptr<Waker> waker_;
+  std::atomic<bool> stop_ = false;
+  std::unordered_map<int, Connection> connections_;
+};
@@ -0,0 +1,334 @@
+#include "stats.h"
+
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+void LatencyHistogram::Record(uint64_t value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::count() const {
+  return count_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::sum() const {
+  return sum_.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Percentile(double p) const {
+  uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  auto target = static_cast<uint64_t>(std::ceil(p * static_cast<double>(total)));
+  target = std::max<uint64_t>(target, 1);
+  uint64_t seen = 0;
+  uint64_t last = 0;
+  for (size_t i = 0; i < kBuckets; ++i) {
+    uint64_t n = buckets_[i].load(std::memory_order_relaxed);
+    if (n == 0) {
+      continue;
+    }
+    seen += n;
+    last = BucketUpperBound(i);
+    if (seen >= target) {
+      return last;
+    }
+  }
+  return last;
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+  if (value < kSubBuckets) {
+    return value;
+  }
+  size_t exponent = std::bit_width(value) - kSubBucketBits;
+  size_t mantissa = value >> exponent;
+  return kSubBuckets + (exponent - 1) * (kSubBuckets / 2) + (mantissa - kSubBuckets / 2);
+}
+
+uint64_t LatencyHistogram::BucketUpperBound(size_t index) {
+  if (index < kSubBuckets) {
+    return index;
+  }
+  size_t k = index - kSubBuckets;
+  size_t exponent = k / (kSubBuckets / 2) + 1;
+  uint64_t mantissa = k % (kSubBuckets / 2) + kSubBuckets / 2;
+  return (mantissa << exponent) + ((uint64_t(1) << exponent) - 1);
+}
+
+void Metrics::RecordStatement(QueryType type, uint64_t nanos, bool failed) {
+  auto& s = statements_[type];
+  s.count.fetch_add(1, std::memory_order_relaxed);
+  if (failed) {
+    s.errors.fetch_add(1, std::memory_order_relaxed);
+  }
+  s.latency.Record(nanos);
+}
+
+void Metrics::RecordParseError() {
+  parse_errors_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRejected() {
+  rejected_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordCancelled(bool timed_out) {
+  (timed_out ? timed_out_ : cancelled_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordRows(uint64_t scanned, uint64_t returned) {
+  rows_scanned_.fetch_add(scanned, std::memory_order_relaxed);
+  rows_returned_.fetch_add(returned, std::memory_order_relaxed);
+}
+
+void Metrics::RecordIndexLookup(bool hit) {
+  index_lookups_.fetch_add(1, std::memory_order_relaxed);
+  if (hit) {
+    index_hits_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void Metrics::RecordSpill(uint64_t files, uint64_t bytes) {
+  spill_files_.fetch_add(files, std::memory_order_relaxed);
+  spill_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void Metrics::RecordCacheLookup(bool hit) {
+  (hit ? cache_hits_ : cache_misses_).fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordMergeJoin() {
+  merge_joins_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordPartitionedJoin() {
+  partitioned_joins_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Metrics::RecordBloomJoin(uint64_t dropped) {
+  bloom_joins_.fetch_add(1, std::memory_order_relaxed);
+  bloom_dropped_rows_.fetch_add(dropped, std::memory_order_relaxed);
+}
+
+const StatementMetrics& Metrics::statement(QueryType type) const {
+  return statements_[type];
+}
+
+uint64_t Metrics::parse_errors() const {
+  return parse_errors_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::rejected() const {
+  return rejected_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::cancelled() const {
+  return cancelled_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::timed_out() const {
+  return timed_out_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::rows_scanned() const {
+  return rows_scanned_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::rows_returned() const {
+  return rows_returned_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::index_lookups() const {
+  return index_lookups_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::index_hits() const {
+  return index_hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::spill_files() const {
+  return spill_files_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::spill_bytes() const {
+  return spill_bytes_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::cache_hits() const {
+  return cache_hits_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::cache_misses() const {
+  return cache_misses_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::merge_joins() const {
+  return merge_joins_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::partitioned_joins() const {
+  return partitioned_joins_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::bloom_joins() const {
+  return bloom_joins_.load(std::memory_order_relaxed);
+}
+
+uint64_t Metrics::bloom_dropped_rows() const {
+  return bloom_dropped_rows_.load(std::memory_order_relaxed);
+}
+
+std::string StatementName(QueryType type) {
+  switch (type) {
+    case kCreate:
+      return "create";
+    case kDrop:
+      return "drop";
+    case kInsert:
+      return "insert";
+    case kSelect:
+      return "select";
+    case kUpdate:
+      return "update";
+    case kDelete:
+      return "delete";
+    case kShow:
+      return "show";
+    case kBegin:
+      return "begin";
+    case kCommit:
+      return "commit";
+    case kRollback:
+      return "rollback";
+  }
+  return "unknown";
+}
+
+DatabaseStats CollectStats(const Metrics& metrics) {
+  DatabaseStats stats;
+  for (size_t i = 0; i < Metrics::kStatementTypes; ++i) {
+    auto type = static_cast<QueryType>(i);
+    const auto& s = metrics.statement(type);
+    StatementStats res;
+    res.statement = StatementName(type);
+    res.count = s.count.load(std::memory_order_relaxed);
+    res.errors = s.errors.load(std::memory_order_relaxed);
+    res.total_ns = s.latency.sum();
+    res.p50_ns = s.latency.Percentile(0.5);
+    res.p99_ns = s.latency.Percentile(0.99);
+    res.p999_ns = s.latency.Percentile(0.999);
+    stats.statements.push_back(res);
+  }
+  stats.parse_errors = metrics.parse_errors();
+  stats.rejected_queries = metrics.rejected();
+  stats.cancelled_queries = metrics.cancelled();
+  stats.timed_out_queries = metrics.timed_out();
+  stats.rows_scanned = metrics.rows_scanned();
+  stats.rows_returned = metrics.rows_returned();
+  stats.index_lookups = metrics.index_lookups();
+  stats.index_hits = metrics.index_hits();
+  stats.spill_files = metrics.spill_files();
+  stats.spill_bytes = metrics.spill_bytes();
+  stats.merge_joins = metrics.merge_joins();
+  stats.partitioned_joins = metrics.partitioned_joins();
+  stats.bloom_joins = metrics.bloom_joins();
+  stats.bloom_dropped_rows = metrics.bloom_dropped_rows();
+  stats.result_cache_hits = metrics.cache_hits();
+  stats.result_cache_misses = metrics.cache_misses();
+  if (stats.index_lookups != 0) {
+    stats.index_hit_ratio = static_cast<double>(stats.index_hits) / static_cast<double>(stats.index_lookups);
+  }
+  return stats;
+}
+
+std::string ToPrometheus(const DatabaseStats& stats) {
+  std::ostringstream out;
+  out << "# TYPE database_statements_total counter\n";
+  for (const auto& s : stats.statements) {
+    out << "database_statements_total{statement=\"" << s.statement << "\"} " << s.count << '\n';
+  }
+  out << "# TYPE database_statement_errors_total counter\n";
+  for (const auto& s : stats.statements) {
+    out << "database_statement_errors_total{statement=\"" << s.statement << "\"} " << s.errors << '\n';
+  }
+  out << "# TYPE database_statement_latency_seconds summary\n";
+  for (const auto& s : stats.statements) {
+    const std::pair<const char*, uint64_t> quantiles[] = {{"0.5", s.p50_ns}, {"0.99", s.p99_ns}, {"0.999", s.p999_ns}};
+    for (const auto& [q, ns] : quantiles) {
+      out << "database_statement_latency_seconds{statement=\"" << s.statement << "\",quantile=\"" << q << "\"} "
+          << static_cast<double>(ns) / 1e9 << '\n';
+    }
+    out << "database_statement_latency_seconds_sum{statement=\"" << s.statement << "\"} "
+        << static_cast<double>(s.total_ns) / 1e9 << '\n';
+    out << "database_statement_latency_seconds_count{statement=\"" << s.statement << "\"} " << s.count << '\n';
+  }
+  out << "# TYPE database_parse_errors_total counter\n"
+      << "database_parse_errors_total " << stats.parse_errors << '\n';
+  out << "# TYPE database_rejected_queries_total counter\n"
+      << "database_rejected_queries_total " << stats.rejected_queries << '\n';
+  out << "# TYPE database_cancelled_queries_total counter\n"
+      << "database_cancelled_queries_total " << stats.cancelled_queries << '\n';
+  out << "# TYPE database_timed_out_queries_total counter\n"
+      << "database_timed_out_queries_total " << stats.timed_out_queries << '\n';
+  out << "# TYPE database_rows_scanned_total counter\n"
+      << "database_rows_scanned_total " << stats.rows_scanned << '\n';
+  out << "# TYPE database_rows_returned_total counter\n"
+      << "database_rows_returned_total " << stats.rows_returned << '\n';
+  out << "# TYPE database_index_lookups_total counter\n"
+      << "database_index_lookups_total " << stats.index_lookups << '\n';
+  out << "# TYPE database_index_hits_total counter\n"
+      << "database_index_hits_total " << stats.index_hits << '\n';
+  out << "# TYPE database_index_hit_ratio gauge\n"
+      << "database_index_hit_ratio " << stats.index_hit_ratio << '\n';
+  out << "# TYPE database_spill_files_total counter\n"
+      << "database_spill_files_total " << stats.spill_files << '\n';
+  out << "# TYPE database_spill_bytes_total counter\n"
+      << "database_spill_bytes_total " << stats.spill_bytes << '\n';
+  out << "# TYPE database_merge_joins_total counter\n"
+      << "database_merge_joins_total " << stats.merge_joins << '\n';
+  out << "# TYPE database_partitioned_joins_total counter\n"
+      << "database_partitioned_joins_total " << stats.partitioned_joins << '\n';
+  out << "# TYPE database_bloom_joins_total counter\n"
+      << "database_bloom_joins_total " << stats.bloom_joins << '\n';
+  out << "# TYPE database_bloom_dropped_rows_total counter\n"
+      << "database_bloom_dropped_rows_total " << stats.bloom_dropped_rows << '\n';
+  out << "# TYPE database_result_cache_hits_total counter\n"
+      << "database_result_cache_hits_total " << stats.result_cache_hits << '\n';
+  out << "# TYPE database_result_cache_misses_total counter\n"
+      << "database_result_cache_misses_total " << stats.result_cache_misses << '\n';
+  out << "# TYPE database_result_cache_entries gauge\n"
+      << "database_result_cache_entries " << stats.result_cache_entries << '\n';
+  out << "# TYPE database_result_cache_bytes gauge\n"
+      << "database_result_cache_bytes " << stats.result_cache_bytes << '\n';
+  out << "# TYPE database_memory_used_bytes gauge\n"
+      << "database_memory_used_bytes " << stats.memory_used << '\n';
+  out << "# TYPE database_memory_peak_bytes gauge\n"
+      << "database_memory_peak_bytes " << stats.memory_peak << '\n';
+  out << "# TYPE database_memory_limit_bytes gauge\n"
+      << "database_memory_limit_bytes " << stats.memory_limit << '\n';
+  out << "# TYPE database_table_rows gauge\n";
+  for (const auto& t : stats.tables) {
+    out << "database_table_rows{table=\"" << t.table << "\"} " << t.rows << '\n';
+  }
+  out << "# TYPE database_table_memory_bytes gauge\n";
+  for (const auto& t : stats.tables) {
+    out << "database_table_memory_bytes{table=\"" << t.table << "\"} " << t.bytes << '\n';
+  }
+  out << "# TYPE database_table_tracked_memory_bytes gauge\n";
+  for (const auto& t : stats.tables) {
+    out << "database_table_tracked_memory_bytes{table=\"" << t.table << "\"} " << t.tracked_bytes << '\n';
+  }
+  out << "# TYPE database_column_memory_bytes gauge\n";
+  for (const auto& t : stats.tables) {
+    for (const auto& c : t.columns) {
+      out << "database_column_memory_bytes{table=\"" << t.table << "\",column=\"" << c.column << "\"} "
+          << c.bytes << '\n';
+    }
+  }
+  return out.str();
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "../Parser/sql_parser.h"
+
+/// гистограмма задержек в стиле HDR: логарифмические корзины с линейным делением внутри,
+/// относительная погрешность ~3%, запись без блокировок
+class LatencyHistogram {
+ public:
+  LatencyHistogram() = default;
+
+  void Record(uint64_t value);
+
+  uint64_t count() const;
+
+  uint64_t sum() const;
+
+  /// значение, не меньше которого доля p записей (p в [0, 1])
+  uint64_t Percentile(double p) const;
+
+ private:
+  static constexpr size_t kSubBucketBits = 5;
+  static constexpr size_t kSubBuckets = size_t(1) << kSubBucketBits;
+  static constexpr size_t kBuckets = kSubBuckets + (64 - kSubBucketBits) * (kSubBuckets / 2);
+
+  static size_t BucketIndex(uint64_t value);
+
+  static uint64_t BucketUpperBound(size_t index);
+
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> sum_ = 0;
+};
+
+struct StatementMetrics {
+  LatencyHistogram latency;
+  std::atomic<uint64_t> count = 0;
+  std::atomic<uint64_t> errors = 0;
+};
+
+/// счетчики работы базы, обновляются из любых потоков
+class Metrics {
+ public:
+  static constexpr size_t kStatementTypes = kRollback + 1;
+
+  void RecordStatement(QueryType type, uint64_t nanos, bool failed);
+  void RecordParseError();
+  void RecordRejected();
+  /// запрос прерван вызовом Cancel или по дедлайну
+  void RecordCancelled(bool timed_out);
+  void RecordRows(uint64_t scanned, uint64_t returned);
+  void RecordIndexLookup(bool hit);
+  void RecordSpill(uint64_t files, uint64_t bytes);
+  void RecordCacheLookup(bool hit);
+  void RecordMergeJoin();
+  void RecordPartitionedJoin();
+  void RecordBloomJoin(uint64_t dropped);
+
+  const StatementMetrics& statement(QueryType type) const;
+  uint64_t parse_errors() const;
+  uint64_t rejected() const;
+  uint64_t cancelled() const;
+  uint64_t timed_out() const;
+  uint64_t rows_scanned() const;
+  uint64_t rows_returned() const;
+  uint64_t index_lookups() const;
+  uint64_t index_hits() const;
+  uint64_t spill_files() const;
+  uint64_t spill_bytes() const;
+  uint64_t cache_hits() const;
+  uint64_t cache_misses() const;
+  uint64_t merge_joins() const;
+  uint64_t partitioned_joins() const;
+  uint64_t bloom_joins() const;
+  uint64_t bloom_dropped_rows() const;
+
+ private:
+  std::array<StatementMetrics, kStatementTypes> statements_;
+  std::atomic<uint64_t> parse_errors_ = 0;
+  std::atomic<uint64_t> rejected_ = 0;
+  std::atomic<uint64_t> cancelled_ = 0;
+  std::atomic<uint64_t> timed_out_ = 0;
+  std::atomic<uint64_t> rows_scanned_ = 0;
+  std::atomic<uint64_t> rows_returned_ = 0;
+  std::atomic<uint64_t> index_lookups_ = 0;
+  std::atomic<uint64_t> index_hits_ = 0;
+  std::atomic<uint64_t> spill_files_ = 0;
+  std::atomic<uint64_t> spill_bytes_ = 0;
+  std::atomic<uint64_t> cache_hits_ = 0;
+  std::atomic<uint64_t> cache_misses_ = 0;
+  std::atomic<uint64_t> merge_joins_ = 0;
+  std::atomic<uint64_t> partitioned_joins_ = 0;
+  std::atomic<uint64_t> bloom_joins_ = 0;
+  std::atomic<uint64_t> bloom_dropped_rows_ = 0;
+};
+
+struct StatementStats {
+  std::string statement;
+  uint64_t count = 0;
+  uint64_t errors = 0;
+  uint64_t total_ns = 0;
+  uint64_t p50_ns = 0;
+  uint64_t p99_ns = 0;
+  uint64_t p999_ns = 0;
+};
+
+struct ColumnMemoryStats {
+  std::string column;
+  size_t bytes = 0;
+};
+
+struct TableMemoryStats {
+  std::string table;
+  size_t rows = 0;
+  size_t bytes = 0;
+  /// байты, списанные с ресурса памяти таблицы, и его лимит (0 — без ограничения)
+  size_t tracked_bytes = 0;
+  size_t memory_limit = 0;
+  std::vector<ColumnMemoryStats> columns;
+};
+
+/// снимок метрик, возвращаемый Database::Stats()
+struct DatabaseStats {
+  std::vector<StatementStats> statements;
+  uint64_t parse_errors = 0;
+  uint64_t rejected_queries = 0;
+  /// запросы, отмененные через Database::Cancel и прерванные по дедлайну
+  uint64_t cancelled_queries = 0;
+  uint64_t timed_out_queries = 0;
+  uint64_t rows_scanned = 0;
+  uint64_t rows_returned = 0;
+  uint64_t index_lookups = 0;
+  uint64_t index_hits = 0;
+  double index_hit_ratio = 0;
+  size_t memory_used = 0;
+  size_t memory_peak = 0;
+  size_t memory_limit = 0;
+  size_t query_memory_limit = 0;
+  /// временные файлы соединений и сортировок, вытесненных из памяти
+  uint64_t spill_files = 0;
+  uint64_t spill_bytes = 0;
+  /// соединения, выполненные слиянием вместо хеш-таблицы
+  uint64_t merge_joins = 0;
+  /// соединения разбитых по ключу таблиц, выполненные попарно по разделам
+  uint64_t partitioned_joins = 0;
+  /// хеш-соединения с фильтром Блума по ключам build и строки probe, отброшенные им до пробы
+  uint64_t bloom_joins = 0;
+  uint64_t bloom_dropped_rows = 0;
+  /// кеш результатов SELECT
+  uint64_t result_cache_hits = 0;
+  uint64_t result_cache_misses = 0;
+  size_t result_cache_entries = 0;
+  size_t result_cache_bytes = 0;
+  std::vector<TableMemoryStats> tables;
+};
+
+std::string StatementName(QueryType type);
+
+/// снимок счетчиков без информации о таблицах
+DatabaseStats CollectStats(const Metrics& metrics);
+
+/// текстовый формат Prometheus для внешнего сборщика
+std::string ToPrometheus(const DatabaseStats& stats);
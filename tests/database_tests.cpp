@@ -1,6 +1,22 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <filesystem>
+#include <latch>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+#include "lib/Client/client.h"
+#include "lib/Database/appender.h"
 #include "lib/Database/database.h"
+#include "lib/Database/operators.h"
+#include "lib/Database/result_cache.h"
+#include "lib/Database/session.h"
+#include "lib/Encoder/result_encoder.h"
+#include "lib/Scheduler/parallel_for.h"
+#include "lib/Server/server.h"
 
 TEST(DatabaseTests, ValidCreateTableTest1) {
   Database db;
@@ -244,4 +260,1533 @@ TEST(DatabaseTests, JoinTest) {
                 JOIN branch
                 ON employee.emp_id = branch.mgr_id
   )") << std::endl;
-}
\ No newline at end of file
+}
+
+TEST(DatabaseTests, StatsTest) {
+  Database db;
+  db.Execute(R"(
+    CREATE TABLE employee (
+      emp_id INT PRIMARY KEY,
+      first_name VARCHAR(20),
+      salary INT
+    )
+  )");
+  db.Execute("INSERT INTO employee(emp_id, first_name, salary) VALUES(100, 'David', 250000)");
+  db.Execute("INSERT INTO employee(emp_id, first_name, salary) VALUES(101, 'Jan', 110000)");
+  db.Execute("SELECT first_name FROM employee WHERE salary > 200000");
+  try {
+    db.Execute("SELEC * FROM employee");
+  } catch (const std::logic_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+  DatabaseStats stats = db.Stats();
+  EXPECT_EQ(stats.statements[kInsert].count, 2);
+  EXPECT_EQ(stats.statements[kSelect].count, 1);
+  EXPECT_GT(stats.statements[kSelect].p99_ns, 0);
+  EXPECT_EQ(stats.parse_errors, 1);
+  EXPECT_EQ(stats.rows_scanned, 2);
+  EXPECT_EQ(stats.rows_returned, 1);
+  ASSERT_EQ(stats.tables.size(), 1);
+  EXPECT_EQ(stats.tables[0].rows, 2);
+  EXPECT_EQ(stats.tables[0].columns.size(), 3);
+  std::cout << db.Execute("SHOW STATS") << std::endl;
+  std::string text = ToPrometheus(db.Stats());
+  EXPECT_NE(text.find("database_statements_total{statement=\"show\"} 1"), std::string::npos);
+  EXPECT_NE(text.find("database_column_memory_bytes{table=\"employee\",column=\"salary\"}"), std::string::npos);
+
+  // metric names embed table and column names of any length
+  std::string long_name = "quarterly_revenue_by_region_and_department";
+  db.Execute("CREATE TABLE " + long_name + " (id INT PRIMARY KEY, amount_in_local_currency_before_taxes INT)");
+  db.Execute("INSERT INTO " + long_name + "(id, amount_in_local_currency_before_taxes) VALUES(1, 123456789)");
+  Response show = db.Execute("SHOW STATS");
+  const Table& metrics = show.table();
+  std::string metric = "column." + long_name + ".amount_in_local_currency_before_taxes.bytes";
+  bool found = false;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    if (metrics.column("metric")[i] == Value(metric)) {
+      found = true;
+      EXPECT_GT(std::get<double>(metrics.column("value")[i]), 0);
+    } else if (metrics.column("metric")[i] == Value(std::string("table." + long_name + ".rows"))) {
+      EXPECT_EQ(metrics.column("value")[i], Value(1.0));
+    }
+  }
+  EXPECT_TRUE(found);
+}
+
+TEST(DatabaseTests, LatencyHistogramTest) {
+  LatencyHistogram histogram;
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    histogram.Record(i * 1000);
+  }
+  EXPECT_EQ(histogram.count(), 1000);
+  EXPECT_NEAR(histogram.Percentile(0.5), 500000, 500000 * 0.04);
+  EXPECT_NEAR(histogram.Percentile(0.99), 990000, 990000 * 0.04);
+  EXPECT_NEAR(histogram.Percentile(0.999), 999000, 999000 * 0.04);
+}
+
+
+TEST(DatabaseTests, ResultEncoderTest) {
+  Database db;
+  db.Execute(R"(
+    CREATE TABLE branch (
+      branch_id INT PRIMARY KEY,
+      branch_name VARCHAR(40),
+      rating DOUBLE,
+      is_open BOOL
+    )
+  )");
+  db.Execute("INSERT INTO branch(branch_id, branch_name, rating, is_open) VALUES(1, 'Corporate, HQ', 4.5, 1)");
+  db.Execute("INSERT INTO branch(branch_id, branch_name) VALUES(2, 'Scranton')");
+  Response response = db.Execute("SELECT branch_id, branch_name, rating, is_open FROM branch");
+
+  ResultEncoder csv(kCsv);
+  EXPECT_EQ(csv.Encode(response),
+            "branch_id,branch_name,rating,is_open\n"
+            "1,\"Corporate, HQ\",4.5,1\n"
+            "2,Scranton,,\n");
+
+  ResultEncoder json(kJsonLines);
+  EXPECT_EQ(json.Encode(response),
+            "{\"branch_id\":1,\"branch_name\":\"Corporate, HQ\",\"rating\":4.5,\"is_open\":true}\n"
+            "{\"branch_id\":2,\"branch_name\":\"Scranton\",\"rating\":null,\"is_open\":null}\n");
+
+  ResultEncoder text(kText);
+  std::ostringstream stream;
+  stream << response;
+  EXPECT_EQ(text.Encode(response), stream.str());
+
+  ResultEncoder binary(kBinary, 16);
+  std::string_view batch = binary.Encode(response);
+  ASSERT_GE(batch.size(), 16);
+  EXPECT_EQ(batch.substr(0, 4), "RBT1");
+  EXPECT_EQ(batch[4], 4);
+  EXPECT_EQ(batch[8], 2);
+  std::cout << text.Encode(db.Execute("DROP TABLE branch"));
+
+  // text follows the ostream formatting of floating point, CSV and JSON keep the shortest form
+  db.Execute("CREATE TABLE measure (id INT PRIMARY KEY, big DOUBLE, pi FLOAT)");
+  db.Execute("INSERT INTO measure(id, big, pi) VALUES(1, 1234567, 3.1415927), (2, 0.1, 2.5)");
+  Response measures = db.Execute("SELECT * FROM measure");
+  std::ostringstream measure_stream;
+  measure_stream << measures;
+  std::string_view encoded = text.Encode(measures);
+  EXPECT_EQ(encoded, measure_stream.str());
+  EXPECT_NE(encoded.find("1.23457e+06"), std::string_view::npos);
+  EXPECT_NE(encoded.find("3.14159 "), std::string_view::npos);
+  EXPECT_EQ(csv.Encode(measures),
+            "id,big,pi\n"
+            "1,1234567,3.1415927\n"
+            "2,0.1,2.5\n");
+}
+
+TEST(DatabaseTests, LexerTest) {
+  EXPECT_EQ(Lexer::LookupKeyword("select"), Keyword::kSelect);
+  EXPECT_EQ(Lexer::LookupKeyword("VarChar"), Keyword::kVarchar);
+  EXPECT_EQ(Lexer::LookupKeyword("selects"), Keyword::kNone);
+  EXPECT_EQ(Lexer::LookupKeyword("salary"), Keyword::kNone);
+
+  std::string query = "SELECT name FROM t\n  WHERE price >= -2.5e3 AND name = 'O''Neil'";
+  Lexer lexer(query);
+  std::vector<Lexeme> lexemes;
+  for (Lexeme l = lexer.Next(); l.type != LexemeType::kEnd; l = lexer.Next()) {
+    lexemes.push_back(l);
+  }
+  ASSERT_EQ(lexemes.size(), 12);
+  EXPECT_EQ(lexemes[4].keyword, Keyword::kWhere);
+  EXPECT_EQ(lexemes[4].line, 2);
+  EXPECT_EQ(lexemes[4].column, 3);
+  EXPECT_EQ(lexemes[6].text, ">=");
+  EXPECT_EQ(lexemes[7].type, LexemeType::kNumber);
+  EXPECT_EQ(lexemes[7].text, "-2.5e3");
+  EXPECT_EQ(Unescape(lexemes[11]), "O'Neil");
+  EXPECT_GE(lexemes[11].text.data(), query.data());
+  EXPECT_LT(lexemes[11].text.data(), query.data() + query.size());
+
+  Database db;
+  try {
+    db.Execute("CREATE TABLE t (\n  id INT PRIMARY KEY,\n  name TEXT)");
+    FAIL();
+  } catch (const std::logic_error& e) {
+    EXPECT_STREQ(e.what(), "3:8: Invalid data type");
+  }
+}
+
+TEST(DatabaseTests, MultiRowInsertTest) {
+  Database db;
+  db.Execute(R"(
+    CREATE TABLE branch (
+      branch_id INT PRIMARY KEY,
+      branch_name VARCHAR(40),
+      mgr_id INT
+    )
+  )");
+  db.Execute(R"(
+    INSERT INTO branch(branch_id, branch_name, mgr_id)
+    VALUES(1, 'Corporate', 100), (2, 'Scranton', 102), (3, 'Stamford', NULL);
+  )");
+  Response response = db.Execute("SELECT branch.branch_name, branch_id FROM branch WHERE mgr_id >= 101");
+  ASSERT_TRUE(response.is_table());
+  EXPECT_EQ(response.table().size(), 1);
+  EXPECT_EQ(response.table().column_names(), (std::vector<std::string>{"branch_name", "branch_id"}));
+  try {
+    db.Execute("INSERT INTO branch(branch_id, branch_name) VALUES(4, 'Houston', 110)");
+    FAIL();
+  } catch (const std::logic_error& e) {
+    std::cout << e.what() << std::endl;
+  }
+
+  // a column named twice would get two values per row and misalign every later row
+  EXPECT_THROW(db.Execute("INSERT INTO branch(mgr_id, mgr_id, branch_id) VALUES(1, 2, 5)"), std::logic_error);
+  db.Execute("INSERT INTO branch(branch_id, mgr_id) VALUES(5, 6)");
+  response = db.Execute("SELECT branch_id, mgr_id FROM branch WHERE branch_id = 5");
+  ASSERT_EQ(response.table().size(), 1);
+  EXPECT_EQ(std::get<int>(response.table().column("mgr_id")[0]), 6);
+  EXPECT_EQ(db.Execute("SELECT * FROM branch").table().size(), 4);
+}
+
+TEST(DatabaseTests, TypedApiTest) {
+  Database db;
+  db.Execute(R"(
+    CREATE TABLE employee (
+      emp_id INT PRIMARY KEY,
+      first_name VARCHAR(20),
+      sex VARCHAR(1),
+      salary DOUBLE,
+      super_id INT
+    )
+  )");
+  Appender appender(db, "employee");
+  appender.Append(100).Append("David").Append("M").Append(250000).AppendNull().EndRow();
+  appender.Append(101).Append("Jan").Append("F").Append(110000.5).Append(100).EndRow();
+  appender.Append(102).Append("Michael").Append("M").Append(75000).Append(100).EndRow();
+  EXPECT_EQ(appender.rows_appended(), 3);
+
+  EXPECT_THROW(appender.Append(102).Append("Copy").Append("M").Append(1).Append(1).EndRow(), std::logic_error);
+  EXPECT_THROW(appender.Append("oops"), std::logic_error);
+  appender.AppendNull().AppendNull().AppendNull().AppendNull();
+  EXPECT_THROW(appender.AppendNull().AppendNull(), std::logic_error);
+  EXPECT_EQ(db.GetTable("employee").size(), 3);
+  EXPECT_EQ(db.GetTable("employee").column("super_id").size(), 3);
+
+  Table result = db.Scan("employee", {"first_name", "salary"}, (Col("salary") > 100000 && Col("sex") == "M") ||
+      (Col("super_id") == 100 && Col("first_name") != "Michael"));
+  ASSERT_EQ(result.size(), 2);
+  EXPECT_EQ(std::get<std::string>(result.column("first_name")[0]), "David");
+  EXPECT_EQ(std::get<double>(result.column("salary")[1]), 110000.5);
+  std::cout << db.Execute("SELECT * FROM employee") << std::endl;
+  EXPECT_THROW(db.GetTable("branch"), std::logic_error);
+}
+
+namespace {
+
+struct DetachedTask {
+  struct promise_type {
+    DetachedTask get_return_object() { return {}; }
+    std::suspend_never initial_suspend() { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+DetachedTask CountEmployees(Database& db, size_t& rows, std::latch& done) {
+  Response response = co_await db.ExecuteAsync("SELECT emp_id FROM employee WHERE salary > 1000");
+  rows = response.table().size();
+  done.count_down();
+}
+
+}  // namespace
+
+TEST(DatabaseTests, ExecuteAsyncTest) {
+  Database db;
+  SchedulerOptions options;
+  options.max_concurrency = 4;
+  db.ConfigureScheduler(options);
+  db.ExecuteAsync("CREATE TABLE employee (emp_id INT PRIMARY KEY, salary INT)").Get();
+  std::vector<Future<Response>> inserts;
+  for (int i = 0; i < 100; ++i) {
+    inserts.push_back(db.ExecuteAsync("INSERT INTO employee(emp_id, salary) VALUES(" + std::to_string(i) + ", "
+                                          + std::to_string(i * 100) + ")"));
+  }
+  for (auto& f : inserts) {
+    f.Get();
+  }
+
+  std::vector<std::thread> clients;
+  std::atomic<size_t> total = 0;
+  for (int t = 0; t < 4; ++t) {
+    clients.emplace_back([&db, &total] {
+      for (int i = 0; i < 25; ++i) {
+        total += db.ExecuteAsync("SELECT emp_id FROM employee WHERE salary >= 5000").Get().table().size();
+      }
+    });
+  }
+  for (auto& c : clients) {
+    c.join();
+  }
+  EXPECT_EQ(total, 100 * 50);
+
+  size_t rows = 0;
+  std::latch done(1);
+  CountEmployees(db, rows, done);
+  done.wait();
+  EXPECT_EQ(rows, 89);
+
+  EXPECT_THROW(db.ExecuteAsync("SELECT FROM employee").Get(), std::logic_error);
+  EXPECT_THROW(db.ExecuteAsync("SELECT emp_id FROM branch").Get(), std::logic_error);
+  EXPECT_EQ(db.Stats().statements[kInsert].count, 100);
+}
+
+TEST(DatabaseTests, QuerySchedulerTest) {
+  SchedulerOptions options;
+  options.max_concurrency = 2;
+  options.max_long_queries = 1;
+  options.max_queued_long = 1;
+  QueryScheduler scheduler(options);
+  std::latch release(1);
+  std::latch long_started(1);
+  std::atomic<int> finished = 0;
+  ASSERT_TRUE(scheduler.Submit(kLongQuery, [&] {
+    long_started.count_down();
+    release.wait();
+    ++finished;
+  }));
+  long_started.wait();
+  ASSERT_TRUE(scheduler.Submit(kLongQuery, [&] { ++finished; }));
+  EXPECT_FALSE(scheduler.Submit(kLongQuery, [&] { ++finished; }));
+  EXPECT_EQ(scheduler.queued(kLongQuery), 1);
+
+  std::latch short_done(1);
+  ASSERT_TRUE(scheduler.Submit(kShortQuery, [&] { short_done.count_down(); }));
+  short_done.wait();
+  EXPECT_EQ(scheduler.running(kLongQuery), 1);
+  EXPECT_EQ(scheduler.queued(kLongQuery), 1);
+  release.count_down();
+  while (finished != 2) {
+    std::this_thread::yield();
+  }
+}
+
+TEST(DatabaseTests, RowBatchRoundTripTest) {
+  Database db;
+  db.Execute("CREATE TABLE t (id INT PRIMARY KEY, name VARCHAR(10), score FLOAT, ok BOOL, rate DOUBLE)");
+  db.Execute("INSERT INTO t(id, name, score, ok, rate) VALUES(-1, 'a', 1.5, 1, 0.1), (2, NULL, NULL, 0, NULL)");
+  Response response = db.Execute("SELECT * FROM t");
+  ResultEncoder encoder(kBinary);
+  Table decoded = DecodeRowBatch(encoder.Encode(response));
+  ResultEncoder csv1(kCsv);
+  ResultEncoder csv2(kCsv);
+  EXPECT_EQ(csv1.Encode(decoded), csv2.Encode(response.table()));
+  EXPECT_THROW(DecodeRowBatch("RBT1\x01"), std::logic_error);
+}
+
+TEST(DatabaseTests, ServerTest) {
+  Database db;
+  ServerOptions options;
+  options.unix_path = "/tmp/database_tests_" + std::to_string(::getpid()) + ".sock";
+  Server server(db, options);
+  std::jthread loop([&server] { server.Run(); });
+  struct StopGuard {
+    Server& server;
+    ~StopGuard() { server.Stop(); }
+  } guard{server};
+
+  Client client = Client::ConnectUnix(options.unix_path);
+  client.Send("CREATE TABLE branch (branch_id INT PRIMARY KEY, branch_name VARCHAR(40))");
+  for (int i = 0; i < 50; ++i) {
+    client.Send("INSERT INTO branch(branch_id, branch_name) VALUES(" + std::to_string(i) + ", 'b"
+                    + std::to_string(i) + "')");
+  }
+  client.Send("SELECT branch_name FROM branch WHERE branch_id < 10");
+  client.Send("SELECT branch_id FROM missing");
+  EXPECT_EQ(client.Receive().message, "Table is successfully created");
+  for (int i = 0; i < 50; ++i) {
+    EXPECT_EQ(client.Receive().status, kMessageResponse);
+  }
+  ClientResponse select = client.Receive();
+  ASSERT_EQ(select.status, kTableResponse);
+  EXPECT_EQ(select.table.size(), 10);
+  EXPECT_EQ(std::get<std::string>(select.table.column("branch_name")[3]), "b3");
+  EXPECT_EQ(client.Receive().status, kErrorResponse);
+
+  Client tcp = Client::ConnectTcp("127.0.0.1", server.tcp_port());
+  EXPECT_EQ(tcp.Execute("SELECT branch_id FROM branch").table.size(), 50);
+  EXPECT_THROW(tcp.Execute("DROP"), std::logic_error);
+}
+
+TEST(DatabaseTests, MemoryLimitTest) {
+  auto root = std::make_shared<TrackingResource>("root", 1024);
+  auto child = std::make_shared<TrackingResource>("child", 0, root);
+  {
+    std::pmr::vector<int> v(child.get());
+    v.resize(100);
+    EXPECT_EQ(child->used(), 400);
+    EXPECT_EQ(root->used(), 400);
+    EXPECT_THROW(v.resize(1000), MemoryLimitError);
+    EXPECT_EQ(v.size(), 100);
+  }
+  EXPECT_EQ(root->used(), 0);
+  EXPECT_EQ(root->peak(), 400);
+
+  Database db;
+  db.Execute("CREATE TABLE t (id INT PRIMARY KEY, name VARCHAR(64))");
+  std::string long_name(40, 'x');
+  for (int i = 0; i < 100; ++i) {
+    db.Execute("INSERT INTO t(id, name) VALUES(" + std::to_string(i) + ", '" + long_name + "')");
+  }
+  DatabaseStats stats = db.Stats();
+  ASSERT_EQ(stats.tables.size(), 1);
+  EXPECT_GT(stats.tables[0].tracked_bytes, 100 * sizeof(Value));
+  EXPECT_EQ(stats.memory_used, stats.tables[0].tracked_bytes);
+
+  // a failed multi-row insert leaves the table untouched
+  db.SetTableMemoryLimit("t", stats.tables[0].tracked_bytes + 64);
+  std::string insert = "INSERT INTO t(id, name) VALUES(1000, '" + long_name + "')";
+  for (int i = 1001; i < 1100; ++i) {
+    insert += ", (" + std::to_string(i) + ", '" + long_name + "')";
+  }
+  EXPECT_THROW(db.Execute(insert), MemoryLimitError);
+  EXPECT_EQ(db.Execute("SELECT id FROM t").table().size(), 100);
+  db.SetTableMemoryLimit("t", 0);
+  EXPECT_NO_THROW(db.Execute(insert));
+
+  // query intermediates are charged to the query, not to the table
+  db.ConfigureMemory({.query_limit = 4096});
+  EXPECT_THROW(db.Execute("SELECT * FROM t"), MemoryLimitError);
+  EXPECT_EQ(db.Execute("SELECT name FROM t WHERE id < 5").table().size(), 5);
+  db.ConfigureMemory({.global_limit = db.Stats().memory_used});
+  EXPECT_THROW(db.Execute("INSERT INTO t(id, name) VALUES(5000, '" + long_name + "')"), MemoryLimitError);
+
+  db.Execute("DROP TABLE t");
+  EXPECT_EQ(db.Stats().memory_used, 0);
+}
+
+TEST(DatabaseTests, QueryArenaTest) {
+  auto root = std::make_shared<TrackingResource>("root");
+  auto query = TrackingResource::WithArena("query", 0, root);
+  ASSERT_NE(query->arena(), nullptr);
+  {
+    std::pmr::vector<int> v(query.get());
+    for (int i = 0; i < 1000; ++i) {
+      v.push_back(i);
+    }
+    EXPECT_EQ(query->used(), v.capacity() * sizeof(int));
+    EXPECT_EQ(root->used(), query->used());
+    // regrowth leaves the old buffers in the arena, but the accounting only sees live bytes
+    EXPECT_GT(query->arena()->allocated(), query->used());
+  }
+  EXPECT_EQ(query->used(), 0);
+  EXPECT_EQ(root->used(), 0);
+  EXPECT_EQ(std::make_shared<TrackingResource>("plain")->arena(), nullptr);
+
+  Database db;
+  db.Execute("CREATE TABLE a (id INT PRIMARY KEY, k INT)");
+  db.Execute("CREATE TABLE b (id INT PRIMARY KEY, name VARCHAR(8))");
+  Appender a(db, "a");
+  Appender b(db, "b");
+  for (int i = 0; i < 2000; ++i) {
+    a.Append(i).Append(i % 100).EndRow();
+    b.Append(i).Append("n" + std::to_string(i % 10)).EndRow();
+  }
+  size_t tables = db.Stats().memory_used;
+  {
+    Response response = db.Execute("SELECT a.id, b.name FROM a JOIN b ON a.k = b.id ORDER BY name");
+    ASSERT_EQ(response.table().size(), 2000);
+    ASSERT_NE(response.table().memory(), nullptr);
+    ASSERT_NE(response.table().memory()->arena(), nullptr);
+    EXPECT_GE(response.table().memory()->arena()->allocated(), response.table().memory()->used());
+    EXPECT_GT(db.Stats().memory_used, tables);
+  }
+  EXPECT_EQ(db.Stats().memory_used, tables);
+}
+
+TEST(DatabaseTests, SpillTest) {
+  Database db;
+  db.Execute("CREATE TABLE a (id INT PRIMARY KEY, k INT, name VARCHAR(16))");
+  db.Execute("CREATE TABLE b (id INT PRIMARY KEY, k INT, amount DOUBLE)");
+  Appender a(db, "a");
+  Appender b(db, "b");
+  for (int i = 0; i < 4000; ++i) {
+    a.Append(i).Append(i % 1000).Append("n" + std::to_string(i % 7)).EndRow();
+    b.Append(i).Append((i * 7) % 1200).Append(i * 0.5).EndRow();
+  }
+  const std::string join = "SELECT a.id, a.name, b.amount FROM a LEFT JOIN b ON a.k = b.k";
+  const std::string sort = "SELECT id, k, name FROM a ORDER BY name DESC, k, id DESC";
+  ResultEncoder in_memory(kCsv);
+  std::string expected_join(in_memory.Encode(db.Execute(join)));
+  std::string expected_sort(in_memory.Encode(db.Execute(sort)));
+  EXPECT_EQ(db.Stats().spill_files, 0);
+
+  Response sorted = db.Execute(sort);
+  const Column& names = sorted.table().column("name");
+  const Column& keys = sorted.table().column("k");
+  EXPECT_EQ(std::get<std::string>(names[0]), "n6");
+  EXPECT_EQ(std::get<std::string>(names[3999]), "n0");
+  EXPECT_LE(std::get<int>(keys[0]), std::get<int>(keys[1]));
+
+  db.ConfigureMemory({.operator_memory = 16 << 10});
+  ResultEncoder spilled(kCsv);
+  EXPECT_EQ(spilled.Encode(db.Execute(join)), expected_join);
+  uint64_t join_files = db.Stats().spill_files;
+  EXPECT_GT(join_files, 0);
+  EXPECT_EQ(spilled.Encode(db.Execute(sort)), expected_sort);
+  EXPECT_GT(db.Stats().spill_files, join_files);
+  EXPECT_GT(db.Stats().spill_bytes, 0);
+}
+
+TEST(DatabaseTests, ExternalSortTest) {
+  // a 16 KiB grant gives runs of about 1.5k rows, so 100k rows make dozens of runs
+  const size_t n = 100000;
+  Column key(kInt, 0, true);
+  for (size_t i = 0; i < n; ++i) {
+    key.PushValue(static_cast<int>((i * 7919) % 100003));
+  }
+  auto open_files = []() {
+    return std::distance(std::filesystem::directory_iterator("/proc/self/fd"), std::filesystem::directory_iterator());
+  };
+  auto before = open_files();
+  auto work = std::make_shared<TrackingResource>("operator", 16 << 10);
+  SpillStats spill;
+  std::vector<size_t> order;
+  std::ptrdiff_t max_open = 0;
+  SortRows({&key}, {false}, n, work, spill, [&](size_t row) {
+    if (order.size() % 4096 == 0) {
+      max_open = std::max(max_open, open_files() - before);
+    }
+    order.push_back(row);
+  });
+  ASSERT_EQ(order.size(), n);
+  for (size_t i = 1; i < n; ++i) {
+    ASSERT_TRUE(key[order[i - 1]] < key[order[i]] || (key[order[i - 1]] == key[order[i]] && order[i - 1] < order[i]));
+  }
+  // the final merge keeps a bounded number of runs open, and the buffers were charged and returned
+  EXPECT_GT(spill.files, 60);
+  EXPECT_LT(max_open, static_cast<std::ptrdiff_t>(spill.files / 4));
+  EXPECT_LE(work->peak(), work->limit());
+  EXPECT_EQ(work->used(), 0);
+  EXPECT_EQ(open_files(), before);
+}
+
+TEST(DatabaseTests, CheckpointTest) {
+  auto dir = std::filesystem::temp_directory_path() / ("database_checkpoint_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  Database db;
+  db.Execute("CREATE TABLE big (id INT PRIMARY KEY, k INT, name VARCHAR(16))");
+  db.Execute("CREATE TABLE small (id INT PRIMARY KEY, flag BOOL)");
+  Appender appender(db, "big");
+  for (int i = 0; i < 2 * 4096 + 10; ++i) {
+    appender.Append(i).Append(i % 3).Append("name" + std::to_string(i)).EndRow();
+  }
+  db.Execute("INSERT INTO small(id, flag) VALUES(1, TRUE)");
+
+  CheckpointStats stats = db.Checkpoint(dir.string());
+  EXPECT_TRUE(stats.full);
+  EXPECT_EQ(stats.tables_written, 2);
+  EXPECT_EQ(stats.blocks_written, 3 * 3 + 2);
+
+  // only the block holding the updated value is rewritten
+  db.Execute("UPDATE big SET k = 100 WHERE id = 5000");
+  stats = db.Checkpoint(dir.string());
+  EXPECT_FALSE(stats.full);
+  EXPECT_EQ(stats.tables_written, 1);
+  EXPECT_EQ(stats.blocks_written, 1);
+
+  stats = db.Checkpoint(dir.string());
+  EXPECT_EQ(stats.tables_written, 0);
+  EXPECT_EQ(stats.blocks_written, 0);
+
+  db.Execute("INSERT INTO small(id, flag) VALUES(2, NULL)");
+  db.Execute("DELETE FROM big WHERE id = 5000");
+  stats = db.Checkpoint(dir.string());
+  EXPECT_EQ(stats.tables_written, 2);
+  EXPECT_EQ(stats.blocks_written, 2 * 3 + 2);
+
+  Database restored;
+  restored.OpenCheckpoint(dir.string());
+  ResultEncoder expected(kCsv);
+  ResultEncoder actual(kCsv);
+  for (const std::string query : {"SELECT * FROM big", "SELECT * FROM small"}) {
+    EXPECT_EQ(actual.Encode(restored.Execute(query)), expected.Encode(db.Execute(query)));
+  }
+  // the restored database continues the chain of incremental checkpoints
+  restored.Execute("UPDATE small SET flag = FALSE WHERE id = 1");
+  stats = restored.Checkpoint(dir.string());
+  EXPECT_FALSE(stats.full);
+  EXPECT_EQ(stats.blocks_written, 1);
+
+  stats = restored.Checkpoint(dir.string(), {.force_full = true});
+  EXPECT_TRUE(stats.full);
+  size_t files = 0;
+  for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+    EXPECT_TRUE(entry.is_regular_file());
+    ++files;
+  }
+  EXPECT_EQ(files, 2);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DatabaseTests, SaveAsyncTest) {
+  Database db;
+  db.Execute("CREATE TABLE t (id INT PRIMARY KEY, name VARCHAR(16))");
+  db.Execute("CREATE TABLE u (id INT PRIMARY KEY)");
+  Appender appender(db, "t");
+  for (int i = 0; i < 1000; ++i) {
+    appender.Append(i).Append("name" + std::to_string(i)).EndRow();
+  }
+  ResultEncoder encoder(kCsv);
+  std::string expected(encoder.Encode(db.Execute("SELECT * FROM t")));
+
+  std::atomic<size_t> calls = 0;
+  Future<SaveProgress> future = db.SaveAsync("ASYNC", [&calls](const SaveProgress&) { ++calls; });
+  // writes after the call are not part of the snapshot
+  db.Execute("INSERT INTO t(id, name) VALUES(1000, 'late')");
+  db.Execute("DROP TABLE u");
+  SaveProgress progress = future.Get();
+  EXPECT_TRUE(progress.done);
+  EXPECT_EQ(progress.tables_total, 2);
+  EXPECT_EQ(progress.tables_written, 2);
+  EXPECT_EQ(progress.rows_written, 1000);
+  EXPECT_EQ(calls, 3);
+
+  Database restored;
+  restored.Open("ASYNC");
+  EXPECT_EQ(encoder.Encode(restored.Execute("SELECT * FROM t")), expected);
+  EXPECT_NO_THROW(restored.Execute("SELECT id FROM u"));
+}
+
+TEST(DatabaseTests, CompressionTest) {
+  std::vector<int64_t> sorted(4096);
+  std::vector<int64_t> small(4096);
+  std::vector<int64_t> runs(4096);
+  std::vector<uint8_t> is_null(4096);
+  for (int i = 0; i < 4096; ++i) {
+    sorted[i] = 1000000 + i;
+    small[i] = i % 7 - 3;
+    runs[i] = i / 1000;
+    is_null[i] = i % 5 == 0;
+  }
+  EXPECT_EQ(EncodedBlock::Encode(sorted, {}).encoding(), kDelta);
+  EXPECT_EQ(EncodedBlock::Encode(small, {}).encoding(), kFrameOfReference);
+  EXPECT_EQ(EncodedBlock::Encode(runs, {}).encoding(), kRunLength);
+  for (const auto* values : {&sorted, &small, &runs}) {
+    EncodedBlock block = EncodedBlock::Encode(*values, is_null);
+    std::string data;
+    block.Serialize(data);
+    size_t offset = 0;
+    EncodedBlock copy = EncodedBlock::Deserialize(data, offset);
+    EXPECT_EQ(offset, data.size());
+    std::vector<int64_t> decoded(4096);
+    copy.Decode(decoded);
+    std::vector<uint8_t> less(4096);
+    copy.Match(kLess, (*values)[2000], less.data());
+    for (size_t i = 0; i < 4096; ++i) {
+      EXPECT_EQ(copy.IsNull(i), is_null[i] != 0);
+      if (!is_null[i]) {
+        EXPECT_EQ(decoded[i], (*values)[i]);
+        EXPECT_EQ(copy[i], (*values)[i]);
+        EXPECT_EQ(less[i], (*values)[i] < (*values)[2000]);
+      } else {
+        // a comparison with NULL is UNKNOWN and never matches
+        EXPECT_EQ(less[i], 0);
+      }
+    }
+    EXPECT_TRUE(copy.Contains((*values)[2001]));
+    EXPECT_FALSE(copy.Contains(-100));
+  }
+
+  Database db;
+  db.Execute("CREATE TABLE t (id INT PRIMARY KEY, branch_id INT, active BOOL, name VARCHAR(16))");
+  Appender appender(db, "t");
+  for (int i = 0; i < 3 * 4096 + 100; ++i) {
+    appender.Append(i).Append(i % 4).Append(i < 6000).Append("n" + std::to_string(i)).EndRow();
+  }
+  TableMemoryStats stats = db.GetTable("t").MemoryUsage();
+  EXPECT_LT(stats.columns[1].bytes, 4096 * sizeof(Value));
+  EXPECT_THROW(db.Execute("INSERT INTO t(id, branch_id) VALUES(5000, 1)"), std::logic_error);
+
+  ResultEncoder encoder(kCsv);
+  EXPECT_EQ(db.Execute("SELECT id FROM t WHERE branch_id = 2 AND active = 0").table().size(), 1597);
+  EXPECT_EQ(db.Execute("SELECT id FROM t WHERE 4000 < id AND id <= 4100").table().size(), 100);
+  db.Execute("UPDATE t SET branch_id = NULL WHERE id = 4097");
+  db.Execute("DELETE FROM t WHERE id < 10");
+  Table result = db.Execute("SELECT id, branch_id FROM t WHERE branch_id <> 1 AND id < 4100").table();
+  EXPECT_EQ(result.size(), 3068);
+  EXPECT_EQ(result.column("id")[0], Value(10));
+  std::string csv(encoder.Encode(db.Execute("SELECT * FROM t WHERE id = 4097")));
+  EXPECT_NE(csv.find("4097,,1,n4097"), std::string::npos);
+
+  auto dir = std::filesystem::temp_directory_path() / ("database_compression_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  db.Checkpoint(dir.string());
+  Database restored;
+  restored.OpenCheckpoint(dir.string());
+  std::string expected(encoder.Encode(db.Execute("SELECT * FROM t")));
+  EXPECT_EQ(encoder.Encode(restored.Execute("SELECT * FROM t")), expected);
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DatabaseTests, NullPredicateTest) {
+  Database db;
+  db.Execute("CREATE TABLE t (id INT PRIMARY KEY, branch_id INT, name VARCHAR(16))");
+  Appender appender(db, "t");
+  // 2.5 blocks so that both sealed blocks and the tail carry NULLs
+  for (int i = 0; i < 2 * 4096 + 2048; ++i) {
+    appender.Append(i);
+    if (i % 10 == 0) {
+      appender.AppendNull();
+    } else {
+      appender.Append(i % 3);
+    }
+    if (i % 100 == 0) {
+      appender.AppendNull();
+    } else {
+      appender.Append("n" + std::to_string(i));
+    }
+    appender.EndRow();
+  }
+  auto count = [&db](const std::string& where) {
+    return db.Execute("SELECT id FROM t WHERE " + where).table().size();
+  };
+  EXPECT_EQ(db.GetTable("t").column("branch_id").null_count(), 1024);
+  EXPECT_EQ(count("branch_id IS NULL"), 1024);
+  EXPECT_EQ(count("branch_id IS NOT NULL"), 9216);
+  EXPECT_EQ(count("name IS NULL"), 103);
+  EXPECT_EQ(count("branch_id IS NULL AND name IS NULL"), 103);
+  EXPECT_EQ(count("(branch_id IS NULL OR name IS NULL) AND id < 100"), 10);
+  EXPECT_EQ(count("t.branch_id IS NOT NULL AND branch_id = 0"), count("branch_id = 0"));
+
+  // comparisons with NULL are UNKNOWN and filter the row out
+  size_t below = count("branch_id < 1");
+  size_t rest = count("branch_id >= 1");
+  EXPECT_EQ(below + rest, 9216);
+  EXPECT_EQ(count("branch_id <> 1") + count("branch_id = 1"), 9216);
+  EXPECT_EQ(count("branch_id = NULL"), 0);
+  EXPECT_EQ(count("name <> 'x'"), 10137);
+  // IS NULL over an expression is true exactly where the expression is UNKNOWN
+  EXPECT_EQ(count("(branch_id = 1) IS NULL"), 1024);
+  EXPECT_EQ(count("(branch_id = 1) IS NOT NULL"), 9216);
+  EXPECT_EQ(count("(branch_id = 1 OR id < 10) IS NULL"), 1023);
+  EXPECT_EQ(count("(branch_id = 1 AND id < 10) IS NULL"), 1);
+  EXPECT_EQ(count("(branch_id = NULL) IS NULL"), 10240);
+
+  db.Execute("UPDATE t SET branch_id = NULL WHERE id = 1");
+  db.Execute("UPDATE t SET branch_id = 2 WHERE id = 0");
+  db.Execute("DELETE FROM t WHERE id < 5 AND id > 2");
+  EXPECT_EQ(count("branch_id IS NULL"), 1024);
+  Table nulls = db.Execute("SELECT id FROM t WHERE branch_id IS NULL AND id < 30").table();
+  ASSERT_EQ(nulls.size(), 3);
+  EXPECT_EQ(nulls.column("id")[0], Value(1));
+  EXPECT_EQ(nulls.column("id")[1], Value(10));
+  EXPECT_EQ(nulls.column("id")[2], Value(20));
+
+  Table scanned = db.Scan("t", {"id"}, Col("name").IsNull() && Col("branch_id").IsNotNull());
+  ASSERT_EQ(scanned.size(), 1);
+  EXPECT_EQ(scanned.column("id")[0], Value(0));
+  EXPECT_EQ(db.Scan("t", {"id"}, Col("name").IsNotNull() || Col("id") == 0).size(), 10136);
+  EXPECT_THROW(db.Execute("SELECT id FROM t WHERE IS NULL"), std::logic_error);
+  EXPECT_THROW(db.Execute("SELECT id FROM t WHERE name IS 5"), std::logic_error);
+}
+
+TEST(DatabaseTests, ParallelAndLazyOpenTest) {
+  Database db;
+  db.Execute("CREATE TABLE hot (id INT PRIMARY KEY, name VARCHAR(16), score DOUBLE)");
+  db.Execute("CREATE TABLE cold (id INT PRIMARY KEY, flag BOOL)");
+  Appender appender(db, "hot");
+  for (int i = 0; i < 4096 + 50; ++i) {
+    appender.Append(i).Append("h" + std::to_string(i)).Append(i * 0.5).EndRow();
+  }
+  db.Execute("INSERT INTO cold(id, flag) VALUES(1, TRUE)");
+  db.Save("OPEN_TEST");
+  auto dir = std::filesystem::temp_directory_path() / ("database_open_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  db.Checkpoint(dir.string());
+
+  ResultEncoder encoder(kCsv);
+  std::string hot(encoder.Encode(db.Execute("SELECT * FROM hot")));
+  std::string cold(encoder.Encode(db.Execute("SELECT * FROM cold")));
+  auto loaded_bytes = [](const Database& database, const std::string& table) {
+    for (const auto& t : database.Stats().tables) {
+      if (t.table == table) {
+        EXPECT_EQ(t.rows, table == "hot" ? 4146 : 1);
+        return t.bytes;
+      }
+    }
+    ADD_FAILURE() << "no table " << table;
+    return size_t(0);
+  };
+
+  for (bool lazy : {false, true}) {
+    Database restored;
+    restored.Open("OPEN_TEST", {.threads = 4, .lazy = lazy});
+    EXPECT_EQ(loaded_bytes(restored, "cold") == 0, lazy);
+    EXPECT_EQ(encoder.Encode(restored.Execute("SELECT * FROM hot")), hot);
+    EXPECT_EQ(loaded_bytes(restored, "cold") == 0, lazy);
+    EXPECT_NE(loaded_bytes(restored, "hot"), 0);
+    EXPECT_EQ(encoder.Encode(restored.Execute("SELECT * FROM cold")), cold);
+
+    Database from_checkpoint;
+    from_checkpoint.OpenCheckpoint(dir.string(), {.threads = 4, .lazy = lazy});
+    EXPECT_EQ(loaded_bytes(from_checkpoint, "hot") == 0, lazy);
+    from_checkpoint.Execute("INSERT INTO cold(id, flag) VALUES(2, FALSE)");
+    EXPECT_EQ(loaded_bytes(from_checkpoint, "hot") == 0, lazy);
+    // the checkpoint loads the remaining tables before it rewrites the chain
+    CheckpointStats stats = from_checkpoint.Checkpoint(dir.string());
+    EXPECT_FALSE(stats.full);
+    EXPECT_EQ(stats.tables_written, 1);
+    EXPECT_EQ(encoder.Encode(from_checkpoint.Execute("SELECT * FROM hot")), hot);
+    from_checkpoint.Execute("DELETE FROM cold WHERE id = 2");
+    from_checkpoint.Checkpoint(dir.string());
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(DatabaseTests, MaterializedViewTest) {
+  Database db;
+  db.Execute("CREATE TABLE dept (dept_id INT PRIMARY KEY, title VARCHAR(20))");
+  db.Execute("CREATE TABLE emp (emp_id INT PRIMARY KEY, dept INT, salary INT)");
+  db.Execute("INSERT INTO dept(dept_id, title) VALUES(1, 'sales'), (2, 'it'), (3, 'hr')");
+  for (int i = 0; i < 40; ++i) {
+    db.Execute("INSERT INTO emp(emp_id, dept, salary) VALUES(" + std::to_string(i) + ", " +
+               std::to_string(i % 4) + ", " + std::to_string(100 * i) + ")");
+  }
+  db.Execute("CREATE MATERIALIZED VIEW rich AS SELECT emp_id, salary FROM emp WHERE salary > 1500");
+  db.Execute("CREATE MATERIALIZED VIEW staff AS SELECT emp_id, title FROM emp JOIN dept ON dept = dept_id");
+
+  ResultEncoder encoder(kCsv);
+  // incremental maintenance appends changed rows, so the order may differ from a fresh SELECT
+  auto rows = [&encoder](const Response& response) {
+    std::istringstream in{std::string(encoder.Encode(response))};
+    std::vector<std::string> lines;
+    for (std::string line; std::getline(in, line);) {
+      lines.push_back(line);
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+  };
+  auto check = [&]() {
+    EXPECT_EQ(rows(db.Execute("SELECT * FROM rich")),
+              rows(db.Execute("SELECT emp_id, salary FROM emp WHERE salary > 1500")));
+    EXPECT_EQ(rows(db.Execute("SELECT * FROM staff")),
+              rows(db.Execute("SELECT emp_id, title FROM emp JOIN dept ON dept = dept_id")));
+  };
+  check();
+  EXPECT_EQ(db.GetTable("staff").size(), 30);
+
+  db.Execute("INSERT INTO emp(emp_id, dept, salary) VALUES(40, 3, 5000), (41, 0, 10)");
+  db.Execute("INSERT INTO dept(dept_id, title) VALUES(0, 'ops')");
+  check();
+  db.Execute("UPDATE emp SET salary = 0 WHERE emp_id > 35");
+  db.Execute("UPDATE emp SET dept = 2 WHERE emp_id < 4");
+  db.Execute("UPDATE dept SET title = 'dev' WHERE dept_id = 2");
+  check();
+  db.Execute("DELETE FROM emp WHERE salary < 800");
+  db.Execute("DELETE FROM dept WHERE dept_id = 3");
+  check();
+  db.Execute("DELETE FROM dept");
+  check();
+  EXPECT_EQ(db.GetTable("staff").size(), 0);
+
+  EXPECT_THROW(db.Execute("INSERT INTO rich(emp_id, salary) VALUES(100, 1)"), std::logic_error);
+  EXPECT_THROW(db.Execute("DROP TABLE emp"), std::logic_error);
+  EXPECT_THROW(db.Execute("CREATE MATERIALIZED VIEW rich AS SELECT * FROM emp"), std::logic_error);
+  EXPECT_THROW(db.Execute("CREATE MATERIALIZED VIEW sorted AS SELECT * FROM emp ORDER BY salary"),
+               std::logic_error);
+  db.Execute("DROP TABLE rich");
+  db.Execute("DROP TABLE staff");
+  db.Execute("DROP TABLE emp");
+}
+
+TEST(DatabaseTests, ResultCacheTest) {
+  Database db;
+  db.Execute("CREATE TABLE item (id INT PRIMARY KEY, price INT)");
+  db.Execute("INSERT INTO item(id, price) VALUES(1, 10), (2, 20), (3, 30)");
+  db.ConfigureResultCache({.max_bytes = 1 << 20, .max_entries = 2});
+  EXPECT_EQ(NormalizeQuery("select  id FROM item\n where price > 'x' ;"), "SELECT id FROM item WHERE price > 'x'");
+
+  EXPECT_EQ(db.Execute("SELECT id FROM item WHERE price > 15").table().size(), 2);
+  EXPECT_EQ(db.Execute("select id from item  WHERE price > 15;").table().size(), 2);
+  DatabaseStats stats = db.Stats();
+  EXPECT_EQ(stats.result_cache_misses, 1);
+  EXPECT_EQ(stats.result_cache_hits, 1);
+  EXPECT_EQ(stats.result_cache_entries, 1);
+
+  // every mutation bumps the table version and invalidates the entry
+  db.Execute("INSERT INTO item(id, price) VALUES(4, 40)");
+  EXPECT_EQ(db.Execute("SELECT id FROM item WHERE price > 15").table().size(), 3);
+  db.Execute("UPDATE item SET price = 0 WHERE id = 4");
+  EXPECT_EQ(db.ExecuteAsync("SELECT id FROM item WHERE price > 15").Get().table().size(), 2);
+  db.Execute("DROP TABLE item");
+  db.Execute("CREATE TABLE item (id INT PRIMARY KEY, price INT)");
+  EXPECT_EQ(db.Execute("SELECT id FROM item WHERE price > 15").table().size(), 0);
+  stats = db.Stats();
+  EXPECT_EQ(stats.result_cache_hits, 1);
+  EXPECT_EQ(stats.result_cache_misses, 4);
+
+  // least recently used entry goes first
+  db.Execute("SELECT * FROM item");
+  db.Execute("SELECT id FROM item WHERE price > 15");
+  db.Execute("SELECT price FROM item");
+  EXPECT_EQ(db.Stats().result_cache_entries, 2);
+  db.Execute("SELECT id FROM item WHERE price > 15");
+  EXPECT_EQ(db.Stats().result_cache_hits, 3);
+  db.Execute("SELECT * FROM item");
+  EXPECT_EQ(db.Stats().result_cache_hits, 3);
+  EXPECT_NE(ToPrometheus(db.Stats()).find("database_result_cache_hits_total 3"), std::string::npos);
+
+  // hits copy the entry into their own memory, so the entry's arena stays flat
+  db.Execute("INSERT INTO item(id, price) VALUES(1, 10), (2, 20), (3, 30)");
+  Response first = db.Execute("SELECT id, price FROM item WHERE price > 15");
+  const ArenaResource* arena = first.table().memory()->arena();
+  ASSERT_NE(arena, nullptr);
+  size_t allocated = arena->allocated();
+  size_t bytes = db.Stats().result_cache_bytes;
+  for (int i = 0; i < 200; ++i) {
+    Response hit = db.Execute("SELECT id, price FROM item WHERE price > 15");
+    ASSERT_EQ(hit.table().size(), 2);
+    EXPECT_NE(hit.table().memory(), first.table().memory());
+  }
+  EXPECT_EQ(arena->allocated(), allocated);
+  EXPECT_EQ(db.Stats().result_cache_bytes, bytes);
+  EXPECT_EQ(db.Stats().result_cache_hits, 203);
+
+  ResultCache cache({.max_bytes = 1 << 20});
+  cache.Insert("SELECT * FROM item", {1}, first);
+  auto entry = cache.Find("SELECT * FROM item", {1});
+  ASSERT_NE(entry, nullptr);
+  EXPECT_EQ(cache.Find("SELECT * FROM item", {1}), entry);
+  EXPECT_EQ(cache.Find("SELECT * FROM item", {2}), nullptr);
+  EXPECT_EQ(cache.size(), 0);
+
+  db.ConfigureResultCache({});
+  db.Execute("SELECT * FROM item");
+  EXPECT_EQ(db.Stats().result_cache_entries, 0);
+}
+
+TEST(DatabaseTests, ForeignKeyTest) {
+  Database db;
+  db.Execute("CREATE TABLE branch (branch_id INT PRIMARY KEY, name VARCHAR(20))");
+  db.Execute(R"(CREATE TABLE worker (
+                  worker_id INT PRIMARY KEY,
+                  branch INT,
+                  boss INT,
+                  FOREIGN KEY (branch) REFERENCES branch(branch_id),
+                  FOREIGN KEY (boss) REFERENCES worker(worker_id)))");
+  EXPECT_THROW(db.Execute("CREATE TABLE bad (id INT PRIMARY KEY, ref INT, FOREIGN KEY (ref) REFERENCES branch(name))"),
+               std::logic_error);
+  EXPECT_THROW(db.Execute("CREATE TABLE bad (id INT PRIMARY KEY, ref INT, FOREIGN KEY (ref) REFERENCES none(id))"),
+               std::logic_error);
+  db.Execute("INSERT INTO branch(branch_id, name) VALUES(1, 'north'), (2, 'south')");
+
+  // a bulk insert is validated once at the end, so rows may reference each other
+  std::string values;
+  for (int i = 0; i < 5000; ++i) {
+    values += (i == 0 ? "" : ", ") + std::string("(") + std::to_string(i) + ", " + std::to_string(i % 2 + 1) + ", "
+              + (i == 0 ? "NULL" : std::to_string((i + 1) % 5000)) + ")";
+  }
+  db.Execute("INSERT INTO worker(worker_id, branch, boss) VALUES" + values);
+  EXPECT_EQ(db.GetTable("worker").size(), 5000);
+  EXPECT_GT(db.Stats().index_lookups, 2);
+
+  // a failed statement leaves no rows behind
+  EXPECT_THROW(db.Execute("INSERT INTO worker(worker_id, branch, boss) VALUES(5000, 1, 0), (5001, 3, 0)"),
+               std::logic_error);
+  EXPECT_EQ(db.GetTable("worker").size(), 5000);
+  EXPECT_THROW(db.Execute("UPDATE worker SET branch = 7 WHERE worker_id = 3"), std::logic_error);
+  db.Execute("UPDATE worker SET branch = NULL WHERE worker_id = 3");
+  // no matched rows, nothing to violate
+  db.Execute("UPDATE worker SET branch = 7 WHERE worker_id = -1");
+
+  EXPECT_THROW(db.Execute("DELETE FROM branch WHERE branch_id = 1"), std::logic_error);
+  EXPECT_THROW(db.Execute("UPDATE branch SET branch_id = 5 WHERE branch_id = 2"), std::logic_error);
+  EXPECT_THROW(db.Execute("DROP TABLE branch"), std::logic_error);
+  db.Execute("INSERT INTO branch(branch_id, name) VALUES(3, 'east')");
+  db.Execute("UPDATE branch SET branch_id = 4 WHERE branch_id = 3");
+
+  // worker 4 is the boss of worker 3; deleting both in one statement is allowed
+  EXPECT_THROW(db.Execute("DELETE FROM worker WHERE worker_id = 4"), std::logic_error);
+  db.Execute("UPDATE worker SET boss = NULL WHERE worker_id = 2");
+  db.Execute("DELETE FROM worker WHERE worker_id > 2 AND worker_id < 5");
+  EXPECT_EQ(db.GetTable("worker").size(), 4998);
+
+  // typed appends are checked and maintain views the same way as INSERT
+  db.Execute("CREATE MATERIALIZED VIEW south AS SELECT worker_id FROM worker WHERE branch = 2");
+  size_t south = db.Execute("SELECT * FROM south").table().size();
+  Appender appender(db, "worker");
+  EXPECT_THROW(appender.Append(7000).Append(9).AppendNull().EndRow(), std::logic_error);
+  EXPECT_EQ(db.GetTable("worker").size(), 4998);
+  appender.Append(7000).Append(2).AppendNull().EndRow();
+  EXPECT_EQ(db.GetTable("worker").size(), 4999);
+  EXPECT_EQ(db.Execute("SELECT * FROM south").table().size(), south + 1);
+  db.Execute("DROP TABLE south");
+  db.Execute("DELETE FROM worker WHERE worker_id = 7000");
+
+  auto dir = std::filesystem::temp_directory_path() / ("fk_test_" + std::to_string(getpid()));
+  std::filesystem::remove_all(dir);
+  db.Checkpoint(dir.string());
+  Database restored;
+  restored.OpenCheckpoint(dir.string());
+  EXPECT_THROW(restored.Execute("INSERT INTO worker(worker_id, branch, boss) VALUES(6000, 9, NULL)"),
+               std::logic_error);
+  EXPECT_THROW(restored.Execute("DELETE FROM branch"), std::logic_error);
+  Database lazy;
+  lazy.OpenCheckpoint(dir.string(), {.lazy = true});
+  EXPECT_THROW(lazy.Execute("DELETE FROM branch WHERE branch_id = 2"), std::logic_error);
+  std::filesystem::remove_all(dir);
+
+  db.Execute("DELETE FROM worker");
+  db.Execute("DELETE FROM branch");
+  db.Execute("DROP TABLE worker");
+  db.Execute("DROP TABLE branch");
+}
+
+TEST(DatabaseTests, MultiJoinTest) {
+  Database db;
+  db.Execute("CREATE TABLE sales (sale_id INT PRIMARY KEY, product INT, store INT, day INT)");
+  db.Execute("CREATE TABLE product (product_id INT PRIMARY KEY, title VARCHAR(16))");
+  db.Execute("CREATE TABLE store (store_id INT PRIMARY KEY, city VARCHAR(16))");
+  db.Execute("CREATE TABLE day (day_id INT PRIMARY KEY, weekday VARCHAR(16))");
+  Appender sales(db, "sales");
+  for (int i = 0; i < 2000; ++i) {
+    sales.Append(i).Append(i % 25).Append(i % 5).Append(i % 10).EndRow();
+  }
+  for (int i = 0; i < 20; ++i) {
+    db.Execute("INSERT INTO product(product_id, title) VALUES(" + std::to_string(i) + ", 'p" + std::to_string(i) + "')");
+  }
+  for (int i = 0; i < 5; ++i) {
+    db.Execute("INSERT INTO store(store_id, city) VALUES(" + std::to_string(i) + ", 'c" + std::to_string(i) + "')");
+  }
+  for (int i : {0, 1, 2, 3, 4, 5, 6, 100}) {
+    db.Execute("INSERT INTO day(day_id, weekday) VALUES(" + std::to_string(i) + ", 'd" + std::to_string(i) + "')");
+  }
+  size_t expected = 0;
+  for (int i = 0; i < 2000; ++i) {
+    expected += i % 25 < 20 && i % 10 < 7;
+  }
+
+  // the fact table is listed second, the planner still drives the probes from it
+  Response star = db.Execute("SELECT sale_id, product.title, city, weekday FROM product "
+                             "JOIN sales ON product_id = sales.product "
+                             "JOIN store ON sales.store = store.store_id "
+                             "JOIN day ON day_id = day");
+  const Table& result = star.table();
+  ASSERT_EQ(result.size(), expected);
+  EXPECT_EQ(result.column_names(), (std::vector<std::string>{"title", "sale_id", "city", "weekday"}));
+  for (size_t r = 0; r < result.size(); ++r) {
+    int id = std::get<int>(result.column("sale_id")[r]);
+    ASSERT_EQ(std::get<std::string>(result.column("title")[r]), "p" + std::to_string(id % 25));
+    ASSERT_EQ(std::get<std::string>(result.column("city")[r]), "c" + std::to_string(id % 5));
+    ASSERT_EQ(std::get<std::string>(result.column("weekday")[r]), "d" + std::to_string(id % 10));
+  }
+
+  const Table& fact = db.GetTable("sales");
+  std::vector<JoinEdge> edges{
+      {0, &db.GetTable("product").column("product_id"), 1, &fact.column("product")},
+      {1, &fact.column("store"), 2, &db.GetTable("store").column("store_id")},
+      {1, &fact.column("day"), 3, &db.GetTable("day").column("day_id")}};
+  std::vector<size_t> order = PlanJoinOrder({20, 2000, 5, 8}, edges);
+  ASSERT_EQ(order.size(), 4);
+  EXPECT_EQ(order[0], 1);
+
+  EXPECT_EQ(db.Execute("SELECT * FROM sales LEFT JOIN product ON product = product_id "
+                       "LEFT JOIN day ON sales.day = day_id").table().size(), 2000);
+  size_t right = 0;
+  for (int i = 0; i < 2000; ++i) {
+    right += i % 10 < 7;
+  }
+  Response outer = db.Execute("SELECT sale_id, weekday FROM sales JOIN store ON store = store_id "
+                              "RIGHT JOIN day ON sales.day = day_id ORDER BY sale_id");
+  ASSERT_EQ(outer.table().size(), right + 1);
+  // NULL sorts first
+  EXPECT_EQ(outer.table().column("sale_id")[0], Value());
+  EXPECT_EQ(outer.table().column("weekday")[0], Value(std::string("d100")));
+  EXPECT_EQ(outer.table().column("sale_id")[1], Value(0));
+
+  EXPECT_THROW(db.Execute("SELECT * FROM sales JOIN store ON store = store_id JOIN store ON day = store_id"),
+               std::logic_error);
+  EXPECT_THROW(db.Execute("SELECT * FROM sales JOIN store ON store = store_id JOIN day ON sale_id = store_id"),
+               std::logic_error);
+}
+
+namespace {
+
+std::vector<std::string> SortedLines(std::string_view csv) {
+  std::vector<std::string> lines;
+  std::istringstream in{std::string(csv)};
+  for (std::string line; std::getline(in, line);) {
+    lines.push_back(line);
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+}  // namespace
+
+TEST(DatabaseTests, BloomJoinTest) {
+  BloomFilter filter(1000);
+  for (uint64_t key = 0; key < 1000; ++key) {
+    filter.Add(key * 3);
+  }
+  size_t false_positives = 0;
+  for (uint64_t key = 0; key < 100000; ++key) {
+    if (key % 3 == 0 && key < 3000) {
+      EXPECT_TRUE(filter.MayContain(key));
+    } else {
+      false_positives += filter.MayContain(key);
+    }
+  }
+  EXPECT_LT(false_positives, 100000 / 50);
+
+  Database db;
+  db.Execute("CREATE TABLE facts (id INT PRIMARY KEY, k INT, tag VARCHAR(8))");
+  db.Execute("CREATE TABLE dims (id INT PRIMARY KEY, k INT, name VARCHAR(16))");
+  Appender facts(db, "facts");
+  for (int i = 0; i < 20000; ++i) {
+    facts.Append(i);
+    if (i % 97 == 0) {
+      facts.AppendNull();
+    } else {
+      facts.Append(i % 2000);
+    }
+    facts.Append("t" + std::to_string(i % 500)).EndRow();
+  }
+  // a small, unordered dimension covering keys 0..149 of the 2000 in facts
+  Appender dims(db, "dims");
+  for (int i = 0; i < 150; ++i) {
+    dims.Append(i).Append(149 - i).Append("d" + std::to_string(149 - i)).EndRow();
+  }
+  size_t matching = 0;
+  for (int i = 0; i < 20000; ++i) {
+    matching += i % 97 != 0 && i % 2000 < 150;
+  }
+
+  uint64_t joins = db.Stats().bloom_joins;
+  uint64_t dropped = db.Stats().bloom_dropped_rows;
+  Table inner = db.Execute("SELECT facts.id, facts.k, name FROM facts JOIN dims ON facts.k = dims.k").table();
+  EXPECT_EQ(inner.size(), matching);
+  for (size_t row = 0; row < inner.size(); ++row) {
+    EXPECT_EQ(ToString(inner.column("name")[row]), "d" + ToString(inner.column("k")[row]));
+  }
+  EXPECT_EQ(db.Stats().bloom_joins, joins + 1);
+  // every row without a pair is dropped, apart from a few false positives
+  EXPECT_GT(db.Stats().bloom_dropped_rows - dropped, (20000 - matching) * 9 / 10);
+
+  Table left = db.Execute("SELECT facts.id, name FROM dims RIGHT JOIN facts ON dims.k = facts.k").table();
+  ASSERT_EQ(left.size(), 20000);
+  size_t named = 0;
+  for (size_t row = 0; row < left.size(); ++row) {
+    EXPECT_EQ(left.column("id")[row], Value(static_cast<int>(row)));
+    named += !std::holds_alternative<MyMonostate>(left.column("name")[row]);
+  }
+  EXPECT_EQ(named, matching);
+  EXPECT_EQ(db.Stats().bloom_joins, joins + 2);
+
+  // string keys go through the unsealed values
+  db.Execute("CREATE TABLE tags (id INT PRIMARY KEY, tag VARCHAR(8))");
+  db.Execute("INSERT INTO tags(id, tag) VALUES(1, 't7'), (2, 't300'), (3, 'missing')");
+  EXPECT_EQ(db.Execute("SELECT facts.id FROM facts JOIN tags ON facts.tag = tags.tag").table().size(), 80);
+  EXPECT_EQ(db.Stats().bloom_joins, joins + 3);
+
+  // a probe side smaller than the build side is joined without the filter
+  EXPECT_EQ(db.Execute("SELECT dims.id FROM dims JOIN facts ON dims.k = facts.k").table().size(), matching);
+  EXPECT_EQ(db.Stats().bloom_joins, joins + 3);
+}
+
+TEST(DatabaseTests, MergeJoinTest) {
+  Database db;
+  db.Execute("CREATE TABLE facts (id INT PRIMARY KEY, k INT)");
+  db.Execute("CREATE TABLE dims (id INT PRIMARY KEY, k INT, name VARCHAR(16))");
+  db.Execute("CREATE TABLE shuffled (id INT PRIMARY KEY, k INT, name VARCHAR(16))");
+  db.Execute("INSERT INTO dims(id, k, name) VALUES(-1, NULL, 'none')");
+  db.Execute("INSERT INTO shuffled(id, k, name) VALUES(-1, NULL, 'none')");
+  Appender facts(db, "facts");
+  for (int i = 0; i < 6000; ++i) {
+    facts.Append(i).Append(i / 3).EndRow();
+  }
+  // keys 1000..2999 with two rows each, sorted in dims and reversed in shuffled
+  Appender dims(db, "dims");
+  Appender shuffled(db, "shuffled");
+  for (int i = 0; i < 4000; ++i) {
+    dims.Append(i).Append(1000 + i / 2).Append("n" + std::to_string(i)).EndRow();
+    shuffled.Append(3999 - i).Append(2999 - i / 2).Append("n" + std::to_string(3999 - i)).EndRow();
+  }
+  EXPECT_TRUE(db.GetTable("facts").column("k").sorted());
+  EXPECT_TRUE(db.GetTable("dims").column("k").sorted());
+  EXPECT_FALSE(db.GetTable("shuffled").column("k").sorted());
+
+  for (std::string type : {"JOIN", "LEFT JOIN", "RIGHT JOIN"}) {
+    uint64_t merges = db.Stats().merge_joins;
+    ResultEncoder merged(kCsv);
+    ResultEncoder hashed(kCsv);
+    Response merge = db.Execute("SELECT facts.id, facts.k, name FROM facts " + type + " dims ON facts.k = dims.k");
+    Response hash = db.Execute("SELECT facts.id, facts.k, name FROM facts " + type + " shuffled ON facts.k = shuffled.k");
+    EXPECT_EQ(db.Stats().merge_joins, merges + 1);
+    size_t expected = type == "JOIN" ? 6000 : type == "LEFT JOIN" ? 6000 + 3000 : 6000 + 1 + 2000;
+    EXPECT_EQ(merge.table().size(), expected);
+    EXPECT_EQ(SortedLines(merged.Encode(merge)), SortedLines(hashed.Encode(hash)));
+  }
+
+  // an update breaks the order, the planner falls back to the hash join
+  db.Execute("UPDATE dims SET k = 0 WHERE id = 3999");
+  EXPECT_FALSE(db.GetTable("dims").column("k").sorted());
+  uint64_t merges = db.Stats().merge_joins;
+  db.Execute("SELECT * FROM facts JOIN dims ON facts.k = dims.k");
+  EXPECT_EQ(db.Stats().merge_joins, merges);
+
+  // primary keys in arbitrary order merge when their hash table does not fit
+  db.Execute("CREATE TABLE a (id INT PRIMARY KEY, x INT)");
+  db.Execute("CREATE TABLE b (id INT PRIMARY KEY, y INT)");
+  Appender a(db, "a");
+  Appender b(db, "b");
+  for (int i = 0; i < 5000; ++i) {
+    a.Append(4999 - i).Append(i).EndRow();
+    b.Append((i * 7919) % 5000 * 2).Append(i).EndRow();
+  }
+  const std::string pk_join = "SELECT a.id, x, y FROM a RIGHT JOIN b ON a.id = b.id";
+  ResultEncoder hashed(kCsv);
+  std::string expected(hashed.Encode(db.Execute(pk_join)));
+  EXPECT_EQ(db.Stats().merge_joins, merges);
+  db.ConfigureMemory({.operator_memory = 16 << 10});
+  uint64_t files = db.Stats().spill_files;
+  ResultEncoder merged(kCsv);
+  Response merge = db.Execute(pk_join);
+  EXPECT_EQ(db.Stats().merge_joins, merges + 1);
+  EXPECT_GT(db.Stats().spill_files, files);
+  EXPECT_EQ(merge.table().size(), 5000);
+  EXPECT_EQ(SortedLines(merged.Encode(merge)), SortedLines(expected));
+}
+
+TEST(DatabaseTests, ApproxAggregateTest) {
+  Database db;
+  db.Execute("CREATE TABLE m (id INT PRIMARY KEY, host INT, latency DOUBLE, name VARCHAR(16))");
+  Appender appender(db, "m");
+  // two full sketch segments and a partial one
+  const int n = 2 * static_cast<int>(Column::kSketchRows) + 5000;
+  for (int i = 0; i < n; ++i) {
+    appender.Append(i).Append(i % 5000);
+    if (i % 50 == 0) {
+      appender.AppendNull();
+    } else {
+      appender.Append(static_cast<double>(i % 1000));
+    }
+    appender.Append("h" + std::to_string(i % 300)).EndRow();
+  }
+  auto single = [&db](const std::string& query) {
+    Table table = db.Execute(query).table();
+    EXPECT_EQ(table.size(), 1);
+    EXPECT_EQ(table.column_names().size(), 1);
+    return table.column(table.column_names()[0])[0];
+  };
+  auto near = [](const Value& value, double expected, double tolerance) {
+    double actual = std::holds_alternative<int>(value) ? std::get<int>(value) : std::get<double>(value);
+    EXPECT_NEAR(actual, expected, tolerance) << ToString(value);
+  };
+
+  near(single("SELECT APPROX_COUNT_DISTINCT(host) FROM m"), 5000, 5000 * 0.05);
+  near(single("SELECT APPROX_COUNT_DISTINCT(id) FROM m"), n, n * 0.05);
+  near(single("SELECT approx_count_distinct(name) FROM m"), 300, 300 * 0.05);
+  // NULL is not a distinct value
+  near(single("SELECT APPROX_COUNT_DISTINCT(latency) FROM m"), 1000, 1000 * 0.05);
+  near(single("SELECT APPROX_PERCENTILE(latency, 0.5) FROM m"), 500, 1000 * 0.02);
+  near(single("SELECT APPROX_PERCENTILE(latency, 0.99) FROM m"), 990, 1000 * 0.02);
+  EXPECT_EQ(single("SELECT APPROX_PERCENTILE(host, 0) FROM m"), Value(0));
+  EXPECT_EQ(single("SELECT APPROX_PERCENTILE(m.host, 1) FROM m"), Value(4999));
+
+  // a filtered selection is sketched directly
+  near(single("SELECT APPROX_COUNT_DISTINCT(host) FROM m WHERE host < 100"), 100, 100 * 0.05);
+  near(single("SELECT APPROX_PERCENTILE(host, 0.5) FROM m WHERE id >= 1000 AND host < 1000"), 500, 1000 * 0.02);
+  EXPECT_EQ(single("SELECT APPROX_PERCENTILE(latency, 0.5) FROM m WHERE id < 0"), Value());
+
+  // changing a segment drops its cached sketch
+  db.Execute("UPDATE m SET latency = 100000 WHERE host < 2500");
+  near(single("SELECT APPROX_PERCENTILE(latency, 0.99) FROM m"), 100000, 1);
+  db.Execute("UPDATE m SET latency = 1 WHERE host < 2500");
+  near(single("SELECT APPROX_PERCENTILE(latency, 0.99) FROM m"), 990, 1000 * 0.02);
+  db.Execute("DELETE FROM m WHERE id >= 130000");
+  near(single("SELECT APPROX_PERCENTILE(id, 1) FROM m"), 129999, 0);
+
+  Table both = db.Execute("SELECT APPROX_COUNT_DISTINCT(host), APPROX_PERCENTILE(latency, 0.25) FROM m").table();
+  EXPECT_EQ(both.column_names(), (std::vector<std::string>{"APPROX_COUNT_DISTINCT(host)",
+                                                           "APPROX_PERCENTILE(latency, 0.25)"}));
+  EXPECT_THROW(db.Execute("SELECT APPROX_PERCENTILE(name, 0.5) FROM m"), std::logic_error);
+  EXPECT_THROW(db.Execute("SELECT APPROX_PERCENTILE(latency, 2) FROM m"), std::logic_error);
+  EXPECT_THROW(db.Execute("SELECT id, APPROX_COUNT_DISTINCT(host) FROM m"), std::logic_error);
+  EXPECT_THROW(db.Execute("SELECT APPROX_COUNT_DISTINCT(host) FROM m ORDER BY id"), std::logic_error);
+}
+
+TEST(DatabaseTests, PartitionTest) {
+  Database db;
+  db.Execute("CREATE TABLE orders (id INT PRIMARY KEY, customer INT, amount INT) "
+             "PARTITION BY HASH(customer) PARTITIONS 4");
+  db.Execute("CREATE TABLE customers (id INT PRIMARY KEY, name VARCHAR(16)) PARTITION BY HASH(id) PARTITIONS 4");
+  db.Execute("CREATE TABLE plain (id INT PRIMARY KEY, name VARCHAR(16))");
+  Appender orders(db, "orders");
+  for (int i = 0; i < 3000; ++i) {
+    orders.Append(i).Append(i % 97).Append(i).EndRow();
+  }
+  for (int i = 0; i < 80; ++i) {
+    std::string values = "(" + std::to_string(i) + ", 'c" + std::to_string(i) + "')";
+    db.Execute("INSERT INTO customers(id, name) VALUES" + values);
+    db.Execute("INSERT INTO plain(id, name) VALUES" + values);
+  }
+
+  auto check = [&db](const std::string& name) {
+    const Table& table = db.GetTable(name);
+    const Column& key = table.column(table.partition_key());
+    size_t rows = 0;
+    for (size_t p = 0; p < table.partitions().size(); ++p) {
+      const auto& partition = table.partitions()[p];
+      EXPECT_TRUE(std::is_sorted(partition.begin(), partition.end()));
+      for (size_t row : partition) {
+        ASSERT_LT(row, table.size());
+        EXPECT_EQ(table.PartitionOf(key[row]), p);
+      }
+      rows += partition.size();
+    }
+    EXPECT_EQ(rows, table.size());
+  };
+  ASSERT_EQ(db.GetTable("orders").partitions().size(), 4);
+  EXPECT_TRUE(db.GetTable("plain").partitions().empty());
+  check("orders");
+  check("customers");
+
+  // a point filter on the partition key reads a single partition
+  EXPECT_EQ(db.Execute("SELECT * FROM orders WHERE customer = 7").table().size(), 31);
+  EXPECT_EQ(db.Execute("SELECT * FROM orders WHERE 7 = customer").table().size(), 31);
+  EXPECT_EQ(db.Execute("SELECT * FROM orders WHERE customer = 500").table().size(), 0);
+
+  db.Execute("DELETE FROM orders WHERE amount < 100");
+  db.Execute("UPDATE orders SET customer = 7 WHERE id = 2000");
+  check("orders");
+  EXPECT_EQ(db.Execute("SELECT * FROM orders WHERE customer = 7").table().size(), 31);
+
+  uint64_t joins = db.Stats().partitioned_joins;
+  const std::string join = "SELECT orders.id, amount, name FROM orders LEFT JOIN customers ON customer = customers.id";
+  Response partitioned = db.Execute(join);
+  EXPECT_EQ(db.Stats().partitioned_joins, joins + 1);
+  Response regular = db.Execute("SELECT orders.id, amount, name FROM orders LEFT JOIN plain ON customer = plain.id");
+  EXPECT_EQ(db.Stats().partitioned_joins, joins + 1);
+  ResultEncoder a(kCsv);
+  ResultEncoder b(kCsv);
+  EXPECT_EQ(partitioned.table().size(), 2900);
+  EXPECT_EQ(a.Encode(partitioned), b.Encode(regular));
+
+  // a failed commit moves updated keys back and reinserts deleted rows into their partitions
+  auto partitions = db.GetTable("orders").partitions();
+  Session session(db);
+  session.Execute("BEGIN");
+  session.Execute("UPDATE orders SET customer = 1 WHERE id < 1000");
+  session.Execute("DELETE FROM orders WHERE customer = 7");
+  session.Execute("INSERT INTO orders(id, customer, amount) VALUES(2001, 1, 1)");
+  EXPECT_THROW(session.Execute("COMMIT"), std::logic_error);
+  check("orders");
+  EXPECT_EQ(db.GetTable("orders").partitions(), partitions);
+
+  auto dir = std::filesystem::temp_directory_path() / ("database_partition_" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  db.Checkpoint(dir.string());
+  Database restored;
+  restored.OpenCheckpoint(dir.string());
+  EXPECT_EQ(restored.GetTable("orders").partition_key(), "customer");
+  EXPECT_EQ(restored.GetTable("orders").partitions(), db.GetTable("orders").partitions());
+  std::filesystem::remove_all(dir);
+
+  EXPECT_THROW(db.Execute("CREATE TABLE bad (id INT PRIMARY KEY) PARTITION BY HASH(id) PARTITIONS 0"),
+               std::logic_error);
+  EXPECT_THROW(db.Execute("CREATE TABLE bad (id INT PRIMARY KEY) PARTITION BY HASH(missing) PARTITIONS 2"),
+               std::logic_error);
+}
+
+TEST(DatabaseTests, TransactionTest) {
+  Database db;
+  db.Execute("CREATE TABLE accounts (id INT PRIMARY KEY, owner VARCHAR(16), balance INT)");
+  db.Execute("CREATE MATERIALIZED VIEW rich AS SELECT id, balance FROM accounts WHERE balance > 500");
+  Session session(db);
+  EXPECT_THROW(db.Execute("BEGIN"), std::logic_error);
+  EXPECT_THROW(session.Execute("COMMIT"), std::logic_error);
+
+  session.Execute("BEGIN TRANSACTION");
+  EXPECT_THROW(session.Execute("BEGIN"), std::logic_error);
+  EXPECT_THROW(session.Execute("CREATE TABLE t (id INT PRIMARY KEY)"), std::logic_error);
+  for (int i = 0; i < 1000; ++i) {
+    session.Execute("INSERT INTO accounts(id, owner, balance) VALUES(" + std::to_string(i) + ", 'o', "
+                    + std::to_string(i) + ")");
+  }
+  EXPECT_EQ(session.pending(), 1000);
+  // other callers do not see uncommitted rows, the session itself does
+  EXPECT_EQ(db.Execute("SELECT * FROM accounts").table().size(), 0);
+  EXPECT_EQ(session.Execute("SELECT * FROM accounts").table().size(), 1000);
+  EXPECT_EQ(session.Execute("SELECT * FROM rich").table().size(), 499);
+  EXPECT_EQ(db.GetTable("accounts").size(), 0);
+  EXPECT_EQ(db.GetTable("rich").size(), 0);
+  session.Execute("COMMIT");
+  EXPECT_FALSE(session.in_transaction());
+  EXPECT_EQ(db.GetTable("accounts").size(), 1000);
+  EXPECT_EQ(db.GetTable("rich").size(), 499);
+  EXPECT_EQ(db.Stats().statements[kCommit].count, 1);
+
+  session.Execute("BEGIN");
+  session.Execute("DELETE FROM accounts WHERE id < 10");
+  session.Execute("ROLLBACK");
+  EXPECT_EQ(db.GetTable("accounts").size(), 1000);
+
+  // a failing statement undoes the whole transaction, including updates and deletes
+  ResultEncoder before(kCsv);
+  std::string expected(before.Encode(db.Execute("SELECT * FROM accounts")));
+  std::string expected_view(before.Encode(db.Execute("SELECT * FROM rich")));
+  session.Execute("BEGIN");
+  session.Execute("INSERT INTO accounts(id, owner, balance) VALUES(5000, 'new', 9000)");
+  session.Execute("UPDATE accounts SET balance = 0 WHERE balance > 900");
+  session.Execute("DELETE FROM accounts WHERE id < 100");
+  session.Execute("INSERT INTO accounts(id, owner, balance) VALUES(500, 'dup', 1)");
+  EXPECT_THROW(session.Execute("COMMIT"), std::logic_error);
+  EXPECT_FALSE(session.in_transaction());
+  ResultEncoder after(kCsv);
+  EXPECT_EQ(after.Encode(db.Execute("SELECT * FROM accounts")), expected);
+  EXPECT_EQ(after.Encode(db.Execute("SELECT * FROM rich")), expected_view);
+  EXPECT_EQ(db.Execute("SELECT * FROM accounts WHERE id = 5000").table().size(), 0);
+
+  // single statements stay atomic: a bad value in a later column leaves nothing behind
+  EXPECT_THROW(db.Execute("INSERT INTO accounts(id, owner, balance) VALUES(6000, 'x', 'oops')"), std::exception);
+  EXPECT_THROW(db.Execute("UPDATE accounts SET owner = 'y', balance = 'oops' WHERE id = 1"), std::exception);
+  const Table& accounts = db.GetTable("accounts");
+  EXPECT_EQ(accounts.size(), 1000);
+  for (const auto& name : accounts.column_names()) {
+    EXPECT_EQ(accounts.column(name).size(), 1000);
+  }
+  EXPECT_EQ(accounts.column("owner")[1], Value(std::string("o")));
+
+  Future<Response> begin = session.ExecuteAsync("BEGIN");
+  EXPECT_TRUE(begin.ready());
+  session.ExecuteAsync("INSERT INTO accounts(id, owner, balance) VALUES(7000, 'async', 1)").Get();
+  EXPECT_EQ(session.ExecuteAsync("COMMIT").Get().message(), "Transaction is committed");
+  EXPECT_EQ(accounts.size(), 1001);
+
+  // reads inside a transaction undo only the touched rows: versions, views and cached results survive
+  db.Execute("CREATE TABLE big (id INT PRIMARY KEY, v INT)");
+  Appender big(db, "big");
+  for (int i = 0; i < 10000; ++i) {
+    big.Append(i).Append(i % 100).EndRow();
+  }
+  db.ConfigureResultCache({.max_bytes = 1 << 24});
+  ResultEncoder encoder(kCsv);
+  std::string big_before(encoder.Encode(db.Execute("SELECT * FROM big")));
+  std::string rich_before(encoder.Encode(db.Execute("SELECT * FROM rich")));
+  uint64_t big_version = db.GetTable("big").version();
+  uint64_t accounts_version = accounts.version();
+  uint64_t rich_version = db.GetTable("rich").version();
+  session.Execute("BEGIN");
+  session.Execute("UPDATE big SET v = 1000 WHERE id < 5000");
+  session.Execute("DELETE FROM big WHERE v = 7");
+  session.Execute("INSERT INTO big(id, v) VALUES(20000, 5)");
+  session.Execute("UPDATE accounts SET balance = 10000 WHERE id < 3");
+  EXPECT_EQ(session.Execute("SELECT id FROM big WHERE v = 1000").table().size(), 5000);
+  EXPECT_EQ(session.Execute("SELECT id FROM big").table().size(), 10000 - 50 + 1);
+  EXPECT_EQ(session.Execute("SELECT id FROM rich WHERE balance = 10000").table().size(), 3);
+  EXPECT_EQ(db.GetTable("big").version(), big_version);
+  EXPECT_EQ(accounts.version(), accounts_version);
+  EXPECT_EQ(db.GetTable("rich").version(), rich_version);
+  uint64_t hits = db.Stats().result_cache_hits;
+  EXPECT_EQ(encoder.Encode(db.Execute("SELECT * FROM big")), big_before);
+  EXPECT_EQ(encoder.Encode(db.Execute("SELECT * FROM rich")), rich_before);
+  EXPECT_EQ(db.Stats().result_cache_hits, hits + 2);
+  session.Execute("INSERT INTO big(id, v) VALUES(0, 1)");
+  EXPECT_THROW(session.Execute("COMMIT"), std::logic_error);
+  EXPECT_EQ(encoder.Encode(db.Execute("SELECT * FROM big")), big_before);
+  EXPECT_EQ(db.GetTable("big").version(), big_version);
+  EXPECT_EQ(db.Execute("SELECT id FROM big WHERE v = 0").table().size(), 100);
+}
+
+TEST(DatabaseTests, LateMaterializationTest) {
+  Database db;
+  db.Execute("CREATE TABLE wide (id INT PRIMARY KEY, grp INT, a VARCHAR(32), b VARCHAR(32), c VARCHAR(32))");
+  db.Execute("CREATE TABLE groups (grp_id INT PRIMARY KEY, label VARCHAR(16))");
+  Appender wide(db, "wide");
+  for (int i = 0; i < 3000; ++i) {
+    std::string pad(24, static_cast<char>('a' + i % 26));
+    wide.Append(i).Append(i % 50).Append(pad).Append(pad).Append(pad).EndRow();
+  }
+  for (int g = 0; g < 50; g += 10) {
+    db.Execute("INSERT INTO groups(grp_id, label) VALUES(" + std::to_string(g) + ", 'g" + std::to_string(g) + "')");
+  }
+
+  // only the projected columns of the matching rows reach the result, already ordered
+  Response joined = db.Execute("SELECT id, label FROM wide JOIN groups ON grp = grp_id ORDER BY label DESC, id");
+  const Table& result = joined.table();
+  EXPECT_EQ(result.column_names(), (std::vector<std::string>{"id", "label"}));
+  ASSERT_EQ(result.size(), 300);
+  EXPECT_EQ(result.column("label")[0], Value(std::string("g40")));
+  EXPECT_EQ(result.column("id")[0], Value(40));
+  EXPECT_EQ(result.column("id")[1], Value(90));
+  EXPECT_EQ(result.column("label")[299], Value(std::string("g0")));
+  EXPECT_EQ(result.column("id")[299], Value(2950));
+
+  // rows without a pair sort as NULL
+  Response outer = db.Execute("SELECT label, id FROM wide LEFT JOIN groups ON grp = grp_id ORDER BY label, id");
+  ASSERT_EQ(outer.table().size(), 3000);
+  EXPECT_EQ(outer.table().column("label")[0], Value());
+  EXPECT_EQ(outer.table().column("id")[0], Value(1));
+  EXPECT_EQ(outer.table().column("label")[2700], Value(std::string("g0")));
+
+  Response filtered = db.Execute("SELECT id FROM wide WHERE grp = 7 ORDER BY id DESC");
+  ASSERT_EQ(filtered.table().size(), 60);
+  EXPECT_EQ(filtered.table().column("id")[0], Value(2957));
+  EXPECT_EQ(filtered.table().column("id")[59], Value(7));
+  EXPECT_THROW(db.Execute("SELECT id FROM wide ORDER BY a"), std::logic_error);
+}
+
+TEST(DatabaseTests, QueryCancellationTest) {
+  CancellationToken token;
+  EXPECT_NO_THROW(token.Check());
+  token.Cancel();
+  EXPECT_THROW(token.Check(), QueryCancelledError);
+  EXPECT_THROW(CancellationToken(CancellationToken::Clock::now()).Check(), QueryCancelledError);
+  {
+    // worker threads of ParallelFor see the query of the calling thread
+    CancellationScope scope(&token);
+    std::atomic<size_t> calls = 0;
+    EXPECT_THROW(ParallelFor(64, 4, [&calls](size_t) { ++calls; }), QueryCancelledError);
+    EXPECT_EQ(calls, 0);
+  }
+  EXPECT_EQ(CurrentCancellation(), nullptr);
+  EXPECT_NO_THROW(CheckCancellation());
+
+  Database db;
+  SchedulerOptions options;
+  options.max_concurrency = 2;
+  db.ConfigureScheduler(options);
+  db.Execute("CREATE TABLE a (id INT PRIMARY KEY, k INT)");
+  db.Execute("CREATE TABLE b (id INT PRIMARY KEY, k INT)");
+  Appender a(db, "a");
+  Appender b(db, "b");
+  for (int i = 0; i < 3000; ++i) {
+    a.Append(i).Append(1).EndRow();
+    b.Append(i).Append(1).EndRow();
+  }
+  size_t tables = db.Stats().memory_used;
+  // every row matches every row: 9M pairs that nobody wants to wait for
+  const std::string runaway = "SELECT a.id, b.id FROM a JOIN b ON a.k = b.k ORDER BY a.id";
+
+  EXPECT_THROW(db.Execute(runaway, {.timeout = std::chrono::milliseconds(10)}), QueryCancelledError);
+  EXPECT_EQ(db.Stats().timed_out_queries, 1);
+  EXPECT_EQ(db.Stats().memory_used, tables);
+
+  Future<Response> running = db.ExecuteAsync(runaway, {.id = 7});
+  EXPECT_THROW(db.ExecuteAsync("SELECT id FROM a", {.id = 7}).Get(), std::logic_error);
+  EXPECT_TRUE(db.Cancel(7));
+  EXPECT_THROW(running.Get(), QueryCancelledError);
+  EXPECT_FALSE(db.Cancel(7));
+  EXPECT_FALSE(db.Cancel(8));
+  EXPECT_EQ(db.Stats().cancelled_queries, 1);
+  EXPECT_EQ(db.Stats().memory_used, tables);
+
+  // the id is free again, and the database serves other queries as usual
+  EXPECT_EQ(db.ExecuteAsync("SELECT id FROM a WHERE id < 10", {.id = 7}).Get().table().size(), 10);
+  EXPECT_EQ(db.Execute("SELECT a.id FROM a JOIN b ON a.id = b.id").table().size(), 3000);
+
+  // the default deadline applies to queries without their own
+  options.query_timeout = std::chrono::milliseconds(10);
+  db.ConfigureScheduler(options);
+  EXPECT_THROW(db.ExecuteAsync(runaway).Get(), QueryCancelledError);
+  EXPECT_EQ(db.Execute("SELECT id FROM a WHERE k = 1").table().size(), 3000);
+  EXPECT_EQ(db.Stats().timed_out_queries, 2);
+}